@@ -0,0 +1,254 @@
+/*!
+ *  @file I2CAsync.h
+ *
+ *  @brief Non-blocking transaction queue: [I2CDevice] reads and writes are
+ *  handed to a bus worker and complete in the background.
+ *
+ *  On the ESP32 the worker is a FreeRTOS task, on the `native` build a
+ *  [std::thread]. Other platforms have no worker and execute requests
+ *  synchronously when they are enqueued, so the same driver code runs
+ *  everywhere.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_ASYNC_H_
+#define I2C_ASYNC_H_
+
+#include <Arduino.h>
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#elif defined(I2C_NATIVE)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+class I2CDevice;
+struct I2CRequest;
+
+/// @brief Called from the bus worker when a request has completed. The
+/// request is released when the callback returns.
+typedef void (*I2CRequestCallback)(I2CRequest *request, void *arg);
+
+/// @brief The transaction a request performs.
+enum I2CRequestType {
+    I2C_REQUEST_READ,
+    I2C_REQUEST_WRITE,
+    I2C_REQUEST_WRITE_THEN_READ
+};
+
+/// @brief Life cycle of a request.
+enum I2CRequestStatus {
+    I2C_REQUEST_FREE,
+    I2C_REQUEST_QUEUED,
+    I2C_REQUEST_BUSY,
+    I2C_REQUEST_DONE,
+    I2C_REQUEST_FAILED
+};
+
+/// @brief A queued transaction, returned as a handle by [I2CAsync]. The
+/// buffers must stay valid until the request has completed.
+struct I2CRequest {
+
+    /// @brief The device the transaction is addressed to.
+    I2CDevice *device;
+
+    /// @brief The transaction to perform.
+    I2CRequestType type;
+
+    /// @brief Data to write (write and write-then-read).
+    const uint8_t *writeBuffer;
+
+    /// @brief Number of bytes to write.
+    size_t writeLen;
+
+    /// @brief Optional prefix written before [writeBuffer] (write only).
+    const uint8_t *prefixBuffer;
+
+    /// @brief Number of prefix bytes.
+    size_t prefixLen;
+
+    /// @brief Buffer to read into (read and write-then-read).
+    uint8_t *readBuffer;
+
+    /// @brief Number of bytes to read.
+    size_t readLen;
+
+    /// @brief Whether to send a STOP, as for the blocking call.
+    bool stop;
+
+    /// @brief Completion callback, or nullptr.
+    I2CRequestCallback callback;
+
+    /// @brief Argument passed to [callback].
+    void *arg;
+
+    /// @brief Current state, updated by the worker.
+    volatile I2CRequestStatus status;
+
+    /// @brief [micros()] when the request was queued.
+    uint32_t queuedAt;
+
+    /// @brief [micros()] when the worker started the transaction.
+    uint32_t startedAt;
+
+    /// @brief [micros()] when the transaction completed.
+    uint32_t finishedAt;
+
+    #if defined(ESP32)
+    /// @brief Given when the request completes.
+    SemaphoreHandle_t done;
+    #endif
+
+};
+
+/// @brief A bus worker with a fixed pool of [depth] requests. Requests
+/// are executed in the order they were queued. A request queued with a
+/// callback is released after its callback returns; without a callback
+/// the caller collects the result with [wait] and gives the handle back
+/// with [release].
+class I2CAsync {
+public:
+
+    /// @brief Instantiates a queue with room for [depth] requests.
+    I2CAsync(size_t depth = 8);
+
+    ~I2CAsync();
+
+    I2CAsync(const I2CAsync &) = delete;
+    I2CAsync & operator=(const I2CAsync &) = delete;
+
+    /// @brief Starts the bus worker.
+    /// @param priority FreeRTOS priority of the worker task (ESP32).
+    /// @param core The core the worker task is pinned to (ESP32).
+    /// @param stackSize Stack size of the worker task (ESP32).
+    /// @return true if the worker is running.
+    bool begin(uint8_t priority = 5, int core = 0, uint32_t stackSize = 4096);
+
+    /// @brief Stops the worker once the queued requests are done.
+    void end();
+
+    /// @brief Queues [device].read(buffer, len, stop).
+    /// @return The request, or nullptr if the pool is exhausted.
+    I2CRequest * read(I2CDevice &device, uint8_t *buffer, size_t len,
+                      I2CRequestCallback callback = nullptr,
+                      void *arg = nullptr, bool stop = true);
+
+    /// @brief Queues [device].write(buffer, len, stop, prefix_buffer,
+    /// prefix_len).
+    /// @return The request, or nullptr if the pool is exhausted.
+    I2CRequest * write(I2CDevice &device, const uint8_t *buffer, size_t len,
+                       I2CRequestCallback callback = nullptr,
+                       void *arg = nullptr, bool stop = true,
+                       const uint8_t *prefix_buffer = nullptr,
+                       size_t prefix_len = 0);
+
+    /// @brief Queues [device].write_then_read(...).
+    /// @return The request, or nullptr if the pool is exhausted.
+    I2CRequest * write_then_read(I2CDevice &device,
+                                 const uint8_t *write_buffer,
+                                 size_t write_len,
+                                 uint8_t *read_buffer,
+                                 size_t read_len,
+                                 I2CRequestCallback callback = nullptr,
+                                 void *arg = nullptr,
+                                 bool stop = false);
+
+    /// @brief Blocks until [request] has completed or [timeoutMs] passed.
+    /// @return true if the request completed successfully.
+    bool wait(I2CRequest *request, uint32_t timeoutMs = 1000);
+
+    /// @brief Returns true if [request] has completed, successfully or not.
+    bool done(I2CRequest *request);
+
+    /// @brief Gives a completed request without callback back to the
+    /// pool.
+    void release(I2CRequest *request);
+
+    /// @brief Returns the number of requests waiting or in progress.
+    size_t pending();
+
+    /// @brief Returns true if the worker is running.
+    bool running() { return _running; }
+
+private:
+
+    /// @brief Takes a free request from the pool and fills in the common
+    /// fields.
+    I2CRequest * allocate(I2CDevice &device, I2CRequestType type,
+                          I2CRequestCallback callback, void *arg);
+
+    /// @brief Hands [request] to the worker, or executes it right away if
+    /// there is none.
+    I2CRequest * submit(I2CRequest *request);
+
+    /// @brief Performs the transaction of [request] and completes it.
+    void execute(I2CRequest *request);
+
+    /// @brief The worker loop.
+    void work();
+
+    /// @brief The request pool.
+    I2CRequest *_requests;
+
+    /// @brief Number of requests in the pool.
+    size_t _depth;
+
+    /// @brief Requests queued or in progress.
+    volatile size_t _pending;
+
+    /// @brief True while the worker runs.
+    volatile bool _running;
+
+    #if defined(ESP32)
+    /// @brief Entry point of the worker task.
+    static void task(void *queue);
+
+    /// @brief Requests waiting for the worker.
+    QueueHandle_t _queue;
+
+    /// @brief The worker task.
+    TaskHandle_t _task;
+
+    /// @brief Given by the worker when it exits.
+    SemaphoreHandle_t _stopped;
+
+    /// @brief Guards the pool.
+    portMUX_TYPE _mux;
+    #elif defined(I2C_NATIVE)
+    /// @brief Guards the pool and the queue.
+    std::mutex _mutex;
+
+    /// @brief Signals the worker that a request was queued.
+    std::condition_variable _queued;
+
+    /// @brief Signals waiters that a request completed.
+    std::condition_variable _completed;
+
+    /// @brief Requests waiting for the worker, a ring of [_depth].
+    I2CRequest **_queue;
+
+    /// @brief Index of the oldest request in [_queue].
+    size_t _head;
+
+    /// @brief Number of requests in [_queue].
+    size_t _count;
+
+    /// @brief Set to stop the worker.
+    bool _stopping;
+
+    /// @brief The worker thread.
+    std::thread _thread;
+    #endif
+
+};
+
+#endif // I2C_ASYNC_H_
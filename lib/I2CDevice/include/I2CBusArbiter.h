@@ -0,0 +1,181 @@
+/*!
+ *  @file I2CBusArbiter.h
+ *
+ *  @brief Serialises the transactions of several [I2CDevice] instances
+ *  that share one [TwoWire] from different tasks.
+ *
+ *  Each device is given the arbiter of its bus with
+ *  [I2CDevice::setArbiter] and a priority. A transaction locks the bus;
+ *  when it is released it is handed directly to the waiting device with
+ *  the highest priority, first come first served among equals. Locks are
+ *  recursive, so an [I2CBusLock] scope can hold the bus across a batch of
+ *  transactions with a single acquisition. On platforms without tasks
+ *  the arbiter only keeps the statistics.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_BUS_ARBITER_H_
+#define I2C_BUS_ARBITER_H_
+
+#include <Arduino.h>
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#elif defined(I2C_NATIVE)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#ifndef I2C_ARBITER_MAX_WAITERS
+/// @brief Max number of tasks waiting for the bus at the same time.
+#define I2C_ARBITER_MAX_WAITERS 8
+#endif
+
+/// @brief Timeout value that waits for the bus indefinitely.
+#define I2C_ARBITER_WAIT_FOREVER 0xFFFFFFFFUL
+
+/// @brief Bus usage statistics of one device. Times are in microseconds.
+struct I2CBusStats {
+
+    /// @brief Number of times the device acquired the bus (outermost
+    /// locks only).
+    uint32_t acquisitions;
+
+    /// @brief Number of acquisitions that had to wait for another device.
+    uint32_t contended;
+
+    /// @brief Number of acquisitions that timed out.
+    uint32_t timeouts;
+
+    /// @brief Total time spent waiting for the bus.
+    uint64_t waitUs;
+
+    /// @brief Longest wait for the bus.
+    uint32_t maxWaitUs;
+
+    /// @brief Total time the bus was held.
+    uint64_t holdUs;
+
+    /// @brief Longest time the bus was held.
+    uint32_t maxHoldUs;
+
+    /// @brief Number of times the device changed the bus clock to its
+    /// own, see [I2CDevice::setMaxClock].
+    uint32_t clockSwitches;
+
+};
+
+/// @brief A priority lock for one I2C bus, shared by all the devices on it.
+class I2CBusArbiter {
+public:
+
+    I2CBusArbiter();
+
+    ~I2CBusArbiter();
+
+    I2CBusArbiter(const I2CBusArbiter &) = delete;
+    I2CBusArbiter & operator=(const I2CBusArbiter &) = delete;
+
+    /// @brief Acquires the bus for the calling task. If the task already
+    /// holds it the lock is nested and returns immediately.
+    /// @param priority Higher values are served first.
+    /// @param stats Statistics to update, or nullptr.
+    /// @param timeoutMs Max time to wait, or [I2C_ARBITER_WAIT_FOREVER].
+    /// @return true if the bus was acquired.
+    bool lock(uint8_t priority = 0,
+              I2CBusStats *stats = nullptr,
+              uint32_t timeoutMs = I2C_ARBITER_WAIT_FOREVER);
+
+    /// @brief Releases one level of the calling task's lock. The bus is
+    /// handed to the highest priority waiter when the outermost lock is
+    /// released.
+    void unlock();
+
+    /// @brief Returns true if the calling task holds the bus.
+    bool owned();
+
+    /// @brief Returns the number of tasks waiting for the bus.
+    uint8_t waiting();
+
+private:
+
+    #if defined(ESP32)
+    typedef TaskHandle_t TaskId;
+    #elif defined(I2C_NATIVE)
+    typedef std::thread::id TaskId;
+    #else
+    typedef uint8_t TaskId;
+    #endif
+
+    /// @brief A task waiting for the bus.
+    struct Waiter {
+        bool used;
+        bool granted;
+        TaskId task;
+        uint8_t priority;
+        uint32_t seq;
+        I2CBusStats *stats;
+        #if defined(ESP32)
+        SemaphoreHandle_t wake;
+        #endif
+    };
+
+    /// @brief Returns the id of the calling task.
+    static TaskId currentTask();
+
+    /// @brief Enters the critical section guarding the arbiter state.
+    void enter();
+
+    /// @brief Leaves the critical section.
+    void exit();
+
+    /// @brief Blocks in the critical section until [waiter] is granted
+    /// the bus or [timeoutMs] passed. Returns with the critical section
+    /// entered.
+    bool block(Waiter &waiter, uint32_t timeoutMs);
+
+    /// @brief Makes [task] the owner of the bus.
+    void take(TaskId task, I2CBusStats *stats);
+
+    /// @brief The task holding the bus, valid if [_depth] is not 0.
+    TaskId _owner;
+
+    /// @brief Nesting level of the owner's lock, 0 if the bus is free.
+    uint16_t _depth;
+
+    /// @brief Statistics of the owner.
+    I2CBusStats *_ownerStats;
+
+    /// @brief [micros()] when the owner acquired the bus.
+    uint32_t _lockedAt;
+
+    /// @brief Tasks waiting for the bus.
+    Waiter _waiters[I2C_ARBITER_MAX_WAITERS];
+
+    /// @brief Number of waiters not yet granted the bus.
+    uint8_t _waiting;
+
+    /// @brief Arrival counter, orders waiters of equal priority.
+    uint32_t _seq;
+
+    #if defined(ESP32)
+    /// @brief Guards the arbiter state.
+    portMUX_TYPE _mux;
+    #elif defined(I2C_NATIVE)
+    /// @brief Guards the arbiter state.
+    std::mutex _mutex;
+
+    /// @brief Signals waiters that the bus was handed over.
+    std::condition_variable _granted;
+    #endif
+
+};
+
+#endif // I2C_BUS_ARBITER_H_
@@ -0,0 +1,303 @@
+/*!
+ *  @file I2CChannel.h
+ *
+ *  @brief A lock-free single-producer/single-consumer channel for handing
+ *  samples from the task that reads the bus to a task, or core, that
+ *  processes them, without a mutex.
+ *
+ *  Both sides work in place: the producer reserves a slot, reads the
+ *  device straight into it and publishes it; the consumer gets the
+ *  oldest slot with [front] and hands it back with [release]. When the
+ *  channel is full the producer either drops the new value or takes the
+ *  slot of the oldest one, see [I2CChannelPolicy].
+ *
+ *  The producer and consumer indices sit on separate cache lines, and
+ *  each side keeps a private copy of the other side's index that it only
+ *  refreshes when the channel looks full or empty.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_CHANNEL_H_
+#define I2C_CHANNEL_H_
+
+#include <Arduino.h>
+
+#if defined(ESP32) || defined(I2C_NATIVE)
+#include <atomic>
+#endif
+
+#ifndef I2C_CACHE_LINE_SIZE
+#if defined(ESP32)
+/// @brief Size of a cache line; the producer and consumer state of a
+/// channel are kept this far apart.
+#define I2C_CACHE_LINE_SIZE 32
+#else
+#define I2C_CACHE_LINE_SIZE 64
+#endif
+#endif
+
+/// @brief What the producer does when the channel is full.
+enum I2CChannelPolicy {
+
+    /// @brief The new value is dropped and counted in [dropped()].
+    I2C_DROP_NEWEST,
+
+    /// @brief The oldest value is discarded to make room and counted in
+    /// [overwritten()]. If the consumer still holds the only slot that
+    /// could be reused, the new value is dropped instead.
+    I2C_OVERWRITE_OLDEST
+};
+
+/// @brief A 32-bit index shared by the two sides of an [I2CChannel].
+/// Loads acquire and stores release. Without [std::atomic] the platform
+/// has a single core, and the compare-and-swap masks interrupts.
+class I2CChannelIndex {
+public:
+
+    I2CChannelIndex(uint32_t value = 0) : _value(value) {}
+
+    #if defined(ESP32) || defined(I2C_NATIVE)
+    uint32_t load() const {
+        return _value.load(std::memory_order_acquire);
+    }
+
+    void store(uint32_t value) {
+        _value.store(value, std::memory_order_release);
+    }
+
+    /// @brief Replaces the value with [desired] if it is [expected];
+    /// otherwise loads the current value into [expected].
+    bool exchange(uint32_t &expected, uint32_t desired) {
+        return _value.compare_exchange_strong(expected, desired,
+                                              std::memory_order_acq_rel,
+                                              std::memory_order_acquire);
+    }
+    #else
+    uint32_t load() const { return _value; }
+
+    void store(uint32_t value) { _value = value; }
+
+    bool exchange(uint32_t &expected, uint32_t desired) {
+        noInterrupts();
+        bool swapped = _value == expected;
+        if (swapped) {
+            _value = desired;
+        } else {
+            expected = _value;
+        }
+        interrupts();
+        return swapped;
+    }
+    #endif
+
+private:
+
+    #if defined(ESP32) || defined(I2C_NATIVE)
+    std::atomic<uint32_t> _value;
+    #else
+    volatile uint32_t _value;
+    #endif
+
+};
+
+/// @brief A bounded channel of [T] values between exactly one producer
+/// and one consumer task.
+template <typename T>
+class I2CChannel {
+public:
+
+    /// @brief Instantiates a channel holding at least [capacity] values.
+    /// The slots are allocated here and never again; the number of slots
+    /// is rounded up to a power of two, one of which is kept free.
+    I2CChannel(size_t capacity, I2CChannelPolicy policy = I2C_DROP_NEWEST) {
+        size_t slots = 2;
+        while (slots < capacity + 1) {
+            slots <<= 1;
+        }
+        _slots = new T[slots];
+        _mask = (uint32_t)(slots - 1);
+        _policy = policy;
+        _headCache = 0;
+        _tailCache = 0;
+        _reading.store(NONE);
+    }
+
+    ~I2CChannel() {
+        delete[] _slots;
+    }
+
+    I2CChannel(const I2CChannel &) = delete;
+    I2CChannel & operator=(const I2CChannel &) = delete;
+
+    /// @brief Returns the number of values the channel holds when full.
+    size_t capacity() const { return _mask; }
+
+    /// @brief Returns the full policy.
+    I2CChannelPolicy policy() const { return _policy; }
+
+    // Producer side.
+
+    /// @brief Returns the slot for the next value, to be filled in place
+    /// and made visible with [publish]. Calling it again before
+    /// [publish] returns the same slot.
+    /// @return The slot, or nullptr if the value has to be dropped.
+    T * reserve() {
+        uint32_t tail = _tail.load();
+        if (tail - _headCache < _mask) {
+            return &_slots[tail & _mask];
+        }
+        _headCache = _head.load();
+        if (tail - _headCache < _mask) {
+            return &_slots[tail & _mask];
+        }
+        if (_policy == I2C_DROP_NEWEST) {
+            _dropped.store(_dropped.load() + 1);
+            return nullptr;
+        }
+        // only when full can the slot to fill be the one the consumer
+        // holds; discarding the oldest value would not free it, and the
+        // next reserve would hand it out while it is being read
+        if (_reading.load() == (tail & _mask)) {
+            _dropped.store(_dropped.load() + 1);
+            return nullptr;
+        }
+        uint32_t oldest = _headCache;
+        if (!_head.exchange(oldest, oldest + 1)) {
+            // the consumer just took the oldest value, which made room
+            _headCache = oldest;
+            return &_slots[tail & _mask];
+        }
+        _headCache = oldest + 1;
+        _overwritten.store(_overwritten.load() + 1);
+        return &_slots[tail & _mask];
+    }
+
+    /// @brief Makes the slot returned by [reserve] visible to the
+    /// consumer.
+    void publish() {
+        _tail.store(_tail.load() + 1);
+    }
+
+    /// @brief Copies [value] into the channel.
+    /// @return false if it was dropped.
+    bool push(const T &value) {
+        T *slot = reserve();
+        if (slot == nullptr) {
+            return false;
+        }
+        *slot = value;
+        publish();
+        return true;
+    }
+
+    /// @brief Returns the number of values dropped by the producer.
+    uint32_t dropped() const { return _dropped.load(); }
+
+    /// @brief Returns the number of values discarded unread to make room
+    /// ([I2C_OVERWRITE_OLDEST]).
+    uint32_t overwritten() const { return _overwritten.load(); }
+
+    // Consumer side.
+
+    /// @brief Takes the oldest value out of the channel. It stays valid
+    /// until [release]; the producer will not reuse its slot before.
+    /// Release a value before taking the next one.
+    /// @return The value, or nullptr if the channel is empty.
+    const T * front() {
+        uint32_t head = _head.load();
+        for (;;) {
+            // the producer may have moved [head] past the cached tail
+            if ((int32_t)(_tailCache - head) <= 0) {
+                _tailCache = _tail.load();
+                if ((int32_t)(_tailCache - head) <= 0) {
+                    _reading.store(NONE);
+                    return nullptr;
+                }
+            }
+            // announce the slot before claiming it, so a producer that
+            // sees the claim also sees that the slot is in use
+            _reading.store(head & _mask);
+            if (_head.exchange(head, head + 1)) {
+                return &_slots[head & _mask];
+            }
+            // the producer overwrote it; [head] is the new oldest
+        }
+    }
+
+    /// @brief Gives the slot returned by [front] back to the producer.
+    void release() {
+        _reading.store(NONE);
+    }
+
+    /// @brief Copies the oldest value to [value] and releases it.
+    /// @return false if the channel is empty.
+    bool pop(T &value) {
+        const T *slot = front();
+        if (slot == nullptr) {
+            return false;
+        }
+        value = *slot;
+        release();
+        return true;
+    }
+
+    /// @brief Returns the number of values in the channel. Exact only
+    /// when called from one side while the other is idle.
+    size_t size() const {
+        uint32_t head = _head.load();
+        uint32_t count = _tail.load() - head;
+        return count > _mask ? _mask : count;
+    }
+
+    /// @brief Returns true if the channel holds no values.
+    bool empty() const { return size() == 0; }
+
+private:
+
+    /// @brief [_reading] when the consumer holds no slot.
+    static const uint32_t NONE = 0xFFFFFFFFUL;
+
+    // shared, read-only after construction
+
+    /// @brief The slots.
+    T *_slots;
+
+    /// @brief Number of slots - 1.
+    uint32_t _mask;
+
+    /// @brief What to do when full.
+    I2CChannelPolicy _policy;
+
+    // producer line
+
+    /// @brief Index of the next value to publish.
+    alignas(I2C_CACHE_LINE_SIZE) I2CChannelIndex _tail;
+
+    /// @brief The producer's copy of [_head].
+    uint32_t _headCache;
+
+    /// @brief Values dropped.
+    I2CChannelIndex _dropped;
+
+    /// @brief Values overwritten.
+    I2CChannelIndex _overwritten;
+
+    // consumer line
+
+    /// @brief Index of the oldest value. Advanced by the consumer, and
+    /// by the producer when it overwrites the oldest value.
+    alignas(I2C_CACHE_LINE_SIZE) I2CChannelIndex _head;
+
+    /// @brief The consumer's copy of [_tail].
+    uint32_t _tailCache;
+
+    /// @brief The slot the consumer holds, or [NONE].
+    I2CChannelIndex _reading;
+
+};
+
+#endif // I2C_CHANNEL_H_
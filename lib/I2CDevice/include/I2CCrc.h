@@ -0,0 +1,116 @@
+/*!
+ *  @file I2CCrc.h
+ *
+ *  @brief Table-driven CRC-8 with the lookup tables generated at compile
+ *  time, for [I2CDevice::readWords] and the SMBus packet error code of
+ *  [I2CDevice::readPec] and [I2CDevice::writePec].
+ *
+ *  Sensirion sensors (SHT3x, SHT4x, SCD4x, SGP4x) follow every 16-bit
+ *  word with a CRC-8 of polynomial 0x31 and initial value 0xFF; SMBus
+ *  PEC is a CRC-8 of polynomial 0x07 and initial value 0x00 over the
+ *  whole transaction, address bytes included. Each polynomial gets a
+ *  256-byte table, built by the compiler, so a byte costs one lookup
+ *  instead of eight shift-and-XOR steps.
+ *
+ *  The tables are const data: read from flash on the ESP32, but copied
+ *  to RAM at startup on the AVR, 256 bytes per polynomial in use. They
+ *  cannot go in PROGMEM there, as the compiler places static members of
+ *  class templates in sections of their own and ignores the attribute.
+ *
+ *  @code
+ *  uint8_t crc = I2CCrcSensirion::compute(data, 2);   // 0x92 for BE EF
+ *  @endcode
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_CRC_H_
+#define I2C_CRC_H_
+
+#include <Arduino.h>
+
+#ifndef I2C_CRC_MAX_WORDS
+/// @brief Most words [I2CDevice::readWords] reads in one call; the words
+/// and their CRCs are received into a stack buffer of 3 bytes per word.
+#define I2C_CRC_MAX_WORDS 32
+#endif
+
+/// @brief Returns the CRC-8 of polynomial [poly] of the single byte
+/// [crc] with an initial value of 0, i.e. table entry [crc]. Unrolled by
+/// the compiler when the tables are built.
+constexpr uint8_t i2cCrc8Entry(uint8_t crc, uint8_t poly, uint8_t bits = 8) {
+    return bits == 0 ? crc
+        : i2cCrc8Entry((uint8_t)(crc & 0x80 ? (crc << 1) ^ poly : crc << 1),
+                       poly, (uint8_t)(bits - 1));
+}
+
+/// @brief The indices [I]..., for expanding a table initialiser.
+template <size_t... I>
+struct I2CIndexList {};
+
+/// @brief [I2CIndexList] of 0 to [N] - 1.
+template <size_t N, size_t... I>
+struct I2CMakeIndexList : I2CMakeIndexList<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct I2CMakeIndexList<0, I...> {
+    typedef I2CIndexList<I...> type;
+};
+
+/// @brief The lookup table of polynomial [Poly], one entry per index.
+template <uint8_t Poly, typename Indices>
+struct I2CCrc8Table;
+
+template <uint8_t Poly, size_t... I>
+struct I2CCrc8Table<Poly, I2CIndexList<I...>> {
+    static constexpr uint8_t values[sizeof...(I)] = {
+        i2cCrc8Entry((uint8_t)I, Poly)...};
+};
+
+template <uint8_t Poly, size_t... I>
+constexpr uint8_t I2CCrc8Table<Poly, I2CIndexList<I...>>::values[sizeof...(I)];
+
+/// @brief A CRC-8 of polynomial [Poly] (without the x^8 term) and
+/// initial value [Init], unreflected and without final XOR.
+template <uint8_t Poly, uint8_t Init>
+struct I2CCrc8 {
+
+    /// @brief The polynomial and initial value.
+    static constexpr uint8_t polynomial = Poly;
+    static constexpr uint8_t init = Init;
+
+    /// @brief The 256 entry lookup table, in RAM on the AVR.
+    typedef I2CCrc8Table<Poly, typename I2CMakeIndexList<256>::type> table;
+
+    /// @brief Returns [crc] updated with the byte [b].
+    static uint8_t update(uint8_t crc, uint8_t b) {
+        return table::values[crc ^ b];
+    }
+
+    /// @brief Returns the CRC of [len] bytes at [data], continuing from
+    /// [crc].
+    static uint8_t compute(const uint8_t *data, size_t len,
+                           uint8_t crc = Init) {
+        for (size_t i = 0; i < len; i++) {
+            crc = table::values[crc ^ data[i]];
+        }
+        return crc;
+    }
+
+};
+
+/// @brief The CRC-8 of Sensirion sensors, also used by the AHT20 and
+/// others: polynomial 0x31, initial value 0xFF.
+typedef I2CCrc8<0x31, 0xFF> I2CCrcSensirion;
+
+/// @brief The SMBus packet error code: polynomial 0x07, initial value 0.
+typedef I2CCrc8<0x07, 0x00> I2CCrcSmbus;
+
+static_assert(I2CCrcSensirion::table::values[
+                  I2CCrcSensirion::table::values[0xFF ^ 0xBE] ^ 0xEF] == 0x92,
+              "CRC-8 of 0xBEEF must be 0x92 (Sensirion datasheets)");
+
+#endif // I2C_CRC_H_
@@ -0,0 +1,286 @@
+/*!
+ *  @file I2CDataReady.h
+ *
+ *  @brief Data-ready interrupt driven reads: the device's interrupt line
+ *  triggers a pre-declared burst read instead of the MCU polling a status
+ *  register.
+ *
+ *  The interrupt handler only timestamps the edge and wakes a task; the
+ *  task performs the read, optionally followed by a write that clears the
+ *  device's interrupt flag (after a repeated START, with one STOP, except
+ *  on the ESP32, whose reads always end with a STOP), and hands the
+ *  result over through an [I2CChannel]. Edges that
+ *  arrive while a read is still pending are coalesced into it. On the
+ *  ESP32 the reads run in a FreeRTOS task, on the `native` build in a
+ *  [std::thread]; elsewhere call [poll] from [loop()].
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_DATA_READY_H_
+#define I2C_DATA_READY_H_
+
+#include <Arduino.h>
+#include "I2CChannel.h"
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#elif defined(I2C_NATIVE)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#ifndef IRAM_ATTR
+/// @brief Places interrupt handlers in IRAM on the ESP32.
+#define IRAM_ATTR
+#endif
+
+#ifndef I2C_DATA_READY_SIZE
+/// @brief Max number of registers read per event.
+#define I2C_DATA_READY_SIZE 16
+#endif
+
+#ifndef I2C_DATA_READY_CLEAR_SIZE
+/// @brief Max number of bytes written to clear the interrupt.
+#define I2C_DATA_READY_CLEAR_SIZE 4
+#endif
+
+class I2CDevice;
+
+/// @brief The registers read after a data-ready edge.
+struct I2CDataReadyEvent {
+
+    /// @brief [micros()] at the edge.
+    uint32_t edgeUs;
+
+    /// @brief [micros()] when the data had been read.
+    uint32_t readUs;
+
+    /// @brief Number of bytes in [data].
+    uint8_t len;
+
+    /// @brief The raw register values.
+    uint8_t data[I2C_DATA_READY_SIZE];
+
+};
+
+/// @brief Counters of an [I2CDataReady]. Times are in microseconds.
+struct I2CDataReadyStats {
+
+    /// @brief Edges seen by the interrupt handler, and software triggers.
+    uint32_t edges;
+
+    /// @brief Edges that arrived while a read was pending and were
+    /// served by it.
+    uint32_t coalesced;
+
+    /// @brief Successful reads.
+    uint32_t reads;
+
+    /// @brief Reads that failed.
+    uint32_t errors;
+
+    /// @brief Sum and maximum of the time from an edge to its data.
+    uint64_t latencyUs;
+    uint32_t maxLatencyUs;
+
+};
+
+/// @brief Reads a device's registers when its data-ready line fires.
+class I2CDataReady {
+public:
+
+    /// @brief Called by the reading task after each successful read.
+    typedef void (*Callback)(const I2CDataReadyEvent &event, void *arg);
+
+    /// @brief Instantiates a reader for [device] buffering at least
+    /// [capacity] events. When the buffer is full the oldest event is
+    /// overwritten.
+    I2CDataReady(I2CDevice &device, size_t capacity = 16);
+
+    ~I2CDataReady();
+
+    I2CDataReady(const I2CDataReady &) = delete;
+    I2CDataReady & operator=(const I2CDataReady &) = delete;
+
+    /// @brief Declares the read: [len] registers from [reg], with the
+    /// device's register command bits. Volatile data registers are read
+    /// from the device, bypassing the register cache.
+    /// @return false if [len] is 0, larger than [I2C_DATA_READY_SIZE] or
+    /// than the Wire buffer, or the reader is running.
+    bool setRead(uint8_t reg, uint8_t len);
+
+    /// @brief Declares the [len] bytes written after the read, in the
+    /// same transaction where the core can read without a STOP (not the
+    /// ESP32), to clear the device's interrupt flag, e.g.
+    /// {0xE7} for the APDS9930. [len] 0 writes nothing; the device must
+    /// then release the line by itself, e.g. when the data is read.
+    /// @return false if [len] is larger than [I2C_DATA_READY_CLEAR_SIZE]
+    /// or the reader is running.
+    bool setClear(const uint8_t *bytes, uint8_t len);
+
+    /// @brief Sets a function the reading task calls with every event,
+    /// just before the event is added to the buffer.
+    void onData(Callback callback, void *arg = nullptr) {
+        _callback = callback;
+        _callbackArg = arg;
+    }
+
+    /// @brief Attaches the interrupt handler to [pin] and starts the
+    /// reading task. If the line is already active no edge will come, so
+    /// a read is scheduled right away.
+    /// @param pin The GPIO connected to the device's interrupt output.
+    /// @param mode FALLING for an active LOW (open drain) line, which is
+    /// then pulled up; RISING for an active HIGH line.
+    /// @param priority FreeRTOS priority of the task (ESP32).
+    /// @param core The core the task is pinned to (ESP32).
+    /// @param stackSize Stack size of the task (ESP32).
+    /// @return true if the reader started.
+    bool begin(uint8_t pin,
+               int mode = FALLING,
+               uint8_t priority = 10,
+               int core = 0,
+               uint32_t stackSize = 4096);
+
+    /// @brief Detaches the interrupt handler and stops the reading task.
+    void end();
+
+    /// @brief Returns true between [begin] and [end].
+    bool running() { return _running; }
+
+    /// @brief Schedules a read as if an edge had been seen. Call it from
+    /// a task, not from an interrupt handler.
+    void trigger();
+
+    /// @brief Performs the pending read, if any, in the caller's context.
+    /// Without tasks call it from [loop()].
+    /// @return true if a read was performed.
+    bool poll();
+
+    /// @brief Takes the oldest event out of the buffer.
+    /// @return false if the buffer is empty.
+    bool pop(I2CDataReadyEvent &event) { return _channel.pop(event); }
+
+    /// @brief Returns the event buffer, a lock-free channel the reading
+    /// task reads the registers straight into.
+    I2CChannel<I2CDataReadyEvent> & channel() { return _channel; }
+
+    /// @brief Returns the number of buffered events.
+    size_t available() { return _channel.size(); }
+
+    /// @brief Returns the number of events overwritten before they were
+    /// popped, or dropped because the consumer held the only free slot.
+    uint32_t lost();
+
+    /// @brief Returns a copy of the counters.
+    I2CDataReadyStats stats();
+
+    /// @brief Returns the mean time from an edge to its data, in
+    /// microseconds.
+    float meanLatencyUs();
+
+    /// @brief Zeroes the counters and the lost counter.
+    void resetStats();
+
+private:
+
+    /// @brief The interrupt handler.
+    static void IRAM_ATTR isr(void *reader);
+
+    /// @brief Records an edge at [now]; called with the critical section
+    /// held.
+    void IRAM_ATTR signal(uint32_t now);
+
+    /// @brief Enters the critical section guarding the edge state and
+    /// the counters.
+    void enter();
+
+    /// @brief Leaves the critical section.
+    void exit();
+
+    /// @brief Reads the registers into [buf] and writes the clear bytes,
+    /// retried as a whole under the device's recovery policy.
+    bool transact(uint8_t *buf);
+
+    /// @brief The reading loop of the task.
+    void work();
+
+    /// @brief The device to read.
+    I2CDevice &_device;
+
+    /// @brief The declared read.
+    uint8_t _reg;
+    uint8_t _len;
+
+    /// @brief The bytes clearing the interrupt.
+    uint8_t _clear[I2C_DATA_READY_CLEAR_SIZE];
+    uint8_t _clearLen;
+
+    /// @brief The interrupt pin.
+    uint8_t _pin;
+
+    /// @brief The event buffer.
+    I2CChannel<I2CDataReadyEvent> _channel;
+
+    /// @brief The data callback.
+    Callback _callback;
+    void *_callbackArg;
+
+    /// @brief True if an edge is waiting for its read.
+    volatile bool _pending;
+
+    /// @brief [micros()] of the first edge of the pending read.
+    volatile uint32_t _edgeUs;
+
+    /// @brief The counters.
+    I2CDataReadyStats _stats;
+
+    /// @brief [lost()] when the counters were last reset.
+    uint32_t _lostBefore;
+
+    /// @brief True between [begin] and [end].
+    volatile bool _running;
+
+    /// @brief Set to stop the task.
+    volatile bool _stopping;
+
+    #if defined(ESP32)
+    /// @brief Entry point of the reading task.
+    static void task(void *reader);
+
+    /// @brief The reading task.
+    TaskHandle_t _task;
+
+    /// @brief Given by the task when it exits.
+    SemaphoreHandle_t _stopped;
+
+    /// @brief Guards the edge state and the counters, also against the
+    /// interrupt handler.
+    portMUX_TYPE _mux;
+    #elif defined(I2C_NATIVE)
+    /// @brief Guards the edge state and the counters.
+    std::mutex _mutex;
+
+    /// @brief Wakes the reading thread.
+    std::condition_variable _wake;
+
+    /// @brief The reading thread.
+    std::thread _thread;
+    #else
+    /// @brief The reader the interrupt handler serves; [attachInterrupt]
+    /// takes no argument here, so only one reader can run at a time.
+    static I2CDataReady *_instance;
+
+    /// @brief Calls [isr] for [_instance].
+    static void isrTrampoline();
+    #endif
+
+};
+
+#endif // I2C_DATA_READY_H_
@@ -0,0 +1,98 @@
+/*!
+ *  @file I2CDecode.h
+ *
+ *  @brief Bulk conversion of raw samples, as read from a register block
+ *  or drained from a sensor FIFO, to integers or scaled floats: byte
+ *  order, bit width, justification and sign extension are applied to a
+ *  whole array in one pass instead of one sample at a time with shifts
+ *  and ORs.
+ *
+ *  @code
+ *  // ADXL345, 13-bit right-justified, little-endian, 3.9 mg/LSB
+ *  const I2CSampleFormat adxl = {2, I2C_LITTLE_ENDIAN, 13, 0, true};
+ *  uint8_t raw[6];
+ *  float g[3];
+ *  accel.readRegister(0x32, raw, 6);
+ *  I2CDecode::toFloat(raw, 3, adxl, g, 0.0039f);
+ *  @endcode
+ *
+ *  Two-byte samples, the common case, take a SIMD path on hosts with
+ *  SSE2 (every x86-64 [native] build), 8 samples per step. Other sample
+ *  sizes and targets run plain loops with the layout resolved before the
+ *  loop, which the compiler unrolls or vectorises where the target has
+ *  vector instructions. All paths produce the same values.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_DECODE_H_
+#define I2C_DECODE_H_
+
+#include <Arduino.h>
+#include "I2CRegister.h"
+
+#if defined(I2C_NATIVE) && defined(__SSE2__) && !defined(I2C_DECODE_NO_SIMD)
+/// @brief Defined when two-byte samples are decoded with SSE2; define
+/// I2C_DECODE_NO_SIMD to run the plain loops instead.
+#define I2C_DECODE_SSE2
+#endif
+
+/// @brief The layout of a raw sample in the register bytes.
+struct I2CSampleFormat {
+
+    /// @brief Bytes per sample, 1 to 4.
+    uint8_t bytes;
+
+    /// @brief Byte order of a sample.
+    I2CByteOrder order;
+
+    /// @brief Significant bits, 1 to 8 * [bytes].
+    uint8_t bits;
+
+    /// @brief Unused bits below the value, e.g. 4 for a 12-bit value
+    /// left-justified in 16 bits; [bits] + [shift] is at most 8 * [bytes].
+    uint8_t shift;
+
+    /// @brief True if the value is two's complement and is sign
+    /// extended, false if unsigned.
+    bool isSigned;
+
+};
+
+/// @brief Bulk decoders of raw samples. The destination must not overlap
+/// the raw bytes.
+class I2CDecode {
+public:
+
+    /// @brief Returns true if [format] describes a sample the decoders
+    /// handle.
+    static bool valid(const I2CSampleFormat &format);
+
+    /// @brief Decodes [count] samples of [format] at [raw] into [out].
+    /// @return false if [format] is invalid or has more than 16 bits.
+    static bool toInt16(const uint8_t *raw, size_t count,
+                        const I2CSampleFormat &format, int16_t *out);
+
+    /// @brief Decodes [count] samples of [format] at [raw] into [out].
+    /// Unsigned values of 32 bits wrap to negative.
+    /// @return false if [format] is invalid.
+    static bool toInt32(const uint8_t *raw, size_t count,
+                        const I2CSampleFormat &format, int32_t *out);
+
+    /// @brief Decodes [count] samples of [format] at [raw] into [out] as
+    /// value * [scale] + [offset].
+    /// @return false if [format] is invalid.
+    static bool toFloat(const uint8_t *raw, size_t count,
+                        const I2CSampleFormat &format, float *out,
+                        float scale = 1.0f, float offset = 0.0f);
+
+    /// @brief Decodes a single sample of [format] at [raw]; the reference
+    /// the bulk decoders agree with.
+    static int32_t sample(const uint8_t *raw, const I2CSampleFormat &format);
+
+};
+
+#endif // I2C_DECODE_H_
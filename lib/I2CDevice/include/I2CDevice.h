@@ -49,14 +49,124 @@
 
 // #define DEBUG_I2DEVICE_SERIAL Serial
 
+// Counters and latency histograms without printing, see I2CMetrics.h.
+// Define in build_flags, as it changes the layout of I2CDevice.
+// -D I2C_DEVICE_METRICS
+
 #include <Arduino.h>
 #include <Wire.h>
-
+#include "I2CBusArbiter.h"
+#include "I2CCrc.h"
+#include "I2CDecode.h"
+#include "I2CFifo.h"
+#include "I2CFormat.h"
+#include "I2CMetrics.h"
+#include "I2CReadPlan.h"
+#include "I2CRecovery.h"
+#include "I2CRegister.h"
+#include "I2CRegisterCache.h"
+#include "I2CTrace.h"
+#include "I2CWriteStage.h"
+
+
+#if (defined(ARDUINO_ARCH_AVR) && !defined(TinyWireM_h)) || \
+    (defined(I2C_NATIVE) && defined(I2C_NATIVE_IADDRESS))
+/// @brief Defined if [TwoWire] has the internal-address variant of
+/// [requestFrom] that writes up to [I2C_WIRE_IADDRESS_MAX] bytes, then
+/// reads with a repeated START in one call. The `native` build takes the
+/// ESP32 path (a write without STOP, then the read) unless built with
+/// I2C_NATIVE_IADDRESS.
+#define I2C_WIRE_HAS_IADDRESS
+
+/// @brief Most internal address bytes [requestFrom] writes; the AVR core
+/// clamps [isize] to 3.
+#define I2C_WIRE_IADDRESS_MAX 3
+#endif
+
+#ifndef I2C_WRITE_CYCLE_TIMEOUT_US
+/// @brief Default time to wait for an EEPROM write cycle to end.
+#define I2C_WRITE_CYCLE_TIMEOUT_US 10000UL
+#endif
+
+/// @brief First and last address probed by a bus scan, the 7-bit range
+/// without the reserved addresses.
+#define I2C_SCAN_FIRST 0x08
+#define I2C_SCAN_LAST 0x77
+
+/// @brief Error code of an address a bus scan did not probe.
+#define I2C_SCAN_NOT_PROBED 0xFF
+
+#ifndef I2C_CALIBRATE_CLOCKS
+/// @brief SCL frequencies tried by [I2CDevice::calibrateClock], in
+/// ascending order.
+#define I2C_CALIBRATE_CLOCKS {100000, 200000, 400000, 600000, 800000, 1000000}
+#endif
+
+#ifndef I2C_CALIBRATE_READS
+/// @brief Reads verified per frequency by [I2CDevice::calibrateClock].
+#define I2C_CALIBRATE_READS 8
+#endif
+
+/// @brief Largest register block [I2CDevice::calibrateClock] verifies.
+#define I2C_CALIBRATE_SIZE 16
 
 #define I2C_SDA 21
 #define I2C_SCL 22
 #define I2C_FREQ 0U
 
+/// @brief One piece of a scatter-gather write: [len] bytes at [buffer].
+struct I2CWriteSegment {
+
+    /// @brief The bytes to write.
+    const uint8_t *buffer;
+
+    /// @brief The number of bytes to write.
+    size_t len;
+
+};
+
+/// @brief One destination of a scatter-gather read: the next [len] bytes
+/// received are stored at [buffer], or discarded if it is nullptr.
+struct I2CReadSegment {
+
+    /// @brief The buffer to read into, or nullptr to skip the bytes.
+    uint8_t *buffer;
+
+    /// @brief The number of bytes to read.
+    size_t len;
+
+};
+
+/// @brief The outcome of a bus scan.
+struct I2CScanResult {
+
+    /// @brief Presence bitmap, bit (address & 31) of word (address >> 5).
+    uint32_t present[4];
+
+    /// @brief [endTransmission] result per address: 0 if present, 2 for
+    /// an address NACK, other values are bus errors, [I2C_SCAN_NOT_PROBED]
+    /// outside the scanned range.
+    uint8_t errors[128];
+
+    /// @brief Number of devices that responded.
+    uint8_t count;
+
+    /// @brief SCL frequency used for probing, 0 if unknown.
+    uint32_t clock;
+
+    /// @brief Wall-clock duration of the scan, in microseconds.
+    uint32_t elapsedUs;
+
+    /// @brief Returns true if a device responded at [address].
+    bool has(uint8_t address) const {
+        return address < 0x80 &&
+               (present[address >> 5] >> (address & 31)) & 1;
+    }
+
+};
+
+class I2CMux;
+
 /// The class which defines how we will talk to this device over I2C
 class I2CDevice {
 public:
@@ -67,6 +177,11 @@ public:
     /// instance. Defaults to [Wire].
     I2CDevice(uint8_t addr, TwoWire *theWire = &Wire);
 
+    ~I2CDevice();
+
+    I2CDevice(const I2CDevice &) = delete;
+    I2CDevice & operator=(const I2CDevice &) = delete;
+
     /// @brief Returns the I2C address of the device on the bus.
     /// @return The I2C address of the device on the bus
     uint8_t address(void);
@@ -87,6 +202,127 @@ public:
             int scl = I2C_SCL, 
             uint32_t frequency = I2C_FREQ);
 
+    /// @brief Runs the device at its own SCL frequency on a shared bus:
+    /// every operation first switches the bus clock to [frequency] unless
+    /// the bus already runs at it, so devices of different speeds share a
+    /// bus without holding the fast ones to the slowest. Once one device
+    /// on a bus has a clock, give every device on it one, or a device
+    /// without runs at whatever clock the bus was left at.
+    /// @param frequency The SCL frequency in Hz, or 0 to leave the bus
+    /// clock alone (the default).
+    void setMaxClock(uint32_t frequency) { _maxClock = frequency; }
+
+    /// @brief Returns the device's SCL frequency, 0 if it has none.
+    uint32_t maxClock() { return _maxClock; }
+
+    /// @brief Finds the highest SCL frequency at which the device reads
+    /// reliably: reads [len] bytes from [reg] at [clocks][0], then
+    /// [reads] times at each following frequency, and stops at the first
+    /// one where a read fails or differs. The registers must not change
+    /// meanwhile, e.g. an ID register. The reads go to the bus, never to
+    /// the register cache or write stage, and are tried once each, without
+    /// the recovery policy's retries. The result becomes the device's
+    /// clock, see [setMaxClock], and the bus clock is restored.
+    /// @param reg The first register.
+    /// @param len The number of bytes, at most [I2C_CALIBRATE_SIZE].
+    /// @param clocks Frequencies to try in ascending order, or nullptr
+    /// for [I2C_CALIBRATE_CLOCKS].
+    /// @param count The number of [clocks].
+    /// @param reads Reads per frequency.
+    /// @return The highest reliable frequency, or 0 if even the first
+    /// failed; the device's clock is left unchanged then.
+    uint32_t calibrateClock(uint8_t reg, size_t len = 1,
+                            const uint32_t *clocks = nullptr,
+                            size_t count = 0,
+                            uint8_t reads = I2C_CALIBRATE_READS);
+
+    /// @brief Puts the device behind [channel] of multiplexer [mux], see
+    /// I2CMux.h: every operation, and [detected], first selects the
+    /// channel unless the multiplexer already has it enabled.
+    /// @param mux The multiplexer, or nullptr if the device is on the bus
+    /// directly (the default).
+    /// @param channel The channel, 0 to [I2C_MUX_CHANNELS] - 1.
+    void setMux(I2CMux *mux, uint8_t channel) {
+        _mux = mux;
+        _muxChannel = channel;
+    }
+
+    /// @brief Returns the multiplexer, or nullptr.
+    I2CMux * mux() { return _mux; }
+
+    /// @brief Returns the multiplexer channel.
+    uint8_t muxChannel() { return _muxChannel; }
+
+    /// @brief Shares the bus with other devices on the same [TwoWire]
+    /// through [arbiter]. Every transaction then locks the bus.
+    /// @param arbiter The arbiter of the bus, or nullptr to stop locking.
+    /// @param priority The device's priority, higher values are served
+    /// first when several devices wait for the bus.
+    void setArbiter(I2CBusArbiter *arbiter, uint8_t priority = 0);
+
+    /// @brief Returns the bus arbiter, or nullptr if none is set.
+    /// @return The bus arbiter.
+    I2CBusArbiter * arbiter() { return _arbiter; }
+
+    /// @brief Acquires the bus for a batch of transactions; prefer an
+    /// [I2CBusLock] scope. Always succeeds without an arbiter.
+    /// @param timeoutMs Max time to wait for the bus.
+    /// @return true if the bus was acquired.
+    bool acquireBus(uint32_t timeoutMs = I2C_ARBITER_WAIT_FOREVER);
+
+    /// @brief Releases the bus acquired with [acquireBus].
+    void releaseBus();
+
+    /// @brief Returns the device's bus contention statistics.
+    /// @return The statistics.
+    const I2CBusStats & busStats() { return _busStats; }
+
+    /// @brief Resets the bus contention statistics.
+    void resetBusStats();
+
+    /// @brief Copies the device's performance counters and latency
+    /// histograms to [snapshot], holding the bus so the copy is
+    /// consistent.
+    /// @return false if the library was built without
+    /// [I2C_DEVICE_METRICS]; [snapshot] is zeroed then.
+    bool metrics(I2CMetrics &snapshot);
+
+    /// @brief Zeroes the performance counters.
+    void resetMetrics();
+
+    /// @brief Records every write and read transfer of the device in
+    /// [trace], which several devices can share.
+    /// @param trace The trace, or nullptr to stop recording.
+    void setTrace(I2CTrace *trace) { _trace = trace; }
+
+    /// @brief Returns the trace, or nullptr if none is set.
+    I2CTrace * trace() { return _trace; }
+
+    /// @brief Retries failed operations, clears a stuck bus and gives up
+    /// at a deadline according to [policy], see I2CRecovery.h. Applies
+    /// once per outermost [write], [writeSegments], [read],
+    /// [readSegments] or [write_then_read], including those the register
+    /// and memory helpers run, with the bus held across the retries and
+    /// the backoff between them. A deadline also sets the Wire timeout,
+    /// which is shared by all devices on the bus.
+    /// @param policy The policy; all zero to try operations once.
+    void setRecoveryPolicy(const I2CRecoveryPolicy &policy);
+
+    /// @brief Returns the recovery policy.
+    const I2CRecoveryPolicy & recoveryPolicy() { return _recovery; }
+
+    /// @brief Returns the recovery counters.
+    const I2CRecoveryStats & recoveryStats() { return _recoveryStats; }
+
+    /// @brief Zeroes the recovery counters.
+    void resetRecoveryStats();
+
+    /// @brief Ends the Wire interface, clears the bus with
+    /// [I2CRecovery::clearBus] on the pins of the last [begin] and begins
+    /// it again at the current clock.
+    /// @return true if SDA was released.
+    bool recoverBus();
+
     /// @brief returns true if the [I2CDeivce] has been initialized;
     /// @return true if the [I2CDeivce] has been initialized;
     bool isInitialized();
@@ -107,61 +343,238 @@ public:
     /// @return True if read was successful, otherwise false.
     bool read(uint8_t *buffer, size_t len, bool stop = true);
 
-    // /// @brief  Reads num bytes from specified register into a given buffer
-    // /// @param  reg Register
-    // /// @param  buf Buffer
-    // /// @param  num  Number of bytes
-    // /// @param verbose Prints the results of the register poll 
-    // /// to the serial port if true. Defaults to true.
-    // /// @return Position after reading
-    // uint8_t readRegister(uint8_t reg, 
-    //              uint8_t *buf, 
-    //              uint8_t num,
-    //              bool verbose = false);
-
-    // /// @brief Reads the register values from the device, starting
-    // /// at [startReg] and reading [len] elements
-    // /// @param buf The array to populate with the register values.
-    // /// @param len The number of registers to read.
-    // /// @param startReg The register starting addres to commence 
-    // /// reading at.
-    // /// @param verbose Prints the results of the register poll 
-    // /// to the serial port if true. Defaults to true.
-    // void readAllRegisters(byte * buf, 
-    //                      uint8_t len, 
-    //                       byte startReg = 0,
-    //                       bool verbose = true);
-
-    // /// @brief  Writes num bytes from specified buffer into a given register
-    // /// @param  reg Register
-    // /// @param  buf Buffer
-    // /// @param  num Number of bytes
-    // void write(uint8_t reg, uint8_t *buf, uint8_t num);
-
-    // /// @brief  Writes specified value to given register
-    // /// @param  reg Register to write to
-    // /// @param  value Value to write
-    // void write8(byte reg, byte value);
-
-    // /// @brief  Reads 8 bits from specified register.
-    // /// @param  reg Register to write from.
-    // /// @return Value in register [reg].
-    // uint8_t read8(byte reg);
-
-    // /// @brief  Reads 32 bits from specified register.
-    // /// @param  reg Register to write to
-    // /// @return Value in register
-    // uint32_t read32(uint8_t reg, bool bigEndian = true);
-
-    // /// @brief  Reads 16 bits from specified register.
-    // /// @param  reg Register to write to
-    // /// @return Value in register
-    // uint16_t read16(uint8_t reg, bool bigEndian = true);
-    
-    // /// @brief  Reads 16 bits from specified register.
-    // /// @param  reg Register to write to
-    // /// @return Value in register
-    // uint16_t read16R(uint8_t reg);
+    /// @brief Sets the command bits ORed into the register address byte
+    /// of every register access, e.g. 0xA0 for the APDS9930 (command bit
+    /// plus auto-increment protocol). Defaults to 0x00.
+    /// @param command The command bits.
+    void setRegisterCommand(uint8_t command) { _regCommand = command; }
+
+    /// @brief Returns the command bits set with [setRegisterCommand].
+    /// @return The command bits.
+    uint8_t registerCommand() { return _regCommand; }
+
+    /// @brief  Reads [len] bytes from the registers starting at [reg] into
+    /// [buf], relying on the device to auto-increment its register
+    /// pointer. Served from the register cache if it is enabled and all
+    /// the registers are non-volatile and cached.
+    /// @param  reg The first register.
+    /// @param  buf Buffer to read into.
+    /// @param  len Number of registers to read.
+    /// @return True if the registers were read, otherwise false.
+    bool readRegister(uint8_t reg, uint8_t *buf, size_t len);
+
+    /// @brief Reads all the registers declared in [plan] with as few
+    /// burst reads as possible and copies them to the destinations given
+    /// to [I2CReadPlan::add]. Bursts are limited to [maxBufferSize()] and
+    /// use the command bits set with [setRegisterCommand]. Non-volatile
+    /// registers read are stored in the register cache, if enabled.
+    /// @param plan The registers to read.
+    /// @return True if all the registers were read, otherwise false.
+    bool readPlan(I2CReadPlan &plan);
+
+    /// @brief Reads the fill level of the sensor FIFO described by
+    /// [fifo] and, if it reached the watermark, reads the frames into the
+    /// ring of [fifo] in bursts of as many whole frames as fit
+    /// [maxBufferSize()], one transaction each. Frames the ring has no
+    /// room for stay in the sensor. The level is always read from the
+    /// bus, never from the register cache or write stage. Uses the
+    /// command bits set with [setRegisterCommand] and holds the bus
+    /// throughout.
+    /// @param fifo The FIFO and the ring to fill.
+    /// @param force True to read below the watermark.
+    /// @return True if the level and all the frames taken were read,
+    /// otherwise false; the frames of earlier bursts stay in the ring.
+    bool drainFifo(I2CFifo &fifo, bool force = false);
+
+    /// @brief  Writes [len] bytes from [buf] to the registers starting at
+    /// [reg]. The register cache, if enabled, is written through.
+    /// @param  reg The first register.
+    /// @param  buf Pointer to buffer of data to write.
+    /// @param  len Number of bytes from buffer to write.
+    /// @param  stop Whether to send an I2C STOP signal on write
+    /// @return True if the registers were written, otherwise false.
+    bool writeRegister(uint8_t reg,
+                       const uint8_t *buf,
+                       size_t len,
+                       bool stop = true);
+
+    /// @brief  Writes specified value to given register
+    /// @param  reg Register to write to
+    /// @param  value Value to write
+    /// @return True if the register was written, otherwise false.
+    bool write8(uint8_t reg, uint8_t value);
+
+    /// @brief  Reads 8 bits from specified register.
+    /// @param  reg Register to read from.
+    /// @return Value in register [reg], or 0 if the read failed.
+    uint8_t read8(uint8_t reg);
+
+    /// @brief  Reads 16 bits from specified register.
+    /// @param  reg The first of the two registers to read.
+    /// @param  bigEndian If true the first register holds the high byte.
+    /// @return Value in the registers, or 0 if the read failed.
+    uint16_t read16(uint8_t reg, bool bigEndian = true);
+
+    /// @brief  Reads 32 bits from specified register.
+    /// @param  reg The first of the four registers to read.
+    /// @param  bigEndian If true the first register holds the high byte.
+    /// @return Value in the registers, or 0 if the read failed.
+    uint32_t read32(uint8_t reg, bool bigEndian = true);
+
+    /// @brief Reads [count] 16-bit words, each sent MSB first and
+    /// followed by its CRC-8 [Crc], as Sensirion sensors do, checks the
+    /// CRCs and stores the words in [words]. The optional command is
+    /// written first, with a STOP before the read if [stop] is true. A CRC
+    /// mismatch fails the read like a NACK: it is counted in the metrics
+    /// ([I2CMetrics::crcErrors]) and retried under the recovery policy.
+    /// @param words Receives the words; partly written if a CRC fails.
+    /// @param count The number of words, at most [I2C_CRC_MAX_WORDS].
+    /// @param command Optional command, e.g. the two bytes of a Sensirion
+    /// command.
+    /// @param commandLen Number of bytes of [command].
+    /// @param stop Whether to send a STOP between command and read.
+    /// @return True if all the words were read with a valid CRC.
+    template <typename Crc = I2CCrcSensirion>
+    bool readWords(uint16_t *words, size_t count,
+                   const uint8_t *command = nullptr, size_t commandLen = 0,
+                   bool stop = true) {
+        return _readWords(words, count, command, commandLen, stop,
+                          Crc::table::values, Crc::init);
+    }
+
+    /// @brief Reads [len] bytes from SMBus command [command] followed by
+    /// the packet error code, which covers both address bytes, the
+    /// command and the data, and checks it. A mismatch is counted and
+    /// retried like a CRC error of [readWords].
+    /// @param command The SMBus command code.
+    /// @param buffer Receives the data.
+    /// @param len Number of data bytes, 1 for read byte, 2 for read word.
+    /// @return True if the data was read with a valid PEC.
+    bool readPec(uint8_t command, uint8_t *buffer, size_t len);
+
+    /// @brief Writes [len] bytes to SMBus command [command] followed by
+    /// the packet error code. The bytes go straight from [buffer] into
+    /// the Wire buffer.
+    /// @param command The SMBus command code.
+    /// @param buffer The data.
+    /// @param len Number of data bytes.
+    /// @return True if the device acknowledged every byte and the PEC.
+    bool writePec(uint8_t command, const uint8_t *buffer, size_t len);
+
+    /// @brief Reads register [R], an [I2CRegister], and converts it from
+    /// the device's byte order. Does not compile for write-only
+    /// registers.
+    /// @param value Receives the register value.
+    /// @return True if the register was read, otherwise false.
+    template <typename R>
+    bool get(typename R::type &value) {
+        static_assert(R::readable, "register is write-only");
+        uint8_t buf[R::width];
+        if (!readRegister(R::address, buf, R::width)) {
+            return false;
+        }
+        value = R::decode(buf);
+        return true;
+    }
+
+    /// @brief Reads register [R], an [I2CRegister].
+    /// @return The register value, or 0 if the read failed.
+    template <typename R>
+    typename R::type get() {
+        typename R::type value = 0;
+        get<R>(value);
+        return value;
+    }
+
+    /// @brief Writes [value] to register [R], an [I2CRegister], in the
+    /// device's byte order. Does not compile for read-only registers.
+    /// @return True if the register was written, otherwise false.
+    template <typename R>
+    bool set(typename R::type value) {
+        static_assert(R::writable, "register is read-only");
+        uint8_t buf[R::width];
+        R::encode(value, buf);
+        return writeRegister(R::address, buf, R::width);
+    }
+
+    /// @brief Reads the bit field [F], an [I2CField].
+    /// @param value Receives the field value.
+    /// @return True if the register was read, otherwise false.
+    template <typename F>
+    bool getField(typename F::type &value) {
+        typename F::reg::type reg;
+        if (!get<typename F::reg>(reg)) {
+            return false;
+        }
+        value = F::get((typename F::type)reg);
+        return true;
+    }
+
+    /// @brief Sets the bit field [F], an [I2CField], to [value] with a
+    /// read-modify-write of its register; the read is served from the
+    /// register cache if the register is cached. Does not compile unless
+    /// the register is read-write.
+    /// @return True if the register was written, otherwise false.
+    template <typename F>
+    bool setField(typename F::type value) {
+        static_assert(F::reg::readable && F::reg::writable,
+                      "field must be in a read-write register");
+        typename F::reg::type reg;
+        if (!get<typename F::reg>(reg)) {
+            return false;
+        }
+        return set<typename F::reg>(
+            (typename F::reg::type)F::set((typename F::type)reg, value));
+    }
+
+    /// @brief Enables a RAM shadow of registers 0 to [size] - 1. All
+    /// registers start out volatile; mark the ones that only change when
+    /// written with [registerCache()->setVolatile(reg, false)].
+    /// @param size The number of registers to shadow, at most 256.
+    /// @return true if the cache is enabled.
+    bool enableRegisterCache(size_t size = 256);
+
+    /// @brief Disables and frees the register cache.
+    void disableRegisterCache();
+
+    /// @brief Returns the register cache, or nullptr if disabled.
+    /// @return The register cache.
+    I2CRegisterCache * registerCache() { return _cache; }
+
+    /// @brief Reads [count] registers from [reg] from the device,
+    /// bypassing the cache, and stores the non-volatile ones in it.
+    /// @param reg The first register.
+    /// @param count The number of registers to refresh; those past 0xFF
+    /// are left out.
+    /// @return True if the registers were read, otherwise false.
+    bool refreshRegisters(uint8_t reg, size_t count);
+
+    /// @brief Starts staging register writes: until [commit] or
+    /// [discardStaged], [writeRegister], [write8], [set] and [setField]
+    /// only update the write stage, and register reads return the staged
+    /// values. Writes of values the register cache already holds are
+    /// dropped. Raw [write] calls are not staged.
+    /// @param size The number of registers covered, at most 256. The
+    /// stage is allocated on first use and kept.
+    /// @return true if staging started.
+    bool beginStaging(size_t size = 256);
+
+    /// @brief Writes the staged registers with the fewest auto-increment
+    /// bursts of at most [maxBufferSize()] bytes, rewriting short gaps of
+    /// cached registers to join them, and stops staging. If a burst
+    /// fails, staging continues with the registers not yet written.
+    /// @return True if all the staged registers were written.
+    bool commit();
+
+    /// @brief Drops the staged registers and stops staging.
+    void discardStaged();
+
+    /// @brief Returns true between [beginStaging] and [commit].
+    bool isStaging() { return _staging; }
+
+    /// @brief Returns the write stage, or nullptr if staging was never
+    /// started.
+    I2CWriteStage * writeStage() { return _stage; }
 
     /// @brief  Write a buffer or two to the I2C device. Cannot be more than
     /// maxBufferSize() bytes.
@@ -181,18 +594,73 @@ public:
                 size_t prefix_len = 0);
 
 
-    // /// @brief Writes the bytes in [buf] to the device starting
-    // /// at regeister address [reg]
-    // /// @param reg The 8-bit register address to write to.
-    // /// @param buf Pointer to buffer of data to write. This is const to
-    // ///  ensure the content of this buffer doesn't change.   
-    // /// @param  stop Whether to send an I2C STOP signal on write
-    // /// @param  len Number of bytes from buffer to write.
-    // /// @return true if the data in [buf]  were written.
-    // bool write(uint8_t reg, 
-    //            const uint8_t * buf, 
-    //            size_t len, 
-    //            bool stop = true);
+    /// @brief  Writes [count] segments to the I2C device as one
+    /// transaction. The segments are copied straight into the Wire
+    /// transmit buffer, so they cannot total more than maxBufferSize()
+    /// bytes.
+    /// @param  segments The segments to write, in order.
+    /// @param  count The number of segments.
+    /// @param  stop Whether to send an I2C STOP signal on write
+    /// @return True if write was successful, otherwise false.
+    bool writeSegments(const I2CWriteSegment *segments,
+                       size_t count,
+                       bool stop = true);
+
+    /// @brief  Reads from the I2C device into [count] segments, filling
+    /// each in turn. The read is split into maxBufferSize() chunks joined
+    /// by repeated STARTs, like [read]. The optional prefix (usually a
+    /// register address) is written first, with a repeated START before
+    /// the read.
+    /// @param  segments The destinations, in order.
+    /// @param  count The number of segments.
+    /// @param  stop Whether to send an I2C STOP signal after the read.
+    /// @param  prefix_buffer Pointer to optional data to write before
+    /// reading.
+    /// @param  prefix_len Number of bytes from prefix buffer to write.
+    /// @return True if read was successful, otherwise false.
+    bool readSegments(const I2CReadSegment *segments,
+                      size_t count,
+                      bool stop = true,
+                      const uint8_t *prefix_buffer = nullptr,
+                      size_t prefix_len = 0);
+
+    /// @brief Sets the memory layout of an EEPROM or FRAM for
+    /// [writeMemory] and [readMemory].
+    /// @param pageSize The write page size in bytes, or 0 if writes may
+    /// cross any boundary (FRAM).
+    /// @param addressBytes The number of memory address bytes sent MSB
+    /// first, 1 to 4.
+    void setPageSize(uint16_t pageSize, uint8_t addressBytes = 2);
+
+    /// @brief Sets the longest write cycle [waitReady] waits for.
+    /// @param timeoutUs The timeout in microseconds.
+    void setWriteCycleTimeout(uint32_t timeoutUs) {
+        _writeCycleTimeoutUs = timeoutUs;
+    }
+
+    /// @brief  Writes [len] bytes to memory address [address], in chunks
+    /// that never cross a page and fit maxBufferSize() with the address
+    /// prefix, which is sent again with every chunk. After each chunk the
+    /// device is ACK polled, so the next one starts as soon as the write
+    /// cycle has ended. The bus is not held during write cycles.
+    /// @param  address The memory address of the first byte.
+    /// @param  buffer The data to write.
+    /// @param  len Number of bytes to write.
+    /// @return True if all the data was written, otherwise false.
+    bool writeMemory(uint32_t address, const uint8_t *buffer, size_t len);
+
+    /// @brief  Reads [len] bytes from memory address [address].
+    /// @param  address The memory address of the first byte.
+    /// @param  buffer Buffer to read into.
+    /// @param  len Number of bytes to read.
+    /// @return True if the data was read, otherwise false.
+    bool readMemory(uint32_t address, uint8_t *buffer, size_t len);
+
+    /// @brief Polls the device address ([detected]) until the device
+    /// ACKs, i.e. until an EEPROM write cycle has ended.
+    /// @return True if the device responded within the write cycle
+    /// timeout.
+    bool waitReady();
 
     /// @brief Writes a single byte to the I2C device.
     /// @param val The byte to write.
@@ -200,26 +668,14 @@ public:
     bool write(uint8_t val, 
                bool stop = true);
 
-    // /// @brief Writes a 16 bit value to the I2C device.
-    // /// @param val The 16 bit value to write.
-    // /// @param bigEndian If true the data is sent with the highest 
-    // /// byte first
-    // /// @return true if the 16 bit value was written.
-    // bool write(uint16_t val, 
-    //            bool bigEndian = true, 
-    //            bool stop = true);
-
-    // /// @brief Writes a 32 bit value to the I2C device.
-    // /// @param val The 32 bit value to write.
-    // /// @param bigEndian If true the data is sent with the highest 
-    // /// byte first
-    // /// @return true if the 32 bit value was written.
-    // bool write(uint32_t val, 
-    //            bool bigEndian = true, 
-    //            bool stop = true);
-
     /// @brief  Write some data, then read some data from I2C into another buffer.
-    /// Cannot be more than maxBufferSize() bytes. The buffers can point to
+    /// The write cannot be more than maxBufferSize() bytes; the read is
+    /// split into maxBufferSize() chunks joined by repeated STARTs with a
+    /// single STOP at the end. Unless [stop] is true the write and the
+    /// first chunk are one combined transaction, issued as a single
+    /// internal-address [requestFrom] where the platform has one
+    /// ([I2C_WIRE_HAS_IADDRESS]) and [write_len] is at most
+    /// [I2C_WIRE_IADDRESS_MAX]. The buffers can point to
     /// same/overlapping locations.
     /// @param  write_buffer Pointer to buffer of data to write from
     /// @param  write_len Number of bytes from buffer to write.
@@ -243,17 +699,67 @@ public:
     /// @return The size of the Wire receive/transmit buffer */
     size_t maxBufferSize() { return _maxBufferSize; }
 
-    /// @brief Poll all addresses on [i2c_wire] and populate an 
-    /// array of the addresses that respond.
+    /// @brief Probes addresses [I2C_SCAN_FIRST] to [I2C_SCAN_LAST] on
+    /// the device's bus and records which respond. The bus is held for
+    /// the duration of the scan.
+    /// @param result Receives the presence bitmap, the probe results and
+    /// the scan time.
+    /// @param probeClock If not 0, SCL is raised to this frequency for
+    /// the scan and restored afterwards. Only use a clock all the devices
+    /// on the bus support.
+    /// @return true if the scan ran.
+    bool scan(I2CScanResult &result, uint32_t probeClock = 0);
+
+    /// @brief Scans the buses of [count] devices, each on a different
+    /// [TwoWire], at the same time: the first in the calling task, the
+    /// others in tasks (threads on the `native` build) of their own.
+    /// Without tasks the buses are scanned one after the other.
+    /// @param devices One device on each bus to scan.
+    /// @param results One result per device.
+    /// @param count The number of devices.
+    /// @param probeClock Passed to [scan].
+    /// @return The wall-clock time of all the scans, in microseconds.
+    static uint32_t scanBuses(I2CDevice **devices,
+                              I2CScanResult *results,
+                              size_t count,
+                              uint32_t probeClock = 0);
+
+    /// @brief Scans the bus and populates an array of the addresses
+    /// that respond.
     /// @param devices Array that will be populated with the 
     /// addresses of the attached I2C devices.
+    /// @param size The number of entries in [devices].
     /// @param verbose Prints the results of the device poll 
     /// to the serial port if true. Defaults to true.
-    /// @return the number of devices that responded.
-    uint8_t listDevices(byte * devices, 
-                        bool verbose = true);
+    /// @return the number of addresses stored in [devices].
+    uint8_t listDevicesTo(byte * devices,
+                          size_t size,
+                          bool verbose = true);
 
-    /// @brief Returns a string from the byte [b].
+    /// @brief Scans the bus and populates the array [devices] with the
+    /// addresses that respond, never more than it can hold.
+    /// @param devices Array that will be populated with the 
+    /// addresses of the attached I2C devices.
+    /// @param verbose Prints the results of the device poll 
+    /// to the serial port if true. Defaults to true.
+    /// @return the number of addresses stored in [devices].
+    template <size_t N>
+    uint8_t listDevices(byte (&devices)[N], bool verbose = true) {
+        return listDevicesTo(devices, N, verbose);
+    }
+
+    /// @brief Reads [count] registers from [reg] and prints them as a
+    /// register table to [out] with [I2CFormat::printRegisters], without
+    /// heap allocations.
+    /// @param out Where to print, e.g. [Serial].
+    /// @param reg The first register.
+    /// @param count The number of registers; those past 0xFF are left
+    /// out.
+    /// @return True if the registers were read, otherwise false.
+    bool dumpRegisters(Print &out, uint8_t reg, size_t count);
+
+    /// @brief Returns a string from the byte [b]. Allocates a [String];
+    /// use [I2CFormat::formatByte] to format into a buffer instead.
     /// @param b The byte to stringify.
     /// @return A string from the byte [b].
     static String getByteString(byte b, 
@@ -261,6 +767,9 @@ public:
         bool addPrefix = true);
 
 private:
+
+    /// @brief Runs its read and clear as one operation of [_attempt].
+    friend class I2CDataReady;
     
     /// @brief 
     uint8_t _addr;
@@ -274,13 +783,240 @@ private:
     /// @brief 
     size_t _maxBufferSize;
 
-    /// @brief 
-    /// @param buffer 
-    /// @param len 
-    /// @param stop 
-    /// @return 
-    bool _read(uint8_t *buffer, size_t len, bool stop);
+    /// @brief Command bits ORed into register address bytes.
+    uint8_t _regCommand;
+
+    /// @brief The register cache, or nullptr if disabled.
+    I2CRegisterCache *_cache;
+
+    /// @brief The write stage, or nullptr if never used.
+    I2CWriteStage *_stage;
+
+    /// @brief True while register writes are staged.
+    bool _staging;
+
+    /// @brief Last SCL frequency set with [setSpeed], 0 if never set.
+    uint32_t _speed;
+
+    /// @brief Returns the current SCL frequency of the bus.
+    uint32_t _clock();
+
+    /// @brief EEPROM page size, 0 for none.
+    uint16_t _pageSize;
+
+    /// @brief Number of EEPROM memory address bytes.
+    uint8_t _memAddressBytes;
+
+    /// @brief Longest EEPROM write cycle, in microseconds.
+    uint32_t _writeCycleTimeoutUs;
+
+    /// @brief Stores [address] MSB first in [_memAddressBytes] bytes of
+    /// [prefix].
+    void _memoryAddress(uint32_t address, uint8_t *prefix);
+
+    /// @brief The bus arbiter, or nullptr.
+    I2CBusArbiter *_arbiter;
+
+    /// @brief Priority passed to [_arbiter].
+    uint8_t _priority;
+
+    /// @brief Bus contention statistics.
+    I2CBusStats _busStats;
+
+    /// @brief The transfer trace, or nullptr.
+    I2CTrace *_trace;
+
+    /// @brief Adds a write transfer of [segments] that started at
+    /// [start] and ended with [result] to [_trace].
+    void _traceWrite(uint32_t start, const I2CWriteSegment *segments,
+                     size_t count, size_t total, bool stop, uint8_t result);
+
+    /// @brief The device's SCL frequency, 0 for none.
+    uint32_t _maxClock;
+
+    /// @brief Switches the bus to [_maxClock] unless it runs at it.
+    void _selectClock();
+
+    /// @brief The multiplexer and its channel, see [setMux].
+    I2CMux *_mux;
+    uint8_t _muxChannel;
+
+    /// @brief Selects [_muxChannel] of [_mux], if any.
+    /// @return false if the channel could not be selected.
+    bool _route();
+
+    /// @brief SDA and SCL pins of the last [begin].
+    int _sda;
+    int _scl;
+
+    /// @brief The recovery policy.
+    I2CRecoveryPolicy _recovery;
+
+    /// @brief True if [_recovery] is not all zero.
+    bool _recovering;
+
+    /// @brief The recovery counters.
+    I2CRecoveryStats _recoveryStats;
+
+    /// @brief Consecutive failed attempts since the last success or bus
+    /// clear.
+    uint8_t _failureRun;
+
+    /// @brief True while an outermost operation runs, so the operations
+    /// it is built on neither switch the clock nor retry. Only read and
+    /// written with the bus held: the arbiter's lock is recursive, so a
+    /// task that finds it set holds the bus and runs that operation.
+    bool _attempting;
+
+    /// @brief Runs [op], a callable returning true on success, at the
+    /// device's clock, behind its multiplexer channel and under the
+    /// recovery policy.
+    template <typename Op>
+    bool _attempt(Op op);
+
+    /// @brief Called after failed attempt [retry] of an operation that
+    /// started at [start]: clears the bus if failures persist and waits
+    /// the backoff.
+    /// @return false if the operation is to be given up.
+    bool _retry(uint32_t start, uint8_t retry);
+
+    /// @brief Counts an operation that started at [start] and ended with
+    /// [ok] after [retries] retries.
+    void _attempted(bool ok, uint32_t start, uint8_t retries);
+
+    /// @brief Sets the Wire timeout to the share of the deadline of one
+    /// attempt.
+    void _applyWireTimeout();
+
+    /// @brief The operations run by [_attempt].
+    bool _writeByte(uint8_t val, bool stop);
+    bool _writeSegments(const I2CWriteSegment *segments, size_t count,
+                        bool stop);
+    bool _readAll(uint8_t *buffer, size_t len, bool stop);
+    bool _readSegments(const I2CReadSegment *segments, size_t count,
+                       bool stop, const uint8_t *prefix_buffer,
+                       size_t prefix_len);
+    bool _writeThenRead(const uint8_t *write_buffer, size_t write_len,
+                        uint8_t *read_buffer, size_t read_len, bool stop);
+
+    /// @brief [readWords] with the CRC lookup table [table] and initial
+    /// value [init].
+    bool _readWords(uint16_t *words, size_t count, const uint8_t *command,
+                    size_t commandLen, bool stop, const uint8_t *table,
+                    uint8_t init);
+
+    #if defined(I2C_DEVICE_METRICS)
+    /// @brief Performance counters.
+    I2CMetrics _metrics;
+
+    /// @brief Nesting depth of timed operations.
+    uint8_t _metricsDepth;
+    #endif
+
+    /// @brief Requests a single chunk of at most maxBufferSize() bytes
+    /// into the Wire receive buffer.
+    /// @param len Number of bytes to read.
+    /// @param stop Whether to send an I2C STOP signal after the read.
+    /// @param iaddress Internal address written before the read with a
+    /// repeated START, if [isize] is not 0 ([I2C_WIRE_HAS_IADDRESS] only).
+    /// @param isize Number of bytes of [iaddress] to write, MSB first.
+    /// @param record If not nullptr, receives the trace record of the
+    /// read except its payload, for the caller to add to [_trace]. The
+    /// write of [iaddress] is added here.
+    /// @return True if [len] bytes were received.
+    bool _request(size_t len, bool stop,
+                  uint32_t iaddress = 0, uint8_t isize = 0,
+                  I2CTraceRecord *record = nullptr);
+
+    /// @brief Reads a single chunk of at most maxBufferSize() bytes.
+    /// @param buffer Pointer to buffer of data to read into.
+    /// @param len Number of bytes to read.
+    /// @param stop Whether to send an I2C STOP signal after the read.
+    /// @param iaddress Internal address written before the read with a
+    /// repeated START, if [isize] is not 0 ([I2C_WIRE_HAS_IADDRESS] only).
+    /// @param isize Number of bytes of [iaddress] to write, MSB first.
+    /// @return True if [len] bytes were read.
+    bool _read(uint8_t *buffer, size_t len, bool stop,
+               uint32_t iaddress = 0, uint8_t isize = 0);
 
 };
 
+/// @brief Holds the bus of an [I2CDevice] for the lifetime of the scope,
+/// so a batch of transactions needs a single acquisition and cannot be
+/// interleaved with other devices' transactions.
+class I2CBusLock {
+public:
+
+    /// @brief Acquires the bus of [device].
+    /// @param device The device whose arbiter to lock.
+    /// @param timeoutMs Max time to wait for the bus.
+    I2CBusLock(I2CDevice &device,
+               uint32_t timeoutMs = I2C_ARBITER_WAIT_FOREVER)
+        : _device(device) {
+        _locked = device.acquireBus(timeoutMs);
+    }
+
+    /// @brief Releases the bus.
+    ~I2CBusLock() {
+        if (_locked) {
+            _device.releaseBus();
+        }
+    }
+
+    I2CBusLock(const I2CBusLock &) = delete;
+    I2CBusLock & operator=(const I2CBusLock &) = delete;
+
+    /// @brief Returns true if the bus was acquired.
+    bool locked() { return _locked; }
+
+private:
+
+    /// @brief The device whose bus is held.
+    I2CDevice &_device;
+
+    /// @brief True if the bus was acquired.
+    bool _locked;
+
+};
+
+template <typename Op>
+bool I2CDevice::_attempt(Op op) {
+    if (!_recovering && _maxClock == 0 && _mux == nullptr) {
+        return op();
+    }
+    // the deadline includes the wait for the bus
+    uint32_t start = micros();
+    // the bus is held from the clock switch and channel selection to the
+    // end, and across the retries and their backoff, so no other device's
+    // transaction lands in between
+    I2CBusLock lock(*this, _recovery.deadlineUs == 0
+        ? I2C_ARBITER_WAIT_FOREVER
+        : (_recovery.deadlineUs + 999) / 1000);
+    if (!lock.locked()) {
+        return false;
+    }
+    // nested in this task's own outermost operation; another task's
+    // would still hold the bus
+    if (_attempting) {
+        return op();
+    }
+    _attempting = true;
+    if (_maxClock != 0) {
+        _selectClock();
+    }
+    if (!_recovering) {
+        bool ok = _route() && op();
+        _attempting = false;
+        return ok;
+    }
+    uint8_t retry = 0;
+    bool ok;
+    while (!(ok = _route() && op()) && _retry(start, retry)) {
+        retry++;
+    }
+    _attempted(ok, start, retry);
+    _attempting = false;
+    return ok;
+}
+
 #endif // IC2_DEVICE_H_
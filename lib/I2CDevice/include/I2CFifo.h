@@ -0,0 +1,209 @@
+/*!
+ *  @file I2CFifo.h
+ *
+ *  @brief Draining the on-chip FIFO of an IMU or accelerometer with
+ *  [I2CDevice::drainFifo]: the fill level is read from a count register,
+ *  then whole frames are read from the FIFO data register in bursts as
+ *  large as [I2CDevice::maxBufferSize] allows, straight into a ring of
+ *  frames in the caller's memory.
+ *
+ *  A burst is one transaction: the data register address, a repeated
+ *  START and as many whole frames as fit the Wire buffer, so a frame is
+ *  never split across transactions and the register address is sent
+ *  once per burst. A burst that wraps around the end of the ring is read
+ *  into both ends with [I2CDevice::readSegments], without an extra
+ *  transaction.
+ *
+ *  @code
+ *  // LSM6DSO: DIFF_FIFO in FIFO_STATUS1..2, FIFO_OVR_IA in bit 14,
+ *  // 7-byte frames (tag and one 16-bit sample per axis) at 0x78
+ *  I2CFifoConfig config = {0x3A, 2, I2C_LITTLE_ENDIAN, 0x03FF, 0x4000,
+ *                          true, 0x78, 7, 16};
+ *  uint8_t frames[64 * 7];
+ *  I2CFifo fifo(config, frames, 64);
+ *  imu.drainFifo(fifo);
+ *  @endcode
+ *
+ *  The ring takes one producer, the task calling [drainFifo], and one
+ *  consumer, which may be another task or core. When the ring cannot
+ *  take all the frames, the rest stay in the sensor's FIFO for the next
+ *  drain and the shortfall is counted; the sensor's own overflow flag,
+ *  if it reports one in the count register, is counted too.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_FIFO_H_
+#define I2C_FIFO_H_
+
+#include <Arduino.h>
+#include "I2CChannel.h"
+#include "I2CRegister.h"
+
+/// @brief How a sensor reports its FIFO and where the data is read.
+struct I2CFifoConfig {
+
+    /// @brief The first register of the fill level.
+    uint8_t countReg;
+
+    /// @brief Number of count registers, 1 or 2.
+    uint8_t countBytes;
+
+    /// @brief Byte order of the count registers.
+    I2CByteOrder countOrder;
+
+    /// @brief The bits of the count holding the fill level.
+    uint16_t levelMask;
+
+    /// @brief The bits of the count flagging a FIFO overrun, 0 if the
+    /// sensor reports none there.
+    uint16_t overflowMask;
+
+    /// @brief True if the level is in frames, false if in bytes.
+    bool levelInFrames;
+
+    /// @brief The FIFO data register, read repeatedly.
+    uint8_t dataReg;
+
+    /// @brief Bytes per frame, at most [I2CDevice::maxBufferSize].
+    uint8_t frameSize;
+
+    /// @brief Frames the FIFO must hold before [I2CDevice::drainFifo]
+    /// reads them, 0 or 1 to drain any frame.
+    uint16_t watermark;
+
+};
+
+/// @brief Counters of an [I2CFifo], kept by the draining task.
+struct I2CFifoStats {
+
+    /// @brief Count register reads.
+    uint32_t drains;
+
+    /// @brief Drains that found fewer frames than the watermark.
+    uint32_t belowWatermark;
+
+    /// @brief Frames read into the ring.
+    uint32_t frames;
+
+    /// @brief FIFO data transactions.
+    uint32_t bursts;
+
+    /// @brief Drains that found the sensor's overflow flag set: frames
+    /// were lost in the sensor.
+    uint32_t overflows;
+
+    /// @brief Drains that left frames in the sensor because the ring
+    /// was full.
+    uint32_t ringFull;
+
+    /// @brief Fill level in frames found by the last drain.
+    uint16_t lastLevel;
+
+};
+
+/// @brief A sensor FIFO and the ring of frames it is drained into. The
+/// ring is [frames] slots of [I2CFifoConfig::frameSize] bytes in memory
+/// owned by the caller; [frames] must be a power of two, all of which
+/// are used.
+class I2CFifo {
+public:
+
+    /// @brief Instantiates a FIFO described by [config] draining into
+    /// [frames] frames at [ring].
+    I2CFifo(const I2CFifoConfig &config, uint8_t *ring, size_t frames);
+
+    I2CFifo(const I2CFifo &) = delete;
+    I2CFifo & operator=(const I2CFifo &) = delete;
+
+    /// @brief Returns the sensor's FIFO layout.
+    const I2CFifoConfig & config() const { return _config; }
+
+    /// @brief Returns false if the ring or the layout cannot be drained:
+    /// no frames, a count that is not a power of two, or a count
+    /// register of other than 1 or 2 bytes.
+    bool valid() const;
+
+    /// @brief Returns the number of frames the ring holds when full.
+    size_t capacity() const { return _mask + 1; }
+
+    /// @brief Returns the number of frames in the ring. Exact only when
+    /// called from one side while the other is idle.
+    size_t size() const { return _tail.load() - _head.load(); }
+
+    /// @brief Returns the frames the ring can still take.
+    size_t space() const { return capacity() - size(); }
+
+    /// @brief Returns the counters.
+    const I2CFifoStats & stats() const { return _stats; }
+
+    /// @brief Zeroes the counters.
+    void resetStats();
+
+    /// @brief Returns the fill level, in frames, of the count registers
+    /// [raw], and sets [overflow] if they flag an overrun. A byte count
+    /// is rounded down to whole frames.
+    uint16_t level(const uint8_t *raw, bool &overflow) const;
+
+    // Consumer side.
+
+    /// @brief Returns the oldest frame, and in [contiguous] the number of
+    /// frames following it in memory (itself included), which can be
+    /// processed in place before [release]. Returns nullptr if the ring
+    /// is empty.
+    const uint8_t * front(size_t &contiguous);
+
+    /// @brief Returns the oldest frame, or nullptr if the ring is empty.
+    const uint8_t * front() {
+        size_t contiguous;
+        return front(contiguous);
+    }
+
+    /// @brief Hands the oldest [frames] frames back to the producer.
+    void release(size_t frames = 1) {
+        _head.store(_head.load() + (uint32_t)frames);
+    }
+
+    /// @brief Copies the oldest frame to [frame] and releases it.
+    /// @return false if the ring is empty.
+    bool pop(uint8_t *frame);
+
+private:
+
+    friend class I2CDevice;
+
+    /// @brief Returns the slot of frame index [index].
+    uint8_t * _slot(uint32_t index) {
+        return _ring + (size_t)(index & _mask) * _config.frameSize;
+    }
+
+    /// @brief Makes [frames] frames read into the ring visible to the
+    /// consumer.
+    void _publish(uint32_t frames) {
+        _tail.store(_tail.load() + frames);
+    }
+
+    /// @brief The sensor's FIFO layout.
+    I2CFifoConfig _config;
+
+    /// @brief The frames, owned by the caller.
+    uint8_t *_ring;
+
+    /// @brief Number of frames - 1.
+    uint32_t _mask;
+
+    /// @brief The counters.
+    I2CFifoStats _stats;
+
+    /// @brief Index of the next frame to read from the sensor.
+    alignas(I2C_CACHE_LINE_SIZE) I2CChannelIndex _tail;
+
+    /// @brief Index of the oldest frame.
+    alignas(I2C_CACHE_LINE_SIZE) I2CChannelIndex _head;
+
+};
+
+#endif // I2C_FIFO_H_
@@ -0,0 +1,66 @@
+/*!
+ *  @file I2CFormat.h
+ *
+ *  @brief Allocation-free formatting of register values: zero-padded HEX
+ *  and BIN into caller buffers, and a register table rendered straight to
+ *  any [Print].
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_FORMAT_H_
+#define I2C_FORMAT_H_
+
+#include <Arduino.h>
+
+/// @brief Buffer size for a byte formatted as HEX with prefix, "0XFF".
+#define I2C_FORMAT_HEX_SIZE 5
+
+/// @brief Buffer size for a byte formatted as BIN with prefix,
+/// "0B11111111".
+#define I2C_FORMAT_BIN_SIZE 11
+
+/// @brief Buffer size that fits a byte in any format.
+#define I2C_FORMAT_MAX_SIZE I2C_FORMAT_BIN_SIZE
+
+/// @brief Formatting helpers that never touch the heap.
+class I2CFormat {
+public:
+
+    /// @brief Writes [b] to [buffer] as a NUL-terminated string: HEX is
+    /// two upper case digits, BIN eight digits, with a "0X" or "0B"
+    /// prefix if [addPrefix]; any other format is plain decimal.
+    /// @param b The byte to format.
+    /// @param buffer At least [I2C_FORMAT_MAX_SIZE] bytes, or the size
+    /// for [format].
+    /// @param format HEX, BIN or DEC.
+    /// @param addPrefix Whether to prefix HEX and BIN.
+    /// @return The number of characters written, without the NUL.
+    static size_t formatByte(uint8_t b,
+                             char *buffer,
+                             uint8_t format = HEX,
+                             bool addPrefix = true);
+
+    /// @brief Prints a register table, one row per register with its
+    /// address in HEX and its value in BIN and HEX, byte for byte as the
+    /// examples printed it with [println] and [printf]. Every row is
+    /// rendered into a stack buffer and written with a single
+    /// [Print::write].
+    /// @param out Where to print, e.g. [Serial].
+    /// @param values The register values.
+    /// @param count The number of registers.
+    /// @param firstReg The address of [values][0].
+    /// @param header Whether to print the table header.
+    /// @return The number of characters printed.
+    static size_t printRegisters(Print &out,
+                                 const uint8_t *values,
+                                 size_t count,
+                                 uint8_t firstReg = 0,
+                                 bool header = true);
+
+};
+
+#endif // I2C_FORMAT_H_
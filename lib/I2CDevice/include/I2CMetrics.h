@@ -0,0 +1,188 @@
+/*!
+ *  @file I2CMetrics.h
+ *
+ *  @brief Per-device performance counters and latency histograms for
+ *  [I2CDevice], selected at compile time.
+ *
+ *  Build with `-D I2C_DEVICE_METRICS` (in `build_flags`, so every
+ *  translation unit sees the same [I2CDevice] layout) to count the
+ *  transfers, bytes, NACKs, short reads and chunk splits of each device
+ *  and to bucket the latency of its writes, reads and write-then-reads
+ *  by powers of two. Unlike [DEBUG_I2DEVICE_SERIAL] nothing is printed on
+ *  the bus path: an operation costs two [I2C_METRICS_TICKS] reads, the
+ *  CPU cycle counter on the ESP32, and a few increments. Without the flag
+ *  the counters and the code updating them are not compiled at all.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_METRICS_H_
+#define I2C_METRICS_H_
+
+#include <Arduino.h>
+
+#ifndef I2C_METRICS_BUCKETS
+/// @brief Number of latency buckets. Bucket 0 counts operations shorter
+/// than 1 µs, bucket b those from 2^(b-1) up to 2^b µs, and the last one
+/// everything longer.
+#define I2C_METRICS_BUCKETS 20
+#endif
+
+#ifndef I2C_METRICS_TICKS
+#if defined(ESP32)
+/// @brief The time source of the latency histograms, and its ticks per
+/// microsecond. The ESP32 cycle counter is read in one instruction.
+#define I2C_METRICS_TICKS() ESP.getCycleCount()
+#define I2C_METRICS_TICKS_PER_US (F_CPU / 1000000UL)
+#else
+#define I2C_METRICS_TICKS() micros()
+#define I2C_METRICS_TICKS_PER_US 1
+#endif
+#endif
+
+/// @brief The operation types timed by the metrics. Operations built on
+/// others, e.g. [I2CDevice::readRegister], are timed as the outermost
+/// of these they run.
+enum I2CMetricsOp {
+
+    /// @brief [I2CDevice::write] and [I2CDevice::writeSegments].
+    I2C_OP_WRITE,
+
+    /// @brief [I2CDevice::read] and [I2CDevice::readSegments].
+    I2C_OP_READ,
+
+    /// @brief [I2CDevice::write_then_read].
+    I2C_OP_WRITE_READ,
+
+    /// @brief Number of operation types.
+    I2C_OP_COUNT
+};
+
+/// @brief A snapshot of a device's counters.
+struct I2CMetrics {
+
+    /// @brief Operations by type.
+    uint32_t ops[I2C_OP_COUNT];
+
+    /// @brief Write transfers ([endTransmission] calls).
+    uint32_t writes;
+
+    /// @brief Read transfers ([requestFrom] calls).
+    uint32_t reads;
+
+    /// @brief Bytes written, including register addresses.
+    uint32_t bytesOut;
+
+    /// @brief Bytes received.
+    uint32_t bytesIn;
+
+    /// @brief Write transfers that failed, mostly NACKs.
+    uint32_t nacks;
+
+    /// @brief Read transfers that received fewer bytes than requested.
+    uint32_t shortReads;
+
+    /// @brief Extra chunks reads were split into because they were
+    /// larger than the Wire buffer.
+    uint32_t chunkSplits;
+
+    /// @brief Reads whose CRC ([I2CDevice::readWords]) or PEC
+    /// ([I2CDevice::readPec]) did not match, including retried ones.
+    uint32_t crcErrors;
+
+    /// @brief Latency histogram by type, see [bucketLimitUs].
+    uint32_t latency[I2C_OP_COUNT][I2C_METRICS_BUCKETS];
+
+    /// @brief Sum and maximum of the latencies by type, in
+    /// microseconds.
+    uint64_t totalUs[I2C_OP_COUNT];
+    uint32_t maxUs[I2C_OP_COUNT];
+
+    /// @brief Returns the histogram bucket of a latency of [us].
+    static uint8_t bucket(uint32_t us) {
+        uint8_t b = us == 0 ? 0 : (uint8_t)(32 - __builtin_clz(us));
+        return b < I2C_METRICS_BUCKETS ? b : I2C_METRICS_BUCKETS - 1;
+    }
+
+    /// @brief Returns the latency from which operations are counted in
+    /// the next bucket: 1 µs for bucket 0, 2^b µs for bucket b.
+    static uint32_t bucketLimitUs(uint8_t b) {
+        return 1UL << b;
+    }
+
+    /// @brief Returns the upper bound of the bucket holding the [pct]
+    /// percentile of the [op] latencies, in microseconds, or 0 if there
+    /// were none.
+    uint32_t percentileUs(I2CMetricsOp op, float pct) const {
+        uint32_t rank = (uint32_t)(ops[op] * pct / 100.0f);
+        uint32_t seen = 0;
+        for (uint8_t b = 0; b < I2C_METRICS_BUCKETS; b++) {
+            seen += latency[op][b];
+            if (seen > rank) {
+                return bucketLimitUs(b);
+            }
+        }
+        return 0;
+    }
+
+    /// @brief Returns the mean [op] latency, in microseconds.
+    float meanUs(I2CMetricsOp op) const {
+        return ops[op] ? (float)totalUs[op] / ops[op] : 0;
+    }
+
+};
+
+/// @brief Times an operation from construction to destruction and
+/// counts it, unless it runs inside another timed operation of the same
+/// device. Used through [I2C_METRICS_SCOPE] with the bus held.
+class I2CMetricsScope {
+public:
+
+    I2CMetricsScope(I2CMetrics &metrics, uint8_t &depth, I2CMetricsOp op)
+        : _metrics(metrics), _depth(depth), _op(op) {
+        _start = _depth++ == 0 ? (uint32_t)I2C_METRICS_TICKS() : 0;
+    }
+
+    ~I2CMetricsScope() {
+        if (--_depth != 0) {
+            return;
+        }
+        // the difference first, so the counter may wrap
+        uint32_t us = ((uint32_t)I2C_METRICS_TICKS() - _start) /
+                      I2C_METRICS_TICKS_PER_US;
+        _metrics.ops[_op]++;
+        _metrics.latency[_op][I2CMetrics::bucket(us)]++;
+        _metrics.totalUs[_op] += us;
+        if (us > _metrics.maxUs[_op]) {
+            _metrics.maxUs[_op] = us;
+        }
+    }
+
+    I2CMetricsScope(const I2CMetricsScope &) = delete;
+    I2CMetricsScope & operator=(const I2CMetricsScope &) = delete;
+
+private:
+
+    I2CMetrics &_metrics;
+    uint8_t &_depth;
+    I2CMetricsOp _op;
+    uint32_t _start;
+
+};
+
+#if defined(I2C_DEVICE_METRICS)
+/// @brief Times the enclosing [I2CDevice] operation as [op].
+#define I2C_METRICS_SCOPE(op) \
+    I2CMetricsScope _metricsScope(_metrics, _metricsDepth, op)
+
+/// @brief Adds [n] to counter [field] of the device's metrics.
+#define I2C_METRICS_ADD(field, n) (_metrics.field += (n))
+#else
+#define I2C_METRICS_SCOPE(op)
+#define I2C_METRICS_ADD(field, n)
+#endif
+
+#endif // I2C_METRICS_H_
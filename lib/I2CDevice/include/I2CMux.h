@@ -0,0 +1,211 @@
+/*!
+ *  @file I2CMux.h
+ *
+ *  @brief Routing through I2C multiplexers such as the TCA9548A, so
+ *  sensors with the same address can share a bus behind different
+ *  channels.
+ *
+ *  An [I2CDevice] bound to a channel with [I2CDevice::setMux] selects it
+ *  before each operation, with the bus held until the operation ends.
+ *  [I2CMux] remembers which channels it has enabled and only writes its
+ *  control register when another channel is needed, so consecutive reads
+ *  of devices on one channel cost no select writes. [I2CGroupRead] reads
+ *  registers of many such devices and orders the reads by channel, so
+ *  each channel is selected once per group.
+ *
+ *  @code
+ *  I2CMux mux(0x70);
+ *  I2CDevice left(0x44), right(0x44);
+ *  left.setMux(&mux, 0);
+ *  right.setMux(&mux, 1);
+ *  @endcode
+ *
+ *  The cached channels are only valid while every access to the
+ *  multiplexer goes through its [I2CMux]; call [invalidate] after it was
+ *  reset. A device with a recovery policy does so before each retry. With several tasks on the bus give the multiplexer's [device]
+ *  the arbiter of the devices behind it. Multiplexers are cascaded by
+ *  binding the downstream one's [device] to a channel of the upstream
+ *  one.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_MUX_H_
+#define I2C_MUX_H_
+
+#include <Arduino.h>
+#include "I2CDevice.h"
+
+/// @brief Number of channels of an [I2CMux].
+#define I2C_MUX_CHANNELS 8
+
+/// @brief Default address of a TCA9548A, with A0 to A2 low.
+#define I2C_MUX_ADDRESS 0x70
+
+#ifndef I2C_GROUP_MAX_READS
+/// @brief Max number of reads in an [I2CGroupRead].
+#define I2C_GROUP_MAX_READS 32
+#endif
+
+/// @brief Channel selection counters of an [I2CMux].
+struct I2CMuxStats {
+
+    /// @brief Control register writes made.
+    uint32_t selects;
+
+    /// @brief Selections served from the cached channels without a write.
+    uint32_t skipped;
+
+    /// @brief Control register writes that failed.
+    uint32_t failures;
+
+};
+
+/// @brief A TCA9548A-style multiplexer: the bits of a byte written to
+/// its address enable the corresponding downstream channels.
+class I2CMux {
+public:
+
+    /// @brief Instantiates a multiplexer at [address] on [theWire]. The
+    /// enabled channels are unknown until the first selection.
+    I2CMux(uint8_t address = I2C_MUX_ADDRESS, TwoWire *theWire = &Wire);
+
+    I2CMux(const I2CMux &) = delete;
+    I2CMux & operator=(const I2CMux &) = delete;
+
+    /// @brief Returns the device used to write the control register, to
+    /// set its arbiter, trace or recovery policy, or to bind it to a
+    /// channel of an upstream multiplexer.
+    I2CDevice & device() { return _device; }
+
+    /// @brief Enables [channel] alone, unless it already is. Linked
+    /// multiplexers with channels enabled are switched off first.
+    /// @return true if the channel is enabled.
+    bool select(uint8_t channel);
+
+    /// @brief Enables the channels in [mask], unless exactly these are.
+    /// @return true if the channels are enabled.
+    bool selectMask(uint8_t mask);
+
+    /// @brief Disables all channels, unless they already are.
+    /// @return true if all channels are disabled.
+    bool deselect() { return selectMask(0); }
+
+    /// @brief Returns the enabled channels, bit n for channel n, or -1
+    /// if unknown.
+    int16_t selected() { return _mask; }
+
+    /// @brief Forgets the enabled channels, so the next selection writes
+    /// the control register, e.g. after the multiplexer was reset.
+    void invalidate() { _mask = -1; }
+
+    /// @brief Links [other], a multiplexer on the same bus, to this one:
+    /// before either enables a channel, the other is switched off, so
+    /// devices of the same address behind both never answer together.
+    /// Links are transitive; all linked multiplexers form one ring.
+    void link(I2CMux &other);
+
+    /// @brief Returns the selection counters.
+    const I2CMuxStats & stats() { return _stats; }
+
+    /// @brief Zeroes the selection counters.
+    void resetStats();
+
+private:
+
+    /// @brief The device writing the control register.
+    I2CDevice _device;
+
+    /// @brief The enabled channels, -1 if unknown.
+    int16_t _mask;
+
+    /// @brief The next multiplexer of the linked ring, this one if none.
+    I2CMux *_next;
+
+    /// @brief The selection counters.
+    I2CMuxStats _stats;
+
+};
+
+/// @brief A register read of [I2CGroupRead]: [len] registers from [reg]
+/// of [device], copied to [dest].
+struct I2CDeviceRead {
+
+    /// @brief The device, possibly behind a multiplexer.
+    I2CDevice *device;
+
+    /// @brief The first register.
+    uint8_t reg;
+
+    /// @brief The number of registers.
+    uint8_t len;
+
+    /// @brief Where the register values go.
+    void *dest;
+
+    /// @brief True if the last [I2CGroupRead::run] read it.
+    bool ok;
+
+};
+
+/// @brief Register reads of several devices, run in the order that
+/// needs the fewest channel selections: all reads of a channel one after
+/// another, starting with the channel already enabled and going on by
+/// multiplexer address and channel. Devices without a multiplexer are
+/// read first. Declare the reads once with [add] and [run] them every
+/// cycle; the order is worked out on the first [run] after an [add], so
+/// [clear] and add the reads again after binding a device elsewhere.
+class I2CGroupRead {
+public:
+
+    /// @brief Instantiates an empty group.
+    I2CGroupRead();
+
+    /// @brief Adds a read of [len] registers from [reg] of [device] into
+    /// [dest], with [I2CDevice::readRegister].
+    /// @return false if the group is full or [len] is zero.
+    bool add(I2CDevice &device, uint8_t reg, uint8_t len, void *dest);
+
+    /// @brief Removes all reads.
+    void clear() {
+        _count = 0;
+        _dirty = true;
+    }
+
+    /// @brief Returns the number of reads.
+    uint8_t reads() { return _count; }
+
+    /// @brief Runs all the reads; a failed read does not stop the others.
+    /// @return true if all the reads succeeded.
+    bool run();
+
+    /// @brief Returns read [index] in the order of [add], with its result.
+    const I2CDeviceRead & read(uint8_t index) { return _reads[index]; }
+
+private:
+
+    /// @brief The reads, in the order of [add].
+    I2CDeviceRead _reads[I2C_GROUP_MAX_READS];
+
+    /// @brief Number of entries in [_reads].
+    uint8_t _count;
+
+    /// @brief Indices of [_reads] ordered by multiplexer and channel,
+    /// reads without a multiplexer first.
+    uint8_t _order[I2C_GROUP_MAX_READS];
+
+    /// @brief Number of reads without a multiplexer.
+    uint8_t _direct;
+
+    /// @brief True if reads changed since [_order] was built.
+    bool _dirty;
+
+    /// @brief Builds [_order].
+    void _sort();
+
+};
+
+#endif // I2C_MUX_H_
@@ -0,0 +1,147 @@
+/*!
+ *  @file I2CReadPlan.h
+ *
+ *  @brief A set of register reads that [I2CDevice::readPlan] merges into
+ *  as few auto-increment burst reads as possible.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_READ_PLAN_H_
+#define I2C_READ_PLAN_H_
+
+#include <Arduino.h>
+
+#ifndef I2C_READ_PLAN_MAX_READS
+/// @brief Max number of register reads in an [I2CReadPlan].
+#define I2C_READ_PLAN_MAX_READS 16
+#endif
+
+/// @brief A register read declared by a driver: [len] registers from
+/// [reg], copied to [dest].
+struct I2CRegisterRead {
+
+    /// @brief The first register.
+    uint8_t reg;
+
+    /// @brief The number of registers.
+    uint8_t len;
+
+    /// @brief Where the register values go, usually a field of the
+    /// driver's own struct.
+    void *dest;
+
+};
+
+/// @brief A burst read covering one or more [I2CRegisterRead]s.
+struct I2CReadBurst {
+
+    /// @brief The first register of the burst.
+    uint8_t reg;
+
+    /// @brief The number of registers in the burst.
+    size_t len;
+
+    /// @brief Index of the first read covered, in register order.
+    uint8_t first;
+
+    /// @brief Number of reads covered.
+    uint8_t count;
+
+};
+
+/// @brief The registers a driver needs every cycle. Declare them once
+/// with [add]; [I2CDevice::readPlan] then reads them in bursts, reading
+/// and discarding gaps of up to [maxGap] registers between them rather
+/// than starting a new transaction, and copies the values to each read's
+/// [dest].
+class I2CReadPlan {
+public:
+
+    /// @brief Instantiates an empty plan.
+    /// @param maxGap The largest number of unrequested registers read
+    /// to join two reads into one burst.
+    I2CReadPlan(uint8_t maxGap = 2);
+
+    ~I2CReadPlan();
+
+    I2CReadPlan(const I2CReadPlan &) = delete;
+    I2CReadPlan & operator=(const I2CReadPlan &) = delete;
+
+    /// @brief Adds a read of [len] registers from [reg] into [dest].
+    /// @return false if the plan is full or [len] is zero.
+    bool add(uint8_t reg, uint8_t len, void *dest);
+
+    /// @brief Adds a read of [sizeof(T)] registers from [reg] into
+    /// [dest], byte for byte.
+    template <typename T>
+    bool add(uint8_t reg, T *dest) { return add(reg, sizeof(T), dest); }
+
+    /// @brief Removes all reads.
+    void clear();
+
+    /// @brief Sets the gap threshold, see the constructor.
+    void setMaxGap(uint8_t maxGap);
+
+    /// @brief Returns the number of reads.
+    uint8_t reads() { return _readCount; }
+
+    /// @brief Merges the reads into bursts of at most [maxBurst]
+    /// registers. Called by [I2CDevice::readPlan] when needed.
+    /// @return false if a scratch buffer could not be allocated.
+    bool compile(size_t maxBurst);
+
+    /// @brief Returns the number of bursts, valid after [compile].
+    uint8_t bursts() { return _burstCount; }
+
+    /// @brief Returns burst [index], valid after [compile].
+    const I2CReadBurst & burst(uint8_t index) { return _bursts[index]; }
+
+    /// @brief Returns the buffer a burst is read into, at least as
+    /// long as the longest burst.
+    uint8_t * scratch() { return _scratch; }
+
+    /// @brief Copies the reads covered by burst [index] from [scratch]
+    /// to their destinations.
+    void scatter(uint8_t index);
+
+    /// @brief Returns true if [compile] must run before the next read.
+    bool needsCompile(size_t maxBurst) {
+        return _dirty || maxBurst != _maxBurst;
+    }
+
+private:
+
+    /// @brief The declared reads, sorted by register after [compile].
+    I2CRegisterRead _reads[I2C_READ_PLAN_MAX_READS];
+
+    /// @brief Number of entries in [_reads].
+    uint8_t _readCount;
+
+    /// @brief The merged bursts.
+    I2CReadBurst _bursts[I2C_READ_PLAN_MAX_READS];
+
+    /// @brief Number of entries in [_bursts].
+    uint8_t _burstCount;
+
+    /// @brief The gap threshold.
+    uint8_t _maxGap;
+
+    /// @brief The burst limit the plan was compiled for.
+    size_t _maxBurst;
+
+    /// @brief True if reads changed since the last [compile].
+    bool _dirty;
+
+    /// @brief Buffer a burst is read into.
+    uint8_t *_scratch;
+
+    /// @brief Size of [_scratch].
+    size_t _scratchSize;
+
+};
+
+#endif // I2C_READ_PLAN_H_
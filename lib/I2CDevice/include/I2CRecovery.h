@@ -0,0 +1,126 @@
+/*!
+ *  @file I2CRecovery.h
+ *
+ *  @brief Bounded-latency error recovery for [I2CDevice]: retries with
+ *  exponential backoff, a bus clear with re-[begin] after consecutive
+ *  failures, and a deadline per call.
+ *
+ *  A slave reset or glitched in the middle of a read can keep SDA low,
+ *  after which every transfer on the bus fails or waits for the Wire
+ *  timeout until power is cycled. [I2CRecovery::clearBus] clocks SCL up
+ *  to nine times by hand so the slave finishes the byte it is sending and
+ *  releases SDA, then generates a STOP. With an [I2CRecoveryPolicy] set
+ *  on a device, its operations retry failed attempts, clear the bus when
+ *  failures persist and give up at the deadline, so the worst case of a
+ *  call is bounded and visible in [I2CRecoveryStats].
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_RECOVERY_H_
+#define I2C_RECOVERY_H_
+
+#include <Arduino.h>
+
+#ifndef I2C_RECOVERY_CLOCKS
+/// @brief SCL pulses generated by a bus clear: a byte and its ACK bit.
+#define I2C_RECOVERY_CLOCKS 9
+#endif
+
+#ifndef I2C_RECOVERY_HALF_PERIOD_US
+/// @brief Half period of the bus clear pulses, 5 µs for 100 kHz.
+#define I2C_RECOVERY_HALF_PERIOD_US 5
+#endif
+
+/// @brief How an [I2CDevice] recovers from failed operations. All zero,
+/// the default, disables recovery: an operation is tried once.
+struct I2CRecoveryPolicy {
+
+    /// @brief Attempts after the first failed one.
+    uint8_t retries;
+
+    /// @brief Wait before the first retry, in microseconds, doubled for
+    /// every further retry. The device keeps the bus during the wait, so
+    /// other devices on it wait as well.
+    uint32_t backoffUs;
+
+    /// @brief Longest wait between retries, in microseconds; 0 for no
+    /// limit.
+    uint32_t maxBackoffUs;
+
+    /// @brief Consecutive failed attempts after which the bus is cleared
+    /// and the Wire interface begun again; 0 never clears the bus.
+    uint8_t clearAfter;
+
+    /// @brief Longest duration of a call including the wait for the bus
+    /// and its retries, in microseconds; 0 for none. The Wire timeout is
+    /// set to a share of it per attempt, so a stuck bus cannot hold a
+    /// single attempt longer.
+    uint32_t deadlineUs;
+
+};
+
+/// @brief Recovery counters of an [I2CDevice].
+struct I2CRecoveryStats {
+
+    /// @brief Operations run under the policy.
+    uint32_t calls;
+
+    /// @brief Attempts that failed.
+    uint32_t failures;
+
+    /// @brief Retries made.
+    uint32_t retries;
+
+    /// @brief Operations that succeeded after at least one retry.
+    uint32_t recovered;
+
+    /// @brief Operations that failed after their last attempt.
+    uint32_t abandoned;
+
+    /// @brief Of [abandoned], the operations given up at the deadline.
+    uint32_t deadlineMisses;
+
+    /// @brief Bus clears.
+    uint32_t busClears;
+
+    /// @brief Bus clears after which SDA was still held low.
+    uint32_t busClearFailures;
+
+    /// @brief Times the Wire interface was begun again.
+    uint32_t rebegins;
+
+    /// @brief Longest operation including retries, in microseconds.
+    uint32_t maxCallUs;
+
+};
+
+/// @brief Bus-level recovery helpers.
+class I2CRecovery {
+public:
+
+    /// @brief Frees a bus whose SDA is held low by a slave: with the Wire
+    /// interface ended, clocks SCL up to [I2C_RECOVERY_CLOCKS] times until
+    /// SDA is released, then generates a STOP and leaves both lines
+    /// released with their pull-ups.
+    /// @param sda The SDA pin.
+    /// @param scl The SCL pin.
+    /// @param halfPeriodUs Half period of the SCL pulses.
+    /// @return true if SDA was released.
+    static bool clearBus(int sda, int scl,
+                         uint32_t halfPeriodUs = I2C_RECOVERY_HALF_PERIOD_US);
+
+    /// @brief Returns the wait before retry [retry] (0 for the first
+    /// retry) of [policy], in microseconds.
+    static uint32_t backoffUs(const I2CRecoveryPolicy &policy, uint8_t retry);
+
+    /// @brief Waits [us] microseconds, yielding to other tasks for the
+    /// whole milliseconds.
+    static void wait(uint32_t us);
+
+};
+
+#endif // I2C_RECOVERY_H_
@@ -0,0 +1,158 @@
+/*!
+ *  @file I2CRegister.h
+ *
+ *  @brief Compile-time register descriptors. A register map is a set of
+ *  typedefs giving each register its address, value type, access mode
+ *  and byte order; [I2CDevice::get], [I2CDevice::set] and the field
+ *  accessors generate the byte shuffling and masking for each register
+ *  at compile time. Writing a read-only register or reading a write-only
+ *  one does not compile.
+ *
+ *  @code
+ *  struct APDS9930 {
+ *      typedef I2CRegister<0x00, uint8_t> ENABLE;
+ *      typedef I2CField<ENABLE, 0, 1> PON;
+ *      typedef I2CRegister<0x12, uint8_t, I2C_RO> ID;
+ *      typedef I2CRegister<0x14, uint16_t, I2C_RO, I2C_LITTLE_ENDIAN> CH0;
+ *  };
+ *  uint16_t ch0 = apds.get<APDS9930::CH0>();
+ *  apds.setField<APDS9930::PON>(1);
+ *  @endcode
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_REGISTER_H_
+#define I2C_REGISTER_H_
+
+#include <Arduino.h>
+
+/// @brief Access mode of a register.
+enum I2CRegisterAccess {
+    I2C_RO,
+    I2C_WO,
+    I2C_RW
+};
+
+/// @brief Byte order of a register wider than one byte.
+enum I2CByteOrder {
+    I2C_BIG_ENDIAN,
+    I2C_LITTLE_ENDIAN
+};
+
+/// @brief The unsigned integer type of [N] bytes.
+template <size_t N> struct I2CUnsigned;
+template <> struct I2CUnsigned<1> { typedef uint8_t type; };
+template <> struct I2CUnsigned<2> { typedef uint16_t type; };
+template <> struct I2CUnsigned<4> { typedef uint32_t type; };
+
+/// @brief Moves byte [I] (most significant first) of an [N] byte value
+/// to or from its position on the wire, then recurses to byte [I] + 1.
+/// The recursion is unrolled at compile time.
+template <typename U, uint8_t N, I2CByteOrder Order, uint8_t I = 0>
+struct I2CByteCodec {
+
+    /// @brief Offset of byte [I] in the register buffer.
+    static constexpr uint8_t offset = Order == I2C_BIG_ENDIAN ? I : N - 1 - I;
+
+    static U decode(const uint8_t *buffer, U value) {
+        return I2CByteCodec<U, N, Order, I + 1>::decode(
+            buffer, (U)((U)(value << 8) | buffer[offset]));
+    }
+
+    static void encode(U value, uint8_t *buffer) {
+        buffer[offset] = (uint8_t)(value >> (8 * (N - 1 - I)));
+        I2CByteCodec<U, N, Order, I + 1>::encode(value, buffer);
+    }
+
+};
+
+template <typename U, uint8_t N, I2CByteOrder Order>
+struct I2CByteCodec<U, N, Order, N> {
+
+    static U decode(const uint8_t *buffer, U value) {
+        (void)buffer;
+        return value;
+    }
+
+    static void encode(U value, uint8_t *buffer) {
+        (void)value;
+        (void)buffer;
+    }
+
+};
+
+/// @brief A register at [Address] holding a [T] (1, 2 or 4 bytes, signed
+/// or unsigned) in consecutive registers with byte order [Order].
+template <uint8_t Address,
+          typename T = uint8_t,
+          I2CRegisterAccess Access = I2C_RW,
+          I2CByteOrder Order = I2C_BIG_ENDIAN>
+struct I2CRegister {
+
+    /// @brief The value type.
+    typedef T type;
+
+    /// @brief The unsigned type of the same width.
+    typedef typename I2CUnsigned<sizeof(T)>::type bits;
+
+    /// @brief The (first) register address.
+    static constexpr uint8_t address = Address;
+
+    /// @brief The number of bytes, i.e. of consecutive registers.
+    static constexpr uint8_t width = sizeof(T);
+
+    /// @brief True unless the register is write-only.
+    static constexpr bool readable = Access != I2C_WO;
+
+    /// @brief True unless the register is read-only.
+    static constexpr bool writable = Access != I2C_RO;
+
+    /// @brief Returns the value in the [width] bytes read from the
+    /// device.
+    static T decode(const uint8_t *buffer) {
+        return (T)I2CByteCodec<bits, width, Order>::decode(buffer, 0);
+    }
+
+    /// @brief Stores [value] in [width] bytes in the device's byte order.
+    static void encode(T value, uint8_t *buffer) {
+        I2CByteCodec<bits, width, Order>::encode((bits)value, buffer);
+    }
+
+};
+
+/// @brief A bit field of [Bits] bits at bit [Shift] of register [R].
+template <typename R, uint8_t Shift, uint8_t Bits = 1>
+struct I2CField {
+
+    static_assert(Bits > 0 && Shift + Bits <= 8 * R::width,
+                  "field does not fit its register");
+
+    /// @brief The register the field is part of.
+    typedef R reg;
+
+    /// @brief The type of the field value, unsigned and as wide as the
+    /// register.
+    typedef typename R::bits type;
+
+    /// @brief The field's bits within the register.
+    static constexpr type mask = (type)(
+        (Bits >= 8 * sizeof(type) ? (type)~(type)0
+                                  : (type)(((type)1 << Bits) - 1)) << Shift);
+
+    /// @brief Returns the field in the register value [value].
+    static constexpr type get(type value) {
+        return (type)((value & mask) >> Shift);
+    }
+
+    /// @brief Returns [value] with the field set to [field].
+    static constexpr type set(type value, type field) {
+        return (type)((value & (type)~mask) | (((type)(field << Shift)) & mask));
+    }
+
+};
+
+#endif // I2C_REGISTER_H_
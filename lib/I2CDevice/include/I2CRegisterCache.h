@@ -0,0 +1,115 @@
+/*!
+ *  @file I2CRegisterCache.h
+ *
+ *  @brief RAM shadow of a device's 8-bit register space, used by
+ *  [I2CDevice] to serve reads of non-volatile registers without a bus
+ *  transaction.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_REGISTER_CACHE_H_
+#define I2C_REGISTER_CACHE_H_
+
+#include <Arduino.h>
+
+/// @brief Shadow copy of registers 0 to [size] - 1 of a device. Every
+/// register starts out volatile, i.e. never served from the cache; mark
+/// configuration registers that only change when written as non-volatile
+/// with [setVolatile] or [setVolatileMask].
+class I2CRegisterCache {
+public:
+
+    /// @brief Instantiates a cache for registers 0 to [size] - 1.
+    /// @param size The number of registers, at most 256.
+    I2CRegisterCache(size_t size = 256);
+
+    ~I2CRegisterCache();
+
+    /// @brief Returns the number of registers covered by the cache.
+    size_t size() { return _size; }
+
+    /// @brief Marks [count] registers from [reg] as volatile (always read
+    /// from the bus) or non-volatile (served from the cache once read or
+    /// written).
+    void setVolatile(uint8_t reg, bool isVolatile = true, size_t count = 1);
+
+    /// @brief Sets the volatility of all registers from a bitmask, one bit
+    /// per register, LSB of [mask][0] is register 0. A set bit marks the
+    /// register volatile.
+    /// @param mask The bitmask, at least ([size] + 7) / 8 bytes.
+    void setVolatileMask(const uint8_t *mask);
+
+    /// @brief Returns true if [reg] is volatile or outside the cache.
+    bool isVolatile(uint8_t reg);
+
+    /// @brief Copies [len] registers from [reg] into [buf] if all of them
+    /// are non-volatile and valid, and counts a hit; otherwise counts a
+    /// miss.
+    /// @return true if [buf] was filled from the cache.
+    bool lookup(uint8_t reg, uint8_t *buf, size_t len);
+
+    /// @brief Copies the cached value of [reg] to [value] if [reg] is
+    /// non-volatile and valid, without counting a hit or miss.
+    /// @return true if [value] was set.
+    bool peek(uint8_t reg, uint8_t &value);
+
+    /// @brief Stores [len] register values from [reg], as read from or
+    /// written to the device. Volatile registers are not stored.
+    void store(uint8_t reg, const uint8_t *buf, size_t len);
+
+    /// @brief Discards the cached values of [count] registers from [reg].
+    void invalidate(uint8_t reg, size_t count = 1);
+
+    /// @brief Discards all cached values.
+    void invalidate();
+
+    /// @brief Returns the number of [lookup] calls served from the cache.
+    uint32_t hits() { return _hits; }
+
+    /// @brief Returns the number of [lookup] calls that needed the bus.
+    uint32_t misses() { return _misses; }
+
+    /// @brief Zeroes the hit and miss counters.
+    void resetStats();
+
+private:
+
+    /// @brief Returns bit [reg] of the bitmask [bits].
+    static bool bit(const uint8_t *bits, uint8_t reg) {
+        return (bits[reg >> 3] >> (reg & 0x07)) & 0x01;
+    }
+
+    /// @brief Sets bit [reg] of the bitmask [bits] to [value].
+    static void setBit(uint8_t *bits, uint8_t reg, bool value) {
+        if (value) {
+            bits[reg >> 3] |= (uint8_t)(1 << (reg & 0x07));
+        } else {
+            bits[reg >> 3] &= (uint8_t) ~(1 << (reg & 0x07));
+        }
+    }
+
+    /// @brief Number of registers covered.
+    size_t _size;
+
+    /// @brief Cached register values.
+    uint8_t *_values;
+
+    /// @brief One bit per register, set if [_values] holds its value.
+    uint8_t _valid[32];
+
+    /// @brief One bit per register, set if the register is volatile.
+    uint8_t _volatile[32];
+
+    /// @brief Lookups served from the cache.
+    uint32_t _hits;
+
+    /// @brief Lookups that needed the bus.
+    uint32_t _misses;
+
+};
+
+#endif // I2C_REGISTER_CACHE_H_
@@ -0,0 +1,284 @@
+/*!
+ *  @file I2CSampler.h
+ *
+ *  @brief Periodic register sampling: "read these registers every N ms"
+ *  without [delay()] loops.
+ *
+ *  Each job reads a block of registers of an [I2CDevice] at a fixed
+ *  period. Due times advance by exactly one period per sample, so the
+ *  schedule does not drift however long the reads take, and samples that
+ *  could not be taken in time are counted as overruns rather than
+ *  queued up. Samples are read straight into an [I2CChannel] allocated up
+ *  front, which the consumer reads without locking. On the ESP32 the jobs
+ *  run in a FreeRTOS task, on the `native` build in a [std::thread];
+ *  elsewhere call [poll] from [loop()]. Of the jobs due at the same
+ *  time, those whose devices run at the clock the bus is already at go
+ *  first (see [I2CDevice::setMaxClock]), so a bus shared by devices of
+ *  different speeds changes clock once per speed rather than per job.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_SAMPLER_H_
+#define I2C_SAMPLER_H_
+
+#include <Arduino.h>
+#include "I2CChannel.h"
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#elif defined(I2C_NATIVE)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#ifndef I2C_SAMPLER_MAX_JOBS
+/// @brief Max number of jobs per sampler.
+#define I2C_SAMPLER_MAX_JOBS 8
+#endif
+
+#ifndef I2C_SAMPLER_SAMPLE_SIZE
+/// @brief Max number of registers read by one job.
+#define I2C_SAMPLER_SAMPLE_SIZE 16
+#endif
+
+#ifndef I2C_SAMPLER_JITTER_BINS
+/// @brief Number of bins of the jitter histogram. Bin 0 counts samples
+/// started less than 16 µs late, every further bin is four times as wide
+/// and the last one counts everything later.
+#define I2C_SAMPLER_JITTER_BINS 8
+#endif
+
+#ifndef I2C_SAMPLER_SPIN_US
+/// @brief Waits for the next job up to this long are spun (ESP32); the
+/// task blocks through longer ones on a timer that wakes it this much
+/// before the job is due, so lower priority tasks and IDLE get to run.
+#define I2C_SAMPLER_SPIN_US 150
+#endif
+
+class I2CDevice;
+
+/// @brief A timestamped sample of a job's registers.
+struct I2CSample {
+
+    /// @brief [micros()] when the read started.
+    uint32_t timestamp;
+
+    /// @brief The job that took the sample.
+    uint8_t job;
+
+    /// @brief Number of bytes in [data].
+    uint8_t len;
+
+    /// @brief The raw register values.
+    uint8_t data[I2C_SAMPLER_SAMPLE_SIZE];
+
+};
+
+/// @brief Timing statistics of one job. Times are in microseconds.
+struct I2CSamplerStats {
+
+    /// @brief Samples taken.
+    uint32_t samples;
+
+    /// @brief Reads that failed.
+    uint32_t errors;
+
+    /// @brief Periods skipped because the job could not run in time.
+    uint32_t overruns;
+
+    /// @brief Latest start of a read after its due time.
+    uint32_t maxLateUs;
+
+    /// @brief Time spent reading.
+    uint64_t busyUs;
+
+    /// @brief [micros()] of the first and the last sample.
+    uint32_t firstUs;
+    uint32_t lastUs;
+
+    /// @brief Histogram of how late reads started, see
+    /// [I2CSampler::jitterBinLimit].
+    uint32_t jitter[I2C_SAMPLER_JITTER_BINS];
+
+};
+
+/// @brief Runs periodic register reads and buffers the samples.
+class I2CSampler {
+public:
+
+    /// @brief Instantiates a sampler buffering at least [capacity]
+    /// samples. When the buffer is full the oldest sample is overwritten.
+    I2CSampler(size_t capacity = 64);
+
+    ~I2CSampler();
+
+    I2CSampler(const I2CSampler &) = delete;
+    I2CSampler & operator=(const I2CSampler &) = delete;
+
+    /// @brief Adds a job reading [len] registers from [reg] of [device]
+    /// every [periodUs]. Jobs can only be added while the sampler is
+    /// stopped.
+    /// @return The job number, or -1 if the job table is full, [len] is
+    /// larger than [I2C_SAMPLER_SAMPLE_SIZE] or the sampler is running.
+    int8_t addJob(I2CDevice &device,
+                  uint8_t reg,
+                  uint8_t len,
+                  uint32_t periodUs);
+
+    /// @brief Removes all the jobs, if the sampler is stopped.
+    void clearJobs();
+
+    /// @brief Returns the number of jobs.
+    uint8_t jobs() { return _jobCount; }
+
+    /// @brief Schedules every job from now and starts the sampling task.
+    /// Without tasks only the schedule is reset; call [poll] from
+    /// [loop()].
+    /// @param priority FreeRTOS priority of the task (ESP32).
+    /// @param core The core the task is pinned to (ESP32).
+    /// @param stackSize Stack size of the task (ESP32).
+    /// @return true if sampling started.
+    bool begin(uint8_t priority = 5, int core = 0, uint32_t stackSize = 4096);
+
+    /// @brief Stops the sampling task.
+    void end();
+
+    /// @brief Returns true while the sampling task runs.
+    bool running() { return _running; }
+
+    /// @brief Runs the jobs that are due.
+    /// @return Microseconds until the next job is due.
+    uint32_t poll();
+
+    /// @brief Takes the oldest sample out of the buffer.
+    /// @return false if the buffer is empty.
+    bool pop(I2CSample &sample) { return _channel.pop(sample); }
+
+    /// @brief Returns the sample buffer, a lock-free channel the sampling
+    /// task reads the registers straight into. A single consumer can use
+    /// [I2CChannel::front] and [I2CChannel::release] to process samples
+    /// in place.
+    I2CChannel<I2CSample> & channel() { return _channel; }
+
+    /// @brief Returns the number of buffered samples.
+    size_t available() { return _channel.size(); }
+
+    /// @brief Returns the number of samples overwritten before they were
+    /// popped, or dropped because the consumer held the only free slot.
+    uint32_t lost();
+
+    /// @brief Copies the statistics of [job] to [stats].
+    /// @return false if there is no such job.
+    bool stats(uint8_t job, I2CSamplerStats &stats);
+
+    /// @brief Returns the sample rate [job] achieved, in Hz.
+    float achievedHz(uint8_t job);
+
+    /// @brief Returns the fraction of the time since [begin] the jobs
+    /// spent reading; close to 1 when the bus is oversubscribed.
+    float utilization();
+
+    /// @brief Zeroes the statistics of all jobs and the lost counter.
+    void resetStats();
+
+    /// @brief Returns the lateness from which a read is counted in the
+    /// next jitter bin: 16 µs for bin 0, four times the previous limit
+    /// for each further bin.
+    static uint32_t jitterBinLimit(uint8_t bin) {
+        return 16UL << (2 * bin);
+    }
+
+private:
+
+    /// @brief A periodic read.
+    struct Job {
+        I2CDevice *device;
+        uint8_t reg;
+        uint8_t len;
+        uint32_t periodUs;
+        uint32_t due;
+        I2CSamplerStats stats;
+    };
+
+    /// @brief Enters the critical section guarding the statistics.
+    void enter();
+
+    /// @brief Leaves the critical section.
+    void exit();
+
+    /// @brief Takes a sample for job [index], due at [job].due.
+    void run(uint8_t index, uint32_t now);
+
+    /// @brief Returns the job to run instead of [next], the most overdue
+    /// one: a due job whose device runs at [_clock], unless [next] is
+    /// late by a whole period.
+    uint8_t batch(uint8_t next, uint32_t now);
+
+    /// @brief The sampling loop of the task.
+    void work();
+
+    /// @brief The jobs.
+    Job _jobs[I2C_SAMPLER_MAX_JOBS];
+
+    /// @brief Number of jobs.
+    uint8_t _jobCount;
+
+    /// @brief The sample buffer.
+    I2CChannel<I2CSample> _channel;
+
+    /// @brief Clock of the device of the last job run with one, 0 if
+    /// none.
+    uint32_t _clock;
+
+    /// @brief [lost()] when the statistics were last reset.
+    uint32_t _lostBefore;
+
+    /// @brief [micros()] when the statistics were last reset.
+    uint32_t _statsFrom;
+
+    /// @brief True while the task runs.
+    volatile bool _running;
+
+    /// @brief Set to stop the task.
+    volatile bool _stopping;
+
+    #if defined(ESP32)
+    /// @brief Entry point of the sampling task.
+    static void task(void *sampler);
+
+    /// @brief The sampling task.
+    TaskHandle_t _task;
+
+    /// @brief Given by the task when it exits.
+    SemaphoreHandle_t _stopped;
+
+    /// @brief Callback of [_timer]: wakes the sampling task.
+    static void wake(void *sampler);
+
+    /// @brief The one-shot timer ending the task's waits.
+    esp_timer_handle_t _timer;
+
+    /// @brief Guards the statistics.
+    portMUX_TYPE _mux;
+    #elif defined(I2C_NATIVE)
+    /// @brief Guards the statistics.
+    std::mutex _mutex;
+
+    /// @brief Wakes the sampling thread to stop.
+    std::condition_variable _wake;
+
+    /// @brief The sampling thread.
+    std::thread _thread;
+    #endif
+
+};
+
+#endif // I2C_SAMPLER_H_
@@ -0,0 +1,181 @@
+/*!
+ *  @file I2CTrace.h
+ *
+ *  @brief An in-RAM trace of the bus transfers of one or more
+ *  [I2CDevice]s, for seeing the exact bus sequence of a misbehaving unit
+ *  without the timing changes of [DEBUG_I2DEVICE_SERIAL].
+ *
+ *  Every write and read transfer is stored as a small binary record in a
+ *  ring buffer allocated up front: start time, duration, address,
+ *  direction, length, STOP or repeated START, result and the first
+ *  [I2C_TRACE_PAYLOAD] bytes. When the ring is full the oldest records
+ *  are overwritten. [dump] prints the records as hex lines that survive a
+ *  serial console or a log file; the `native` program decodes them into
+ *  a timeline (`program decode < log.txt`).
+ *
+ *  Dump format, one line each:
+ *
+ *      #I2CT H <version> <payload size> <records> <overwritten>
+ *      #I2CT R <record as hex>
+ *      #I2CT E
+ *
+ *  A record is encoded little-endian as timestamp (4 bytes), duration
+ *  (2), length (2), address (1), flags (1), result (1) and the payload.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_TRACE_H_
+#define I2C_TRACE_H_
+
+#include <Arduino.h>
+
+#if defined(I2C_NATIVE)
+#include <mutex>
+#endif
+
+#ifndef I2C_TRACE_PAYLOAD
+/// @brief Number of payload bytes stored per record.
+#define I2C_TRACE_PAYLOAD 8
+#endif
+
+/// @brief Version of the dump format.
+#define I2C_TRACE_VERSION 1
+
+/// @brief Prefix of the dump lines.
+#define I2C_TRACE_PREFIX "#I2CT"
+
+/// @brief Size of an encoded record.
+#define I2C_TRACE_RECORD_SIZE (11 + I2C_TRACE_PAYLOAD)
+
+/// @brief Record flag: a read transfer, otherwise a write.
+#define I2C_TRACE_READ 0x01
+
+/// @brief Record flag: the transfer ended with a STOP, otherwise the
+/// next one follows with a repeated START.
+#define I2C_TRACE_STOP 0x02
+
+/// @brief Record flag: the write and the read of a single internal
+/// address [requestFrom] call ([I2C_WIRE_HAS_IADDRESS]).
+#define I2C_TRACE_COMBINED 0x04
+
+/// @brief Record result of a read that received fewer bytes than
+/// requested. Write results are the [endTransmission] codes: 0 success,
+/// 1 too long, 2 address NACK, 3 data NACK, 4 other error, 5 timeout.
+#define I2C_TRACE_SHORT_READ 0x10
+
+/// @brief One bus transfer.
+struct I2CTraceRecord {
+
+    /// @brief [micros()] when the transfer started.
+    uint32_t timestamp;
+
+    /// @brief Duration in microseconds, at most 65535.
+    uint16_t durationUs;
+
+    /// @brief Bytes written, or requested by a read.
+    uint16_t len;
+
+    /// @brief The 7-bit device address.
+    uint8_t address;
+
+    /// @brief [I2C_TRACE_READ], [I2C_TRACE_STOP], [I2C_TRACE_COMBINED].
+    uint8_t flags;
+
+    /// @brief 0 on success, see [I2C_TRACE_SHORT_READ].
+    uint8_t result;
+
+    /// @brief The first bytes written or read.
+    uint8_t payload[I2C_TRACE_PAYLOAD];
+
+};
+
+/// @brief A ring buffer of [I2CTraceRecord]s. Attach it to devices with
+/// [I2CDevice::setTrace]; devices sharing a trace share a timeline.
+class I2CTrace {
+public:
+
+    /// @brief Instantiates a trace holding the last [capacity] records.
+    I2CTrace(size_t capacity = 128);
+
+    ~I2CTrace();
+
+    I2CTrace(const I2CTrace &) = delete;
+    I2CTrace & operator=(const I2CTrace &) = delete;
+
+    /// @brief Stores [record], overwriting the oldest one when full.
+    /// Ignored while paused.
+    void add(const I2CTraceRecord &record);
+
+    /// @brief Stops recording, e.g. when a fault is detected, so the
+    /// records leading up to it are kept.
+    void pause() { _paused = true; }
+
+    /// @brief Resumes recording.
+    void resume() { _paused = false; }
+
+    /// @brief Returns true while paused.
+    bool paused() { return _paused; }
+
+    /// @brief Drops all records.
+    void clear();
+
+    /// @brief Returns the number of records held.
+    size_t size();
+
+    /// @brief Returns the number of records the trace holds when full.
+    size_t capacity() { return _capacity; }
+
+    /// @brief Returns the number of records overwritten.
+    uint32_t overwritten();
+
+    /// @brief Copies record [index], 0 being the oldest, to [record].
+    /// @return false if there is no such record.
+    bool get(size_t index, I2CTraceRecord &record);
+
+    /// @brief Prints the records, oldest first, in the dump format.
+    /// @return The number of records printed.
+    size_t dump(Print &out);
+
+    /// @brief Encodes [record] into [I2C_TRACE_RECORD_SIZE] bytes at
+    /// [buf].
+    static void encode(const I2CTraceRecord &record, uint8_t *buf);
+
+private:
+
+    /// @brief Enters the critical section guarding the ring.
+    void enter();
+
+    /// @brief Leaves the critical section.
+    void exit();
+
+    /// @brief The records.
+    I2CTraceRecord *_records;
+
+    /// @brief Number of records.
+    size_t _capacity;
+
+    /// @brief Records ever added; the next one goes to
+    /// [_count % _capacity].
+    uint32_t _count;
+
+    /// @brief [_count] when last cleared.
+    uint32_t _first;
+
+    /// @brief True while paused.
+    volatile bool _paused;
+
+    #if defined(ESP32)
+    /// @brief Guards the ring.
+    portMUX_TYPE _mux;
+    #elif defined(I2C_NATIVE)
+    /// @brief Guards the ring.
+    std::mutex _mutex;
+    #endif
+
+};
+
+#endif // I2C_TRACE_H_
@@ -0,0 +1,150 @@
+/*!
+ *  @file I2CWriteStage.h
+ *
+ *  @brief Staged register writes for [I2CDevice]. While a device is
+ *  staging, register writes only update this buffer; [I2CDevice::commit]
+ *  then writes the dirty registers with as few auto-increment bursts as
+ *  possible.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_WRITE_STAGE_H_
+#define I2C_WRITE_STAGE_H_
+
+#include <Arduino.h>
+#include "I2CRegisterCache.h"
+
+#ifndef I2C_STAGE_MAX_GAP
+/// @brief Default number of clean registers a burst may rewrite to join
+/// two dirty ranges. A separate transaction costs a START, the address and
+/// register bytes, a STOP and the bus free time, about three byte times.
+#define I2C_STAGE_MAX_GAP 2
+#endif
+
+/// @brief Staged values of registers 0 to [size] - 1 with a dirty bit per
+/// register.
+class I2CWriteStage {
+public:
+
+    /// @brief Instantiates a stage for registers 0 to [size] - 1.
+    /// @param size The number of registers, at most 256.
+    I2CWriteStage(size_t size = 256);
+
+    ~I2CWriteStage();
+
+    /// @brief Returns the number of registers covered by the stage.
+    size_t size() { return _size; }
+
+    /// @brief Sets the number of clean registers a burst may rewrite to
+    /// join two dirty ranges. Only registers whose device value is in the
+    /// register cache are rewritten.
+    void setMaxGap(uint8_t gap) { _maxGap = gap; }
+
+    /// @brief Stages [len] register values from [reg]. A value equal to
+    /// the one in [cache] (non-volatile registers only) is dropped, and
+    /// clears the register's dirty bit if an earlier value was staged.
+    /// @param cache The device's register cache, or nullptr.
+    /// @return false if a register is outside the stage; nothing is
+    /// staged then.
+    bool stage(uint8_t reg,
+               const uint8_t *buf,
+               size_t len,
+               I2CRegisterCache *cache);
+
+    /// @brief Returns true if all [len] registers from [reg] are dirty.
+    bool covers(uint8_t reg, size_t len);
+
+    /// @brief Replaces the dirty registers among the [len] registers from
+    /// [reg] in [buf] with their staged values.
+    void overlay(uint8_t reg, uint8_t *buf, size_t len);
+
+    /// @brief Finds the next burst to write, starting at register [from]:
+    /// the first dirty register and the following ones, joined across gaps
+    /// of up to [setMaxGap] clean registers found in [cache].
+    /// @param from The first register to look at.
+    /// @param maxLen The longest burst.
+    /// @param cache The device's register cache, or nullptr.
+    /// @param reg Receives the first register of the burst.
+    /// @param len Receives the length of the burst.
+    /// @return false if no register from [from] is dirty.
+    bool nextBurst(size_t from,
+                   size_t maxLen,
+                   I2CRegisterCache *cache,
+                   uint8_t &reg,
+                   size_t &len);
+
+    /// @brief Returns the staged values, indexed by register.
+    const uint8_t * values() { return _values; }
+
+    /// @brief Clears the dirty bits of [len] registers from [reg] after
+    /// a burst was written, and counts it.
+    void written(uint8_t reg, size_t len);
+
+    /// @brief Returns the number of dirty registers.
+    size_t dirty() { return _dirty; }
+
+    /// @brief Drops all staged values.
+    void clear();
+
+    /// @brief Returns the number of register values staged.
+    uint32_t staged() { return _staged; }
+
+    /// @brief Returns the number of staged values dropped because the
+    /// device already held them.
+    uint32_t dropped() { return _dropped; }
+
+    /// @brief Returns the number of bursts written.
+    uint32_t bursts() { return _bursts; }
+
+    /// @brief Returns the number of register bytes written, including
+    /// rewritten gaps.
+    uint32_t bytesWritten() { return _bytesWritten; }
+
+    /// @brief Zeroes the counters.
+    void resetStats();
+
+private:
+
+    /// @brief Returns true if register [reg] is dirty.
+    bool isDirty(size_t reg) {
+        return (_dirtyBits[reg >> 3] >> (reg & 0x07)) & 0x01;
+    }
+
+    /// @brief Sets or clears the dirty bit of [reg], keeping [_dirty].
+    void setDirty(size_t reg, bool dirty);
+
+    /// @brief Number of registers covered.
+    size_t _size;
+
+    /// @brief Staged register values.
+    uint8_t *_values;
+
+    /// @brief One bit per register, set if [_values] holds a staged
+    /// value not yet written.
+    uint8_t _dirtyBits[32];
+
+    /// @brief Number of dirty registers.
+    size_t _dirty;
+
+    /// @brief Longest gap of clean registers joined into a burst.
+    uint8_t _maxGap;
+
+    /// @brief Values staged.
+    uint32_t _staged;
+
+    /// @brief Values dropped as unchanged.
+    uint32_t _dropped;
+
+    /// @brief Bursts written.
+    uint32_t _bursts;
+
+    /// @brief Bytes written.
+    uint32_t _bytesWritten;
+
+};
+
+#endif // I2C_WRITE_STAGE_H_
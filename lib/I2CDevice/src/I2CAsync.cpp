@@ -0,0 +1,375 @@
+#include "I2CAsync.h"
+#include "I2CDevice.h"
+
+
+I2CAsync::I2CAsync(size_t depth) {
+    _depth = depth ? depth : 1;
+    _requests = new I2CRequest[_depth];
+    for (size_t i = 0; i < _depth; i++) {
+        _requests[i].status = I2C_REQUEST_FREE;
+        #if defined(ESP32)
+        _requests[i].done = xSemaphoreCreateBinary();
+        #endif
+    }
+    _pending = 0;
+    _running = false;
+    #if defined(ESP32)
+    _queue = xQueueCreate(_depth, sizeof(I2CRequest *));
+    _task = nullptr;
+    _stopped = xSemaphoreCreateBinary();
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    #elif defined(I2C_NATIVE)
+    _queue = new I2CRequest *[_depth];
+    _head = 0;
+    _count = 0;
+    _stopping = false;
+    #endif
+};
+
+I2CAsync::~I2CAsync() {
+    end();
+    #if defined(ESP32)
+    for (size_t i = 0; i < _depth; i++) {
+        vSemaphoreDelete(_requests[i].done);
+    }
+    vQueueDelete(_queue);
+    vSemaphoreDelete(_stopped);
+    #elif defined(I2C_NATIVE)
+    delete[] _queue;
+    #endif
+    delete[] _requests;
+};
+
+bool I2CAsync::begin(uint8_t priority, int core, uint32_t stackSize) {
+    if (_running) {
+        return true;
+    }
+    #if defined(ESP32)
+    if (_queue == nullptr || _stopped == nullptr) {
+        return false;
+    }
+    _running = true;
+    if (xTaskCreatePinnedToCore(task, "I2CAsync", stackSize, this, priority,
+                                &_task, core) != pdPASS) {
+        _running = false;
+    }
+    #elif defined(I2C_NATIVE)
+    (void)priority;
+    (void)core;
+    (void)stackSize;
+    _stopping = false;
+    _running = true;
+    _thread = std::thread(&I2CAsync::work, this);
+    #else
+    (void)priority;
+    (void)core;
+    (void)stackSize;
+    #endif
+    return _running;
+};
+
+void I2CAsync::end() {
+    if (!_running) {
+        return;
+    }
+    #if defined(ESP32)
+    // a null request tells the worker to exit once the queue is drained
+    I2CRequest *stop = nullptr;
+    xQueueSend(_queue, &stop, portMAX_DELAY);
+    xSemaphoreTake(_stopped, portMAX_DELAY);
+    _task = nullptr;
+    #elif defined(I2C_NATIVE)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _queued.notify_one();
+    _thread.join();
+    #endif
+    _running = false;
+};
+
+I2CRequest * I2CAsync::allocate(I2CDevice &device, I2CRequestType type,
+                                I2CRequestCallback callback, void *arg) {
+    I2CRequest *request = nullptr;
+    #if defined(ESP32)
+    portENTER_CRITICAL(&_mux);
+    #elif defined(I2C_NATIVE)
+    std::lock_guard<std::mutex> lock(_mutex);
+    #endif
+    for (size_t i = 0; i < _depth; i++) {
+        if (_requests[i].status == I2C_REQUEST_FREE) {
+            request = &_requests[i];
+            request->status = I2C_REQUEST_QUEUED;
+            _pending++;
+            break;
+        }
+    }
+    #if defined(ESP32)
+    portEXIT_CRITICAL(&_mux);
+    #endif
+    if (request == nullptr) {
+        return nullptr;
+    }
+    request->device = &device;
+    request->type = type;
+    request->writeBuffer = nullptr;
+    request->writeLen = 0;
+    request->prefixBuffer = nullptr;
+    request->prefixLen = 0;
+    request->readBuffer = nullptr;
+    request->readLen = 0;
+    request->stop = true;
+    request->callback = callback;
+    request->arg = arg;
+    request->queuedAt = micros();
+    request->startedAt = 0;
+    request->finishedAt = 0;
+    return request;
+};
+
+I2CRequest * I2CAsync::submit(I2CRequest *request) {
+    #if defined(ESP32)
+    if (_running) {
+        // drop a completion left over from the previous use of the slot
+        xSemaphoreTake(request->done, 0);
+        if (xQueueSend(_queue, &request, portMAX_DELAY) == pdTRUE) {
+            return request;
+        }
+    }
+    #elif defined(I2C_NATIVE)
+    if (_running) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queue[(_head + _count) % _depth] = request;
+            _count++;
+        }
+        _queued.notify_one();
+        return request;
+    }
+    #endif
+    // no worker, complete the request in the caller
+    execute(request);
+    return request;
+};
+
+I2CRequest * I2CAsync::read(I2CDevice &device, uint8_t *buffer, size_t len,
+                            I2CRequestCallback callback, void *arg,
+                            bool stop) {
+    I2CRequest *request = allocate(device, I2C_REQUEST_READ, callback, arg);
+    if (request == nullptr) {
+        return nullptr;
+    }
+    request->readBuffer = buffer;
+    request->readLen = len;
+    request->stop = stop;
+    return submit(request);
+};
+
+I2CRequest * I2CAsync::write(I2CDevice &device, const uint8_t *buffer,
+                             size_t len, I2CRequestCallback callback,
+                             void *arg, bool stop,
+                             const uint8_t *prefix_buffer,
+                             size_t prefix_len) {
+    I2CRequest *request = allocate(device, I2C_REQUEST_WRITE, callback, arg);
+    if (request == nullptr) {
+        return nullptr;
+    }
+    request->writeBuffer = buffer;
+    request->writeLen = len;
+    request->prefixBuffer = prefix_buffer;
+    request->prefixLen = prefix_len;
+    request->stop = stop;
+    return submit(request);
+};
+
+I2CRequest * I2CAsync::write_then_read(I2CDevice &device,
+                                       const uint8_t *write_buffer,
+                                       size_t write_len,
+                                       uint8_t *read_buffer,
+                                       size_t read_len,
+                                       I2CRequestCallback callback,
+                                       void *arg,
+                                       bool stop) {
+    I2CRequest *request =
+        allocate(device, I2C_REQUEST_WRITE_THEN_READ, callback, arg);
+    if (request == nullptr) {
+        return nullptr;
+    }
+    request->writeBuffer = write_buffer;
+    request->writeLen = write_len;
+    request->readBuffer = read_buffer;
+    request->readLen = read_len;
+    request->stop = stop;
+    return submit(request);
+};
+
+void I2CAsync::execute(I2CRequest *request) {
+    request->startedAt = micros();
+    #if defined(I2C_NATIVE)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        request->status = I2C_REQUEST_BUSY;
+    }
+    #else
+    request->status = I2C_REQUEST_BUSY;
+    #endif
+    bool ok = false;
+    switch (request->type) {
+        case I2C_REQUEST_READ:
+            ok = request->device->read(request->readBuffer,
+                                       request->readLen,
+                                       request->stop);
+        break;
+        case I2C_REQUEST_WRITE:
+            ok = request->device->write(request->writeBuffer,
+                                        request->writeLen,
+                                        request->stop,
+                                        request->prefixBuffer,
+                                        request->prefixLen);
+        break;
+        case I2C_REQUEST_WRITE_THEN_READ:
+            ok = request->device->write_then_read(request->writeBuffer,
+                                                  request->writeLen,
+                                                  request->readBuffer,
+                                                  request->readLen,
+                                                  request->stop);
+        break;
+    }
+    request->finishedAt = micros();
+    I2CRequestStatus status = ok ? I2C_REQUEST_DONE : I2C_REQUEST_FAILED;
+    if (request->callback != nullptr) {
+        #if defined(I2C_NATIVE)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            request->status = status;
+        }
+        #else
+        request->status = status;
+        #endif
+        request->callback(request, request->arg);
+        release(request);
+        return;
+    }
+    #if defined(ESP32)
+    request->status = status;
+    portENTER_CRITICAL(&_mux);
+    _pending--;
+    portEXIT_CRITICAL(&_mux);
+    xSemaphoreGive(request->done);
+    #elif defined(I2C_NATIVE)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        request->status = status;
+        _pending--;
+    }
+    _completed.notify_all();
+    #else
+    request->status = status;
+    _pending--;
+    #endif
+};
+
+bool I2CAsync::wait(I2CRequest *request, uint32_t timeoutMs) {
+    if (request == nullptr) {
+        return false;
+    }
+    #if defined(ESP32)
+    if (!done(request) &&
+        xSemaphoreTake(request->done, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) {
+        return false;
+    }
+    #elif defined(I2C_NATIVE)
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_completed.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+            [request] {
+                return request->status == I2C_REQUEST_DONE ||
+                       request->status == I2C_REQUEST_FAILED;
+            })) {
+        return false;
+    }
+    #else
+    (void)timeoutMs;
+    #endif
+    return request->status == I2C_REQUEST_DONE;
+};
+
+bool I2CAsync::done(I2CRequest *request) {
+    #if defined(I2C_NATIVE)
+    std::lock_guard<std::mutex> lock(_mutex);
+    #endif
+    return request->status == I2C_REQUEST_DONE ||
+           request->status == I2C_REQUEST_FAILED;
+};
+
+void I2CAsync::release(I2CRequest *request) {
+    if (request == nullptr) {
+        return;
+    }
+    #if defined(ESP32)
+    portENTER_CRITICAL(&_mux);
+    if (request->callback != nullptr) {
+        _pending--;
+    }
+    request->status = I2C_REQUEST_FREE;
+    portEXIT_CRITICAL(&_mux);
+    #elif defined(I2C_NATIVE)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (request->callback != nullptr) {
+            _pending--;
+        }
+        request->status = I2C_REQUEST_FREE;
+    }
+    _completed.notify_all();
+    #else
+    if (request->callback != nullptr) {
+        _pending--;
+    }
+    request->status = I2C_REQUEST_FREE;
+    #endif
+};
+
+size_t I2CAsync::pending() {
+    #if defined(I2C_NATIVE)
+    std::lock_guard<std::mutex> lock(_mutex);
+    #endif
+    return _pending;
+};
+
+void I2CAsync::work() {
+    #if defined(ESP32)
+    I2CRequest *request;
+    while (xQueueReceive(_queue, &request, portMAX_DELAY) == pdTRUE) {
+        if (request == nullptr) {
+            break;
+        }
+        execute(request);
+    }
+    #elif defined(I2C_NATIVE)
+    for (;;) {
+        I2CRequest *request;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _queued.wait(lock, [this] { return _count > 0 || _stopping; });
+            if (_count == 0) {
+                // stopping and drained
+                return;
+            }
+            request = _queue[_head];
+            _head = (_head + 1) % _depth;
+            _count--;
+        }
+        execute(request);
+    }
+    #endif
+};
+
+#if defined(ESP32)
+void I2CAsync::task(void *queue) {
+    I2CAsync *self = (I2CAsync *)queue;
+    self->work();
+    xSemaphoreGive(self->_stopped);
+    vTaskDelete(NULL);
+};
+#endif
@@ -0,0 +1,244 @@
+#include "I2CBusArbiter.h"
+
+
+I2CBusArbiter::I2CBusArbiter() {
+    _owner = TaskId();
+    _depth = 0;
+    _ownerStats = nullptr;
+    _lockedAt = 0;
+    _waiting = 0;
+    _seq = 0;
+    for (uint8_t i = 0; i < I2C_ARBITER_MAX_WAITERS; i++) {
+        _waiters[i].used = false;
+        _waiters[i].granted = false;
+        #if defined(ESP32)
+        _waiters[i].wake = xSemaphoreCreateBinary();
+        #endif
+    }
+    #if defined(ESP32)
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    #endif
+};
+
+I2CBusArbiter::~I2CBusArbiter() {
+    #if defined(ESP32)
+    for (uint8_t i = 0; i < I2C_ARBITER_MAX_WAITERS; i++) {
+        vSemaphoreDelete(_waiters[i].wake);
+    }
+    #endif
+};
+
+I2CBusArbiter::TaskId I2CBusArbiter::currentTask() {
+    #if defined(ESP32)
+    return xTaskGetCurrentTaskHandle();
+    #elif defined(I2C_NATIVE)
+    return std::this_thread::get_id();
+    #else
+    return 0;
+    #endif
+};
+
+void I2CBusArbiter::enter() {
+    #if defined(ESP32)
+    portENTER_CRITICAL(&_mux);
+    #elif defined(I2C_NATIVE)
+    _mutex.lock();
+    #endif
+};
+
+void I2CBusArbiter::exit() {
+    #if defined(ESP32)
+    portEXIT_CRITICAL(&_mux);
+    #elif defined(I2C_NATIVE)
+    _mutex.unlock();
+    #endif
+};
+
+bool I2CBusArbiter::block(Waiter &waiter, uint32_t timeoutMs) {
+    #if defined(ESP32)
+    TickType_t start = xTaskGetTickCount();
+    TickType_t ticks = timeoutMs == I2C_ARBITER_WAIT_FOREVER ?
+        portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+    while (!waiter.granted) {
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (ticks != portMAX_DELAY && waited >= ticks) {
+            break;
+        }
+        exit();
+        // a wake-up left over from a hand-over that raced with an earlier
+        // timeout just goes round the loop again
+        xSemaphoreTake(waiter.wake,
+            ticks == portMAX_DELAY ? portMAX_DELAY : ticks - waited);
+        enter();
+    }
+    return waiter.granted;
+    #elif defined(I2C_NATIVE)
+    std::unique_lock<std::mutex> lock(_mutex, std::adopt_lock);
+    if (timeoutMs == I2C_ARBITER_WAIT_FOREVER) {
+        _granted.wait(lock, [&waiter] { return waiter.granted; });
+    } else {
+        _granted.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                          [&waiter] { return waiter.granted; });
+    }
+    // keep the mutex locked for the caller
+    lock.release();
+    return waiter.granted;
+    #else
+    (void)timeoutMs;
+    return waiter.granted;
+    #endif
+};
+
+void I2CBusArbiter::take(TaskId task, I2CBusStats *stats) {
+    _owner = task;
+    _depth = 1;
+    _ownerStats = stats;
+    _lockedAt = micros();
+};
+
+bool I2CBusArbiter::lock(uint8_t priority,
+                         I2CBusStats *stats,
+                         uint32_t timeoutMs) {
+    TaskId self = currentTask();
+    enter();
+    if (_depth > 0 && _owner == self) {
+        _depth++;
+        exit();
+        return true;
+    }
+    uint32_t start = micros();
+    if (_depth == 0 && _waiting == 0) {
+        // uncontended
+        take(self, stats);
+        exit();
+        if (stats != nullptr) {
+            stats->acquisitions++;
+        }
+        return true;
+    }
+    Waiter *waiter = nullptr;
+    for (;;) {
+        for (uint8_t i = 0; i < I2C_ARBITER_MAX_WAITERS; i++) {
+            if (!_waiters[i].used) {
+                waiter = &_waiters[i];
+                break;
+            }
+        }
+        if (waiter != nullptr) {
+            break;
+        }
+        // all the waiter slots are taken, try again shortly
+        exit();
+        if (timeoutMs != I2C_ARBITER_WAIT_FOREVER &&
+            micros() - start >= timeoutMs * 1000UL) {
+            if (stats != nullptr) {
+                enter();
+                stats->timeouts++;
+                exit();
+            }
+            return false;
+        }
+        delay(1);
+        enter();
+        if (_depth == 0 && _waiting == 0) {
+            take(self, stats);
+            exit();
+            if (stats != nullptr) {
+                stats->acquisitions++;
+            }
+            return true;
+        }
+    }
+    waiter->used = true;
+    waiter->granted = false;
+    waiter->task = self;
+    waiter->priority = priority;
+    waiter->seq = _seq++;
+    waiter->stats = stats;
+    _waiting++;
+    bool granted = block(*waiter, timeoutMs);
+    if (!granted) {
+        _waiting--;
+    }
+    waiter->used = false;
+    if (!granted && stats != nullptr) {
+        stats->timeouts++;
+    }
+    exit();
+    if (!granted) {
+        return false;
+    }
+    if (stats != nullptr) {
+        uint32_t waited = micros() - start;
+        stats->acquisitions++;
+        stats->contended++;
+        stats->waitUs += waited;
+        if (waited > stats->maxWaitUs) {
+            stats->maxWaitUs = waited;
+        }
+    }
+    return true;
+};
+
+void I2CBusArbiter::unlock() {
+    enter();
+    if (_depth == 0 || _owner != currentTask()) {
+        exit();
+        return;
+    }
+    if (--_depth > 0) {
+        exit();
+        return;
+    }
+    if (_ownerStats != nullptr) {
+        uint32_t held = micros() - _lockedAt;
+        _ownerStats->holdUs += held;
+        if (held > _ownerStats->maxHoldUs) {
+            _ownerStats->maxHoldUs = held;
+        }
+    }
+    // hand the bus to the highest priority waiter, oldest first
+    Waiter *next = nullptr;
+    for (uint8_t i = 0; i < I2C_ARBITER_MAX_WAITERS; i++) {
+        Waiter &waiter = _waiters[i];
+        if (!waiter.used || waiter.granted) {
+            continue;
+        }
+        if (next == nullptr || waiter.priority > next->priority ||
+            (waiter.priority == next->priority &&
+             (int32_t)(waiter.seq - next->seq) < 0)) {
+            next = &waiter;
+        }
+    }
+    if (next == nullptr) {
+        exit();
+        return;
+    }
+    take(next->task, next->stats);
+    next->granted = true;
+    _waiting--;
+    #if defined(ESP32)
+    // the slot stays in use until its task has woken up
+    exit();
+    xSemaphoreGive(next->wake);
+    #elif defined(I2C_NATIVE)
+    exit();
+    _granted.notify_all();
+    #else
+    exit();
+    #endif
+};
+
+bool I2CBusArbiter::owned() {
+    enter();
+    bool owned = _depth > 0 && _owner == currentTask();
+    exit();
+    return owned;
+};
+
+uint8_t I2CBusArbiter::waiting() {
+    enter();
+    uint8_t waiting = _waiting;
+    exit();
+    return waiting;
+};
@@ -0,0 +1,325 @@
+#include "I2CDataReady.h"
+#include "I2CDevice.h"
+
+#if !defined(ESP32) && !defined(I2C_NATIVE)
+I2CDataReady *I2CDataReady::_instance = nullptr;
+#endif
+
+
+I2CDataReady::I2CDataReady(I2CDevice &device, size_t capacity)
+    : _device(device),
+      _channel(capacity ? capacity : 1, I2C_OVERWRITE_OLDEST) {
+    _reg = 0;
+    _len = 0;
+    _clearLen = 0;
+    _pin = 0;
+    _callback = nullptr;
+    _callbackArg = nullptr;
+    _pending = false;
+    _edgeUs = 0;
+    memset(&_stats, 0, sizeof(_stats));
+    _lostBefore = 0;
+    _running = false;
+    _stopping = false;
+    #if defined(ESP32)
+    _task = nullptr;
+    _stopped = xSemaphoreCreateBinary();
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    #endif
+};
+
+I2CDataReady::~I2CDataReady() {
+    end();
+    #if defined(ESP32)
+    vSemaphoreDelete(_stopped);
+    #endif
+};
+
+void I2CDataReady::enter() {
+    #if defined(ESP32)
+    portENTER_CRITICAL(&_mux);
+    #elif defined(I2C_NATIVE)
+    _mutex.lock();
+    #else
+    noInterrupts();
+    #endif
+};
+
+void I2CDataReady::exit() {
+    #if defined(ESP32)
+    portEXIT_CRITICAL(&_mux);
+    #elif defined(I2C_NATIVE)
+    _mutex.unlock();
+    #else
+    interrupts();
+    #endif
+};
+
+bool I2CDataReady::setRead(uint8_t reg, uint8_t len) {
+    if (_running || len == 0 || len > I2C_DATA_READY_SIZE ||
+        len > _device.maxBufferSize()) {
+        return false;
+    }
+    _reg = reg;
+    _len = len;
+    return true;
+};
+
+bool I2CDataReady::setClear(const uint8_t *bytes, uint8_t len) {
+    if (_running || len > I2C_DATA_READY_CLEAR_SIZE) {
+        return false;
+    }
+    memcpy(_clear, bytes, len);
+    _clearLen = len;
+    return true;
+};
+
+bool I2CDataReady::begin(uint8_t pin,
+                         int mode,
+                         uint8_t priority,
+                         int core,
+                         uint32_t stackSize) {
+    if (_running) {
+        return true;
+    }
+    if (_len == 0) {
+        return false;
+    }
+    _pin = pin;
+    _pending = false;
+    _stopping = false;
+    pinMode(pin, mode == FALLING ? INPUT_PULLUP : INPUT);
+    #if defined(ESP32)
+    if (_stopped == nullptr) {
+        return false;
+    }
+    _running = true;
+    if (xTaskCreatePinnedToCore(task, "I2CDataReady", stackSize, this,
+                                priority, &_task, core) != pdPASS) {
+        _running = false;
+        return false;
+    }
+    attachInterruptArg(pin, isr, this, mode);
+    #elif defined(I2C_NATIVE)
+    (void)priority;
+    (void)core;
+    (void)stackSize;
+    _running = true;
+    _thread = std::thread(&I2CDataReady::work, this);
+    attachInterruptArg(pin, isr, this, mode);
+    #else
+    (void)priority;
+    (void)core;
+    (void)stackSize;
+    if (_instance != nullptr) {
+        return false;
+    }
+    _instance = this;
+    _running = true;
+    attachInterrupt(digitalPinToInterrupt(pin), isrTrampoline, mode);
+    #endif
+    // an edge before the handler was attached is gone
+    int active = mode == FALLING ? LOW : mode == RISING ? HIGH : -1;
+    if (active >= 0 && digitalRead(pin) == active) {
+        trigger();
+    }
+    return true;
+};
+
+void I2CDataReady::end() {
+    if (!_running) {
+        return;
+    }
+    #if defined(ESP32)
+    detachInterrupt(digitalPinToInterrupt(_pin));
+    _stopping = true;
+    xTaskNotifyGive(_task);
+    xSemaphoreTake(_stopped, portMAX_DELAY);
+    _task = nullptr;
+    #elif defined(I2C_NATIVE)
+    detachInterrupt(digitalPinToInterrupt(_pin));
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_one();
+    _thread.join();
+    #else
+    detachInterrupt(digitalPinToInterrupt(_pin));
+    _instance = nullptr;
+    #endif
+    _running = false;
+};
+
+void IRAM_ATTR I2CDataReady::signal(uint32_t now) {
+    _stats.edges++;
+    if (_pending) {
+        _stats.coalesced++;
+        return;
+    }
+    _pending = true;
+    _edgeUs = now;
+};
+
+void IRAM_ATTR I2CDataReady::isr(void *reader) {
+    I2CDataReady *self = (I2CDataReady *)reader;
+    uint32_t now = micros();
+    #if defined(ESP32)
+    portENTER_CRITICAL_ISR(&self->_mux);
+    self->signal(now);
+    portEXIT_CRITICAL_ISR(&self->_mux);
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(self->_task, &woken);
+    if (woken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+    #elif defined(I2C_NATIVE)
+    {
+        std::lock_guard<std::mutex> lock(self->_mutex);
+        self->signal(now);
+    }
+    self->_wake.notify_one();
+    #else
+    // interrupts are already masked in the handler
+    self->signal(now);
+    #endif
+};
+
+#if !defined(ESP32) && !defined(I2C_NATIVE)
+void I2CDataReady::isrTrampoline() {
+    if (_instance != nullptr) {
+        isr(_instance);
+    }
+};
+#endif
+
+void I2CDataReady::trigger() {
+    uint32_t now = micros();
+    enter();
+    signal(now);
+    exit();
+    #if defined(ESP32)
+    if (_task != nullptr) {
+        xTaskNotifyGive(_task);
+    }
+    #elif defined(I2C_NATIVE)
+    _wake.notify_one();
+    #endif
+};
+
+bool I2CDataReady::transact(uint8_t *buf) {
+    I2CBusLock lock(_device);
+    if (!lock.locked()) {
+        return false;
+    }
+    uint8_t cmd[1] = {(uint8_t)(_reg | _device.registerCommand())};
+    if (_clearLen == 0) {
+        return _device.write_then_read(cmd, 1, buf, _len);
+    }
+    // one operation, so a retry starts over from the register address.
+    // A repeated START before the clear where the read can end without a
+    // STOP; the ESP32 core ends every read with one, so the clear is a
+    // transaction of its own there
+    I2CWriteSegment address = {cmd, 1};
+    I2CWriteSegment clear = {_clear, _clearLen};
+    return _device._attempt([&]() {
+        return _device._writeSegments(&address, 1, false) &&
+               _device._readAll(buf, _len, false) &&
+               _device._writeSegments(&clear, 1, true);
+    });
+};
+
+bool I2CDataReady::poll() {
+    enter();
+    bool pending = _pending;
+    uint32_t edgeUs = _edgeUs;
+    // edges from here on announce new data and need a read of their own
+    _pending = false;
+    exit();
+    if (!pending) {
+        return false;
+    }
+    // read straight into the next slot of the channel
+    I2CDataReadyEvent *event = _channel.reserve();
+    I2CDataReadyEvent discard;
+    I2CDataReadyEvent *target = event != nullptr ? event : &discard;
+    bool ok = transact(target->data);
+    uint32_t now = micros();
+    if (ok) {
+        target->edgeUs = edgeUs;
+        target->readUs = now;
+        target->len = _len;
+        if (_callback != nullptr) {
+            _callback(*target, _callbackArg);
+        }
+        if (event != nullptr) {
+            _channel.publish();
+        }
+    }
+    uint32_t latency = now - edgeUs;
+    enter();
+    if (ok) {
+        _stats.reads++;
+        _stats.latencyUs += latency;
+        if (latency > _stats.maxLatencyUs) {
+            _stats.maxLatencyUs = latency;
+        }
+    } else {
+        _stats.errors++;
+    }
+    exit();
+    return true;
+};
+
+uint32_t I2CDataReady::lost() {
+    return _channel.overwritten() + _channel.dropped() - _lostBefore;
+};
+
+I2CDataReadyStats I2CDataReady::stats() {
+    enter();
+    I2CDataReadyStats stats = _stats;
+    exit();
+    return stats;
+};
+
+float I2CDataReady::meanLatencyUs() {
+    I2CDataReadyStats s = stats();
+    return s.reads ? (float)s.latencyUs / s.reads : 0;
+};
+
+void I2CDataReady::resetStats() {
+    enter();
+    memset(&_stats, 0, sizeof(_stats));
+    _lostBefore = _channel.overwritten() + _channel.dropped();
+    exit();
+};
+
+void I2CDataReady::work() {
+    #if defined(ESP32)
+    while (!_stopping) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (poll()) {
+        }
+    }
+    #elif defined(I2C_NATIVE)
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this] { return _pending || _stopping; });
+            if (_stopping) {
+                return;
+            }
+        }
+        poll();
+    }
+    #endif
+};
+
+#if defined(ESP32)
+void I2CDataReady::task(void *reader) {
+    I2CDataReady *self = (I2CDataReady *)reader;
+    self->work();
+    xSemaphoreGive(self->_stopped);
+    vTaskDelete(NULL);
+};
+#endif
@@ -0,0 +1,236 @@
+#include "I2CDecode.h"
+#include <type_traits>
+#if defined(I2C_DECODE_SSE2)
+#include <emmintrin.h>
+#endif
+
+
+/// @brief Returns the [Bytes] byte sample at [p], right-aligned.
+template <uint8_t Bytes, bool Big>
+static inline uint32_t assemble(const uint8_t *p) {
+    uint32_t u = 0;
+    for (uint8_t i = 0; i < Bytes; i++) {
+        u |= (uint32_t)p[i] << (8 * (Big ? Bytes - 1 - i : i));
+    }
+    return u;
+}
+
+static inline void put(int16_t &out, int32_t v, float, float) {
+    out = (int16_t)v;
+}
+
+static inline void put(int32_t &out, int32_t v, float, float) {
+    out = v;
+}
+
+static inline void put(float &out, int32_t v, float scale, float offset) {
+    out = (float)v * scale + offset;
+}
+
+static inline void put(int16_t &out, uint32_t v, float, float) {
+    out = (int16_t)v;
+}
+
+static inline void put(int32_t &out, uint32_t v, float, float) {
+    out = (int32_t)v;
+}
+
+static inline void put(float &out, uint32_t v, float scale, float offset) {
+    out = (float)v * scale + offset;
+}
+
+/// @brief The plain loop: the value's top bit is shifted [up] to bit 31,
+/// then the value [down] to bit 0, sign extending when [Signed]. No
+/// branches in the loop, so the compiler can unroll and vectorise it.
+template <uint8_t Bytes, bool Big, bool Signed, typename T>
+static void decodeLoop(const uint8_t *__restrict raw, size_t count,
+                       uint8_t up, uint8_t down, T *__restrict out,
+                       float scale, float offset) {
+    typedef typename std::conditional<Signed, int32_t, uint32_t>::type V;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t u = assemble<Bytes, Big>(raw + i * Bytes) << up;
+        put(out[i], (V)((V)u >> down), scale, offset);
+    }
+}
+
+template <uint8_t Bytes, typename T>
+static void decodeBytes(const uint8_t *raw, size_t count,
+                        const I2CSampleFormat &format, T *out,
+                        float scale, float offset) {
+    uint8_t up = (uint8_t)(32 - format.bits - format.shift);
+    uint8_t down = (uint8_t)(32 - format.bits);
+    bool big = format.order == I2C_BIG_ENDIAN;
+    if (big && format.isSigned) {
+        decodeLoop<Bytes, true, true>(raw, count, up, down, out, scale, offset);
+    } else if (big) {
+        decodeLoop<Bytes, true, false>(raw, count, up, down, out, scale, offset);
+    } else if (format.isSigned) {
+        decodeLoop<Bytes, false, true>(raw, count, up, down, out, scale, offset);
+    } else {
+        decodeLoop<Bytes, false, false>(raw, count, up, down, out, scale,
+                                        offset);
+    }
+}
+
+#if defined(I2C_DECODE_SSE2)
+
+/// @brief Eight two-byte samples at [p] in 16-bit lanes, shifted [up]
+/// and [down] as in [decodeLoop].
+template <bool Big, bool Signed>
+static inline __m128i lanes16(const uint8_t *p, __m128i up, __m128i down) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    if (Big) {
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    }
+    v = _mm_sll_epi16(v, up);
+    return Signed ? _mm_sra_epi16(v, down) : _mm_srl_epi16(v, down);
+}
+
+/// @brief The 32-bit values of lanes 0 to 3 and 4 to 7 of [v].
+template <bool Signed>
+static inline void widen(__m128i v, __m128i &lo, __m128i &hi) {
+    if (Signed) {
+        lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    } else {
+        lo = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+        hi = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+    }
+}
+
+template <bool Big, bool Signed>
+static void store8(const uint8_t *p, __m128i up, __m128i down, int16_t *out,
+                   __m128, __m128) {
+    _mm_storeu_si128((__m128i *)out, lanes16<Big, Signed>(p, up, down));
+}
+
+template <bool Big, bool Signed>
+static void store8(const uint8_t *p, __m128i up, __m128i down, int32_t *out,
+                   __m128, __m128) {
+    __m128i lo, hi;
+    widen<Signed>(lanes16<Big, Signed>(p, up, down), lo, hi);
+    _mm_storeu_si128((__m128i *)out, lo);
+    _mm_storeu_si128((__m128i *)(out + 4), hi);
+}
+
+template <bool Big, bool Signed>
+static void store8(const uint8_t *p, __m128i up, __m128i down, float *out,
+                   __m128 scale, __m128 offset) {
+    __m128i lo, hi;
+    widen<Signed>(lanes16<Big, Signed>(p, up, down), lo, hi);
+    // multiply, then add: the rounding of the scalar loop
+    _mm_storeu_ps(out, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), scale),
+                                  offset));
+    _mm_storeu_ps(out + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), scale),
+                                      offset));
+}
+
+template <bool Big, bool Signed, typename T>
+static size_t decodeSse2(const uint8_t *raw, size_t count,
+                         const I2CSampleFormat &format, T *out,
+                         float scale, float offset) {
+    __m128i up = _mm_cvtsi32_si128(16 - format.bits - format.shift);
+    __m128i down = _mm_cvtsi32_si128(16 - format.bits);
+    __m128 scales = _mm_set1_ps(scale);
+    __m128 offsets = _mm_set1_ps(offset);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        store8<Big, Signed>(raw + 2 * i, up, down, out + i, scales, offsets);
+    }
+    return i;
+}
+
+/// @brief Decodes the two-byte samples in steps of 8.
+/// @return The number of samples decoded, a multiple of 8.
+template <typename T>
+static size_t decodeVector(const uint8_t *raw, size_t count,
+                           const I2CSampleFormat &format, T *out,
+                           float scale, float offset) {
+    bool big = format.order == I2C_BIG_ENDIAN;
+    if (big && format.isSigned) {
+        return decodeSse2<true, true>(raw, count, format, out, scale, offset);
+    } else if (big) {
+        return decodeSse2<true, false>(raw, count, format, out, scale, offset);
+    } else if (format.isSigned) {
+        return decodeSse2<false, true>(raw, count, format, out, scale, offset);
+    }
+    return decodeSse2<false, false>(raw, count, format, out, scale, offset);
+}
+
+#endif
+
+template <typename T>
+static void decode(const uint8_t *raw, size_t count,
+                   const I2CSampleFormat &format, T *out,
+                   float scale, float offset) {
+    switch (format.bytes) {
+    case 1:
+        decodeBytes<1>(raw, count, format, out, scale, offset);
+        break;
+    case 2: {
+        size_t done = 0;
+        #if defined(I2C_DECODE_SSE2)
+        done = decodeVector(raw, count, format, out, scale, offset);
+        #endif
+        decodeBytes<2>(raw + 2 * done, count - done, format, out + done,
+                       scale, offset);
+        break;
+    }
+    case 3:
+        decodeBytes<3>(raw, count, format, out, scale, offset);
+        break;
+    default:
+        decodeBytes<4>(raw, count, format, out, scale, offset);
+        break;
+    }
+}
+
+bool I2CDecode::valid(const I2CSampleFormat &format) {
+    return format.bytes >= 1 && format.bytes <= 4 && format.bits >= 1 &&
+           format.bits + format.shift <= 8 * format.bytes;
+};
+
+bool I2CDecode::toInt16(const uint8_t *raw, size_t count,
+                        const I2CSampleFormat &format, int16_t *out) {
+    if (!valid(format) || format.bits > 16) {
+        return false;
+    }
+    decode(raw, count, format, out, 1.0f, 0.0f);
+    return true;
+};
+
+bool I2CDecode::toInt32(const uint8_t *raw, size_t count,
+                        const I2CSampleFormat &format, int32_t *out) {
+    if (!valid(format)) {
+        return false;
+    }
+    decode(raw, count, format, out, 1.0f, 0.0f);
+    return true;
+};
+
+bool I2CDecode::toFloat(const uint8_t *raw, size_t count,
+                        const I2CSampleFormat &format, float *out,
+                        float scale, float offset) {
+    if (!valid(format)) {
+        return false;
+    }
+    decode(raw, count, format, out, scale, offset);
+    return true;
+};
+
+int32_t I2CDecode::sample(const uint8_t *raw, const I2CSampleFormat &format) {
+    uint32_t u = 0;
+    for (uint8_t i = 0; i < format.bytes; i++) {
+        uint8_t b = format.order == I2C_BIG_ENDIAN
+            ? raw[i] : raw[format.bytes - 1 - i];
+        u = (u << 8) | b;
+    }
+    u >>= format.shift;
+    if (format.bits < 32) {
+        u &= (1UL << format.bits) - 1;
+        if (format.isSigned && (u & (1UL << (format.bits - 1)))) {
+            u -= 1UL << format.bits;
+        }
+    }
+    return (int32_t)u;
+};
@@ -1,26 +1,66 @@
 #include "I2CDevice.h"
-#include <algorithm>
-#include <string>
+#include "I2CMux.h"
+#if defined(I2C_NATIVE)
+#include <thread>
+#endif
 
 
 I2CDevice::I2CDevice(uint8_t addr, TwoWire *theWire) {
     _addr = addr;
     _wire = theWire;
     _begun = false;
+    _regCommand = 0x00;
+    _cache = nullptr;
+    _stage = nullptr;
+    _staging = false;
+    _arbiter = nullptr;
+    _priority = 0;
+    _speed = 0;
+    _pageSize = 0;
+    _memAddressBytes = 2;
+    _writeCycleTimeoutUs = I2C_WRITE_CYCLE_TIMEOUT_US;
+    _trace = nullptr;
+    _maxClock = 0;
+    _mux = nullptr;
+    _muxChannel = 0;
+    _sda = I2C_SDA;
+    _scl = I2C_SCL;
+    memset(&_recovery, 0, sizeof(_recovery));
+    _recovering = false;
+    _failureRun = 0;
+    _attempting = false;
+    resetBusStats();
+    resetRecoveryStats();
+    #if defined(I2C_DEVICE_METRICS)
+    memset(&_metrics, 0, sizeof(_metrics));
+    _metricsDepth = 0;
+    #endif
     #ifdef ARDUINO_ARCH_SAMD
     _maxBufferSize = 250; // as defined in _wire->h's RingBuffer
-    #elif defined(ESP32)
+    #elif defined(ESP32) || defined(I2C_NATIVE)
     _maxBufferSize = I2C_BUFFER_LENGTH;
     #else
     _maxBufferSize = 32;
     #endif
 };
 
+I2CDevice::~I2CDevice() {
+    disableRegisterCache();
+    delete _stage;
+};
+
 bool I2CDevice::begin(bool addr_detect, 
             int sda, 
             int scl, 
             uint32_t frequency) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
     if (!_wire->begin(sda, scl, frequency)) return false;
+    _sda = sda;
+    _scl = scl;
+    _applyWireTimeout();
     _begun = true;
     if (addr_detect) {
         _begun = detected();
@@ -32,6 +72,144 @@ TwoWire * I2CDevice::wire(){
     return _wire;
 };
 
+void I2CDevice::setArbiter(I2CBusArbiter *arbiter, uint8_t priority) {
+    _arbiter = arbiter;
+    _priority = priority;
+};
+
+bool I2CDevice::acquireBus(uint32_t timeoutMs) {
+    return _arbiter == nullptr ||
+           _arbiter->lock(_priority, &_busStats, timeoutMs);
+};
+
+void I2CDevice::releaseBus() {
+    if (_arbiter != nullptr) {
+        _arbiter->unlock();
+    }
+};
+
+void I2CDevice::resetBusStats() {
+    memset(&_busStats, 0, sizeof(_busStats));
+};
+
+bool I2CDevice::metrics(I2CMetrics &snapshot) {
+    #if defined(I2C_DEVICE_METRICS)
+    I2CBusLock lock(*this);
+    snapshot = _metrics;
+    return true;
+    #else
+    memset(&snapshot, 0, sizeof(snapshot));
+    return false;
+    #endif
+};
+
+void I2CDevice::resetMetrics() {
+    #if defined(I2C_DEVICE_METRICS)
+    I2CBusLock lock(*this);
+    memset(&_metrics, 0, sizeof(_metrics));
+    #endif
+};
+
+void I2CDevice::setRecoveryPolicy(const I2CRecoveryPolicy &policy) {
+    _recovery = policy;
+    _recovering = policy.retries != 0 || policy.clearAfter != 0 ||
+                  policy.deadlineUs != 0;
+    _failureRun = 0;
+    _applyWireTimeout();
+};
+
+void I2CDevice::resetRecoveryStats() {
+    memset(&_recoveryStats, 0, sizeof(_recoveryStats));
+};
+
+void I2CDevice::_applyWireTimeout() {
+    if (_recovery.deadlineUs == 0) {
+        return;
+    }
+    uint32_t us = _recovery.deadlineUs / ((uint32_t)_recovery.retries + 1);
+    #if defined(ESP32) || defined(I2C_NATIVE)
+    uint32_t ms = us / 1000;
+    _wire->setTimeOut(ms == 0 ? 1 : ms > 0xFFFF ? 0xFFFF : (uint16_t)ms);
+    #elif defined(WIRE_HAS_TIMEOUT)
+    _wire->setWireTimeout(us, true);
+    #endif
+};
+
+bool I2CDevice::recoverBus() {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    uint32_t clock = _clock();
+    // the pins are only free for bit-banging with the peripheral detached
+    #if !(defined(ESP8266) ||                                                      \
+    (defined(ARDUINO_ARCH_AVR) && !defined(WIRE_HAS_END)))
+    _wire->end();
+    #endif
+    bool released = I2CRecovery::clearBus(_sda, _scl);
+    _recoveryStats.busClears++;
+    if (!released) {
+        _recoveryStats.busClearFailures++;
+    }
+    _failureRun = 0;
+    // the clear may have reset the multiplexer too
+    if (_mux != nullptr) {
+        _mux->invalidate();
+    }
+    _begun = _wire->begin(_sda, _scl, clock);
+    _recoveryStats.rebegins++;
+    _applyWireTimeout();
+    #ifdef DEBUG_I2DEVICE_SERIAL
+    DEBUG_I2DEVICE_SERIAL.println(released ? F("\tI2C bus cleared")
+                                           : F("\tI2C bus still held low"));
+    #endif
+    return released;
+};
+
+bool I2CDevice::_retry(uint32_t start, uint8_t retry) {
+    _recoveryStats.failures++;
+    // a multiplexer that browned out lost its channel: select it again
+    // rather than trust the cached one
+    if (_mux != nullptr) {
+        _mux->invalidate();
+    }
+    if (_recovery.clearAfter != 0 && ++_failureRun >= _recovery.clearAfter) {
+        recoverBus();
+    }
+    if (retry >= _recovery.retries) {
+        return false;
+    }
+    uint32_t backoff = I2CRecovery::backoffUs(_recovery, retry);
+    // give up unless the retry can time out before the deadline
+    uint32_t attemptUs =
+        _recovery.deadlineUs / ((uint32_t)_recovery.retries + 1);
+    if (_recovery.deadlineUs != 0 &&
+        (uint64_t)(micros() - start) + backoff + attemptUs >
+        _recovery.deadlineUs) {
+        _recoveryStats.deadlineMisses++;
+        return false;
+    }
+    I2CRecovery::wait(backoff);
+    _recoveryStats.retries++;
+    return true;
+};
+
+void I2CDevice::_attempted(bool ok, uint32_t start, uint8_t retries) {
+    uint32_t us = micros() - start;
+    _recoveryStats.calls++;
+    if (ok) {
+        _failureRun = 0;
+        if (retries > 0) {
+            _recoveryStats.recovered++;
+        }
+    } else {
+        _recoveryStats.abandoned++;
+    }
+    if (us > _recoveryStats.maxCallUs) {
+        _recoveryStats.maxCallUs = us;
+    }
+};
+
 bool I2CDevice::isInitialized(){
     return _begun;
 };
@@ -60,6 +238,10 @@ bool I2CDevice::detected(void) {
     if (!_begun && !begin()) {
         return false;
     }
+    I2CBusLock lock(*this);
+    if (!lock.locked() || !_route()) {
+        return false;
+    }
 
 // A basic scanner, see if it ACK's
     _wire->beginTransmission(_addr);
@@ -81,57 +263,61 @@ bool I2CDevice::detected(void) {
 
 bool I2CDevice::write(uint8_t val, 
                       bool stop){
+    return _attempt([&]() { return _writeByte(val, stop); });
+};
+
+bool I2CDevice::_writeByte(uint8_t val, bool stop) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    I2C_METRICS_SCOPE(I2C_OP_WRITE);
     _wire->beginTransmission(_addr);
     _wire->write(val);
-    if( _wire->endTransmission(stop) != 0 ) {
+    I2C_METRICS_ADD(writes, 1);
+    uint32_t start = _trace != nullptr ? micros() : 0;
+    uint8_t result = _wire->endTransmission(stop);
+    if (_trace != nullptr) {
+        I2CWriteSegment segment = {&val, 1};
+        _traceWrite(start, &segment, 1, 1, stop, result);
+    }
+    if (result != 0) {
+        I2C_METRICS_ADD(nacks, 1);
         return false;
     }    
+    I2C_METRICS_ADD(bytesOut, 1);
     return true;
 };
 
-
-// bool I2CDevice::write(uint16_t val, 
-//                       bool bigEndian, 
-//                       bool stop){
-//     byte buf[2];
-//     buf[0] = bigEndian? highByte(val): lowByte(val);
-//     buf[1] = bigEndian? lowByte(val): highByte(val);
-//     _wire->beginTransmission(_addr);
-//     if( _wire->write(buf,2) == 2) {
-//         return  _wire->endTransmission(stop) == 0;
-//     }    
-//     return false;
-// };
-
-
-// bool I2CDevice::write(uint32_t val, bool bigEndian, 
-//                bool stop){
-//     byte buf[4];
-//     buf[0] = bigEndian? highByte(val): lowByte(val);
-//     buf[1] = bigEndian? lowByte(val): highByte(val);
-//     _wire->beginTransmission(_addr);
-//     buf[0] = bigEndian? (val >> 24) & 0xFF: (val) & 0xFF;
-//     buf[1] = bigEndian? (val >> 16) & 0xFF: (val >> 8) & 0xFF;
-//     buf[2] = bigEndian? (val >> 8) & 0xFF: (val >> 16) & 0xFF;
-//     buf[3] = bigEndian? (val) & 0xFF: (val >> 24) & 0xFF;
-//     if( _wire->write(buf, 4) == 4) {
-//         return  _wire->endTransmission(stop) == 0;
-//     }    
-//     return false;
-// };
-
-// bool I2CDevice::write(uint8_t reg, 
-//         const uint8_t * buf, 
-//         size_t len , 
-//         bool stop){
-//     uint8_t pref[1] = {reg};
-//     return write(buf, len, stop, pref, 1);
-// };
-
 bool I2CDevice::write(const uint8_t *buffer, size_t len, bool stop,
                     const uint8_t *prefix_buffer,
                     size_t prefix_len) {
-    if ((len + prefix_len) > maxBufferSize()) {
+    I2CWriteSegment segments[2] = {
+        {prefix_buffer, prefix_len},
+        {buffer, len}
+    };
+    return writeSegments(segments, 2, stop);
+};
+
+bool I2CDevice::writeSegments(const I2CWriteSegment *segments,
+                              size_t count,
+                              bool stop) {
+    return _attempt([&]() { return _writeSegments(segments, count, stop); });
+};
+
+bool I2CDevice::_writeSegments(const I2CWriteSegment *segments,
+                               size_t count,
+                               bool stop) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    I2C_METRICS_SCOPE(I2C_OP_WRITE);
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += segments[i].len;
+    }
+    if (total > maxBufferSize()) {
         // currently not guaranteed to work if more than 32 bytes!
         // we will need to find out if some platforms have larger
         // I2C buffer sizes :/
@@ -141,52 +327,56 @@ bool I2CDevice::write(const uint8_t *buffer, size_t len, bool stop,
         return false;
     }
     _wire->beginTransmission(_addr);
-    // Write the prefix data (usually an address)
-    if ((prefix_len != 0) && (prefix_buffer != nullptr)) {
-        if (_wire->write(prefix_buffer, prefix_len) != prefix_len) {
+    // each segment goes straight into the Wire transmit buffer
+    for (size_t i = 0; i < count; i++) {
+        const I2CWriteSegment &segment = segments[i];
+        if (segment.len == 0 || segment.buffer == nullptr) {
+            continue;
+        }
+        if (_wire->write(segment.buffer, segment.len) != segment.len) {
             #ifdef DEBUG_I2DEVICE_SERIAL
             DEBUG_I2DEVICE_SERIAL.println(F("\tI2CDevice failed to write"));
             #endif
             return false;
         }
     }
-    // Write the data itself
-    if (_wire->write(buffer, len) != len) {
-        #ifdef DEBUG_I2DEVICE_SERIAL
-        DEBUG_I2DEVICE_SERIAL.println(F("\tI2CDevice failed to write"));
-        #endif
-        return false;
-    }
     #ifdef DEBUG_I2DEVICE_SERIAL
     DEBUG_I2DEVICE_SERIAL.print(F("\tI2CWRITE @ 0x"));
     DEBUG_I2DEVICE_SERIAL.print(_addr, HEX);
     DEBUG_I2DEVICE_SERIAL.print(F(" :: "));
-    if ((prefix_len != 0) && (prefix_buffer != nullptr)) {
-        for (uint16_t i = 0; i < prefix_len; i++) {
+    uint16_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (segments[i].buffer == nullptr) {
+            continue;
+        }
+        for (size_t j = 0; j < segments[i].len; j++, n++) {
             DEBUG_I2DEVICE_SERIAL.print(F("0x"));
-            DEBUG_I2DEVICE_SERIAL.print(prefix_buffer[i], HEX);
+            DEBUG_I2DEVICE_SERIAL.print(segments[i].buffer[j], HEX);
             DEBUG_I2DEVICE_SERIAL.print(F(", "));
-        }
-    }
-    for (uint16_t i = 0; i < len; i++) {
-        DEBUG_I2DEVICE_SERIAL.print(F("0x"));
-        DEBUG_I2DEVICE_SERIAL.print(buffer[i], HEX);
-        DEBUG_I2DEVICE_SERIAL.print(F(", "));
-        if (i % 32 == 31) {
-            DEBUG_I2DEVICE_SERIAL.println();
+            if (n % 32 == 31) {
+                DEBUG_I2DEVICE_SERIAL.println();
+            }
         }
     }
     if (stop) {
         DEBUG_I2DEVICE_SERIAL.print("\tSTOP");
     }
     #endif
-    if (_wire->endTransmission(stop) == 0) {
+    I2C_METRICS_ADD(writes, 1);
+    uint32_t start = _trace != nullptr ? micros() : 0;
+    uint8_t result = _wire->endTransmission(stop);
+    if (_trace != nullptr) {
+        _traceWrite(start, segments, count, total, stop, result);
+    }
+    if (result == 0) {
+        I2C_METRICS_ADD(bytesOut, total);
         #ifdef DEBUG_I2DEVICE_SERIAL
         DEBUG_I2DEVICE_SERIAL.println();
         // DEBUG_I2DEVICE_SERIAL.println("Sent!");
         #endif
         return true;
     } else {
+        I2C_METRICS_ADD(nacks, 1);
         #ifdef DEBUG_I2DEVICE_SERIAL
         DEBUG_I2DEVICE_SERIAL.println("\tFailed to send!");
         #endif
@@ -195,11 +385,23 @@ bool I2CDevice::write(const uint8_t *buffer, size_t len, bool stop,
 };
 
 bool I2CDevice::read(uint8_t *buffer, size_t len, bool stop) {
+    return _attempt([&]() { return _readAll(buffer, len, stop); });
+};
+
+bool I2CDevice::_readAll(uint8_t *buffer, size_t len, bool stop) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    I2C_METRICS_SCOPE(I2C_OP_READ);
     size_t pos = 0;
     while (pos < len) {
         size_t read_len =
         ((len - pos) > maxBufferSize()) ? maxBufferSize() : (len - pos);
         bool read_stop = (pos < (len - read_len)) ? false : stop;
+        if (pos > 0) {
+            I2C_METRICS_ADD(chunkSplits, 1);
+        }
         if (!_read(buffer + pos, read_len, read_stop))
             return false;
         pos += read_len;
@@ -207,15 +409,134 @@ bool I2CDevice::read(uint8_t *buffer, size_t len, bool stop) {
     return true;
 };
 
-bool I2CDevice::_read(uint8_t *buffer, size_t len, bool stop) {
+bool I2CDevice::readSegments(const I2CReadSegment *segments,
+                             size_t count,
+                             bool stop,
+                             const uint8_t *prefix_buffer,
+                             size_t prefix_len) {
+    return _attempt([&]() {
+        return _readSegments(segments, count, stop, prefix_buffer,
+                             prefix_len);
+    });
+};
+
+bool I2CDevice::_readSegments(const I2CReadSegment *segments,
+                              size_t count,
+                              bool stop,
+                              const uint8_t *prefix_buffer,
+                              size_t prefix_len) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    I2C_METRICS_SCOPE(I2C_OP_READ);
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += segments[i].len;
+    }
+    bool prefixed = prefix_len != 0 && prefix_buffer != nullptr;
+    if (prefixed && !write(prefix_buffer, prefix_len, total == 0 && stop)) {
+        return false;
+    }
+    size_t seg = 0;
+    size_t offset = 0;
+    size_t pos = 0;
+    while (pos < total) {
+        size_t read_len =
+        ((total - pos) > maxBufferSize()) ? maxBufferSize() : (total - pos);
+        bool read_stop = (pos < (total - read_len)) ? false : stop;
+        if (pos > 0) {
+            I2C_METRICS_ADD(chunkSplits, 1);
+        }
+        I2CTraceRecord record;
+        I2CTraceRecord *traced = _trace != nullptr ? &record : nullptr;
+        if (!_request(read_len, read_stop, 0, 0, traced)) {
+            if (traced != nullptr) {
+                _trace->add(record);
+            }
+            return false;
+        }
+        // scatter the chunk straight from the Wire receive buffer
+        for (size_t i = 0; i < read_len; i++) {
+            while (offset >= segments[seg].len) {
+                seg++;
+                offset = 0;
+            }
+            uint8_t value = _wire->read();
+            if (segments[seg].buffer != nullptr) {
+                segments[seg].buffer[offset] = value;
+            }
+            if (traced != nullptr && i < I2C_TRACE_PAYLOAD) {
+                record.payload[i] = value;
+            }
+            offset++;
+        }
+        if (traced != nullptr) {
+            _trace->add(record);
+        }
+        pos += read_len;
+    }
+    #ifdef DEBUG_I2DEVICE_SERIAL
+    DEBUG_I2DEVICE_SERIAL.print(F("\tI2CREAD  @ 0x"));
+    DEBUG_I2DEVICE_SERIAL.print(_addr, HEX);
+    DEBUG_I2DEVICE_SERIAL.print(F(" :: "));
+    DEBUG_I2DEVICE_SERIAL.print(total);
+    DEBUG_I2DEVICE_SERIAL.print(F(" bytes into "));
+    DEBUG_I2DEVICE_SERIAL.print(count);
+    DEBUG_I2DEVICE_SERIAL.println(F(" segments"));
+    #endif
+    return true;
+};
+
+bool I2CDevice::_request(size_t len, bool stop,
+                         uint32_t iaddress, uint8_t isize,
+                         I2CTraceRecord *record) {
+    uint32_t start = record != nullptr ? micros() : 0;
     #if defined(TinyWireM_h)
     size_t recv = _wire->requestFrom((uint8_t)_addr, (uint8_t)len);
+    #elif defined(I2C_WIRE_HAS_IADDRESS)
+    // the internal address is written with a repeated START in the same
+    // call, if there is one
+    size_t recv = isize == 0 ?
+        _wire->requestFrom((uint8_t)_addr, (uint8_t)len, (uint8_t)stop) :
+        _wire->requestFrom((uint8_t)_addr, (uint8_t)len, iaddress, isize,
+                           (uint8_t)stop);
     #elif defined(ARDUINO_ARCH_MEGAAVR)
     size_t recv = _wire->requestFrom(_addr, len, stop);
     #else
     size_t recv = _wire->requestFrom((uint8_t)_addr, (uint8_t)len, (uint8_t)stop);
     #endif
+    I2C_METRICS_ADD(reads, 1);
+    I2C_METRICS_ADD(bytesOut, isize);
+    I2C_METRICS_ADD(bytesIn, recv);
+    if (record != nullptr) {
+        uint32_t duration = micros() - start;
+        memset(record, 0, sizeof(*record));
+        record->timestamp = start;
+        record->durationUs = duration > 0xFFFF ? 0xFFFF : (uint16_t)duration;
+        record->address = _addr;
+        if (isize > 0) {
+            // the internal address went out first, in the same call; the
+            // read record carries the duration of both
+            uint16_t both = record->durationUs;
+            record->durationUs = 0;
+            record->len = isize;
+            record->flags = I2C_TRACE_COMBINED;
+            for (uint8_t i = 0; i < isize && i < I2C_TRACE_PAYLOAD; i++) {
+                uint8_t shift = 8 * (isize - 1 - i);
+                record->payload[i] = (uint8_t)(iaddress >> shift);
+            }
+            _trace->add(*record);
+            memset(record->payload, 0, sizeof(record->payload));
+            record->durationUs = both;
+        }
+        record->len = (uint16_t)len;
+        record->flags = I2C_TRACE_READ | (stop ? I2C_TRACE_STOP : 0) |
+                        (isize > 0 ? I2C_TRACE_COMBINED : 0);
+        record->result = recv == len ? 0 : I2C_TRACE_SHORT_READ;
+    }
     if (recv != len) {
+        I2C_METRICS_ADD(shortReads, 1);
         // Not enough data available to fulfill our obligation!
         #ifdef DEBUG_I2DEVICE_SERIAL
         DEBUG_I2DEVICE_SERIAL.print(F("\tI2CDevice did not receive enough data: "));
@@ -223,9 +544,27 @@ bool I2CDevice::_read(uint8_t *buffer, size_t len, bool stop) {
         #endif
         return false;
     }
+    return true;
+};
+
+bool I2CDevice::_read(uint8_t *buffer, size_t len, bool stop,
+                      uint32_t iaddress, uint8_t isize) {
+    I2CTraceRecord record;
+    I2CTraceRecord *traced = _trace != nullptr ? &record : nullptr;
+    if (!_request(len, stop, iaddress, isize, traced)) {
+        if (traced != nullptr) {
+            _trace->add(record);
+        }
+        return false;
+    }
     for (uint16_t i = 0; i < len; i++) {
         buffer[i] = _wire->read();
     }
+    if (traced != nullptr) {
+        memcpy(record.payload, buffer,
+               len < I2C_TRACE_PAYLOAD ? len : I2C_TRACE_PAYLOAD);
+        _trace->add(record);
+    }
     #ifdef DEBUG_I2DEVICE_SERIAL
     DEBUG_I2DEVICE_SERIAL.print(F("\tI2CREAD  @ 0x"));
     DEBUG_I2DEVICE_SERIAL.print(_addr, HEX);
@@ -243,13 +582,82 @@ bool I2CDevice::_read(uint8_t *buffer, size_t len, bool stop) {
     return true;
 };
 
+void I2CDevice::_traceWrite(uint32_t start,
+                            const I2CWriteSegment *segments,
+                            size_t count,
+                            size_t total,
+                            bool stop,
+                            uint8_t result) {
+    uint32_t duration = micros() - start;
+    I2CTraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = start;
+    record.durationUs = duration > 0xFFFF ? 0xFFFF : (uint16_t)duration;
+    record.len = (uint16_t)total;
+    record.address = _addr;
+    record.flags = stop ? I2C_TRACE_STOP : 0;
+    record.result = result;
+    size_t n = 0;
+    for (size_t i = 0; i < count && n < I2C_TRACE_PAYLOAD; i++) {
+        if (segments[i].buffer == nullptr) {
+            continue;
+        }
+        for (size_t j = 0; j < segments[i].len && n < I2C_TRACE_PAYLOAD; j++) {
+            record.payload[n++] = segments[i].buffer[j];
+        }
+    }
+    _trace->add(record);
+};
+
 bool I2CDevice::write_then_read(const uint8_t *write_buffer,
                 size_t write_len, uint8_t *read_buffer,
                 size_t read_len, bool stop) {
-    if (!write(write_buffer, write_len, stop)) {
+    return _attempt([&]() {
+        return _writeThenRead(write_buffer, write_len, read_buffer, read_len,
+                              stop);
+    });
+};
+
+bool I2CDevice::_writeThenRead(const uint8_t *write_buffer,
+                size_t write_len, uint8_t *read_buffer,
+                size_t read_len, bool stop) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
         return false;
     }
-    return read(read_buffer, read_len);
+    I2C_METRICS_SCOPE(I2C_OP_WRITE_READ);
+    if (read_len == 0) {
+        return write(write_buffer, write_len, true);
+    }
+    size_t first_len = read_len > maxBufferSize() ? maxBufferSize() : read_len;
+    bool first_stop = first_len == read_len;
+    #if defined(I2C_WIRE_HAS_IADDRESS)
+    if (!stop && write_len > 0 && write_len <= I2C_WIRE_IADDRESS_MAX) {
+        // write, repeated START and read in a single Wire call
+        uint32_t iaddress = 0;
+        for (size_t i = 0; i < write_len; i++) {
+            iaddress = (iaddress << 8) | write_buffer[i];
+        }
+        if (!_read(read_buffer, first_len, first_stop, iaddress,
+                   (uint8_t)write_len)) {
+            return false;
+        }
+    } else
+    #endif
+    {
+        if (!write(write_buffer, write_len, stop)) {
+            return false;
+        }
+        if (!_read(read_buffer, first_len, first_stop)) {
+            return false;
+        }
+    }
+    if (first_stop) {
+        return true;
+    }
+    I2C_METRICS_ADD(chunkSplits, 1);
+    // the rest follows with repeated STARTs and a single STOP at the end
+    return read(read_buffer + first_len, read_len - first_len);
 };
 
 uint8_t I2CDevice::address(void) { 
@@ -257,6 +665,10 @@ uint8_t I2CDevice::address(void) {
 };
 
 bool I2CDevice::setSpeed(uint32_t desiredclk) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
     #if defined(__AVR_ATmega328__) ||                                              \
     defined(__AVR_ATmega328P__) // fix arduino core set clock
     // calculate TWBR correctly
@@ -289,6 +701,7 @@ bool I2CDevice::setSpeed(uint32_t desiredclk) {
         TWSR = 0x3;
     }
     TWBR = atwbr;
+    _speed = desiredclk;
 
     #ifdef DEBUG_I2DEVICE_SERIAL
     DEBUG_I2DEVICE_SERIAL.print(F("TWSR prescaler = "));
@@ -300,6 +713,7 @@ bool I2CDevice::setSpeed(uint32_t desiredclk) {
     #elif (ARDUINO >= 157) && !defined(ARDUINO_STM32_FEATHER) &&                   \
         !defined(TinyWireM_h)
         _wire->setClock(desiredclk);
+    _speed = desiredclk;
     return true;
 
     #else
@@ -308,45 +722,234 @@ bool I2CDevice::setSpeed(uint32_t desiredclk) {
     #endif
 };
 
-uint8_t I2CDevice::listDevices(uint8_t * devices, 
-                               bool verbose){
-    uint8_t error, address;    
-    uint8_t nDevices;
-    if(verbose) {
-        Serial.println("Scanning I2C bus");
+bool I2CDevice::_route() {
+    return _mux == nullptr || _mux->select(_muxChannel);
+};
+
+void I2CDevice::_selectClock() {
+    #if defined(ESP32) || defined(I2C_NATIVE)
+    if (_wire->getClock() == _maxClock) {
+        return;
     }
-    nDevices = 0;
-    // I2c address is 7 bits, so up to 0x7f addresses on the bus.
-    for(address = 1; address < 0x7f; address++ ) {     
+    #endif
+    // without getClock the clock is set every time, a register write on
+    // the AVR
+    setSpeed(_maxClock);
+    _busStats.clockSwitches++;
+};
+
+uint32_t I2CDevice::calibrateClock(uint8_t reg, size_t len,
+                                   const uint32_t *clocks, size_t count,
+                                   uint8_t reads) {
+    static const uint32_t steps[] = I2C_CALIBRATE_CLOCKS;
+    if (clocks == nullptr || count == 0) {
+        clocks = steps;
+        count = sizeof(steps) / sizeof(steps[0]);
+    }
+    if (len == 0 || len > I2C_CALIBRATE_SIZE) {
+        return 0;
+    }
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return 0;
+    }
+    uint32_t restore = _clock();
+    uint32_t profile = _maxClock;
+    bool recovering = _recovering;
+    // the reads run at the clock under test, and once each: a retry or a
+    // bus recovery would let a marginal clock pass
+    _maxClock = 0;
+    _recovering = false;
+    uint8_t reference[I2C_CALIBRATE_SIZE];
+    uint8_t data[I2C_CALIBRATE_SIZE];
+    // straight to the bus: a read served by the cache or the write stage
+    // would pass at any clock
+    uint8_t cmd[1] = {(uint8_t)(reg | _regCommand)};
+    uint32_t best = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!setSpeed(clocks[i])) {
+            break;
+        }
+        bool ok = true;
+        for (uint8_t r = 0; r < reads && ok; r++) {
+            if (i == 0 && r == 0) {
+                ok = write_then_read(cmd, 1, reference, len);
+            } else {
+                ok = write_then_read(cmd, 1, data, len) &&
+                     memcmp(data, reference, len) == 0;
+            }
+        }
+        if (!ok) {
+            break;
+        }
+        best = clocks[i];
+    }
+    _recovering = recovering;
+    _maxClock = best != 0 ? best : profile;
+    setSpeed(restore);
+    #ifdef DEBUG_I2DEVICE_SERIAL
+    DEBUG_I2DEVICE_SERIAL.print(F("\tI2C calibrated clock "));
+    DEBUG_I2DEVICE_SERIAL.println(best);
+    #endif
+    return best;
+};
+
+uint32_t I2CDevice::_clock() {
+    #if defined(ESP32) || defined(I2C_NATIVE)
+    return _wire->getClock();
+    #else
+    // the Wire default unless set through this instance
+    return _speed != 0 ? _speed : 100000;
+    #endif
+};
+
+bool I2CDevice::scan(I2CScanResult &result, uint32_t probeClock) {
+    memset(result.present, 0, sizeof(result.present));
+    memset(result.errors, I2C_SCAN_NOT_PROBED, sizeof(result.errors));
+    result.count = 0;
+    result.clock = 0;
+    result.elapsedUs = 0;
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    uint32_t previous = _clock();
+    result.clock = previous;
+    if (probeClock != 0 && probeClock != previous && setSpeed(probeClock)) {
+        result.clock = probeClock;
+    }
+    uint32_t start = micros();
+    for (uint8_t address = I2C_SCAN_FIRST; address <= I2C_SCAN_LAST;
+         address++) {
         _wire->beginTransmission(address);
-        error = _wire->endTransmission();
+        uint8_t error = _wire->endTransmission();
+        result.errors[address] = error;
         if (error == 0) {
-            devices[nDevices]=address;
-            nDevices++;
+            result.present[address >> 5] |= 1UL << (address & 31);
+            result.count++;
         }
-        if(verbose) {
-            String addressStr = getByteString(address, HEX);               
-            if (error == 0) {
-                Serial.printf("\nFound I2C device at %s\n", addressStr);
-            } else if (error != 0x02) {        
-                Serial.printf("\nError [%s] occurred while polling address %s\n",
-                    getByteString(error, HEX), addressStr);
-            } else {          
-                Serial.print(".");           
+    }
+    result.elapsedUs = micros() - start;
+    if (result.clock != previous) {
+        setSpeed(previous);
+    }
+    return true;
+};
+
+/// @brief A scan run by [I2CDevice::scanBuses] in a task of its own.
+struct I2CScanJob {
+    I2CDevice *device;
+    I2CScanResult *result;
+    uint32_t probeClock;
+    #if defined(ESP32)
+    SemaphoreHandle_t done;
+    #endif
+};
+
+#if defined(ESP32)
+static void scanTask(void *arg) {
+    I2CScanJob *job = (I2CScanJob *)arg;
+    job->device->scan(*job->result, job->probeClock);
+    xSemaphoreGive(job->done);
+    vTaskDelete(NULL);
+};
+#endif
+
+uint32_t I2CDevice::scanBuses(I2CDevice **devices,
+                              I2CScanResult *results,
+                              size_t count,
+                              uint32_t probeClock) {
+    uint32_t start = micros();
+    if (count == 0) {
+        return 0;
+    }
+    #if defined(ESP32)
+    I2CScanJob *jobs = new I2CScanJob[count];
+    for (size_t i = 1; i < count; i++) {
+        jobs[i].device = devices[i];
+        jobs[i].result = &results[i];
+        jobs[i].probeClock = probeClock;
+        jobs[i].done = xSemaphoreCreateBinary();
+        if (jobs[i].done == nullptr ||
+            xTaskCreate(scanTask, "I2CScan", 4096, &jobs[i],
+                        uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+            // no task, scan in the caller
+            devices[i]->scan(results[i], probeClock);
+            if (jobs[i].done != nullptr) {
+                xSemaphoreGive(jobs[i].done);
             }
         }
     }
+    devices[0]->scan(results[0], probeClock);
+    for (size_t i = 1; i < count; i++) {
+        if (jobs[i].done != nullptr) {
+            xSemaphoreTake(jobs[i].done, portMAX_DELAY);
+            vSemaphoreDelete(jobs[i].done);
+        }
+    }
+    delete[] jobs;
+    #elif defined(I2C_NATIVE)
+    std::thread *threads = new std::thread[count];
+    for (size_t i = 1; i < count; i++) {
+        threads[i] = std::thread([=] {
+            devices[i]->scan(results[i], probeClock);
+        });
+    }
+    devices[0]->scan(results[0], probeClock);
+    for (size_t i = 1; i < count; i++) {
+        threads[i].join();
+    }
+    delete[] threads;
+    #else
+    for (size_t i = 0; i < count; i++) {
+        devices[i]->scan(results[i], probeClock);
+    }
+    #endif
+    return micros() - start;
+};
+
+uint8_t I2CDevice::listDevicesTo(uint8_t * devices,
+                                 size_t size,
+                                 bool verbose){
+    I2CScanResult result;
+    if (!scan(result)) {
+        return 0;
+    }
+    uint8_t nDevices = 0;
+    for (uint8_t address = I2C_SCAN_FIRST; address <= I2C_SCAN_LAST;
+         address++) {
+        if (result.has(address) && nDevices < size) {
+            devices[nDevices++] = address;
+        }
+    }
     if(verbose) {
-        if (nDevices == 0) {
-            Serial.println("\nNO devices found on I2C bus.");
+        Serial.println("Scanning I2C bus");
+        for (uint8_t address = I2C_SCAN_FIRST; address <= I2C_SCAN_LAST;
+             address++) {
+            uint8_t error = result.errors[address];
+            if (error == 0) {
+                Serial.printf("Found I2C device at 0X%02X\n", address);
+            } else if (error != 0x02) {
+                Serial.printf("Error [0X%02X] occurred while polling "
+                    "address 0X%02X\n", error, address);
+            }
+        }
+        if (result.count == 0) {
+            Serial.println("NO devices found on I2C bus.");
         }
-        if (nDevices == 1){ 
-            Serial.println("\nFound ONE device on the I2C bus.");
+        if (result.count == 1){ 
+            Serial.println("Found ONE device on the I2C bus.");
         }  
-        if (nDevices > 1){ 
-            Serial.printf("\nFound %i devices on the I2C bus.\n",
-                    String(nDevices));
+        if (result.count > 1){ 
+            Serial.printf("Found %i devices on the I2C bus.\n",
+                    result.count);
         }
+        if (result.count > nDevices) {
+            Serial.printf("Only %i addresses fit the devices array.\n",
+                    nDevices);
+        }
+        Serial.printf("Scan took %lu us.\n",
+                (unsigned long)result.elapsedUs);
     }
     return nDevices;
 };
@@ -354,118 +957,409 @@ uint8_t I2CDevice::listDevices(uint8_t * devices,
 String I2CDevice::getByteString(uint8_t b, 
                                 uint8_t format, 
                                 bool addPrefix){
-    // prefix with "0x"
-    String bStr;
-    String str = String(b, format);
-    std::transform(str.begin(), str.end(), str.begin(), ::toupper);
-    switch (format){
-        case BIN:
-            bStr = String(addPrefix? "0B": "") +
-                   (b < 0b10? "0000000":
-                    b < 0b100? "000000":
-                    b < 0b1000? "00000":
-                    b < 0b10000? "0000":
-                    b < 0b100000? "000":
-                    b < 0b1000000? "00":
-                    b < 0b10000000? "0":
-                    "") ;
-        break;
-        case HEX:
-            bStr = String(addPrefix? "0X": "") +
-                   (b < 0x10? "0":"");    
-        break;
-        default:
-        break;
-    }
-    if (format == BIN){
-        
-    }
-      // add the b and return the string
-      return bStr+str;
-};
-
-// void I2CDevice::write8(uint8_t reg, uint8_t value) {
-//     uint8_t buf[1] = {value};
-//     this->write(reg, buf, 1);
-// };
-
-// uint8_t I2CDevice::read8(uint8_t reg) {
-//     write(reg);
-//     uint8_t buf[0];
-//     this->read(0, buf, 0x20, true);
-//     return buf[reg];
-// };
-
-// uint32_t I2CDevice::read32(uint8_t reg) {
-//     uint8_t ret[4];
-//     uint32_t ret32;
-//     this->read(reg, ret, 4);
-//     ret32 = ret[3];
-//     ret32 |= (uint32_t)ret[2] << 8;
-//     ret32 |= (uint32_t)ret[1] << 16;
-//     ret32 |= (uint32_t)ret[0] << 24;
-//     return ret32;
-// };
-
-// uint16_t I2CDevice::read16(uint8_t reg) {
-//     uint8_t ret[2];
-//     this->read(reg, ret, 2);
-//     return (ret[0] << 8) | ret[1];
-// };
-
-// uint16_t I2CDevice::read16Reversed(uint8_t reg) {
-//     uint8_t ret[2];
-//     this->read(reg, ret, 2);
-//     return (ret[1] << 8) | ret[0];
-// };
-
-// uint8_t I2CDevice::readRegister(uint8_t reg, 
-//                  uint8_t *buf, 
-//                  uint8_t num,
-//                  bool verbose) {
-    
-//     // buf[0] = reg;
-//     if (write(reg)){
-//         if (read(buf,num, true))
-//     // write_then_read(buf, 1, buf, num);
-//         if(verbose) {    
-//             Serial.println("______________________________");    
-//             Serial.println("REGISTER               VALUE");
-//             Serial.println("------------------------------");
-//             for (uint8_t i = 0; i < num; i++){
-//                 uint8_t regI = i + reg;
-//                 Serial.printf( " %s              %s\n", 
-//                     I2CDevice::getByteString(regI, HEX), 
-//                     I2CDevice::getByteString(buf[i], BIN));  
-//             }
-//         }   
-//     }
-//     return num;
-// }
-
-// void I2CDevice::write(uint8_t reg, uint8_t *buf, uint8_t num) {
-//     uint8_t prefix[1] = {reg};
-//     writeLen(buf, num, true, prefix, 1);
-// };
-
-// void I2CDevice::readAllRegisters(uint8_t * buf,
-//                         uint8_t len, 
-//                         uint8_t startReg,
-//                         bool verbose){
-//     if(verbose) {    
-//     Serial.println("______________________________");    
-//     Serial.println("REGISTER               VALUE");
-//     Serial.println("------------------------------");
-//     }   
-//     for (uint8_t i = 0; i < len; i++){
-//         uint8_t reg = i + startReg;
-//         buf[i] = read8(i + startReg);
-//         Serial.printf("buf[i] = %s\n", String(buf[i], BIN) );
-//         if(verbose) { 
-//         Serial.printf( " %s              %s\n", 
-//             I2CDevice::getByteString(reg, HEX), 
-//             I2CDevice::getByteString(buf[i], BIN));  
-
-//         } 
-//     }
-// };
+    if (format != HEX && format != BIN) {
+        return String(b, format);
+    }
+    char buffer[I2C_FORMAT_MAX_SIZE];
+    I2CFormat::formatByte(b, buffer, format, addPrefix);
+    return String(buffer);
+};
+
+bool I2CDevice::dumpRegisters(Print &out, uint8_t reg, size_t count) {
+    uint8_t values[32];
+    bool header = true;
+    // stop at 0xFF rather than wrap around to 0x00
+    if (count > 256 - (size_t)reg) {
+        count = 256 - (size_t)reg;
+    }
+    while (count > 0) {
+        size_t len = count > sizeof(values) ? sizeof(values) : count;
+        if (!readRegister(reg, values, len)) {
+            return false;
+        }
+        I2CFormat::printRegisters(out, values, len, reg, header);
+        header = false;
+        reg += len;
+        count -= len;
+    }
+    return true;
+};
+
+bool I2CDevice::readRegister(uint8_t reg, uint8_t *buf, size_t len) {
+    // the transfer and the cache and stage updates in one hold of the bus
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    if (_staging && _stage->covers(reg, len)) {
+        _stage->overlay(reg, buf, len);
+        return true;
+    }
+    if (_cache == nullptr || !_cache->lookup(reg, buf, len)) {
+        uint8_t cmd[1] = {(uint8_t)(reg | _regCommand)};
+        if (!write_then_read(cmd, 1, buf, len)) {
+            return false;
+        }
+        if (_cache != nullptr) {
+            _cache->store(reg, buf, len);
+        }
+    }
+    if (_staging) {
+        _stage->overlay(reg, buf, len);
+    }
+    return true;
+};
+
+bool I2CDevice::readPlan(I2CReadPlan &plan) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    if (plan.needsCompile(maxBufferSize()) && !plan.compile(maxBufferSize())) {
+        return false;
+    }
+    for (uint8_t i = 0; i < plan.bursts(); i++) {
+        const I2CReadBurst &burst = plan.burst(i);
+        uint8_t cmd[1] = {(uint8_t)(burst.reg | _regCommand)};
+        if (!write_then_read(cmd, 1, plan.scratch(), burst.len)) {
+            return false;
+        }
+        if (_cache != nullptr) {
+            _cache->store(burst.reg, plan.scratch(), burst.len);
+        }
+        plan.scatter(i);
+    }
+    return true;
+};
+
+bool I2CDevice::drainFifo(I2CFifo &fifo, bool force) {
+    const I2CFifoConfig &config = fifo.config();
+    if (!fifo.valid() || config.frameSize > maxBufferSize()) {
+        return false;
+    }
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    I2CFifoStats &stats = fifo._stats;
+    uint8_t raw[2];
+    // straight to the bus: a level served by the register cache or the
+    // write stage would be stale
+    uint8_t countCmd[1] = {(uint8_t)(config.countReg | _regCommand)};
+    if (!write_then_read(countCmd, 1, raw, config.countBytes)) {
+        return false;
+    }
+    stats.drains++;
+    bool overflow;
+    uint32_t frames = fifo.level(raw, overflow);
+    stats.lastLevel = (uint16_t)frames;
+    if (overflow) {
+        stats.overflows++;
+    }
+    if (frames == 0 || (!force && frames < config.watermark)) {
+        stats.belowWatermark++;
+        return true;
+    }
+    uint32_t space = (uint32_t)fifo.space();
+    if (frames > space) {
+        stats.ringFull++;
+        frames = space;
+    }
+    const uint32_t perBurst = (uint32_t)(maxBufferSize() / config.frameSize);
+    const uint32_t slots = fifo._mask + 1;
+    uint8_t cmd[1] = {(uint8_t)(config.dataReg | _regCommand)};
+    while (frames > 0) {
+        uint32_t n = frames < perBurst ? frames : perBurst;
+        uint32_t tail = fifo._tail.load();
+        uint32_t toEnd = slots - (tail & fifo._mask);
+        uint32_t first = n < toEnd ? n : toEnd;
+        // a burst wrapping around the ring lands in both of its ends
+        const I2CReadSegment segments[2] = {
+            {fifo._slot(tail), (size_t)first * config.frameSize},
+            {fifo._slot(0), (size_t)(n - first) * config.frameSize}};
+        if (!readSegments(segments, first < n ? 2 : 1, true, cmd, 1)) {
+            return false;
+        }
+        fifo._publish(n);
+        stats.frames += n;
+        stats.bursts++;
+        frames -= n;
+    }
+    return true;
+};
+
+bool I2CDevice::writeRegister(uint8_t reg,
+                              const uint8_t *buf,
+                              size_t len,
+                              bool stop) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    if (_staging) {
+        return _stage->stage(reg, buf, len, _cache);
+    }
+    uint8_t cmd[1] = {(uint8_t)(reg | _regCommand)};
+    if (!write(buf, len, stop, cmd, 1)) {
+        if (_cache != nullptr) {
+            // the device may or may not have taken some of the bytes
+            _cache->invalidate(reg, len);
+        }
+        return false;
+    }
+    if (_cache != nullptr) {
+        _cache->store(reg, buf, len);
+    }
+    return true;
+};
+
+bool I2CDevice::write8(uint8_t reg, uint8_t value) {
+    return writeRegister(reg, &value, 1);
+};
+
+uint8_t I2CDevice::read8(uint8_t reg) {
+    uint8_t value;
+    if (!readRegister(reg, &value, 1)) {
+        return 0;
+    }
+    return value;
+};
+
+uint16_t I2CDevice::read16(uint8_t reg, bool bigEndian) {
+    uint8_t buf[2];
+    if (!readRegister(reg, buf, 2)) {
+        return 0;
+    }
+    return bigEndian ? ((uint16_t)buf[0] << 8) | buf[1]
+                     : ((uint16_t)buf[1] << 8) | buf[0];
+};
+
+uint32_t I2CDevice::read32(uint8_t reg, bool bigEndian) {
+    uint8_t buf[4];
+    if (!readRegister(reg, buf, 4)) {
+        return 0;
+    }
+    if (bigEndian) {
+        return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+               ((uint32_t)buf[2] << 8) | buf[3];
+    }
+    return ((uint32_t)buf[3] << 24) | ((uint32_t)buf[2] << 16) |
+           ((uint32_t)buf[1] << 8) | buf[0];
+};
+
+bool I2CDevice::_readWords(uint16_t *words, size_t count,
+                           const uint8_t *command, size_t commandLen,
+                           bool stop, const uint8_t *table, uint8_t init) {
+    if (count == 0 || count > I2C_CRC_MAX_WORDS) {
+        return false;
+    }
+    uint8_t buf[3 * I2C_CRC_MAX_WORDS];
+    size_t len = 3 * count;
+    return _attempt([&]() {
+        I2CBusLock lock(*this);
+        if (!lock.locked()) {
+            return false;
+        }
+        bool ok = commandLen > 0
+            ? _writeThenRead(command, commandLen, buf, len, stop)
+            : _readAll(buf, len, true);
+        if (!ok) {
+            return false;
+        }
+        // de-interleave while checking: (MSB, LSB, CRC) per word
+        const uint8_t *p = buf;
+        for (size_t i = 0; i < count; i++, p += 3) {
+            if (table[table[init ^ p[0]] ^ p[1]] != p[2]) {
+                I2C_METRICS_ADD(crcErrors, 1);
+                return false;
+            }
+            words[i] = (uint16_t)((p[0] << 8) | p[1]);
+        }
+        return true;
+    });
+};
+
+bool I2CDevice::readPec(uint8_t command, uint8_t *buffer, size_t len) {
+    return _attempt([&]() {
+        I2CBusLock lock(*this);
+        if (!lock.locked()) {
+            return false;
+        }
+        uint8_t pec;
+        const I2CReadSegment segments[2] = {{buffer, len}, {&pec, 1}};
+        if (!_readSegments(segments, 2, true, &command, 1)) {
+            return false;
+        }
+        const uint8_t header[3] = {
+            (uint8_t)(_addr << 1), command, (uint8_t)((_addr << 1) | 1)};
+        uint8_t crc = I2CCrcSmbus::compute(header, 3);
+        if (I2CCrcSmbus::compute(buffer, len, crc) != pec) {
+            I2C_METRICS_ADD(crcErrors, 1);
+            return false;
+        }
+        return true;
+    });
+};
+
+bool I2CDevice::writePec(uint8_t command, const uint8_t *buffer,
+                         size_t len) {
+    const uint8_t header[2] = {(uint8_t)(_addr << 1), command};
+    uint8_t pec = I2CCrcSmbus::compute(buffer, len,
+                                       I2CCrcSmbus::compute(header, 2));
+    const I2CWriteSegment segments[3] = {
+        {&command, 1}, {buffer, len}, {&pec, 1}};
+    return _attempt([&]() { return _writeSegments(segments, 3, true); });
+};
+
+bool I2CDevice::enableRegisterCache(size_t size) {
+    disableRegisterCache();
+    _cache = new I2CRegisterCache(size);
+    return _cache != nullptr;
+};
+
+void I2CDevice::disableRegisterCache() {
+    delete _cache;
+    _cache = nullptr;
+};
+
+bool I2CDevice::beginStaging(size_t size) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    if (_staging) {
+        return true;
+    }
+    if (_stage == nullptr || _stage->size() < size) {
+        delete _stage;
+        _stage = new I2CWriteStage(size);
+    }
+    _staging = _stage != nullptr;
+    return _staging;
+};
+
+bool I2CDevice::commit() {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    if (!_staging) {
+        return true;
+    }
+    _staging = false;
+    uint8_t reg;
+    size_t len;
+    size_t from = 0;
+    // one byte of every burst is the register address
+    while (_stage->nextBurst(from, maxBufferSize() - 1, _cache, reg, len)) {
+        if (!writeRegister(reg, _stage->values() + reg, len)) {
+            _staging = true;
+            return false;
+        }
+        _stage->written(reg, len);
+        from = (size_t)reg + len;
+    }
+    return true;
+};
+
+void I2CDevice::discardStaged() {
+    // waits for the bus forever, so the lock cannot fail
+    I2CBusLock lock(*this);
+    if (_stage != nullptr) {
+        _stage->clear();
+    }
+    _staging = false;
+};
+
+bool I2CDevice::refreshRegisters(uint8_t reg, size_t count) {
+    I2CBusLock lock(*this);
+    if (!lock.locked()) {
+        return false;
+    }
+    if (_cache == nullptr) {
+        return false;
+    }
+    uint8_t buf[32];
+    // stop at 0xFF rather than wrap around to 0x00
+    if (count > 256 - (size_t)reg) {
+        count = 256 - (size_t)reg;
+    }
+    while (count > 0) {
+        size_t len = count > sizeof(buf) ? sizeof(buf) : count;
+        uint8_t cmd[1] = {(uint8_t)(reg | _regCommand)};
+        if (!write_then_read(cmd, 1, buf, len)) {
+            _cache->invalidate(reg, count);
+            return false;
+        }
+        _cache->store(reg, buf, len);
+        reg += len;
+        count -= len;
+    }
+    return true;
+};
+
+void I2CDevice::setPageSize(uint16_t pageSize, uint8_t addressBytes) {
+    _pageSize = pageSize;
+    _memAddressBytes = addressBytes < 1 ? 1 : addressBytes > 4 ? 4
+                                                               : addressBytes;
+};
+
+void I2CDevice::_memoryAddress(uint32_t address, uint8_t *prefix) {
+    for (uint8_t i = 0; i < _memAddressBytes; i++) {
+        prefix[i] = (uint8_t)(address >> (8 * (_memAddressBytes - 1 - i)));
+    }
+};
+
+bool I2CDevice::writeMemory(uint32_t address, const uint8_t *buffer,
+                            size_t len) {
+    if (maxBufferSize() <= _memAddressBytes) {
+        return false;
+    }
+    size_t max_chunk = maxBufferSize() - _memAddressBytes;
+    uint8_t prefix[4];
+    while (len > 0) {
+        size_t chunk = len > max_chunk ? max_chunk : len;
+        if (_pageSize != 0) {
+            // writes wrap around inside a page, stop at its end
+            size_t room = _pageSize - address % _pageSize;
+            if (chunk > room) {
+                chunk = room;
+            }
+        }
+        _memoryAddress(address, prefix);
+        I2CWriteSegment segments[2] = {
+            {prefix, _memAddressBytes},
+            {buffer, chunk}
+        };
+        if (!writeSegments(segments, 2)) {
+            return false;
+        }
+        if (!waitReady()) {
+            return false;
+        }
+        address += chunk;
+        buffer += chunk;
+        len -= chunk;
+    }
+    return true;
+};
+
+bool I2CDevice::readMemory(uint32_t address, uint8_t *buffer, size_t len) {
+    uint8_t prefix[4];
+    _memoryAddress(address, prefix);
+    return write_then_read(prefix, _memAddressBytes, buffer, len);
+};
+
+bool I2CDevice::waitReady() {
+    uint32_t start = micros();
+    // the device NACKs its address until the write cycle has ended
+    while (!detected()) {
+        if (micros() - start >= _writeCycleTimeoutUs) {
+            #ifdef DEBUG_I2DEVICE_SERIAL
+            DEBUG_I2DEVICE_SERIAL.println(F("\tI2CDevice write cycle timed out"));
+            #endif
+            return false;
+        }
+    }
+    return true;
+};
@@ -0,0 +1,57 @@
+#include "I2CFifo.h"
+
+
+I2CFifo::I2CFifo(const I2CFifoConfig &config, uint8_t *ring, size_t frames)
+    : _config(config) {
+    _ring = ring;
+    _mask = frames > 0 ? (uint32_t)(frames - 1) : 0;
+    if (frames == 0 || (frames & (frames - 1)) != 0) {
+        // marks the ring invalid
+        _ring = nullptr;
+    }
+    resetStats();
+};
+
+bool I2CFifo::valid() const {
+    return _ring != nullptr && _config.frameSize > 0 &&
+           (_config.countBytes == 1 || _config.countBytes == 2);
+};
+
+void I2CFifo::resetStats() {
+    memset(&_stats, 0, sizeof(_stats));
+};
+
+uint16_t I2CFifo::level(const uint8_t *raw, bool &overflow) const {
+    uint16_t count = raw[0];
+    if (_config.countBytes == 2) {
+        count = _config.countOrder == I2C_BIG_ENDIAN
+            ? (uint16_t)((raw[0] << 8) | raw[1])
+            : (uint16_t)((raw[1] << 8) | raw[0]);
+    }
+    overflow = (count & _config.overflowMask) != 0;
+    count &= _config.levelMask;
+    return _config.levelInFrames ? count
+                                 : (uint16_t)(count / _config.frameSize);
+};
+
+const uint8_t * I2CFifo::front(size_t &contiguous) {
+    uint32_t head = _head.load();
+    uint32_t count = _tail.load() - head;
+    if (count == 0) {
+        contiguous = 0;
+        return nullptr;
+    }
+    uint32_t toEnd = _mask + 1 - (head & _mask);
+    contiguous = count < toEnd ? count : toEnd;
+    return _slot(head);
+};
+
+bool I2CFifo::pop(uint8_t *frame) {
+    const uint8_t *oldest = front();
+    if (oldest == nullptr) {
+        return false;
+    }
+    memcpy(frame, oldest, _config.frameSize);
+    release();
+    return true;
+};
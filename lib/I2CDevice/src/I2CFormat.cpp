@@ -0,0 +1,91 @@
+#include "I2CFormat.h"
+
+
+/// @brief Upper case hex digits.
+static const char hexDigits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+/// @brief The four binary digits of every nibble.
+static const char binNibbles[16][4] = {
+    {'0', '0', '0', '0'}, {'0', '0', '0', '1'},
+    {'0', '0', '1', '0'}, {'0', '0', '1', '1'},
+    {'0', '1', '0', '0'}, {'0', '1', '0', '1'},
+    {'0', '1', '1', '0'}, {'0', '1', '1', '1'},
+    {'1', '0', '0', '0'}, {'1', '0', '0', '1'},
+    {'1', '0', '1', '0'}, {'1', '0', '1', '1'},
+    {'1', '1', '0', '0'}, {'1', '1', '0', '1'},
+    {'1', '1', '1', '0'}, {'1', '1', '1', '1'}};
+
+/// @brief Header of the register table, with the CRLF line ends of
+/// [Print::println] that printed it before.
+static const char tableHeader[] =
+    "___________________________________\r\n"
+    "REGISTER                    VALUE\r\n"
+    "-----------------------------------\r\n";
+
+size_t I2CFormat::formatByte(uint8_t b,
+                             char *buffer,
+                             uint8_t format,
+                             bool addPrefix) {
+    char *p = buffer;
+    switch (format) {
+        case HEX:
+            if (addPrefix) {
+                *p++ = '0';
+                *p++ = 'X';
+            }
+            *p++ = hexDigits[b >> 4];
+            *p++ = hexDigits[b & 0x0F];
+        break;
+        case BIN:
+            if (addPrefix) {
+                *p++ = '0';
+                *p++ = 'B';
+            }
+            memcpy(p, binNibbles[b >> 4], 4);
+            memcpy(p + 4, binNibbles[b & 0x0F], 4);
+            p += 8;
+        break;
+        default:
+            if (b >= 100) {
+                *p++ = '0' + b / 100;
+            }
+            if (b >= 10) {
+                *p++ = '0' + (b / 10) % 10;
+            }
+            *p++ = '0' + b % 10;
+        break;
+    }
+    *p = '\0';
+    return p - buffer;
+};
+
+size_t I2CFormat::printRegisters(Print &out,
+                                 const uint8_t *values,
+                                 size_t count,
+                                 uint8_t firstReg,
+                                 bool header) {
+    size_t written = 0;
+    if (header) {
+        written += out.write((const uint8_t *)tableHeader,
+                             sizeof(tableHeader) - 1);
+    }
+    // " 0X00              0B00000000 (0X00)\n"
+    char row[40];
+    for (size_t i = 0; i < count; i++) {
+        char *p = row;
+        *p++ = ' ';
+        p += formatByte((uint8_t)(firstReg + i), p, HEX);
+        memset(p, ' ', 14);
+        p += 14;
+        p += formatByte(values[i], p, BIN);
+        *p++ = ' ';
+        *p++ = '(';
+        p += formatByte(values[i], p, HEX);
+        *p++ = ')';
+        *p++ = '\n';
+        written += out.write((const uint8_t *)row, p - row);
+    }
+    return written;
+};
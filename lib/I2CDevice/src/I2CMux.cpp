@@ -0,0 +1,143 @@
+#include "I2CMux.h"
+
+
+I2CMux::I2CMux(uint8_t address, TwoWire *theWire)
+    : _device(address, theWire) {
+    _mask = -1;
+    _next = this;
+    resetStats();
+};
+
+bool I2CMux::select(uint8_t channel) {
+    if (channel >= I2C_MUX_CHANNELS) {
+        return false;
+    }
+    return selectMask((uint8_t)(1 << channel));
+};
+
+bool I2CMux::selectMask(uint8_t mask) {
+    I2CBusLock lock(_device);
+    if (!lock.locked()) {
+        return false;
+    }
+    if (_mask == mask) {
+        _stats.skipped++;
+        return true;
+    }
+    if (mask != 0) {
+        for (I2CMux *other = _next; other != this; other = other->_next) {
+            if (other->_mask != 0 && !other->deselect()) {
+                return false;
+            }
+        }
+    }
+    if (!_device.write(mask)) {
+        // the write may or may not have reached the control register
+        _mask = -1;
+        _stats.failures++;
+        return false;
+    }
+    _mask = mask;
+    _stats.selects++;
+    return true;
+};
+
+void I2CMux::link(I2CMux &other) {
+    for (I2CMux *mux = _next; mux != this; mux = mux->_next) {
+        if (mux == &other) {
+            return;
+        }
+    }
+    if (&other == this) {
+        return;
+    }
+    // splice the two rings into one
+    I2CMux *next = _next;
+    _next = other._next;
+    other._next = next;
+};
+
+void I2CMux::resetStats() {
+    memset(&_stats, 0, sizeof(_stats));
+};
+
+I2CGroupRead::I2CGroupRead() {
+    _count = 0;
+    _direct = 0;
+    _dirty = true;
+};
+
+bool I2CGroupRead::add(I2CDevice &device, uint8_t reg, uint8_t len,
+                       void *dest) {
+    if (_count >= I2C_GROUP_MAX_READS || len == 0 || dest == nullptr) {
+        return false;
+    }
+    I2CDeviceRead &read = _reads[_count++];
+    read.device = &device;
+    read.reg = reg;
+    read.len = len;
+    read.dest = dest;
+    read.ok = false;
+    _dirty = true;
+    return true;
+};
+
+/// @brief Returns the sort key of [read]: -1 without a multiplexer, else
+/// the multiplexer address and the channel.
+static int16_t channelKey(const I2CDeviceRead &read) {
+    I2CMux *mux = read.device->mux();
+    if (mux == nullptr) {
+        return -1;
+    }
+    return (int16_t)((mux->device().address() << 3) |
+                     (read.device->muxChannel() & 0x07));
+}
+
+void I2CGroupRead::_sort() {
+    // a stable insertion sort, the group is small
+    _direct = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        int16_t key = channelKey(_reads[i]);
+        uint8_t j = i;
+        while (j > 0 && channelKey(_reads[_order[j - 1]]) > key) {
+            _order[j] = _order[j - 1];
+            j--;
+        }
+        _order[j] = i;
+        if (key < 0) {
+            _direct++;
+        }
+    }
+    _dirty = false;
+};
+
+bool I2CGroupRead::run() {
+    if (_dirty) {
+        _sort();
+    }
+    // start with the channel already enabled, if any, and wrap around
+    uint8_t start = _direct;
+    for (uint8_t i = _direct; i < _count; i++) {
+        const I2CDeviceRead &read = _reads[_order[i]];
+        if (read.device->mux()->selected() ==
+            (1 << read.device->muxChannel())) {
+            start = i;
+            break;
+        }
+    }
+    bool ok = true;
+    for (uint8_t n = 0; n < _count; n++) {
+        uint8_t i = n;
+        if (n >= _direct) {
+            i = start + (n - _direct);
+            if (i >= _count) {
+                i -= _count - _direct;
+            }
+        }
+        I2CDeviceRead &read = _reads[_order[i]];
+        read.ok = read.device->readRegister(read.reg, (uint8_t *)read.dest,
+                                            read.len);
+        ok = ok && read.ok;
+    }
+    return ok;
+};
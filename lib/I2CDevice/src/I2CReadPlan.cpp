@@ -0,0 +1,103 @@
+#include "I2CReadPlan.h"
+
+
+I2CReadPlan::I2CReadPlan(uint8_t maxGap) {
+    _readCount = 0;
+    _burstCount = 0;
+    _maxGap = maxGap;
+    _maxBurst = 0;
+    _dirty = true;
+    _scratch = nullptr;
+    _scratchSize = 0;
+};
+
+I2CReadPlan::~I2CReadPlan() {
+    delete[] _scratch;
+};
+
+bool I2CReadPlan::add(uint8_t reg, uint8_t len, void *dest) {
+    if (_readCount >= I2C_READ_PLAN_MAX_READS || len == 0 || dest == nullptr) {
+        return false;
+    }
+    _reads[_readCount].reg = reg;
+    _reads[_readCount].len = len;
+    _reads[_readCount].dest = dest;
+    _readCount++;
+    _dirty = true;
+    return true;
+};
+
+void I2CReadPlan::clear() {
+    _readCount = 0;
+    _burstCount = 0;
+    _dirty = true;
+};
+
+void I2CReadPlan::setMaxGap(uint8_t maxGap) {
+    _maxGap = maxGap;
+    _dirty = true;
+};
+
+bool I2CReadPlan::compile(size_t maxBurst) {
+    // sort the reads by register, the plan is small enough for an
+    // insertion sort
+    for (uint8_t i = 1; i < _readCount; i++) {
+        I2CRegisterRead read = _reads[i];
+        uint8_t j = i;
+        while (j > 0 && _reads[j - 1].reg > read.reg) {
+            _reads[j] = _reads[j - 1];
+            j--;
+        }
+        _reads[j] = read;
+    }
+    _burstCount = 0;
+    size_t longest = 0;
+    size_t end = 0;
+    for (uint8_t i = 0; i < _readCount; i++) {
+        const I2CRegisterRead &read = _reads[i];
+        size_t readEnd = (size_t)read.reg + read.len;
+        if (_burstCount > 0) {
+            I2CReadBurst &burst = _bursts[_burstCount - 1];
+            size_t mergedEnd = readEnd > end ? readEnd : end;
+            if ((size_t)read.reg <= end + _maxGap &&
+                mergedEnd - burst.reg <= maxBurst) {
+                end = mergedEnd;
+                burst.len = end - burst.reg;
+                burst.count++;
+                if (burst.len > longest) {
+                    longest = burst.len;
+                }
+                continue;
+            }
+        }
+        I2CReadBurst &burst = _bursts[_burstCount++];
+        burst.reg = read.reg;
+        burst.len = read.len;
+        burst.first = i;
+        burst.count = 1;
+        end = readEnd;
+        if (burst.len > longest) {
+            longest = burst.len;
+        }
+    }
+    if (longest > _scratchSize) {
+        delete[] _scratch;
+        _scratch = new uint8_t[longest];
+        if (_scratch == nullptr) {
+            _scratchSize = 0;
+            return false;
+        }
+        _scratchSize = longest;
+    }
+    _maxBurst = maxBurst;
+    _dirty = false;
+    return true;
+};
+
+void I2CReadPlan::scatter(uint8_t index) {
+    const I2CReadBurst &burst = _bursts[index];
+    for (uint8_t i = burst.first; i < burst.first + burst.count; i++) {
+        const I2CRegisterRead &read = _reads[i];
+        memcpy(read.dest, _scratch + (read.reg - burst.reg), read.len);
+    }
+};
@@ -0,0 +1,80 @@
+#include "I2CRecovery.h"
+
+
+/// @brief Drives [pin] LOW or releases it to its pull-up, as an
+/// open-drain output. Without OUTPUT_OPEN_DRAIN the pin is switched
+/// between an output driving LOW and an input with pull-up, so it never
+/// drives HIGH against a slave.
+static void driveOpenDrain(int pin, uint8_t level) {
+    #if defined(OUTPUT_OPEN_DRAIN)
+    digitalWrite(pin, level);
+    #else
+    if (level == LOW) {
+        digitalWrite(pin, LOW);
+        pinMode(pin, OUTPUT);
+    } else {
+        pinMode(pin, INPUT_PULLUP);
+    }
+    #endif
+}
+
+/// @brief Switches [pin] to an open-drain output, released.
+static void beginOpenDrain(int pin) {
+    #if defined(OUTPUT_OPEN_DRAIN)
+    digitalWrite(pin, HIGH);
+    pinMode(pin, OUTPUT_OPEN_DRAIN);
+    #else
+    pinMode(pin, INPUT_PULLUP);
+    #endif
+}
+
+bool I2CRecovery::clearBus(int sda, int scl, uint32_t halfPeriodUs) {
+    if (sda < 0 || scl < 0) {
+        return false;
+    }
+    pinMode(sda, INPUT_PULLUP);
+    beginOpenDrain(scl);
+    delayMicroseconds(halfPeriodUs);
+    // a slave holding SDA is sending a 0 bit of a byte or an ACK; every
+    // clock moves it on until it releases SDA for a 1 bit or the NACK
+    for (uint8_t i = 0; i < I2C_RECOVERY_CLOCKS && digitalRead(sda) == LOW;
+         i++) {
+        driveOpenDrain(scl, LOW);
+        delayMicroseconds(halfPeriodUs);
+        driveOpenDrain(scl, HIGH);
+        delayMicroseconds(halfPeriodUs);
+    }
+    bool released = digitalRead(sda) == HIGH;
+    if (released) {
+        // STOP: SDA rises while SCL is high, resetting every slave's
+        // state machine
+        beginOpenDrain(sda);
+        driveOpenDrain(scl, LOW);
+        delayMicroseconds(halfPeriodUs);
+        driveOpenDrain(sda, LOW);
+        delayMicroseconds(halfPeriodUs);
+        driveOpenDrain(scl, HIGH);
+        delayMicroseconds(halfPeriodUs);
+        driveOpenDrain(sda, HIGH);
+        delayMicroseconds(halfPeriodUs);
+    }
+    pinMode(sda, INPUT_PULLUP);
+    pinMode(scl, INPUT_PULLUP);
+    return released;
+};
+
+uint32_t I2CRecovery::backoffUs(const I2CRecoveryPolicy &policy,
+                                uint8_t retry) {
+    uint64_t us = (uint64_t)policy.backoffUs << (retry < 31 ? retry : 31);
+    if (policy.maxBackoffUs != 0 && us > policy.maxBackoffUs) {
+        us = policy.maxBackoffUs;
+    }
+    return us > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)us;
+};
+
+void I2CRecovery::wait(uint32_t us) {
+    if (us >= 1000) {
+        delay(us / 1000);
+    }
+    delayMicroseconds(us % 1000);
+};
@@ -0,0 +1,84 @@
+#include "I2CRegisterCache.h"
+
+
+I2CRegisterCache::I2CRegisterCache(size_t size) {
+    _size = (size == 0 || size > 256) ? 256 : size;
+    _values = new uint8_t[_size];
+    memset(_values, 0, _size);
+    memset(_valid, 0, sizeof(_valid));
+    memset(_volatile, 0xFF, sizeof(_volatile));
+    _hits = 0;
+    _misses = 0;
+};
+
+I2CRegisterCache::~I2CRegisterCache() {
+    delete[] _values;
+};
+
+void I2CRegisterCache::setVolatile(uint8_t reg, bool isVolatile, size_t count) {
+    for (size_t i = reg; i < (size_t)reg + count && i < _size; i++) {
+        setBit(_volatile, (uint8_t)i, isVolatile);
+        if (isVolatile) {
+            setBit(_valid, (uint8_t)i, false);
+        }
+    }
+};
+
+void I2CRegisterCache::setVolatileMask(const uint8_t *mask) {
+    for (size_t i = 0; i < _size; i++) {
+        setVolatile((uint8_t)i, bit(mask, (uint8_t)i));
+    }
+};
+
+bool I2CRegisterCache::isVolatile(uint8_t reg) {
+    return reg >= _size || bit(_volatile, reg);
+};
+
+bool I2CRegisterCache::lookup(uint8_t reg, uint8_t *buf, size_t len) {
+    if ((size_t)reg + len > _size) {
+        _misses++;
+        return false;
+    }
+    for (size_t i = reg; i < (size_t)reg + len; i++) {
+        if (bit(_volatile, (uint8_t)i) || !bit(_valid, (uint8_t)i)) {
+            _misses++;
+            return false;
+        }
+    }
+    memcpy(buf, _values + reg, len);
+    _hits++;
+    return true;
+};
+
+bool I2CRegisterCache::peek(uint8_t reg, uint8_t &value) {
+    if (reg >= _size || bit(_volatile, reg) || !bit(_valid, reg)) {
+        return false;
+    }
+    value = _values[reg];
+    return true;
+};
+
+void I2CRegisterCache::store(uint8_t reg, const uint8_t *buf, size_t len) {
+    for (size_t i = 0; i < len && (size_t)reg + i < _size; i++) {
+        uint8_t r = (uint8_t)(reg + i);
+        if (!bit(_volatile, r)) {
+            _values[r] = buf[i];
+            setBit(_valid, r, true);
+        }
+    }
+};
+
+void I2CRegisterCache::invalidate(uint8_t reg, size_t count) {
+    for (size_t i = reg; i < (size_t)reg + count && i < _size; i++) {
+        setBit(_valid, (uint8_t)i, false);
+    }
+};
+
+void I2CRegisterCache::invalidate() {
+    memset(_valid, 0, sizeof(_valid));
+};
+
+void I2CRegisterCache::resetStats() {
+    _hits = 0;
+    _misses = 0;
+};
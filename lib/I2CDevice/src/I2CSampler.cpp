@@ -0,0 +1,304 @@
+#include "I2CSampler.h"
+#include "I2CDevice.h"
+
+
+I2CSampler::I2CSampler(size_t capacity)
+    : _channel(capacity ? capacity : 1, I2C_OVERWRITE_OLDEST) {
+    _jobCount = 0;
+    _lostBefore = 0;
+    _clock = 0;
+    _statsFrom = micros();
+    _running = false;
+    _stopping = false;
+    #if defined(ESP32)
+    _task = nullptr;
+    _stopped = xSemaphoreCreateBinary();
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    _timer = nullptr;
+    esp_timer_create_args_t timer = {};
+    timer.callback = wake;
+    timer.arg = this;
+    timer.name = "I2CSampler";
+    esp_timer_create(&timer, &_timer);
+    #endif
+};
+
+I2CSampler::~I2CSampler() {
+    end();
+    #if defined(ESP32)
+    vSemaphoreDelete(_stopped);
+    if (_timer != nullptr) {
+        esp_timer_delete(_timer);
+    }
+    #endif
+};
+
+void I2CSampler::enter() {
+    #if defined(ESP32)
+    portENTER_CRITICAL(&_mux);
+    #elif defined(I2C_NATIVE)
+    _mutex.lock();
+    #endif
+};
+
+void I2CSampler::exit() {
+    #if defined(ESP32)
+    portEXIT_CRITICAL(&_mux);
+    #elif defined(I2C_NATIVE)
+    _mutex.unlock();
+    #endif
+};
+
+int8_t I2CSampler::addJob(I2CDevice &device,
+                          uint8_t reg,
+                          uint8_t len,
+                          uint32_t periodUs) {
+    if (_running || _jobCount >= I2C_SAMPLER_MAX_JOBS ||
+        len == 0 || len > I2C_SAMPLER_SAMPLE_SIZE || periodUs == 0) {
+        return -1;
+    }
+    Job &job = _jobs[_jobCount];
+    job.device = &device;
+    job.reg = reg;
+    job.len = len;
+    job.periodUs = periodUs;
+    job.due = micros();
+    memset(&job.stats, 0, sizeof(job.stats));
+    return (int8_t)_jobCount++;
+};
+
+void I2CSampler::clearJobs() {
+    if (!_running) {
+        _jobCount = 0;
+    }
+};
+
+bool I2CSampler::begin(uint8_t priority, int core, uint32_t stackSize) {
+    if (_running) {
+        return true;
+    }
+    uint32_t now = micros();
+    for (uint8_t i = 0; i < _jobCount; i++) {
+        _jobs[i].due = now;
+    }
+    resetStats();
+    _stopping = false;
+    #if defined(ESP32)
+    if (_stopped == nullptr || _timer == nullptr) {
+        return false;
+    }
+    _running = true;
+    if (xTaskCreatePinnedToCore(task, "I2CSampler", stackSize, this,
+                                priority, &_task, core) != pdPASS) {
+        _running = false;
+    }
+    return _running;
+    #elif defined(I2C_NATIVE)
+    (void)priority;
+    (void)core;
+    (void)stackSize;
+    _running = true;
+    _thread = std::thread(&I2CSampler::work, this);
+    return true;
+    #else
+    (void)priority;
+    (void)core;
+    (void)stackSize;
+    return true;
+    #endif
+};
+
+void I2CSampler::end() {
+    if (!_running) {
+        return;
+    }
+    #if defined(ESP32)
+    _stopping = true;
+    xTaskNotifyGive(_task);
+    xSemaphoreTake(_stopped, portMAX_DELAY);
+    _task = nullptr;
+    #elif defined(I2C_NATIVE)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_one();
+    _thread.join();
+    #endif
+    _running = false;
+};
+
+void I2CSampler::run(uint8_t index, uint32_t now) {
+    Job &job = _jobs[index];
+    uint32_t late = now - job.due;
+    uint32_t skipped = 0;
+    if (late >= job.periodUs) {
+        // whole periods were missed: count them and keep the phase
+        skipped = late / job.periodUs;
+        job.due += skipped * job.periodUs;
+        late -= skipped * job.periodUs;
+    }
+    job.due += job.periodUs;
+    if (job.device->maxClock() != 0) {
+        _clock = job.device->maxClock();
+    }
+    // read straight into the next slot of the channel
+    I2CSample *sample = _channel.reserve();
+    uint8_t discard[I2C_SAMPLER_SAMPLE_SIZE];
+    uint32_t start = micros();
+    bool ok = job.device->readRegister(
+        job.reg, sample != nullptr ? sample->data : discard, job.len);
+    uint32_t busy = micros() - start;
+    if (ok && sample != nullptr) {
+        sample->timestamp = start;
+        sample->job = index;
+        sample->len = job.len;
+        _channel.publish();
+    }
+    uint8_t bin = 0;
+    while (bin < I2C_SAMPLER_JITTER_BINS - 1 && late >= jitterBinLimit(bin)) {
+        bin++;
+    }
+    enter();
+    I2CSamplerStats &stats = job.stats;
+    stats.overruns += skipped;
+    stats.busyUs += busy;
+    stats.jitter[bin]++;
+    if (late > stats.maxLateUs) {
+        stats.maxLateUs = late;
+    }
+    if (ok) {
+        if (stats.samples == 0) {
+            stats.firstUs = start;
+        }
+        stats.lastUs = start;
+        stats.samples++;
+    } else {
+        stats.errors++;
+    }
+    exit();
+};
+
+uint32_t I2CSampler::poll() {
+    if (_jobCount == 0) {
+        return 0xFFFFFFFFUL;
+    }
+    // at most one sample per job, so an oversubscribed bus still returns
+    for (uint8_t runs = 0; ; runs++) {
+        uint32_t now = micros();
+        uint8_t next = 0;
+        int32_t wait = (int32_t)(_jobs[0].due - now);
+        for (uint8_t i = 1; i < _jobCount; i++) {
+            int32_t w = (int32_t)(_jobs[i].due - now);
+            if (w < wait) {
+                wait = w;
+                next = i;
+            }
+        }
+        if (wait > 0 || runs == _jobCount) {
+            return wait > 0 ? (uint32_t)wait : 0;
+        }
+        run(batch(next, now), now);
+    }
+};
+
+uint8_t I2CSampler::batch(uint8_t next, uint32_t now) {
+    const Job &job = _jobs[next];
+    if (_clock == 0 || job.device->maxClock() == _clock ||
+        now - job.due >= job.periodUs) {
+        return next;
+    }
+    uint8_t best = next;
+    int32_t bestWait = 1;
+    for (uint8_t i = 0; i < _jobCount; i++) {
+        int32_t wait = (int32_t)(_jobs[i].due - now);
+        if (wait <= 0 && wait < bestWait &&
+            _jobs[i].device->maxClock() == _clock) {
+            best = i;
+            bestWait = wait;
+        }
+    }
+    return best;
+};
+
+uint32_t I2CSampler::lost() {
+    return _channel.overwritten() + _channel.dropped() - _lostBefore;
+};
+
+bool I2CSampler::stats(uint8_t job, I2CSamplerStats &stats) {
+    if (job >= _jobCount) {
+        return false;
+    }
+    enter();
+    stats = _jobs[job].stats;
+    exit();
+    return true;
+};
+
+float I2CSampler::achievedHz(uint8_t job) {
+    I2CSamplerStats s;
+    if (!stats(job, s) || s.samples < 2 || s.lastUs == s.firstUs) {
+        return 0;
+    }
+    return (s.samples - 1) * 1e6f / (uint32_t)(s.lastUs - s.firstUs);
+};
+
+float I2CSampler::utilization() {
+    enter();
+    uint64_t busy = 0;
+    for (uint8_t i = 0; i < _jobCount; i++) {
+        busy += _jobs[i].stats.busyUs;
+    }
+    uint32_t elapsed = micros() - _statsFrom;
+    exit();
+    return elapsed ? (float)busy / elapsed : 0;
+};
+
+void I2CSampler::resetStats() {
+    enter();
+    for (uint8_t i = 0; i < _jobCount; i++) {
+        memset(&_jobs[i].stats, 0, sizeof(_jobs[i].stats));
+    }
+    _lostBefore = _channel.overwritten() + _channel.dropped();
+    _statsFrom = micros();
+    exit();
+};
+
+void I2CSampler::work() {
+    #if defined(ESP32)
+    while (!_stopping) {
+        uint32_t wait = poll();
+        if (wait > I2C_SAMPLER_SPIN_US) {
+            // block, even for waits shorter than a tick, until the timer
+            // fires shortly before the job is due or [end] notifies
+            esp_timer_start_once(_timer, wait - I2C_SAMPLER_SPIN_US);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            esp_timer_stop(_timer);
+        } else if (wait > 0) {
+            delayMicroseconds(wait);
+        }
+    }
+    #elif defined(I2C_NATIVE)
+    for (;;) {
+        uint32_t wait = poll();
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_wake.wait_for(lock, std::chrono::microseconds(wait),
+                           [this] { return (bool)_stopping; })) {
+            return;
+        }
+    }
+    #endif
+};
+
+#if defined(ESP32)
+void I2CSampler::wake(void *sampler) {
+    xTaskNotifyGive(((I2CSampler *)sampler)->_task);
+};
+
+void I2CSampler::task(void *sampler) {
+    I2CSampler *self = (I2CSampler *)sampler;
+    self->work();
+    xSemaphoreGive(self->_stopped);
+    vTaskDelete(NULL);
+};
+#endif
@@ -0,0 +1,129 @@
+#include "I2CTrace.h"
+#include "I2CFormat.h"
+
+
+I2CTrace::I2CTrace(size_t capacity) {
+    _capacity = capacity ? capacity : 1;
+    _records = new I2CTraceRecord[_capacity];
+    _count = 0;
+    _first = 0;
+    _paused = false;
+    #if defined(ESP32)
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    #endif
+};
+
+I2CTrace::~I2CTrace() {
+    delete[] _records;
+};
+
+void I2CTrace::enter() {
+    #if defined(ESP32)
+    portENTER_CRITICAL(&_mux);
+    #elif defined(I2C_NATIVE)
+    _mutex.lock();
+    #else
+    noInterrupts();
+    #endif
+};
+
+void I2CTrace::exit() {
+    #if defined(ESP32)
+    portEXIT_CRITICAL(&_mux);
+    #elif defined(I2C_NATIVE)
+    _mutex.unlock();
+    #else
+    interrupts();
+    #endif
+};
+
+void I2CTrace::add(const I2CTraceRecord &record) {
+    if (_paused) {
+        return;
+    }
+    enter();
+    _records[_count % _capacity] = record;
+    _count++;
+    exit();
+};
+
+void I2CTrace::clear() {
+    enter();
+    _first = _count;
+    exit();
+};
+
+size_t I2CTrace::size() {
+    enter();
+    uint32_t held = _count - _first;
+    exit();
+    return held < _capacity ? held : _capacity;
+};
+
+uint32_t I2CTrace::overwritten() {
+    enter();
+    uint32_t held = _count - _first;
+    exit();
+    return held > _capacity ? held - _capacity : 0;
+};
+
+bool I2CTrace::get(size_t index, I2CTraceRecord &record) {
+    enter();
+    uint32_t held = _count - _first;
+    if (held > _capacity) {
+        held = _capacity;
+    }
+    bool found = index < held;
+    if (found) {
+        record = _records[(_count - held + index) % _capacity];
+    }
+    exit();
+    return found;
+};
+
+void I2CTrace::encode(const I2CTraceRecord &record, uint8_t *buf) {
+    buf[0] = (uint8_t)record.timestamp;
+    buf[1] = (uint8_t)(record.timestamp >> 8);
+    buf[2] = (uint8_t)(record.timestamp >> 16);
+    buf[3] = (uint8_t)(record.timestamp >> 24);
+    buf[4] = (uint8_t)record.durationUs;
+    buf[5] = (uint8_t)(record.durationUs >> 8);
+    buf[6] = (uint8_t)record.len;
+    buf[7] = (uint8_t)(record.len >> 8);
+    buf[8] = record.address;
+    buf[9] = record.flags;
+    buf[10] = record.result;
+    memcpy(buf + 11, record.payload, I2C_TRACE_PAYLOAD);
+};
+
+size_t I2CTrace::dump(Print &out) {
+    // a snapshot of the indices; records overwritten while printing are
+    // skipped by [get]
+    size_t count = size();
+    out.print(F(I2C_TRACE_PREFIX " H "));
+    out.print(I2C_TRACE_VERSION);
+    out.print(' ');
+    out.print(I2C_TRACE_PAYLOAD);
+    out.print(' ');
+    out.print((unsigned long)count);
+    out.print(' ');
+    out.println((unsigned long)overwritten());
+    uint8_t encoded[I2C_TRACE_RECORD_SIZE];
+    char line[sizeof(I2C_TRACE_PREFIX) + 3 + 2 * I2C_TRACE_RECORD_SIZE + 1];
+    size_t printed = 0;
+    I2CTraceRecord record;
+    for (size_t i = 0; i < count && get(i, record); i++) {
+        encode(record, encoded);
+        char *p = line;
+        memcpy(p, I2C_TRACE_PREFIX " R ", sizeof(I2C_TRACE_PREFIX) + 2);
+        p += sizeof(I2C_TRACE_PREFIX) + 2;
+        for (size_t b = 0; b < sizeof(encoded); b++) {
+            p += I2CFormat::formatByte(encoded[b], p, HEX, false);
+        }
+        *p = '\0';
+        out.println(line);
+        printed++;
+    }
+    out.println(F(I2C_TRACE_PREFIX " E"));
+    return printed;
+};
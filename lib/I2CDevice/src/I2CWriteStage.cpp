@@ -0,0 +1,138 @@
+#include "I2CWriteStage.h"
+
+
+I2CWriteStage::I2CWriteStage(size_t size) {
+    _size = (size == 0 || size > 256) ? 256 : size;
+    _values = new uint8_t[_size];
+    memset(_values, 0, _size);
+    memset(_dirtyBits, 0, sizeof(_dirtyBits));
+    _dirty = 0;
+    _maxGap = I2C_STAGE_MAX_GAP;
+    resetStats();
+};
+
+I2CWriteStage::~I2CWriteStage() {
+    delete[] _values;
+};
+
+void I2CWriteStage::setDirty(size_t reg, bool dirty) {
+    if (isDirty(reg) == dirty) {
+        return;
+    }
+    if (dirty) {
+        _dirtyBits[reg >> 3] |= (uint8_t)(1 << (reg & 0x07));
+        _dirty++;
+    } else {
+        _dirtyBits[reg >> 3] &= (uint8_t) ~(1 << (reg & 0x07));
+        _dirty--;
+    }
+};
+
+bool I2CWriteStage::stage(uint8_t reg,
+                          const uint8_t *buf,
+                          size_t len,
+                          I2CRegisterCache *cache) {
+    if ((size_t)reg + len > _size) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        size_t r = reg + i;
+        uint8_t current;
+        _staged++;
+        if (cache != nullptr && cache->peek((uint8_t)r, current) &&
+            current == buf[i]) {
+            // the device already holds the value
+            setDirty(r, false);
+            _dropped++;
+            continue;
+        }
+        _values[r] = buf[i];
+        setDirty(r, true);
+    }
+    return true;
+};
+
+bool I2CWriteStage::covers(uint8_t reg, size_t len) {
+    if ((size_t)reg + len > _size) {
+        return false;
+    }
+    for (size_t r = reg; r < (size_t)reg + len; r++) {
+        if (!isDirty(r)) {
+            return false;
+        }
+    }
+    return true;
+};
+
+void I2CWriteStage::overlay(uint8_t reg, uint8_t *buf, size_t len) {
+    for (size_t i = 0; i < len && (size_t)reg + i < _size; i++) {
+        if (isDirty(reg + i)) {
+            buf[i] = _values[reg + i];
+        }
+    }
+};
+
+bool I2CWriteStage::nextBurst(size_t from,
+                              size_t maxLen,
+                              I2CRegisterCache *cache,
+                              uint8_t &reg,
+                              size_t &len) {
+    if (_dirty == 0 || maxLen == 0) {
+        return false;
+    }
+    size_t first = from;
+    while (first < _size && !isDirty(first)) {
+        first++;
+    }
+    if (first >= _size) {
+        return false;
+    }
+    size_t end = first + 1;
+    while (end < _size && end - first < maxLen) {
+        if (isDirty(end)) {
+            end++;
+            continue;
+        }
+        // a gap: join the next dirty register if the gap is short, the
+        // device values of the gap are known and the burst still fits
+        size_t next = end;
+        while (next < _size && next - end <= _maxGap && !isDirty(next)) {
+            next++;
+        }
+        if (next >= _size || next - end > _maxGap ||
+            next + 1 - first > maxLen) {
+            break;
+        }
+        bool known = cache != nullptr;
+        for (size_t r = end; r < next && known; r++) {
+            known = cache->peek((uint8_t)r, _values[r]);
+        }
+        if (!known) {
+            break;
+        }
+        end = next + 1;
+    }
+    reg = (uint8_t)first;
+    len = end - first;
+    return true;
+};
+
+void I2CWriteStage::written(uint8_t reg, size_t len) {
+    for (size_t r = reg; r < (size_t)reg + len && r < _size; r++) {
+        setDirty(r, false);
+    }
+    _bursts++;
+    _bytesWritten += len;
+};
+
+void I2CWriteStage::clear() {
+    memset(_dirtyBits, 0, sizeof(_dirtyBits));
+    _dirty = 0;
+};
+
+void I2CWriteStage::resetStats() {
+    _staged = 0;
+    _dropped = 0;
+    _bursts = 0;
+    _bytesWritten = 0;
+};
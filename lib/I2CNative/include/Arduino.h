@@ -0,0 +1,232 @@
+/*!
+ *  @file Arduino.h
+ *
+ *  @brief Minimal host-side stand-in for the Arduino core, used by the
+ *  PlatformIO `native` environment so that [I2CDevice] can be built and
+ *  measured on Linux without a board.
+ *
+ *  Only the subset of the Arduino API used by the I2CDevice library and
+ *  its examples is provided: integer types, [String], [Print], [Stream],
+ *  [Serial] (mapped to stdout), the timing functions and simulated GPIO
+ *  pins with edge interrupts.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_NATIVE_ARDUINO_H_
+#define I2C_NATIVE_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#ifndef ARDUINO
+#define ARDUINO 10819
+#endif
+
+/// @brief Defined when building against the host-side Arduino stand-in.
+#define I2C_NATIVE 1
+
+#define HEX 16
+#define DEC 10
+#define OCT 8
+#define BIN 2
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define OUTPUT_OPEN_DRAIN 0x12
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+/// @brief Number of simulated GPIO pins.
+#define NUM_DIGITAL_PINS 64
+
+#define digitalPinToInterrupt(p) ((p) < NUM_DIGITAL_PINS ? (p) : -1)
+
+/// @brief Places interrupt handlers in IRAM on the ESP32; nothing here.
+#define IRAM_ATTR
+
+#define F(string_literal) (string_literal)
+
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+/// @brief Milliseconds since the program started.
+unsigned long millis(void);
+
+/// @brief Microseconds since the program started.
+unsigned long micros(void);
+
+/// @brief Blocks the calling thread for [ms] milliseconds.
+void delay(unsigned long ms);
+
+/// @brief Blocks the calling thread for [us] microseconds.
+void delayMicroseconds(unsigned int us);
+
+/// @brief Pulls an [INPUT_PULLUP] pin HIGH unless a simulated device
+/// drives it; otherwise a no-op.
+void pinMode(uint8_t pin, uint8_t mode);
+
+/// @brief Sets the level of simulated pin [pin]. Simulated devices call
+/// it to drive their output lines; an edge runs the interrupt handler
+/// attached to the pin in the calling thread, as hardware would
+/// interrupt the CPU.
+void digitalWrite(uint8_t pin, uint8_t val);
+
+/// @brief Returns the level of simulated pin [pin], LOW by default.
+int digitalRead(uint8_t pin);
+
+/// @brief Runs [handler] on [mode] edges (RISING, FALLING or CHANGE) of
+/// pin [interruptNum], see [digitalPinToInterrupt].
+void attachInterrupt(uint8_t interruptNum, void (*handler)(void), int mode);
+
+/// @brief Runs [handler] with [arg] on [mode] edges of [pin], as the
+/// ESP32 core does.
+void attachInterruptArg(uint8_t pin,
+                        void (*handler)(void *),
+                        void *arg,
+                        int mode);
+
+/// @brief Removes the interrupt handler of pin [interruptNum].
+void detachInterrupt(uint8_t interruptNum);
+
+/// @brief Host-side [String] backed by [std::string].
+class String {
+public:
+
+    String(const char *cstr = "");
+    String(const String &str) = default;
+    explicit String(char c);
+    explicit String(unsigned char value, unsigned char base = DEC);
+    explicit String(int value, unsigned char base = DEC);
+    explicit String(unsigned int value, unsigned char base = DEC);
+    explicit String(long value, unsigned char base = DEC);
+    explicit String(unsigned long value, unsigned char base = DEC);
+
+    String & operator=(const String &rhs) = default;
+
+    const char * c_str() const { return _str.c_str(); }
+    unsigned int length() const { return _str.length(); }
+
+    char * begin() { return &_str[0]; }
+    char * end() { return &_str[0] + _str.length(); }
+    const char * begin() const { return _str.c_str(); }
+    const char * end() const { return _str.c_str() + _str.length(); }
+
+    char operator[](unsigned int index) const { return _str[index]; }
+
+    String & operator+=(const String &rhs) { _str += rhs._str; return *this; }
+    String & operator+=(const char *rhs) { _str += rhs; return *this; }
+    String & operator+=(char rhs) { _str += rhs; return *this; }
+
+    bool operator==(const String &rhs) const { return _str == rhs._str; }
+    bool operator==(const char *rhs) const { return _str == rhs; }
+    bool operator!=(const String &rhs) const { return _str != rhs._str; }
+
+    void toUpperCase();
+    void toLowerCase();
+
+    friend String operator+(const String &lhs, const String &rhs);
+    friend String operator+(const String &lhs, const char *rhs);
+    friend String operator+(const char *lhs, const String &rhs);
+
+private:
+
+    std::string _str;
+
+};
+
+/// @brief Host-side [Print] base class. Derived classes implement
+/// [write(uint8_t)] and optionally the buffered [write].
+class Print {
+public:
+
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str);
+    size_t write(const char *buffer, size_t size);
+
+    size_t print(const char *str);
+    size_t print(const String &str);
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(long long n, int base = DEC);
+    size_t print(unsigned long long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println(void);
+    size_t println(const char *str);
+    size_t println(const String &str);
+    size_t println(char c);
+    size_t println(unsigned char n, int base = DEC);
+    size_t println(int n, int base = DEC);
+    size_t println(unsigned int n, int base = DEC);
+    size_t println(long n, int base = DEC);
+    size_t println(unsigned long n, int base = DEC);
+    size_t println(long long n, int base = DEC);
+    size_t println(unsigned long long n, int base = DEC);
+    size_t println(double n, int digits = 2);
+
+    size_t printf(const char *format, ...)
+        __attribute__((format(printf, 2, 3)));
+
+private:
+
+    size_t printNumber(unsigned long long n, int base, bool negative);
+
+};
+
+/// @brief Host-side [Stream]: a [Print] that can also be read from.
+class Stream : public Print {
+public:
+
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+
+};
+
+/// @brief [Serial] stand-in that writes to stdout and never has input.
+class HardwareSerial : public Stream {
+public:
+
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    operator bool() const { return true; }
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override;
+
+};
+
+extern HardwareSerial Serial;
+
+#endif // I2C_NATIVE_ARDUINO_H_
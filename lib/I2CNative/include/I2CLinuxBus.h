@@ -0,0 +1,248 @@
+/*!
+ *  @file I2CLinuxBus.h
+ *
+ *  @brief An [I2CBusBackend] on a Linux i2c-dev adapter (`/dev/i2c-N`),
+ *  so drivers built on [I2CDevice] run on Linux gateways through a host
+ *  [TwoWire]:
+ *
+ *      I2CLinuxBus bus("/dev/i2c-1");
+ *      TwoWire wire(1, &bus);
+ *      I2CDevice sensor(0x39, &wire);
+ *
+ *  A combined transfer, e.g. the register write and the read of
+ *  [I2CDevice::write_then_read], is a single I2C_RDWR ioctl with one
+ *  i2c_msg per segment and repeated STARTs in between. The
+ *  [I2C_LINUX_READ_WRITE] mode issues a read() or write() per segment
+ *  instead, each ending with a STOP, as tools without I2C_RDWR do; it is
+ *  kept for comparison. Adapters that only speak SMBus, such as the
+ *  kernel's i2c-stub, are driven with I2C_SMBUS ioctls for the transfers
+ *  SMBus can express.
+ *
+ *  Linux ends every ioctl with a STOP, so a transfer ending without one
+ *  (a read split into Wire buffer sized chunks) is stopped anyway, and
+ *  the SCL frequency is set in the device tree: [setClock] only records
+ *  it. All system calls go through an [I2CDevFile], which [SimDevFile]
+ *  replaces to run against a [SimBus] without an adapter.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_LINUX_BUS_H_
+#define I2C_LINUX_BUS_H_
+
+#if defined(__linux__)
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <atomic>
+#include <string>
+#include <sys/types.h>
+#include "I2CSimBus.h"
+
+/// @brief Max number of segments of one I2C_RDWR ioctl
+/// (I2C_RDWR_IOCTL_MAX_MSGS).
+#define I2C_LINUX_MAX_MESSAGES 42
+
+/// @brief How [I2CLinuxBus] maps transfers to system calls.
+enum I2CLinuxMode {
+
+    /// @brief One I2C_RDWR ioctl per transfer.
+    I2C_LINUX_RDWR,
+
+    /// @brief One read() or write() per segment, after an I2C_SLAVE
+    /// ioctl when the address changes.
+    I2C_LINUX_READ_WRITE,
+
+    /// @brief One I2C_SMBUS ioctl per transfer: quick, byte, byte data
+    /// and I2C block transfers. Used when the adapter has no plain I2C.
+    I2C_LINUX_SMBUS
+};
+
+/// @brief The system calls [I2CLinuxBus] makes on the device file. The
+/// base class calls the kernel.
+class I2CDevFile {
+public:
+
+    virtual ~I2CDevFile() {}
+
+    /// @brief open(2).
+    virtual int open(const char *path, int flags);
+
+    /// @brief close(2).
+    virtual int close(int fd);
+
+    /// @brief ioctl(2) with a pointer or integer argument [arg].
+    virtual int ioctl(int fd, unsigned long request, void *arg);
+
+    /// @brief read(2).
+    virtual ssize_t read(int fd, void *buf, size_t len);
+
+    /// @brief write(2).
+    virtual ssize_t write(int fd, const void *buf, size_t len);
+
+};
+
+/// @brief A [TwoWire] backend on `/dev/i2c-N`.
+class I2CLinuxBus : public I2CBusBackend {
+public:
+
+    /// @brief Counters since construction or [resetStats].
+    struct Stats {
+
+        /// @brief Calls to [transfer].
+        uint32_t transfers;
+
+        /// @brief Segments transferred.
+        uint32_t messages;
+
+        /// @brief System calls made by transfers.
+        uint32_t syscalls;
+
+        /// @brief Transfers that failed.
+        uint32_t errors;
+
+    };
+
+    /// @brief Instantiates a bus on the adapter at [path], opened by
+    /// [begin].
+    /// @param path The device file, e.g. "/dev/i2c-1".
+    /// @param file The system calls to use, or nullptr for the kernel's.
+    I2CLinuxBus(const char *path, I2CDevFile *file = nullptr);
+
+    ~I2CLinuxBus();
+
+    I2CLinuxBus(const I2CLinuxBus &) = delete;
+    I2CLinuxBus & operator=(const I2CLinuxBus &) = delete;
+
+    /// @brief Opens the device file and reads the adapter's
+    /// functionality; an adapter without plain I2C is run in
+    /// [I2C_LINUX_SMBUS] mode.
+    bool begin() override;
+
+    /// @brief Closes the device file.
+    void end() override;
+
+    void setClock(uint32_t frequency) override { _frequency = frequency; }
+    uint32_t getClock() override { return _frequency; }
+
+    uint8_t transfer(I2CMessage *msgs, size_t count, bool stop) override;
+
+    /// @brief Selects how transfers map to system calls, [I2C_LINUX_RDWR]
+    /// by default. Adapters without plain I2C stay in SMBus mode.
+    void setMode(I2CLinuxMode mode);
+
+    /// @brief Returns the mode transfers are made in.
+    I2CLinuxMode mode() { return _active; }
+
+    /// @brief Returns the adapter's I2C_FUNC_* bits, 0 before [begin].
+    unsigned long functionality() { return _functionality; }
+
+    /// @brief Returns the counters.
+    Stats stats() { return _stats; }
+
+    /// @brief Zeroes the counters.
+    void resetStats();
+
+    /// @brief Returns the I2C_ERROR_* code of errno value [err]. Adapter
+    /// drivers differ: ENXIO usually means the address was not
+    /// acknowledged, EREMOTEIO a NACK in general.
+    static uint8_t resultOf(int err);
+
+private:
+
+    /// @brief Transfers [msgs] in one I2C_RDWR ioctl, or a lone empty
+    /// write as an SMBus quick write.
+    uint8_t transferRdwr(I2CMessage *msgs, size_t count);
+
+    /// @brief Transfers [msgs] with a read() or write() each.
+    uint8_t transferReadWrite(I2CMessage *msgs, size_t count);
+
+    /// @brief Transfers [msgs] in one I2C_SMBUS ioctl.
+    uint8_t transferSmbus(I2CMessage *msgs, size_t count);
+
+    /// @brief Makes [address] the target of read(), write() and
+    /// I2C_SMBUS, unless it already is.
+    uint8_t selectSlave(uint8_t address);
+
+    /// @brief Makes an I2C_SMBUS ioctl.
+    uint8_t smbus(uint8_t readWrite, uint8_t command, uint32_t size,
+                  void *data);
+
+    /// @brief The device file path.
+    std::string _path;
+
+    /// @brief The system calls.
+    I2CDevFile *_file;
+
+    /// @brief The open device file, or -1.
+    int _fd;
+
+    /// @brief The requested and the active mode.
+    I2CLinuxMode _mode;
+    I2CLinuxMode _active;
+
+    /// @brief The adapter's I2C_FUNC_* bits.
+    unsigned long _functionality;
+
+    /// @brief The address set with I2C_SLAVE, or -1.
+    int _slave;
+
+    /// @brief The recorded SCL frequency.
+    uint32_t _frequency;
+
+    /// @brief The counters.
+    Stats _stats;
+
+};
+
+/// @brief An [I2CDevFile] serving I2C_FUNCS, I2C_SLAVE, I2C_RDWR,
+/// I2C_SMBUS, read() and write() from a [SimBus], so [I2CLinuxBus] runs
+/// without an adapter. I2C_RDWR rejects messages of length 0, as many
+/// adapters do. Each call also enters the kernel once, so host
+/// timings include the cost of a system call as on a real adapter.
+class SimDevFile : public I2CDevFile {
+public:
+
+    /// @brief Instantiates a device file on [bus] whose adapter has the
+    /// I2C_FUNC_* bits [functionality]; leave out I2C_FUNC_I2C to
+    /// emulate an SMBus-only adapter such as i2c-stub.
+    SimDevFile(SimBus &bus, unsigned long functionality);
+
+    int open(const char *path, int flags) override;
+    int close(int fd) override;
+    int ioctl(int fd, unsigned long request, void *arg) override;
+    ssize_t read(int fd, void *buf, size_t len) override;
+    ssize_t write(int fd, const void *buf, size_t len) override;
+
+    /// @brief Returns the number of system calls made.
+    uint32_t syscalls() { return _syscalls; }
+
+private:
+
+    /// @brief Runs [msgs] on the bus with a STOP at the end.
+    /// @return 0, or -1 with errno set.
+    int run(I2CMessage *msgs, size_t count);
+
+    /// @brief Serves an I2C_SMBUS ioctl.
+    int smbus(void *arg);
+
+    /// @brief The bus behind the file.
+    SimBus &_bus;
+
+    /// @brief The adapter's I2C_FUNC_* bits.
+    unsigned long _functionality;
+
+    /// @brief The address set with I2C_SLAVE.
+    uint8_t _address;
+
+    /// @brief System calls made.
+    std::atomic<uint32_t> _syscalls;
+
+};
+
+#endif // __linux__
+
+#endif // I2C_LINUX_BUS_H_
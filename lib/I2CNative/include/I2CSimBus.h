@@ -0,0 +1,596 @@
+/*!
+ *  @file I2CSimBus.h
+ *
+ *  @brief Simulated I2C bus with scriptable slave devices and a bit-level
+ *  timing model, used as the [TwoWire] backend of the `native` build.
+ *
+ *  [SimBus] charges every transfer with the time it would occupy a real
+ *  bus at the configured SCL frequency: one bit time each for START,
+ *  repeated START and STOP, nine bit times per byte (eight data bits and
+ *  the ACK bit), any clock stretching by the addressed device and the
+ *  bus free time (tBUF) between a STOP and the next START. The result is
+ *  kept on a virtual clock, so bus time can be measured independently of
+ *  the speed of the host.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_SIM_BUS_H_
+#define I2C_SIM_BUS_H_
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class SimBus;
+
+/// @brief A slave device on a [SimBus]. The base class ACKs its address
+/// and every byte, ignores writes and reads back 0xFF; derived classes
+/// override the protected [on*] callbacks. Faults are scripted with
+/// [nackAddress], [nackWriteAt], [setClockStretch] and [setMaxClock].
+class SimDevice {
+public:
+
+    /// @brief Instantiates a device that responds to [address].
+    SimDevice(uint8_t address);
+
+    virtual ~SimDevice() {}
+
+    /// @brief Returns the 7-bit address of the device.
+    uint8_t address() { return _address; }
+
+    /// @brief Returns the bus the device is attached to, or nullptr.
+    SimBus * bus() { return _bus; }
+
+    /// @brief Sets whether the device responds at all.
+    void setPresent(bool present) { _present = present; }
+
+    /// @brief NACK the address byte of the next [count] segments.
+    void nackAddress(uint16_t count = 1) { _nackAddressCount = count; }
+
+    /// @brief NACK byte [index] of the next write segment. Cleared once
+    /// it fired or by [clearFaults].
+    void nackWriteAt(size_t index) { _nackWriteIndex = (int32_t)index; }
+
+    /// @brief Clears all scripted faults.
+    void clearFaults();
+
+    /// @brief Holds SCL low for [ns] nanoseconds after every byte
+    /// addressed to this device (clock stretching).
+    void setClockStretch(uint32_t ns) { _stretchNs = ns; }
+
+    /// @brief Returns the clock stretch per byte, in nanoseconds.
+    uint32_t clockStretch() { return _stretchNs; }
+
+    /// @brief Sets the highest SCL frequency the device keeps up with.
+    /// Above it the device puts its data bits on SDA a bit late, so every
+    /// byte read from it arrives shifted right by one, with a 1 in bit 7.
+    /// 0, the default, for no limit.
+    void setMaxClock(uint32_t frequency) { _maxClock = frequency; }
+
+    /// @brief Returns the highest SCL frequency, 0 for no limit.
+    uint32_t maxClock() { return _maxClock; }
+
+protected:
+
+    /// @brief Called when the device is addressed after a START or
+    /// repeated START.
+    /// @return true to ACK the address.
+    virtual bool onAddress(bool read) { (void)read; return true; }
+
+    /// @brief Called for every byte written to the device.
+    /// @param value The byte written.
+    /// @param index The offset of the byte in the current segment.
+    /// @return true to ACK the byte.
+    virtual bool onWrite(uint8_t value, size_t index) {
+        (void)value; (void)index; return true;
+    }
+
+    /// @brief Called for every byte read from the device.
+    /// @param index The offset of the byte in the current segment.
+    /// @return The byte to put on the bus.
+    virtual uint8_t onRead(size_t index) { (void)index; return 0xFF; }
+
+    /// @brief Called when a STOP ends a transfer addressed to the device.
+    virtual void onStop() {}
+
+    /// @brief Returns a device behind this one that responds to
+    /// [address], or nullptr; overridden by multiplexers.
+    virtual SimDevice * route(uint8_t address) {
+        (void)address; return nullptr;
+    }
+
+private:
+
+    friend class SimBus;
+    friend class SimMuxDevice;
+
+    /// @brief Address phase, applies scripted faults.
+    bool _addressed(bool read);
+
+    /// @brief Write byte phase, applies scripted faults.
+    bool _written(uint8_t value, size_t index);
+
+    /// @brief The 7-bit address.
+    uint8_t _address;
+
+    /// @brief The bus the device is attached to.
+    SimBus *_bus;
+
+    /// @brief False if the device is unplugged.
+    bool _present;
+
+    /// @brief Number of address phases still to NACK.
+    uint16_t _nackAddressCount;
+
+    /// @brief Index of the write byte to NACK, or -1.
+    int32_t _nackWriteIndex;
+
+    /// @brief Clock stretch per byte, in nanoseconds.
+    uint32_t _stretchNs;
+
+    /// @brief Highest SCL frequency, 0 for no limit.
+    uint32_t _maxClock;
+
+};
+
+/// @brief A device with a register file and a register pointer, as most
+/// I2C sensors have. The first byte of a write segment sets the pointer,
+/// further bytes are written to the registers; reads return registers
+/// from the pointer onwards. The pointer auto-increments unless disabled.
+class SimRegisterDevice : public SimDevice {
+public:
+
+    /// @brief Instantiates a device at [address] with [size] registers.
+    SimRegisterDevice(uint8_t address, size_t size = 256);
+
+    /// @brief Only the bits in [mask] of the first written byte select
+    /// the register; the remaining bits are command bits (e.g. 0x1F for
+    /// the APDS9930, whose commands are prefixed with 0x80 or 0xA0).
+    void setCommandMask(uint8_t mask) { _commandMask = mask; }
+
+    /// @brief Enables or disables auto-increment of the register pointer.
+    void setAutoIncrement(bool enabled) { _autoIncrement = enabled; }
+
+    /// @brief Returns the number of registers.
+    size_t size() { return _registers.size(); }
+
+    /// @brief Returns register [reg] without touching the bus.
+    uint8_t peek(size_t reg) { return _registers[reg % _registers.size()]; }
+
+    /// @brief Sets register [reg] without touching the bus.
+    void poke(size_t reg, uint8_t value) {
+        _registers[reg % _registers.size()] = value;
+    }
+
+    /// @brief Returns the current register pointer.
+    size_t pointer() { return _pointer; }
+
+    /// @brief Copies [len] bytes from [buf] to the registers from [reg]
+    /// under the bus lock, so a thread simulating the sensor can update
+    /// them while another thread reads the bus. Must not be called from
+    /// inside a transfer.
+    void load(size_t reg, const uint8_t *buf, size_t len);
+
+    /// @brief Connects the device's interrupt output to simulated pin
+    /// [pin], active LOW (open drain) unless [activeLow] is false, and
+    /// drives it inactive. Edges run the pin's interrupt handler with the
+    /// bus locked, so like a real ISR it must not touch the bus.
+    void setInterruptPin(uint8_t pin, bool activeLow = true);
+
+    /// @brief Sets the bits in [mask] of status register [reg] when an
+    /// interrupt is raised, e.g. AVALID of the APDS9930 STATUS register.
+    void setInterruptStatus(uint8_t reg, uint8_t mask) {
+        _statusReg = reg;
+        _statusMask = mask;
+    }
+
+    /// @brief A write whose first byte is [command] clears the interrupt:
+    /// the status bits are cleared and the pin is released, e.g. 0xE7 for
+    /// the APDS9930 special function "clear all interrupts".
+    void setInterruptClear(uint8_t command) {
+        _clearCommand = command;
+        _hasClearCommand = true;
+    }
+
+    /// @brief Sets the status bits and asserts the interrupt pin, from
+    /// the thread simulating the sensor. No new edge is produced while the
+    /// interrupt is still pending. Must not be called from inside a
+    /// transfer.
+    void raiseInterrupt();
+
+    /// @brief Returns true while the interrupt is asserted.
+    bool interruptPending() { return _interruptPending; }
+
+protected:
+
+    bool onWrite(uint8_t value, size_t index) override;
+    uint8_t onRead(size_t index) override;
+
+    /// @brief Clears the status bits and releases the interrupt pin.
+    void clearInterrupt();
+
+    /// @brief Advances the register pointer after an access.
+    void advance();
+
+    /// @brief The register file.
+    std::vector<uint8_t> _registers;
+
+    /// @brief The register pointer.
+    size_t _pointer;
+
+    /// @brief Register select bits of the first written byte.
+    uint8_t _commandMask;
+
+    /// @brief True if the pointer auto-increments.
+    bool _autoIncrement;
+
+    /// @brief The interrupt pin, or -1 if not connected.
+    int _interruptPin;
+
+    /// @brief True if the interrupt pin is active LOW.
+    bool _activeLow;
+
+    /// @brief Status register and bits set by [raiseInterrupt].
+    uint8_t _statusReg;
+    uint8_t _statusMask;
+
+    /// @brief The command clearing the interrupt.
+    uint8_t _clearCommand;
+    bool _hasClearCommand;
+
+    /// @brief True while the interrupt is asserted.
+    std::atomic<bool> _interruptPending;
+
+};
+
+/// @brief A serial EEPROM such as the 24LC256: a memory address of
+/// [addressBytes] bytes (MSB first) starts every write, data written
+/// wraps inside the current page, and a STOP after data bytes starts a
+/// write cycle during which the device NACKs its address. Reads are
+/// sequential and wrap at the end of the memory.
+class SimEepromDevice : public SimDevice {
+public:
+
+    /// @brief Instantiates an EEPROM at [address] with [size] bytes in
+    /// pages of [pageSize] bytes.
+    SimEepromDevice(uint8_t address,
+                    size_t size = 32768,
+                    size_t pageSize = 64,
+                    uint8_t addressBytes = 2);
+
+    /// @brief Sets the duration of the internal write cycle (tWR), in
+    /// nanoseconds of virtual bus time.
+    void setWriteCycle(uint64_t ns) { _writeCycleNs = ns; }
+
+    /// @brief Returns true while a write cycle is in progress.
+    bool busy();
+
+    /// @brief Returns the number of write cycles since construction.
+    uint32_t writeCycles() { return _writeCycles; }
+
+    /// @brief Returns byte [address] without touching the bus.
+    uint8_t peek(size_t address) { return _memory[address % _memory.size()]; }
+
+    /// @brief Sets byte [address] without touching the bus.
+    void poke(size_t address, uint8_t value) {
+        _memory[address % _memory.size()] = value;
+    }
+
+protected:
+
+    bool onAddress(bool read) override;
+    bool onWrite(uint8_t value, size_t index) override;
+    uint8_t onRead(size_t index) override;
+    void onStop() override;
+
+    /// @brief The memory.
+    std::vector<uint8_t> _memory;
+
+    /// @brief Page size in bytes.
+    size_t _pageSize;
+
+    /// @brief Number of memory address bytes.
+    uint8_t _addressBytes;
+
+    /// @brief The memory address pointer.
+    size_t _pointer;
+
+    /// @brief Data bytes written since the address phase.
+    size_t _dataBytes;
+
+    /// @brief Duration of a write cycle, in nanoseconds.
+    uint64_t _writeCycleNs;
+
+    /// @brief Virtual time the current write cycle ends.
+    uint64_t _busyUntil;
+
+    /// @brief Number of write cycles.
+    uint32_t _writeCycles;
+
+};
+
+/// @brief A sensor with an on-chip FIFO, such as an IMU. Reading the
+/// data register pops bytes off the FIFO without advancing the register
+/// pointer; the two count registers from the count register hold the
+/// fill level in frames, little-endian, with bit 14 set once frames were
+/// lost to a full FIFO. Reading the high count byte clears that flag.
+/// Other registers behave as for [SimRegisterDevice].
+class SimFifoDevice : public SimRegisterDevice {
+public:
+
+    /// @brief Instantiates a sensor at [address] whose FIFO holds
+    /// [depth] frames of [frameSize] bytes.
+    SimFifoDevice(uint8_t address, uint8_t countReg, uint8_t dataReg,
+                  uint8_t frameSize, size_t depth);
+
+    /// @brief Queues the frame [frame] as the sensor would on a new
+    /// sample, under the bus lock; when the FIFO is full the frame is
+    /// dropped and the overflow flag set. Must not be called from inside
+    /// a transfer.
+    void push(const uint8_t *frame);
+
+    /// @brief Returns the number of frames in the FIFO.
+    size_t level();
+
+    /// @brief Returns the number of frames dropped by a full FIFO.
+    uint32_t lost() { return _lost; }
+
+protected:
+
+    uint8_t onRead(size_t index) override;
+
+    /// @brief The FIFO contents.
+    std::deque<uint8_t> _fifo;
+
+    /// @brief The count and data registers.
+    uint8_t _countReg;
+    uint8_t _dataReg;
+
+    /// @brief Bytes per frame.
+    uint8_t _frameSize;
+
+    /// @brief Capacity of the FIFO in frames.
+    size_t _depth;
+
+    /// @brief True once a frame was dropped, until the count is read.
+    bool _overflow;
+
+    /// @brief Frames dropped.
+    uint32_t _lost;
+
+};
+
+/// @brief Number of channels of a [SimMuxDevice].
+#define SIM_MUX_CHANNELS 8
+
+/// @brief An 8-channel multiplexer such as the TCA9548A: a byte written
+/// to it enables the channels whose bits are set, a read returns them.
+/// The devices attached to a channel are on the bus while it is enabled,
+/// so identical addresses can sit behind different channels.
+class SimMuxDevice : public SimDevice {
+public:
+
+    /// @brief Instantiates a multiplexer at [address] with all channels
+    /// disabled, as after power-on.
+    SimMuxDevice(uint8_t address = 0x70);
+
+    /// @brief Puts [device] behind [channel]. Attach the multiplexer to
+    /// its bus first; must not be called from inside a transfer.
+    void attach(uint8_t channel, SimDevice *device);
+
+    /// @brief Returns the enabled channels, bit n for channel n.
+    uint8_t channels() { return _mask; }
+
+    /// @brief Returns the number of control register writes.
+    uint32_t selects() { return _selects; }
+
+protected:
+
+    bool onWrite(uint8_t value, size_t index) override;
+    uint8_t onRead(size_t index) override;
+    SimDevice * route(uint8_t address) override;
+
+    /// @brief The devices behind each channel.
+    std::vector<SimDevice *> _channels[SIM_MUX_CHANNELS];
+
+    /// @brief The control register.
+    uint8_t _mask;
+
+    /// @brief Control register writes.
+    uint32_t _selects;
+
+};
+
+/// @brief A simulated bus with a bit-level timing model. Implements
+/// [I2CBusBackend] so a [TwoWire] can be attached to it.
+class SimBus : public I2CBusBackend {
+public:
+
+    /// @brief Cumulative counters since construction or [resetStats].
+    struct Stats {
+
+        /// @brief Calls to [transfer].
+        uint32_t transfers;
+
+        /// @brief START conditions.
+        uint32_t starts;
+
+        /// @brief Repeated START conditions.
+        uint32_t repeatedStarts;
+
+        /// @brief STOP conditions.
+        uint32_t stops;
+
+        /// @brief Address bytes that were not acknowledged.
+        uint32_t addressNacks;
+
+        /// @brief Data bytes that were not acknowledged.
+        uint32_t dataNacks;
+
+        /// @brief Address bytes put on the bus.
+        uint32_t addressBytes;
+
+        /// @brief Data bytes written to devices.
+        uint32_t bytesWritten;
+
+        /// @brief Data bytes read from devices.
+        uint32_t bytesRead;
+
+        /// @brief Virtual time the bus was busy, in nanoseconds.
+        uint64_t busTimeNs;
+
+        /// @brief Part of [busTimeNs] spent on START, repeated START,
+        /// address, STOP and tBUF, i.e. not moving data bytes.
+        uint64_t overheadNs;
+
+        /// @brief Part of [busTimeNs] spent on clock stretching.
+        uint64_t stretchNs;
+
+        /// @brief Transfers that timed out because SDA was held low.
+        uint32_t stalls;
+
+        /// @brief Address bytes more than one device responded to, e.g.
+        /// identical sensors behind two multiplexers with channels
+        /// enabled at the same time.
+        uint32_t collisions;
+
+    };
+
+    /// @brief Instantiates a bus running at [frequency] Hz.
+    SimBus(uint32_t frequency = 100000);
+
+    /// @brief Attaches [device] to the bus. Devices are not owned.
+    void attach(SimDevice *device);
+
+    /// @brief Detaches [device] from the bus.
+    void detach(SimDevice *device);
+
+    /// @brief Returns the device at [address], or nullptr.
+    SimDevice * device(uint8_t address);
+
+    void setClock(uint32_t frequency) override;
+    uint32_t getClock() override { return _frequency; }
+
+    uint8_t transfer(I2CMessage *msgs, size_t count, bool stop) override;
+
+    /// @brief Sets how long a transfer waits on a stuck bus before it
+    /// fails with I2C_ERROR_TIMEOUT, 50 ms by default.
+    void setTimeout(uint16_t ms) override { _timeoutNs = ms * 1000000ULL; }
+
+    /// @brief Connects the bus lines to simulated pins [sda] and [scl],
+    /// so a bus clear bit-banging them with [digitalWrite] reaches the
+    /// devices, and releases SDA.
+    void setPins(uint8_t sda, uint8_t scl);
+
+    /// @brief Makes a device hold SDA low, as a slave reset in the middle
+    /// of sending a byte does, until [clocks] SCL pulses were generated on
+    /// the SCL pin. Until then every transfer times out.
+    void holdSda(uint16_t clocks);
+
+    /// @brief Returns true while SDA is held low.
+    bool sdaHeld() { return _sdaHeld > 0; }
+
+    /// @brief Returns the current virtual time, in nanoseconds.
+    uint64_t now() { return _now; }
+
+    /// @brief Advances the virtual clock by [ns] with the bus idle.
+    void idle(uint64_t ns) { _now += ns; }
+
+    /// @brief Returns the counters.
+    Stats stats();
+
+    /// @brief Locks the bus against transfers from other threads, e.g.
+    /// while a device's registers are updated. Not recursive; must not be
+    /// called from inside a transfer.
+    void lock() { _mutex.lock(); }
+
+    /// @brief Unlocks the bus locked with [lock].
+    void unlock() { _mutex.unlock(); }
+
+    /// @brief Zeroes the counters. The virtual clock keeps running.
+    void resetStats();
+
+    /// @brief Returns the bus time of the last [transfer], in
+    /// nanoseconds.
+    uint64_t lastTransferNs() { return _lastTransferNs; }
+
+    /// @brief If enabled, [transfer] also sleeps for the modelled bus
+    /// time so wall-clock measurements include it.
+    void setRealtime(bool enabled) { _realtime = enabled; }
+
+    /// @brief Returns the duration of one SCL period at [frequency] Hz,
+    /// in nanoseconds.
+    static uint32_t bitTimeNs(uint32_t frequency);
+
+    /// @brief Returns the minimum bus free time between a STOP and a
+    /// START (tBUF) at [frequency] Hz, in nanoseconds.
+    static uint32_t busFreeTimeNs(uint32_t frequency);
+
+private:
+
+    /// @brief Returns the first device, direct or behind an enabled
+    /// multiplexer channel, that responds to [address], and in
+    /// [matches] how many do.
+    SimDevice * find(uint8_t address, uint8_t *matches);
+
+    /// @brief Charges [ns] of bus time, of which [overhead] is overhead.
+    void charge(uint64_t ns, bool overhead);
+
+    /// @brief Ends the transfer with a STOP.
+    void stopCondition(SimDevice *device);
+
+    /// @brief Rising edge handler of the SCL pin.
+    static void onSclRising(void *bus);
+
+    /// @brief Serialises access from several threads.
+    std::mutex _mutex;
+
+    /// @brief The attached devices.
+    std::vector<SimDevice *> _devices;
+
+    /// @brief SCL frequency in Hz.
+    std::atomic<uint32_t> _frequency;
+
+    /// @brief The virtual clock, in nanoseconds.
+    std::atomic<uint64_t> _now;
+
+    /// @brief Virtual time of the last STOP.
+    uint64_t _lastStop;
+
+    /// @brief True while a transfer ended without STOP holds the bus.
+    bool _held;
+
+    /// @brief The counters.
+    Stats _stats;
+
+    /// @brief Bus time of the last transfer.
+    std::atomic<uint64_t> _lastTransferNs;
+
+    /// @brief Sleep for the modelled bus time.
+    bool _realtime;
+
+    /// @brief Time a transfer waits on a stuck bus.
+    uint64_t _timeoutNs;
+
+    /// @brief The SDA pin, or -1 if not connected.
+    int _sdaPin;
+
+    /// @brief SCL pulses until SDA is released, 0 if it is not held.
+    std::atomic<uint16_t> _sdaHeld;
+
+};
+
+/// @brief The simulated bus behind [Wire].
+extern SimBus WireBus;
+
+/// @brief The simulated bus behind [Wire1].
+extern SimBus Wire1Bus;
+
+#endif // I2C_SIM_BUS_H_
@@ -0,0 +1,196 @@
+/*!
+ *  @file Wire.h
+ *
+ *  @brief Host-side stand-in for the Arduino [TwoWire] class, used by the
+ *  PlatformIO `native` environment.
+ *
+ *  The API and return codes follow the ESP32 Arduino core. Transactions
+ *  are collected as a list of [I2CMessage] segments and handed to an
+ *  [I2CBusBackend] when a STOP is due, so a write followed by a read with
+ *  a repeated START reaches the backend as one combined transfer. By
+ *  default [Wire] and [Wire1] are attached to the simulated buses
+ *  [WireBus] and [Wire1Bus] declared in I2CSimBus.h.
+ *
+ *  @section license License
+ *
+ *  Copyright (c) 2024, GM Consolidated Holdings Pty Ltd, all rights
+ *  reserved. This library is open-source under the BSD 3-Clause license.
+ */
+
+#ifndef I2C_NATIVE_WIRE_H_
+#define I2C_NATIVE_WIRE_H_
+
+#include <Arduino.h>
+
+#ifndef I2C_BUFFER_LENGTH
+/// @brief Size of the transmit and receive buffers, as on the ESP32.
+#define I2C_BUFFER_LENGTH 128
+#endif
+
+/// @brief Max number of segments in a single combined transfer.
+#define I2C_MAX_MESSAGES 4
+
+/// @brief [endTransmission] and [I2CBusBackend::transfer] result codes.
+#define I2C_ERROR_OK 0
+#define I2C_ERROR_DATA_TOO_LONG 1
+#define I2C_ERROR_ADDR_NACK 2
+#define I2C_ERROR_DATA_NACK 3
+#define I2C_ERROR_OTHER 4
+#define I2C_ERROR_TIMEOUT 5
+
+/// @brief One segment of a combined transfer: a START (or repeated
+/// START), the address byte and [length] bytes in direction [read].
+struct I2CMessage {
+
+    /// @brief The 7-bit device address.
+    uint8_t address;
+
+    /// @brief True for a read segment, false for a write segment.
+    bool read;
+
+    /// @brief The bytes to write, or the buffer to read into.
+    uint8_t *buffer;
+
+    /// @brief The number of bytes to write or read. The backend sets it
+    /// to the number of bytes actually transferred.
+    size_t length;
+
+};
+
+/// @brief The physical (or simulated) bus behind a host [TwoWire].
+class I2CBusBackend {
+public:
+
+    virtual ~I2CBusBackend() {}
+
+    /// @brief Called from [TwoWire::begin].
+    /// @return true if the bus is usable.
+    virtual bool begin() { return true; }
+
+    /// @brief Called from [TwoWire::end].
+    virtual void end() {}
+
+    /// @brief Sets the SCL frequency in Hz.
+    virtual void setClock(uint32_t frequency) = 0;
+
+    /// @brief Returns the SCL frequency in Hz.
+    virtual uint32_t getClock() = 0;
+
+    /// @brief Sets how long a transfer may wait on a stuck bus, in
+    /// milliseconds.
+    virtual void setTimeout(uint16_t ms) { (void)ms; }
+
+    /// @brief Executes [count] segments as one combined transfer, with a
+    /// repeated START between segments.
+    /// @param msgs The segments to transfer.
+    /// @param count The number of segments in [msgs].
+    /// @param stop Whether to send a STOP after the last segment.
+    /// @return One of the I2C_ERROR_* codes.
+    virtual uint8_t transfer(I2CMessage *msgs, size_t count, bool stop) = 0;
+
+};
+
+/// @brief Host-side [TwoWire] with the ESP32 Arduino core's API.
+class TwoWire : public Stream {
+public:
+
+    /// @brief Instantiates a [TwoWire] for bus [busNum] that talks to
+    /// [backend].
+    TwoWire(uint8_t busNum, I2CBusBackend *backend = nullptr);
+
+    /// @brief Attaches the bus to a different [backend].
+    void setBackend(I2CBusBackend *backend) { _backend = backend; }
+
+    /// @brief Returns the backend the bus is attached to.
+    I2CBusBackend * backend() { return _backend; }
+
+    /// @brief Returns the bus number.
+    uint8_t busNum() { return _busNum; }
+
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    bool end();
+
+    bool setClock(uint32_t frequency);
+    uint32_t getClock();
+
+    void setTimeOut(uint16_t timeOutMillis);
+    uint16_t getTimeOut() { return _timeOutMillis; }
+
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address);
+
+    uint8_t endTransmission(bool sendStop);
+    uint8_t endTransmission(void);
+
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, uint8_t sendStop);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity);
+    uint8_t requestFrom(int address, int quantity);
+    uint8_t requestFrom(int address, int quantity, int sendStop);
+
+    /// @brief Writes [isize] bytes of [iaddress], MSB first, then reads
+    /// [quantity] bytes with a repeated START, as one combined transfer
+    /// (the AVR core's internal-address variant). [isize] is clamped to 3,
+    /// as on AVR.
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, uint32_t iaddress,
+                        uint8_t isize, uint8_t sendStop);
+
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *data, size_t quantity) override;
+    using Print::write;
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+
+private:
+
+    /// @brief The bus number.
+    uint8_t _busNum;
+
+    /// @brief The bus behind this instance.
+    I2CBusBackend *_backend;
+
+    /// @brief True between [begin] and [end].
+    bool _begun;
+
+    /// @brief Transfer timeout in milliseconds.
+    uint16_t _timeOutMillis;
+
+    /// @brief Address of the transmission in progress.
+    uint8_t _txAddress;
+
+    /// @brief Bytes queued by [write] since [beginTransmission].
+    uint8_t _txBuffer[I2C_BUFFER_LENGTH];
+
+    /// @brief Number of bytes in [_txBuffer].
+    size_t _txLength;
+
+    /// @brief True between [beginTransmission] and [endTransmission].
+    bool _transmitting;
+
+    /// @brief Write segment held back by [endTransmission(false)] until
+    /// the following [requestFrom], as the ESP32 core does.
+    uint8_t _pendingBuffer[I2C_BUFFER_LENGTH];
+
+    /// @brief The held back write segment, valid if [_pending].
+    I2CMessage _pendingMsg;
+
+    /// @brief True if a write segment is waiting for a repeated START.
+    bool _pending;
+
+    /// @brief Bytes received by the last [requestFrom].
+    uint8_t _rxBuffer[I2C_BUFFER_LENGTH];
+
+    /// @brief Number of bytes in [_rxBuffer].
+    size_t _rxLength;
+
+    /// @brief Read position in [_rxBuffer].
+    size_t _rxIndex;
+
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
+
+#endif // I2C_NATIVE_WIRE_H_
@@ -0,0 +1,328 @@
+#include "Arduino.h"
+#include <algorithm>
+#include <cctype>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+
+HardwareSerial Serial;
+
+static const std::chrono::steady_clock::time_point _startTime =
+    std::chrono::steady_clock::now();
+
+unsigned long millis(void) {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - _startTime).count();
+};
+
+unsigned long micros(void) {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - _startTime).count();
+};
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+};
+
+void delayMicroseconds(unsigned int us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+};
+
+/// @brief Levels of the simulated pins.
+static std::atomic<uint8_t> _pinLevels[NUM_DIGITAL_PINS];
+
+/// @brief True for pins a simulated device has driven.
+static std::atomic<bool> _pinDriven[NUM_DIGITAL_PINS];
+
+/// @brief An interrupt handler attached to a pin.
+struct PinInterrupt {
+    void (*handler)(void);
+    void (*handlerArg)(void *);
+    void *arg;
+    int mode;
+};
+
+/// @brief Handlers by pin, guarded by [_pinMutex].
+static PinInterrupt _pinInterrupts[NUM_DIGITAL_PINS];
+
+/// @brief Serialises pin writes and changes to the handlers.
+static std::mutex _pinMutex;
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    // a pull-up does not override a device driving the line
+    if (pin < NUM_DIGITAL_PINS && mode == INPUT_PULLUP && !_pinDriven[pin]) {
+        _pinLevels[pin] = HIGH;
+    }
+};
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    if (pin >= NUM_DIGITAL_PINS) {
+        return;
+    }
+    PinInterrupt isr;
+    {
+        std::lock_guard<std::mutex> lock(_pinMutex);
+        _pinDriven[pin] = true;
+        uint8_t level = val ? HIGH : LOW;
+        uint8_t previous = _pinLevels[pin].exchange(level);
+        if (previous == level) {
+            return;
+        }
+        isr = _pinInterrupts[pin];
+        int edge = level == HIGH ? RISING : FALLING;
+        if ((isr.mode & edge) == 0) {
+            return;
+        }
+    }
+    // the handler runs outside the lock, so it may touch pins itself
+    if (isr.handlerArg != nullptr) {
+        isr.handlerArg(isr.arg);
+    } else if (isr.handler != nullptr) {
+        isr.handler();
+    }
+};
+
+int digitalRead(uint8_t pin) {
+    return pin < NUM_DIGITAL_PINS ? _pinLevels[pin].load() : LOW;
+};
+
+void attachInterrupt(uint8_t interruptNum, void (*handler)(void), int mode) {
+    if (interruptNum >= NUM_DIGITAL_PINS) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_pinMutex);
+    _pinInterrupts[interruptNum] = {handler, nullptr, nullptr, mode};
+};
+
+void attachInterruptArg(uint8_t pin,
+                        void (*handler)(void *),
+                        void *arg,
+                        int mode) {
+    if (pin >= NUM_DIGITAL_PINS) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_pinMutex);
+    _pinInterrupts[pin] = {nullptr, handler, arg, mode};
+};
+
+void detachInterrupt(uint8_t interruptNum) {
+    if (interruptNum >= NUM_DIGITAL_PINS) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_pinMutex);
+    _pinInterrupts[interruptNum] = {nullptr, nullptr, nullptr, 0};
+};
+
+/// @brief Formats [value] in [base] without leading zeros, as the
+/// Arduino core does.
+static std::string _toBase(unsigned long long value, unsigned char base) {
+    if (base < 2 || base > 36) {
+        base = DEC;
+    }
+    char buf[8 * sizeof(value) + 1];
+    char *p = &buf[sizeof(buf) - 1];
+    *p = '\0';
+    do {
+        uint8_t digit = value % base;
+        *--p = digit < 10 ? '0' + digit : 'a' + digit - 10;
+        value /= base;
+    } while (value);
+    return std::string(p);
+};
+
+/// @brief Signed values are only rendered with a sign in decimal; other
+/// bases show the two's complement bit pattern of the value's own width.
+static std::string _toBase(long long value, unsigned char base,
+                           unsigned long long mask) {
+    if (base == DEC && value < 0) {
+        return "-" + _toBase((unsigned long long)(-value), base);
+    }
+    return _toBase((unsigned long long)value & mask, base);
+};
+
+String::String(const char *cstr) : _str(cstr ? cstr : "") {};
+
+String::String(char c) : _str(1, c) {};
+
+String::String(unsigned char value, unsigned char base)
+    : _str(_toBase((unsigned long long)value, base)) {};
+
+String::String(int value, unsigned char base)
+    : _str(_toBase((long long)value, base, 0xFFFFFFFFULL)) {};
+
+String::String(unsigned int value, unsigned char base)
+    : _str(_toBase((unsigned long long)value, base)) {};
+
+String::String(long value, unsigned char base)
+    : _str(_toBase((long long)value, base, ~0ULL >> (64 - 8 * sizeof(long)))) {};
+
+String::String(unsigned long value, unsigned char base)
+    : _str(_toBase((unsigned long long)value, base)) {};
+
+void String::toUpperCase() {
+    std::transform(_str.begin(), _str.end(), _str.begin(), ::toupper);
+};
+
+void String::toLowerCase() {
+    std::transform(_str.begin(), _str.end(), _str.begin(), ::tolower);
+};
+
+String operator+(const String &lhs, const String &rhs) {
+    String result(lhs);
+    result += rhs;
+    return result;
+};
+
+String operator+(const String &lhs, const char *rhs) {
+    String result(lhs);
+    result += rhs;
+    return result;
+};
+
+String operator+(const char *lhs, const String &rhs) {
+    String result(lhs);
+    result += rhs;
+    return result;
+};
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        if (write(*buffer++)) {
+            n++;
+        } else {
+            break;
+        }
+    }
+    return n;
+};
+
+size_t Print::write(const char *str) {
+    if (str == nullptr) {
+        return 0;
+    }
+    return write((const uint8_t *)str, strlen(str));
+};
+
+size_t Print::write(const char *buffer, size_t size) {
+    return write((const uint8_t *)buffer, size);
+};
+
+size_t Print::printNumber(unsigned long long n, int base, bool negative) {
+    std::string str = _toBase(n, (unsigned char)base);
+    if (negative) {
+        str.insert(str.begin(), '-');
+    }
+    return write(str.c_str(), str.length());
+};
+
+size_t Print::print(const char *str) { return write(str); };
+
+size_t Print::print(const String &str) {
+    return write(str.c_str(), str.length());
+};
+
+size_t Print::print(char c) { return write((uint8_t)c); };
+
+size_t Print::print(unsigned char n, int base) {
+    return printNumber(n, base, false);
+};
+
+size_t Print::print(int n, int base) { return print((long long)n, base); };
+
+size_t Print::print(unsigned int n, int base) {
+    return printNumber(n, base, false);
+};
+
+size_t Print::print(long n, int base) { return print((long long)n, base); };
+
+size_t Print::print(unsigned long n, int base) {
+    return printNumber(n, base, false);
+};
+
+size_t Print::print(long long n, int base) {
+    if (base == DEC && n < 0) {
+        return printNumber((unsigned long long)(-n), base, true);
+    }
+    return printNumber((unsigned long long)n, base, false);
+};
+
+size_t Print::print(unsigned long long n, int base) {
+    return printNumber(n, base, false);
+};
+
+size_t Print::print(double n, int digits) {
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf, len < 0 ? 0 : (size_t)len);
+};
+
+size_t Print::println(void) { return write("\r\n"); };
+
+size_t Print::println(const char *str) { return print(str) + println(); };
+
+size_t Print::println(const String &str) { return print(str) + println(); };
+
+size_t Print::println(char c) { return print(c) + println(); };
+
+size_t Print::println(unsigned char n, int base) {
+    return print(n, base) + println();
+};
+
+size_t Print::println(int n, int base) { return print(n, base) + println(); };
+
+size_t Print::println(unsigned int n, int base) {
+    return print(n, base) + println();
+};
+
+size_t Print::println(long n, int base) { return print(n, base) + println(); };
+
+size_t Print::println(unsigned long n, int base) {
+    return print(n, base) + println();
+};
+
+size_t Print::println(long long n, int base) {
+    return print(n, base) + println();
+};
+
+size_t Print::println(unsigned long long n, int base) {
+    return print(n, base) + println();
+};
+
+size_t Print::println(double n, int digits) {
+    return print(n, digits) + println();
+};
+
+size_t Print::printf(const char *format, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) {
+        return 0;
+    }
+    if ((size_t)len < sizeof(buf)) {
+        return write(buf, len);
+    }
+    // too large for the stack buffer, format again into the heap
+    std::string str(len + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&str[0], str.size(), format, args);
+    va_end(args);
+    return write(str.c_str(), len);
+};
+
+size_t HardwareSerial::write(uint8_t c) {
+    return fputc(c, stdout) == EOF ? 0 : 1;
+};
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    return fwrite(buffer, 1, size, stdout);
+};
+
+void HardwareSerial::flush() {
+    fflush(stdout);
+};
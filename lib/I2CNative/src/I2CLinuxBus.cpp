@@ -0,0 +1,445 @@
+#include "I2CLinuxBus.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+
+int I2CDevFile::open(const char *path, int flags) {
+    return ::open(path, flags);
+};
+
+int I2CDevFile::close(int fd) {
+    return ::close(fd);
+};
+
+int I2CDevFile::ioctl(int fd, unsigned long request, void *arg) {
+    return ::ioctl(fd, request, arg);
+};
+
+ssize_t I2CDevFile::read(int fd, void *buf, size_t len) {
+    return ::read(fd, buf, len);
+};
+
+ssize_t I2CDevFile::write(int fd, const void *buf, size_t len) {
+    return ::write(fd, buf, len);
+};
+
+/// @brief The system calls of buses created without an [I2CDevFile].
+static I2CDevFile kernelFile;
+
+I2CLinuxBus::I2CLinuxBus(const char *path, I2CDevFile *file)
+    : _path(path) {
+    _file = file != nullptr ? file : &kernelFile;
+    _fd = -1;
+    _mode = I2C_LINUX_RDWR;
+    _active = I2C_LINUX_RDWR;
+    _functionality = 0;
+    _slave = -1;
+    _frequency = 100000;
+    resetStats();
+};
+
+I2CLinuxBus::~I2CLinuxBus() {
+    end();
+};
+
+bool I2CLinuxBus::begin() {
+    if (_fd >= 0) {
+        return true;
+    }
+    _fd = _file->open(_path.c_str(), O_RDWR);
+    if (_fd < 0) {
+        return false;
+    }
+    unsigned long funcs = 0;
+    if (_file->ioctl(_fd, I2C_FUNCS, &funcs) < 0) {
+        // old adapters without I2C_FUNCS speak plain I2C
+        funcs = I2C_FUNC_I2C;
+    }
+    _functionality = funcs;
+    _slave = -1;
+    setMode(_mode);
+    return true;
+};
+
+void I2CLinuxBus::end() {
+    if (_fd >= 0) {
+        _file->close(_fd);
+        _fd = -1;
+    }
+};
+
+void I2CLinuxBus::setMode(I2CLinuxMode mode) {
+    _mode = mode;
+    _active = _fd >= 0 && (_functionality & I2C_FUNC_I2C) == 0
+        ? I2C_LINUX_SMBUS : mode;
+};
+
+void I2CLinuxBus::resetStats() {
+    memset(&_stats, 0, sizeof(_stats));
+};
+
+uint8_t I2CLinuxBus::resultOf(int err) {
+    switch (err) {
+        case ENXIO:
+            return I2C_ERROR_ADDR_NACK;
+        case EREMOTEIO:
+            return I2C_ERROR_DATA_NACK;
+        case ETIMEDOUT:
+            return I2C_ERROR_TIMEOUT;
+        case EMSGSIZE:
+            return I2C_ERROR_DATA_TOO_LONG;
+    }
+    return I2C_ERROR_OTHER;
+};
+
+uint8_t I2CLinuxBus::transfer(I2CMessage *msgs, size_t count, bool stop) {
+    // every system call ends with a STOP, held or not
+    (void)stop;
+    if (_fd < 0 || count == 0) {
+        return I2C_ERROR_OTHER;
+    }
+    _stats.transfers++;
+    _stats.messages += count;
+    uint8_t result;
+    switch (_active) {
+        case I2C_LINUX_READ_WRITE:
+            result = transferReadWrite(msgs, count);
+            break;
+        case I2C_LINUX_SMBUS:
+            result = transferSmbus(msgs, count);
+            break;
+        default:
+            result = transferRdwr(msgs, count);
+            break;
+    }
+    if (result != I2C_ERROR_OK) {
+        _stats.errors++;
+        for (size_t i = 0; i < count; i++) {
+            if (msgs[i].read) {
+                msgs[i].length = 0;
+            }
+        }
+    }
+    return result;
+};
+
+uint8_t I2CLinuxBus::transferRdwr(I2CMessage *msgs, size_t count) {
+    if (count > I2C_LINUX_MAX_MESSAGES) {
+        return I2C_ERROR_OTHER;
+    }
+    // adapters reject a message of length 0, so an address-only write,
+    // as presence checks and scans make, goes out as an SMBus quick
+    // write, as i2cdetect does
+    if (count == 1 && !msgs[0].read && msgs[0].length == 0 &&
+        (_functionality & I2C_FUNC_SMBUS_QUICK) != 0) {
+        uint8_t result = selectSlave(msgs[0].address);
+        if (result != I2C_ERROR_OK) {
+            return result;
+        }
+        return smbus(I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, nullptr);
+    }
+    struct i2c_msg segments[I2C_LINUX_MAX_MESSAGES];
+    for (size_t i = 0; i < count; i++) {
+        segments[i].addr = msgs[i].address;
+        segments[i].flags = msgs[i].read ? I2C_M_RD : 0;
+        segments[i].len = (__u16)msgs[i].length;
+        segments[i].buf = msgs[i].buffer;
+    }
+    struct i2c_rdwr_ioctl_data data = {segments, (__u32)count};
+    _stats.syscalls++;
+    if (_file->ioctl(_fd, I2C_RDWR, &data) < 0) {
+        return resultOf(errno);
+    }
+    return I2C_ERROR_OK;
+};
+
+uint8_t I2CLinuxBus::selectSlave(uint8_t address) {
+    if (_slave == address) {
+        return I2C_ERROR_OK;
+    }
+    _stats.syscalls++;
+    if (_file->ioctl(_fd, I2C_SLAVE, (void *)(uintptr_t)address) < 0) {
+        _slave = -1;
+        return resultOf(errno);
+    }
+    _slave = address;
+    return I2C_ERROR_OK;
+};
+
+uint8_t I2CLinuxBus::transferReadWrite(I2CMessage *msgs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        I2CMessage &msg = msgs[i];
+        uint8_t result = selectSlave(msg.address);
+        if (result != I2C_ERROR_OK) {
+            return result;
+        }
+        _stats.syscalls++;
+        ssize_t n = msg.read ? _file->read(_fd, msg.buffer, msg.length)
+                             : _file->write(_fd, msg.buffer, msg.length);
+        if (n < 0) {
+            return resultOf(errno);
+        }
+        msg.length = (size_t)n;
+    }
+    return I2C_ERROR_OK;
+};
+
+uint8_t I2CLinuxBus::smbus(uint8_t readWrite, uint8_t command,
+                           uint32_t size, void *data) {
+    struct i2c_smbus_ioctl_data args;
+    args.read_write = readWrite;
+    args.command = command;
+    args.size = size;
+    args.data = (union i2c_smbus_data *)data;
+    _stats.syscalls++;
+    if (_file->ioctl(_fd, I2C_SMBUS, &args) < 0) {
+        return resultOf(errno);
+    }
+    return I2C_ERROR_OK;
+};
+
+uint8_t I2CLinuxBus::transferSmbus(I2CMessage *msgs, size_t count) {
+    uint8_t result = selectSlave(msgs[0].address);
+    if (result != I2C_ERROR_OK) {
+        return result;
+    }
+    union i2c_smbus_data data;
+    I2CMessage &first = msgs[0];
+    if (count == 1 && !first.read) {
+        size_t len = first.length;
+        if (len == 0) {
+            return smbus(I2C_SMBUS_WRITE, 0, I2C_SMBUS_QUICK, nullptr);
+        }
+        if (len == 1) {
+            return smbus(I2C_SMBUS_WRITE, first.buffer[0], I2C_SMBUS_BYTE,
+                         nullptr);
+        }
+        if (len == 2) {
+            data.byte = first.buffer[1];
+            return smbus(I2C_SMBUS_WRITE, first.buffer[0],
+                         I2C_SMBUS_BYTE_DATA, &data);
+        }
+        if (len - 1 > I2C_SMBUS_BLOCK_MAX) {
+            return I2C_ERROR_DATA_TOO_LONG;
+        }
+        data.block[0] = (uint8_t)(len - 1);
+        memcpy(data.block + 1, first.buffer + 1, len - 1);
+        return smbus(I2C_SMBUS_WRITE, first.buffer[0],
+                     I2C_SMBUS_I2C_BLOCK_DATA, &data);
+    }
+    if (count == 1 && first.length == 1) {
+        result = smbus(I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &data);
+        first.buffer[0] = data.byte;
+        return result;
+    }
+    // a register read: one command byte, then up to a block of data
+    if (count != 2 || first.read || first.length != 1 || !msgs[1].read ||
+        msgs[1].address != first.address || msgs[1].length == 0 ||
+        msgs[1].length > I2C_SMBUS_BLOCK_MAX) {
+        return I2C_ERROR_OTHER;
+    }
+    I2CMessage &second = msgs[1];
+    if (second.length == 1) {
+        result = smbus(I2C_SMBUS_READ, first.buffer[0], I2C_SMBUS_BYTE_DATA,
+                       &data);
+        second.buffer[0] = data.byte;
+        return result;
+    }
+    data.block[0] = (uint8_t)second.length;
+    result = smbus(I2C_SMBUS_READ, first.buffer[0], I2C_SMBUS_I2C_BLOCK_DATA,
+                   &data);
+    if (result == I2C_ERROR_OK) {
+        second.length = data.block[0] < second.length ? data.block[0]
+                                                       : second.length;
+        memcpy(second.buffer, data.block + 1, second.length);
+    }
+    return result;
+};
+
+/// @brief The errno value of I2C_ERROR_* code [result].
+static int errnoOf(uint8_t result) {
+    switch (result) {
+        case I2C_ERROR_ADDR_NACK:
+            return ENXIO;
+        case I2C_ERROR_DATA_NACK:
+            return EREMOTEIO;
+        case I2C_ERROR_TIMEOUT:
+            return ETIMEDOUT;
+    }
+    return EIO;
+}
+
+/// @brief Enters the kernel once, as the system call a [SimDevFile] call
+/// stands in for would; getppid() is never answered by the C library.
+static void enterKernel() {
+    getppid();
+}
+
+SimDevFile::SimDevFile(SimBus &bus, unsigned long functionality)
+    : _bus(bus) {
+    _functionality = functionality;
+    _address = 0;
+    _syscalls = 0;
+};
+
+int SimDevFile::open(const char *path, int flags) {
+    (void)path;
+    (void)flags;
+    _syscalls++;
+    // a real descriptor, so the file is closed like one
+    return ::open("/dev/null", O_RDWR);
+};
+
+int SimDevFile::close(int fd) {
+    _syscalls++;
+    return ::close(fd);
+};
+
+int SimDevFile::run(I2CMessage *msgs, size_t count) {
+    uint8_t result = _bus.transfer(msgs, count, true);
+    if (result != I2C_ERROR_OK) {
+        errno = errnoOf(result);
+        return -1;
+    }
+    return 0;
+};
+
+int SimDevFile::ioctl(int fd, unsigned long request, void *arg) {
+    (void)fd;
+    _syscalls++;
+    enterKernel();
+    switch (request) {
+        case I2C_FUNCS:
+            *(unsigned long *)arg = _functionality;
+            return 0;
+        case I2C_SLAVE:
+        case I2C_SLAVE_FORCE:
+            _address = (uint8_t)(uintptr_t)arg;
+            return 0;
+        case I2C_RDWR: {
+            if ((_functionality & I2C_FUNC_I2C) == 0) {
+                errno = EOPNOTSUPP;
+                return -1;
+            }
+            struct i2c_rdwr_ioctl_data *data =
+                (struct i2c_rdwr_ioctl_data *)arg;
+            if (data->nmsgs == 0 || data->nmsgs > I2C_LINUX_MAX_MESSAGES) {
+                errno = EINVAL;
+                return -1;
+            }
+            I2CMessage msgs[I2C_LINUX_MAX_MESSAGES];
+            for (__u32 i = 0; i < data->nmsgs; i++) {
+                // as adapters with the I2C_AQ_NO_ZERO_LEN quirk
+                if (data->msgs[i].len == 0) {
+                    errno = EOPNOTSUPP;
+                    return -1;
+                }
+                msgs[i].address = (uint8_t)data->msgs[i].addr;
+                msgs[i].read = (data->msgs[i].flags & I2C_M_RD) != 0;
+                msgs[i].buffer = data->msgs[i].buf;
+                msgs[i].length = data->msgs[i].len;
+            }
+            return run(msgs, data->nmsgs) < 0 ? -1 : (int)data->nmsgs;
+        }
+        case I2C_SMBUS:
+            return smbus(arg);
+    }
+    errno = ENOTTY;
+    return -1;
+};
+
+int SimDevFile::smbus(void *arg) {
+    struct i2c_smbus_ioctl_data *args = (struct i2c_smbus_ioctl_data *)arg;
+    union i2c_smbus_data *data = args->data;
+    bool read = args->read_write == I2C_SMBUS_READ;
+    uint8_t command[1 + I2C_SMBUS_BLOCK_MAX] = {args->command};
+    I2CMessage msgs[2];
+    msgs[0] = {_address, false, command, 1};
+    msgs[1] = {_address, true, nullptr, 0};
+    switch (args->size) {
+        case I2C_SMBUS_QUICK:
+            msgs[0].read = read;
+            msgs[0].length = 0;
+            return run(msgs, 1);
+        case I2C_SMBUS_BYTE:
+            if (read) {
+                msgs[0].read = true;
+                msgs[0].buffer = &data->byte;
+            }
+            return run(msgs, 1);
+        case I2C_SMBUS_BYTE_DATA:
+        case I2C_SMBUS_WORD_DATA: {
+            size_t len = args->size == I2C_SMBUS_BYTE_DATA ? 1 : 2;
+            uint8_t value[2] = {(uint8_t)data->word, (uint8_t)(data->word >> 8)};
+            if (len == 1) {
+                value[0] = data->byte;
+            }
+            if (!read) {
+                memcpy(command + 1, value, len);
+                msgs[0].length = 1 + len;
+                return run(msgs, 1);
+            }
+            msgs[1].buffer = value;
+            msgs[1].length = len;
+            if (run(msgs, 2) < 0) {
+                return -1;
+            }
+            if (len == 1) {
+                data->byte = value[0];
+            } else {
+                data->word = value[0] | (value[1] << 8);
+            }
+            return 0;
+        }
+        case I2C_SMBUS_I2C_BLOCK_DATA: {
+            size_t len = data->block[0];
+            if (len == 0 || len > I2C_SMBUS_BLOCK_MAX) {
+                errno = EINVAL;
+                return -1;
+            }
+            if (!read) {
+                memcpy(command + 1, data->block + 1, len);
+                msgs[0].length = 1 + len;
+                return run(msgs, 1);
+            }
+            msgs[1].buffer = data->block + 1;
+            msgs[1].length = len;
+            return run(msgs, 2);
+        }
+    }
+    errno = EOPNOTSUPP;
+    return -1;
+};
+
+ssize_t SimDevFile::read(int fd, void *buf, size_t len) {
+    (void)fd;
+    _syscalls++;
+    enterKernel();
+    if ((_functionality & I2C_FUNC_I2C) == 0) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    I2CMessage msg = {_address, true, (uint8_t *)buf, len};
+    return run(&msg, 1) < 0 ? -1 : (ssize_t)msg.length;
+};
+
+ssize_t SimDevFile::write(int fd, const void *buf, size_t len) {
+    (void)fd;
+    _syscalls++;
+    enterKernel();
+    if ((_functionality & I2C_FUNC_I2C) == 0) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    I2CMessage msg = {_address, false, (uint8_t *)buf, len};
+    return run(&msg, 1) < 0 ? -1 : (ssize_t)msg.length;
+};
+
+#endif // __linux__
@@ -0,0 +1,538 @@
+#include "I2CSimBus.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+
+SimBus WireBus;
+SimBus Wire1Bus;
+
+SimDevice::SimDevice(uint8_t address) {
+    _address = address;
+    _bus = nullptr;
+    _present = true;
+    _nackAddressCount = 0;
+    _nackWriteIndex = -1;
+    _stretchNs = 0;
+    _maxClock = 0;
+};
+
+void SimDevice::clearFaults() {
+    _nackAddressCount = 0;
+    _nackWriteIndex = -1;
+};
+
+bool SimDevice::_addressed(bool read) {
+    if (!_present) {
+        return false;
+    }
+    if (_nackAddressCount > 0) {
+        _nackAddressCount--;
+        return false;
+    }
+    return onAddress(read);
+};
+
+bool SimDevice::_written(uint8_t value, size_t index) {
+    if (_nackWriteIndex >= 0 && (size_t)_nackWriteIndex == index) {
+        _nackWriteIndex = -1;
+        return false;
+    }
+    return onWrite(value, index);
+};
+
+SimRegisterDevice::SimRegisterDevice(uint8_t address, size_t size)
+    : SimDevice(address), _registers(size ? size : 1, 0) {
+    _pointer = 0;
+    _commandMask = 0xFF;
+    _autoIncrement = true;
+    _interruptPin = -1;
+    _activeLow = true;
+    _statusReg = 0;
+    _statusMask = 0;
+    _clearCommand = 0;
+    _hasClearCommand = false;
+    _interruptPending = false;
+};
+
+void SimRegisterDevice::load(size_t reg, const uint8_t *buf, size_t len) {
+    SimBus *owner = bus();
+    if (owner != nullptr) {
+        owner->lock();
+    }
+    for (size_t i = 0; i < len; i++) {
+        _registers[(reg + i) % _registers.size()] = buf[i];
+    }
+    if (owner != nullptr) {
+        owner->unlock();
+    }
+};
+
+void SimRegisterDevice::setInterruptPin(uint8_t pin, bool activeLow) {
+    _interruptPin = pin;
+    _activeLow = activeLow;
+    _interruptPending = false;
+    digitalWrite(pin, activeLow ? HIGH : LOW);
+};
+
+void SimRegisterDevice::raiseInterrupt() {
+    SimBus *owner = bus();
+    if (owner != nullptr) {
+        owner->lock();
+    }
+    _registers[_statusReg % _registers.size()] |= _statusMask;
+    _interruptPending = true;
+    // under the bus lock, so a clear cannot slip in between
+    if (_interruptPin >= 0) {
+        digitalWrite(_interruptPin, _activeLow ? LOW : HIGH);
+    }
+    if (owner != nullptr) {
+        owner->unlock();
+    }
+};
+
+void SimRegisterDevice::clearInterrupt() {
+    _registers[_statusReg % _registers.size()] &= (uint8_t)~_statusMask;
+    _interruptPending = false;
+    if (_interruptPin >= 0) {
+        digitalWrite(_interruptPin, _activeLow ? HIGH : LOW);
+    }
+};
+
+bool SimRegisterDevice::onWrite(uint8_t value, size_t index) {
+    if (index == 0 && _hasClearCommand && value == _clearCommand) {
+        clearInterrupt();
+        return true;
+    }
+    if (index == 0) {
+        _pointer = (value & _commandMask) % _registers.size();
+        return true;
+    }
+    _registers[_pointer] = value;
+    advance();
+    return true;
+};
+
+uint8_t SimRegisterDevice::onRead(size_t index) {
+    (void)index;
+    uint8_t value = _registers[_pointer];
+    advance();
+    return value;
+};
+
+void SimRegisterDevice::advance() {
+    if (_autoIncrement) {
+        _pointer = (_pointer + 1) % _registers.size();
+    }
+};
+
+SimEepromDevice::SimEepromDevice(uint8_t address,
+                                 size_t size,
+                                 size_t pageSize,
+                                 uint8_t addressBytes)
+    : SimDevice(address), _memory(size ? size : 1, 0xFF) {
+    _pageSize = pageSize ? pageSize : 1;
+    _addressBytes = addressBytes;
+    _pointer = 0;
+    _dataBytes = 0;
+    // typical tWR of a 24LC256, the datasheet maximum is 5 ms
+    _writeCycleNs = 2500000;
+    _busyUntil = 0;
+    _writeCycles = 0;
+};
+
+bool SimEepromDevice::busy() {
+    return bus() != nullptr && bus()->now() < _busyUntil;
+};
+
+bool SimEepromDevice::onAddress(bool read) {
+    (void)read;
+    if (busy()) {
+        // no ACK during the write cycle
+        return false;
+    }
+    _dataBytes = 0;
+    return true;
+};
+
+bool SimEepromDevice::onWrite(uint8_t value, size_t index) {
+    if (index < _addressBytes) {
+        _pointer = index == 0 ? value : (_pointer << 8) | value;
+        _pointer %= _memory.size();
+        return true;
+    }
+    _memory[_pointer] = value;
+    _dataBytes++;
+    // the address counter rolls over inside the page
+    size_t page = _pointer - _pointer % _pageSize;
+    _pointer = page + (_pointer + 1 - page) % _pageSize;
+    return true;
+};
+
+uint8_t SimEepromDevice::onRead(size_t index) {
+    (void)index;
+    uint8_t value = _memory[_pointer];
+    _pointer = (_pointer + 1) % _memory.size();
+    return value;
+};
+
+void SimEepromDevice::onStop() {
+    if (_dataBytes > 0 && bus() != nullptr) {
+        _busyUntil = bus()->now() + _writeCycleNs;
+        _writeCycles++;
+        _dataBytes = 0;
+    }
+};
+
+SimFifoDevice::SimFifoDevice(uint8_t address, uint8_t countReg,
+                             uint8_t dataReg, uint8_t frameSize,
+                             size_t depth)
+    : SimRegisterDevice(address) {
+    _countReg = countReg;
+    _dataReg = dataReg;
+    _frameSize = frameSize ? frameSize : 1;
+    _depth = depth;
+    _overflow = false;
+    _lost = 0;
+};
+
+void SimFifoDevice::push(const uint8_t *frame) {
+    SimBus *owner = bus();
+    if (owner != nullptr) {
+        owner->lock();
+    }
+    if (_fifo.size() + _frameSize > _depth * _frameSize) {
+        _overflow = true;
+        _lost++;
+    } else {
+        _fifo.insert(_fifo.end(), frame, frame + _frameSize);
+    }
+    if (owner != nullptr) {
+        owner->unlock();
+    }
+};
+
+size_t SimFifoDevice::level() {
+    SimBus *owner = bus();
+    if (owner != nullptr) {
+        owner->lock();
+    }
+    size_t frames = _fifo.size() / _frameSize;
+    if (owner != nullptr) {
+        owner->unlock();
+    }
+    return frames;
+};
+
+uint8_t SimFifoDevice::onRead(size_t index) {
+    if (_pointer == _dataReg) {
+        // the FIFO port: pops a byte, the pointer stays
+        if (_fifo.empty()) {
+            return 0x00;
+        }
+        uint8_t value = _fifo.front();
+        _fifo.pop_front();
+        return value;
+    }
+    // whole frames only, a frame being read does not count
+    uint16_t count = (uint16_t)(_fifo.size() / _frameSize);
+    if (_pointer == _countReg) {
+        advance();
+        return (uint8_t)count;
+    }
+    if (_pointer == (size_t)_countReg + 1) {
+        uint8_t value = (uint8_t)(((count >> 8) & 0x3F) |
+                                  (_overflow ? 0x40 : 0x00));
+        _overflow = false;
+        advance();
+        return value;
+    }
+    return SimRegisterDevice::onRead(index);
+};
+
+SimMuxDevice::SimMuxDevice(uint8_t address) : SimDevice(address) {
+    _mask = 0;
+    _selects = 0;
+};
+
+void SimMuxDevice::attach(uint8_t channel, SimDevice *device) {
+    if (channel >= SIM_MUX_CHANNELS) {
+        return;
+    }
+    SimBus *owner = bus();
+    if (owner != nullptr) {
+        owner->lock();
+    }
+    _channels[channel].push_back(device);
+    device->_bus = owner;
+    if (owner != nullptr) {
+        owner->unlock();
+    }
+};
+
+bool SimMuxDevice::onWrite(uint8_t value, size_t index) {
+    (void)index;
+    _mask = value;
+    _selects++;
+    return true;
+};
+
+uint8_t SimMuxDevice::onRead(size_t index) {
+    (void)index;
+    return _mask;
+};
+
+SimDevice * SimMuxDevice::route(uint8_t address) {
+    for (uint8_t channel = 0; channel < SIM_MUX_CHANNELS; channel++) {
+        if (!(_mask & (1 << channel))) {
+            continue;
+        }
+        for (SimDevice *device : _channels[channel]) {
+            if (!device->_present) {
+                continue;
+            }
+            if (device->_address == address) {
+                return device;
+            }
+            SimDevice *behind = device->route(address);
+            if (behind != nullptr) {
+                return behind;
+            }
+        }
+    }
+    return nullptr;
+};
+
+SimBus::SimBus(uint32_t frequency) {
+    _frequency = frequency;
+    _now = 0;
+    _lastStop = 0;
+    _held = false;
+    _lastTransferNs = 0;
+    _realtime = false;
+    _timeoutNs = 50000000ULL;
+    _sdaPin = -1;
+    _sdaHeld = 0;
+    memset(&_stats, 0, sizeof(_stats));
+};
+
+void SimBus::setPins(uint8_t sda, uint8_t scl) {
+    _sdaPin = sda;
+    digitalWrite(sda, _sdaHeld > 0 ? LOW : HIGH);
+    digitalWrite(scl, HIGH);
+    attachInterruptArg(scl, onSclRising, this, RISING);
+};
+
+void SimBus::holdSda(uint16_t clocks) {
+    _sdaHeld = clocks;
+    if (_sdaPin >= 0) {
+        digitalWrite(_sdaPin, clocks > 0 ? LOW : HIGH);
+    }
+};
+
+void SimBus::onSclRising(void *arg) {
+    SimBus *bus = (SimBus *)arg;
+    uint16_t held = bus->_sdaHeld;
+    while (held > 0 &&
+           !bus->_sdaHeld.compare_exchange_weak(held, held - 1)) {
+    }
+    if (held == 1 && bus->_sdaPin >= 0) {
+        digitalWrite(bus->_sdaPin, HIGH);
+    }
+};
+
+void SimBus::attach(SimDevice *device) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (std::find(_devices.begin(), _devices.end(), device) == _devices.end()) {
+        _devices.push_back(device);
+        device->_bus = this;
+    }
+};
+
+void SimBus::detach(SimDevice *device) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _devices.erase(std::remove(_devices.begin(), _devices.end(), device),
+                   _devices.end());
+    device->_bus = nullptr;
+};
+
+SimDevice * SimBus::device(uint8_t address) {
+    return find(address, nullptr);
+};
+
+SimDevice * SimBus::find(uint8_t address, uint8_t *matches) {
+    SimDevice *found = nullptr;
+    uint8_t count = 0;
+    for (SimDevice *device : _devices) {
+        if (!device->_present) {
+            continue;
+        }
+        SimDevice *match = device->_address == address
+            ? device : device->route(address);
+        if (match == nullptr) {
+            continue;
+        }
+        if (found == nullptr) {
+            found = match;
+        }
+        count++;
+    }
+    if (matches != nullptr) {
+        *matches = count;
+    }
+    return found;
+};
+
+void SimBus::setClock(uint32_t frequency) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _frequency = frequency ? frequency : 100000;
+};
+
+uint32_t SimBus::bitTimeNs(uint32_t frequency) {
+    if (frequency == 0) {
+        frequency = 100000;
+    }
+    return (uint32_t)((1000000000ULL + frequency / 2) / frequency);
+};
+
+uint32_t SimBus::busFreeTimeNs(uint32_t frequency) {
+    // tBUF from the I2C-bus specification (UM10204, table 10)
+    if (frequency <= 100000) {
+        return 4700;
+    } else if (frequency <= 400000) {
+        return 1300;
+    }
+    return 500;
+};
+
+void SimBus::charge(uint64_t ns, bool overhead) {
+    _now += ns;
+    _stats.busTimeNs += ns;
+    if (overhead) {
+        _stats.overheadNs += ns;
+    }
+};
+
+void SimBus::stopCondition(SimDevice *device) {
+    charge(bitTimeNs(_frequency), true);
+    _stats.stops++;
+    _lastStop = _now;
+    _held = false;
+    if (device != nullptr) {
+        device->onStop();
+    }
+};
+
+uint8_t SimBus::transfer(I2CMessage *msgs, size_t count, bool stop) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const uint64_t bit = bitTimeNs(_frequency);
+    const uint64_t byteTime = 9 * bit;
+    const uint64_t begin = _now;
+    uint8_t result = I2C_ERROR_OK;
+    SimDevice *current = nullptr;
+    _stats.transfers++;
+    if (_sdaHeld > 0) {
+        // no START can be generated; the master waits for its timeout
+        // and abandons the transfer
+        _stats.stalls++;
+        charge(_timeoutNs, true);
+        for (size_t i = 0; i < count; i++) {
+            msgs[i].length = 0;
+        }
+        _held = false;
+        _lastTransferNs = _now - begin;
+        if (_realtime) {
+            std::this_thread::sleep_for(
+                std::chrono::nanoseconds(_lastTransferNs.load()));
+        }
+        return I2C_ERROR_TIMEOUT;
+    }
+    for (size_t i = 0; i < count; i++) {
+        I2CMessage &msg = msgs[i];
+        if (i == 0 && !_held) {
+            // respect the bus free time since the last STOP
+            uint64_t tBuf = busFreeTimeNs(_frequency);
+            if ((_now - _lastStop) < tBuf) {
+                charge(tBuf - (_now - _lastStop), true);
+            }
+            _stats.starts++;
+        } else {
+            _stats.repeatedStarts++;
+        }
+        charge(bit, true);
+        // address byte and ACK bit
+        _stats.addressBytes++;
+        charge(byteTime, true);
+        uint8_t matches;
+        SimDevice *next = find(msg.address, &matches);
+        if (matches > 1) {
+            _stats.collisions++;
+        }
+        if (next != nullptr && current != nullptr && next != current) {
+            current->onStop();
+        }
+        current = next;
+        if (current == nullptr || !current->_addressed(msg.read)) {
+            _stats.addressNacks++;
+            result = I2C_ERROR_ADDR_NACK;
+            for (size_t j = i; j < count; j++) {
+                msgs[j].length = 0;
+            }
+            break;
+        }
+        if (current->_stretchNs) {
+            charge(current->_stretchNs, false);
+            _stats.stretchNs += current->_stretchNs;
+        }
+        for (size_t j = 0; j < msg.length; j++) {
+            if (msg.read) {
+                msg.buffer[j] = current->onRead(j);
+                if (current->_maxClock != 0 &&
+                    _frequency > current->_maxClock) {
+                    msg.buffer[j] = (msg.buffer[j] >> 1) | 0x80;
+                }
+                _stats.bytesRead++;
+            } else {
+                _stats.bytesWritten++;
+            }
+            charge(byteTime, false);
+            if (current->_stretchNs) {
+                charge(current->_stretchNs, false);
+                _stats.stretchNs += current->_stretchNs;
+            }
+            if (!msg.read && !current->_written(msg.buffer[j], j)) {
+                _stats.dataNacks++;
+                result = I2C_ERROR_DATA_NACK;
+                msg.length = j;
+                break;
+            }
+        }
+        if (result != I2C_ERROR_OK) {
+            for (size_t j = i + 1; j < count; j++) {
+                msgs[j].length = 0;
+            }
+            break;
+        }
+    }
+    // a NACK always ends the transfer with a STOP
+    if (stop || result != I2C_ERROR_OK) {
+        stopCondition(current);
+    } else {
+        _held = true;
+    }
+    _lastTransferNs = _now - begin;
+    if (_realtime) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(_lastTransferNs.load()));
+    }
+    return result;
+};
+
+SimBus::Stats SimBus::stats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+};
+
+void SimBus::resetStats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    memset(&_stats, 0, sizeof(_stats));
+};
@@ -0,0 +1,199 @@
+#include "Wire.h"
+#include "I2CSimBus.h"
+
+
+TwoWire Wire(0, &WireBus);
+TwoWire Wire1(1, &Wire1Bus);
+
+TwoWire::TwoWire(uint8_t busNum, I2CBusBackend *backend) {
+    _busNum = busNum;
+    _backend = backend;
+    _begun = false;
+    _timeOutMillis = 50;
+    _txAddress = 0;
+    _txLength = 0;
+    _transmitting = false;
+    _pending = false;
+    _rxLength = 0;
+    _rxIndex = 0;
+};
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+    (void)sda;
+    (void)scl;
+    if (_backend == nullptr || !_backend->begin()) {
+        return false;
+    }
+    if (frequency != 0) {
+        _backend->setClock(frequency);
+    }
+    _backend->setTimeout(_timeOutMillis);
+    _begun = true;
+    return true;
+};
+
+bool TwoWire::end() {
+    if (_backend != nullptr) {
+        _backend->end();
+    }
+    _begun = false;
+    _pending = false;
+    return true;
+};
+
+bool TwoWire::setClock(uint32_t frequency) {
+    if (_backend == nullptr) {
+        return false;
+    }
+    _backend->setClock(frequency);
+    return true;
+};
+
+uint32_t TwoWire::getClock() {
+    return _backend == nullptr ? 0 : _backend->getClock();
+};
+
+void TwoWire::setTimeOut(uint16_t timeOutMillis) {
+    _timeOutMillis = timeOutMillis;
+    if (_backend != nullptr) {
+        _backend->setTimeout(timeOutMillis);
+    }
+};
+
+void TwoWire::beginTransmission(uint8_t address) {
+    _txAddress = address;
+    _txLength = 0;
+    _transmitting = true;
+};
+
+void TwoWire::beginTransmission(int address) {
+    beginTransmission((uint8_t)address);
+};
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    if (!_transmitting || _backend == nullptr) {
+        return I2C_ERROR_OTHER;
+    }
+    _transmitting = false;
+    uint8_t result = I2C_ERROR_OK;
+    if (_pending) {
+        // two writes in a row without STOP, flush the first one
+        _pending = false;
+        result = _backend->transfer(&_pendingMsg, 1, false);
+        if (result != I2C_ERROR_OK) {
+            return result;
+        }
+    }
+    memcpy(_pendingBuffer, _txBuffer, _txLength);
+    _pendingMsg.address = _txAddress;
+    _pendingMsg.read = false;
+    _pendingMsg.buffer = _pendingBuffer;
+    _pendingMsg.length = _txLength;
+    if (!sendStop) {
+        // held back until the repeated START of the next segment
+        _pending = true;
+        return I2C_ERROR_OK;
+    }
+    return _backend->transfer(&_pendingMsg, 1, true);
+};
+
+uint8_t TwoWire::endTransmission(void) {
+    return endTransmission(true);
+};
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity,
+                             uint8_t sendStop) {
+    _rxLength = 0;
+    _rxIndex = 0;
+    if (_backend == nullptr) {
+        _pending = false;
+        return 0;
+    }
+    if (quantity > I2C_BUFFER_LENGTH) {
+        quantity = I2C_BUFFER_LENGTH;
+    }
+    I2CMessage msgs[2];
+    size_t count = 0;
+    if (_pending) {
+        msgs[count++] = _pendingMsg;
+        _pending = false;
+    }
+    I2CMessage &msg = msgs[count++];
+    msg.address = address;
+    msg.read = true;
+    msg.buffer = _rxBuffer;
+    msg.length = quantity;
+    if (_backend->transfer(msgs, count, sendStop != 0) != I2C_ERROR_OK) {
+        return 0;
+    }
+    _rxLength = msg.length;
+    return (uint8_t)_rxLength;
+};
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) {
+    return requestFrom(address, quantity, (uint8_t) true);
+};
+
+uint8_t TwoWire::requestFrom(int address, int quantity) {
+    return requestFrom((uint8_t)address, (uint8_t)quantity, (uint8_t) true);
+};
+
+uint8_t TwoWire::requestFrom(int address, int quantity, int sendStop) {
+    return requestFrom((uint8_t)address, (uint8_t)quantity, (uint8_t)sendStop);
+};
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity,
+                             uint32_t iaddress, uint8_t isize,
+                             uint8_t sendStop) {
+    // as the AVR core, which drops the bytes above the third
+    if (isize > 3) {
+        isize = 3;
+    }
+    beginTransmission(address);
+    while (isize-- > 0) {
+        write((uint8_t)(iaddress >> (isize * 8)));
+    }
+    endTransmission(false);
+    return requestFrom(address, quantity, sendStop);
+};
+
+size_t TwoWire::write(uint8_t data) {
+    if (!_transmitting || _txLength >= I2C_BUFFER_LENGTH) {
+        return 0;
+    }
+    _txBuffer[_txLength++] = data;
+    return 1;
+};
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity) {
+    for (size_t i = 0; i < quantity; i++) {
+        if (!write(data[i])) {
+            return i;
+        }
+    }
+    return quantity;
+};
+
+int TwoWire::available() {
+    return (int)(_rxLength - _rxIndex);
+};
+
+int TwoWire::read() {
+    if (_rxIndex >= _rxLength) {
+        return -1;
+    }
+    return _rxBuffer[_rxIndex++];
+};
+
+int TwoWire::peek() {
+    if (_rxIndex >= _rxLength) {
+        return -1;
+    }
+    return _rxBuffer[_rxIndex];
+};
+
+void TwoWire::flush() {
+    _rxLength = 0;
+    _rxIndex = 0;
+    _txLength = 0;
+};
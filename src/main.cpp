@@ -85,7 +85,7 @@ void powerUp(){
 void printReg0x12(){ 
   byte regValues[1];  
   byte pref[1] = {ID_REG_ADDR | READ_CMD};   
-  i2c.write_then_read(pref, 1, regValues, 1, true);
+  i2c.write_then_read(pref, 1, regValues, 1);
   Serial.printf("Returned 0X%02X from register 0X%02X (ID)\n",
      regValues[0], ID_REG_ADDR);
 
@@ -94,14 +94,6 @@ void printReg0x12(){
 void printRegisters(){  
   byte regValues[REG_COUNT];  
   byte pref[1] = {READ_CMD};   
-  i2c.write_then_read(pref, 1, regValues, REG_COUNT, true); 
-  Serial.println("___________________________________");    
-  Serial.println("REGISTER                    VALUE");
-  Serial.println("-----------------------------------");
-  for (uint8_t i = 0; i < REG_COUNT; i++){      
-      Serial.printf( " %s              %s (%s)\n", 
-          I2CDevice::getByteString(i, HEX), 
-          I2CDevice::getByteString(regValues[i], BIN), 
-          I2CDevice::getByteString(regValues[i], HEX));  
-  }
+  i2c.write_then_read(pref, 1, regValues, REG_COUNT); 
+  I2CFormat::printRegisters(Serial, regValues, REG_COUNT);
 }
@@ -0,0 +1,1185 @@
+
+// Throughput and latency benchmarks for the I2CDevice transaction
+// primitives, run against the simulated bus. Every series prints one JSON
+// object per line so results can be diffed between releases:
+//
+//   .pio/build/native/program bench [iterations] > bench.jsonl
+//
+// Bus figures come from the SimBus timing model (virtual time a real bus
+// would be busy); library figures are host time per call minus the host
+// time spent inside the simulated backend.
+
+#include "bench.h"
+#include <I2CSimBus.h>
+#include <I2CChannel.h>
+#include <I2CDevice.h>
+#include <I2CMux.h>
+#if defined(__linux__)
+#include <I2CLinuxBus.h>
+#include <linux/i2c.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+#include <thread>
+
+#define BENCH_ADDR 0x40
+#define BENCH_EEPROM_ADDR 0x50
+
+/// @brief Registers in the formatting benchmark's dump, as the examples.
+#define FORMAT_REG_COUNT 32
+
+/// @brief Size of the simulated datalog flush, in bytes.
+#define EEPROM_FLUSH_LEN 4096
+
+/// @brief Worst-case write cycle of a 24LC256, what a fixed delay waits.
+#define EEPROM_TWR_MAX_NS 5000000
+#define BENCH_ITERATIONS 2000
+
+/// @brief Register block read by the i2c-dev benchmark, the largest an
+/// SMBus I2C block read moves.
+#define LINUX_BLOCK_LEN 16
+
+/// @brief First register of the CRC protected words, and their number:
+/// an SCD4x measurement (CO2, temperature, humidity), above the
+/// registers the write series reach.
+#define CRC_WORDS_REG 0xE0
+#define CRC_WORDS 3
+
+/// @brief Checks per timed sample of the CRC series.
+#define CRC_REPEATS 100
+
+/// @brief Samples per decode batch, 128 frames of a three-axis FIFO,
+/// and batches per timed sample.
+#define DECODE_SAMPLES 384
+#define DECODE_REPEATS 10
+
+/// @brief Multiplexers, sensors behind each and registers read per
+/// sensor in the multiplexer benchmark.
+#define MUX_COUNT 2
+#define MUX_SENSORS 8
+#define MUX_REGS 2
+
+/// @brief Frames queued per round of the FIFO benchmark, bytes per
+/// frame, and frames of the ring they are drained into.
+#define FIFO_FRAMES 96
+#define FIFO_FRAME_SIZE 6
+#define FIFO_RING 128
+
+/// @brief Capacity of the channels in the channel benchmark.
+#define CHANNEL_CAPACITY 64
+
+/// @brief One primitive under test: performs a single call moving [len]
+/// payload bytes and returns the result of the call.
+typedef std::function<bool(I2CDevice &, uint8_t *, size_t)> BenchOp;
+
+struct BenchCase {
+    const char *name;
+    BenchOp op;
+    /// @brief Payload size of a primitive that does not sweep sizes, or 0.
+    size_t fixedLen;
+    bool cached;
+    /// @brief Whether the device locks the bus through an arbiter.
+    bool arbitrated;
+    /// @brief Whether the device records its transfers in an [I2CTrace].
+    bool traced;
+    /// @brief Whether the device has its own clock, equal to the bus
+    /// clock, so every call checks it without switching.
+    bool clocked;
+};
+
+/// @brief The registers an APDS9930-style driver polls every cycle:
+/// enable, timing, interrupt thresholds, config, control, ID, status and
+/// the ALS and proximity data.
+static const uint8_t scatteredRegs[] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x0D, 0x0F, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19};
+
+#define SCATTERED_COUNT sizeof(scatteredRegs)
+
+/// @brief A little-endian 16-bit register and a field of a
+/// configuration register, for the typed accessor series.
+typedef I2CRegister<0x10, uint16_t, I2C_RW, I2C_LITTLE_ENDIAN> BenchWord;
+typedef I2CRegister<0x12, uint8_t> BenchConfig;
+typedef I2CField<BenchConfig, 2, 3> BenchGain;
+
+/// @brief Destination of the planned scattered reads.
+static uint8_t scatteredValues[SCATTERED_COUNT];
+
+/// @brief The Sensirion CRC-8 as drivers compute it without a table,
+/// one shift-and-XOR step per bit.
+static uint8_t legacyCrc8(const uint8_t *data, size_t len) {
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = crc & 0x80 ? (uint8_t)((crc << 1) ^ 0x31)
+                             : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/// @brief Checks and de-interleaves [count] (MSB, LSB, CRC) tuples at
+/// [buf] with [legacyCrc8], as drivers did after [I2CDevice::read].
+static bool legacyWords(const uint8_t *buf, uint16_t *words, size_t count) {
+    for (size_t i = 0; i < count; i++, buf += 3) {
+        if (legacyCrc8(buf, 2) != buf[2]) {
+            return false;
+        }
+        words[i] = (uint16_t)((buf[0] << 8) | buf[1]);
+    }
+    return true;
+}
+
+/// @brief Times checking and de-interleaving CRC protected words with
+/// the bitwise CRC and with the [I2CCrcSensirion] table, without the
+/// bus, and prints the host time per word.
+static void runCrcSeries(uint32_t iterations) {
+    const size_t counts[] = {1, 3, 9, I2C_CRC_MAX_WORDS};
+    uint8_t buf[3 * I2C_CRC_MAX_WORDS];
+    for (size_t i = 0; i < I2C_CRC_MAX_WORDS; i++) {
+        buf[3 * i] = (uint8_t)(i * 29);
+        buf[3 * i + 1] = (uint8_t)(i * 71 + 5);
+        buf[3 * i + 2] = legacyCrc8(buf + 3 * i, 2);
+    }
+    const char *names[] = {"crc_words_bitwise", "crc_words_table"};
+    for (size_t count : counts) {
+        for (int mode = 0; mode < 2; mode++) {
+            uint16_t words[I2C_CRC_MAX_WORDS];
+            std::vector<uint64_t> ns;
+            ns.reserve(iterations);
+            bool ok = true;
+            for (uint32_t n = 0; n < iterations; n++) {
+                auto start = std::chrono::steady_clock::now();
+                for (int r = 0; r < CRC_REPEATS; r++) {
+                    if (mode == 0) {
+                        ok = legacyWords(buf, words, count) && ok;
+                        continue;
+                    }
+                    const uint8_t *p = buf;
+                    for (size_t i = 0; i < count; i++, p += 3) {
+                        ok = I2CCrcSensirion::compute(p, 2) == p[2] && ok;
+                        words[i] = (uint16_t)((p[0] << 8) | p[1]);
+                    }
+                }
+                ns.push_back(benchElapsedNs(start));
+                // keep the words observable
+                ok = ok && words[count - 1] != 0xFFFF;
+            }
+            BenchPercentiles time = benchPercentiles(ns);
+            double perWord = (double)CRC_REPEATS * count;
+            Serial.printf("{\"bench\":\"%s\",\"words\":%lu,"
+                "\"iterations\":%lu,\"ok\":%s,\"ns_per_word_mean\":%.2f,"
+                "\"ns_per_word_p50\":%.2f,\"ns_per_word_p99\":%.2f}\n",
+                names[mode],
+                (unsigned long)count,
+                (unsigned long)iterations,
+                ok ? "true" : "false",
+                time.mean / perWord,
+                time.p50 / perWord,
+                time.p99 / perWord);
+        }
+    }
+}
+
+/// @brief Decodes one sample as drivers did after a burst read: the
+/// bytes ORed together with shifts, then masked and sign extended.
+static int32_t legacySample(const uint8_t *p, const I2CSampleFormat &format) {
+    uint32_t v = 0;
+    for (uint8_t i = 0; i < format.bytes; i++) {
+        v = (v << 8) | (format.order == I2C_BIG_ENDIAN
+                            ? p[i] : p[format.bytes - 1 - i]);
+    }
+    v = (v >> format.shift) & ((1UL << format.bits) - 1);
+    if (format.isSigned && (v & (1UL << (format.bits - 1)))) {
+        v -= 1UL << format.bits;
+    }
+    return (int32_t)v;
+}
+
+/// @brief Times decoding a FIFO-sized batch of raw samples one sample at
+/// a time and with [I2CDecode], without the bus, and prints the host
+/// time per sample.
+static void runDecodeSeries(uint32_t iterations) {
+    struct DecodeCase {
+        const char *name;
+        I2CSampleFormat format;
+        bool toFloat;
+        float scale;
+    };
+    const DecodeCase cases[] = {
+        // MPU6050 accelerometer, +-2 g
+        {"decode_be16_float", {2, I2C_BIG_ENDIAN, 16, 0, true}, true,
+         1.0f / 16384},
+        // LIS3DH high resolution, left-justified, 1 mg/digit
+        {"decode_le12_float", {2, I2C_LITTLE_ENDIAN, 12, 4, true}, true,
+         0.001f},
+        // BMP280 raw pressure, 20 bits in 24
+        {"decode_be20_int32", {3, I2C_BIG_ENDIAN, 20, 4, false}, false, 1},
+    };
+    static uint8_t raw[4 * DECODE_SAMPLES];
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        raw[i] = (uint8_t)(i * 73 + 11);
+    }
+    static float values[DECODE_SAMPLES];
+    static int32_t words[DECODE_SAMPLES];
+    const char *modes[] = {"per_sample", "bulk"};
+    for (const DecodeCase &bench : cases) {
+        const I2CSampleFormat &format = bench.format;
+        float checksum[2] = {0, 0};
+        for (int mode = 0; mode < 2; mode++) {
+            std::vector<uint64_t> ns;
+            ns.reserve(iterations);
+            for (uint32_t n = 0; n < iterations; n++) {
+                auto start = std::chrono::steady_clock::now();
+                for (int r = 0; r < DECODE_REPEATS; r++) {
+                    if (mode == 1 && bench.toFloat) {
+                        I2CDecode::toFloat(raw, DECODE_SAMPLES, format,
+                                           values, bench.scale);
+                    } else if (mode == 1) {
+                        I2CDecode::toInt32(raw, DECODE_SAMPLES, format, words);
+                    } else {
+                        const uint8_t *p = raw;
+                        for (size_t i = 0; i < DECODE_SAMPLES; i++) {
+                            int32_t v = legacySample(p, format);
+                            if (bench.toFloat) {
+                                values[i] = v * bench.scale;
+                            } else {
+                                words[i] = v;
+                            }
+                            p += format.bytes;
+                        }
+                    }
+                }
+                ns.push_back(benchElapsedNs(start));
+            }
+            for (size_t i = 0; i < DECODE_SAMPLES; i++) {
+                checksum[mode] += bench.toFloat ? values[i] : words[i];
+            }
+            BenchPercentiles time = benchPercentiles(ns);
+            double perSample = (double)DECODE_REPEATS * DECODE_SAMPLES;
+            Serial.printf("{\"bench\":\"%s_%s\",\"samples\":%d,"
+                "\"iterations\":%lu,\"ok\":%s,"
+                "\"ns_per_sample_mean\":%.3f,\"ns_per_sample_p50\":%.3f,"
+                "\"ns_per_sample_p99\":%.3f}\n",
+                bench.name, modes[mode], DECODE_SAMPLES,
+                (unsigned long)iterations,
+                checksum[mode] == checksum[0] ? "true" : "false",
+                time.mean / perSample, time.p50 / perSample,
+                time.p99 / perSample);
+        }
+    }
+}
+
+BenchPercentiles benchPercentiles(std::vector<uint64_t> &samples) {
+    BenchPercentiles result = {0, 0, 0, 0, 0};
+    if (samples.empty()) {
+        return result;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (uint64_t sample : samples) {
+        sum += sample;
+    }
+    size_t n = samples.size();
+    result.mean = sum / n;
+    result.p50 = samples[(n - 1) * 50 / 100];
+    result.p90 = samples[(n - 1) * 90 / 100];
+    result.p99 = samples[(n - 1) * 99 / 100];
+    result.max = samples[n - 1];
+    return result;
+};
+
+static void runSeries(const BenchCase &bench, I2CDevice &dev, SimBus &bus,
+                      TimedBackend &timed, size_t len, uint32_t iterations) {
+    std::vector<uint8_t> buffer(len, 0x5A);
+    std::vector<uint64_t> libNs;
+    libNs.reserve(iterations);
+    uint64_t backendNs = 0;
+    bool ok = true;
+    bus.resetStats();
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t hostBefore = timed.hostNs();
+        auto start = std::chrono::steady_clock::now();
+        ok = bench.op(dev, buffer.data(), len) && ok;
+        uint64_t wall = benchElapsedNs(start);
+        uint64_t inBackend = timed.hostNs() - hostBefore;
+        backendNs += inBackend;
+        libNs.push_back(wall > inBackend ? wall - inBackend : 0);
+    }
+    SimBus::Stats stats = bus.stats();
+    BenchPercentiles lib = benchPercentiles(libNs);
+    double busNs = (double)stats.busTimeNs / iterations;
+    double overheadNs = (double)stats.overheadNs / iterations;
+    double bytesPerS = busNs > 0 ? ok * len * 1e9 / busNs : 0;
+    double callsPerS = busNs > 0 ? 1e9 / busNs : 0;
+    Serial.printf("{\"bench\":\"%s\",\"clock_hz\":%lu,\"bytes\":%lu,"
+        "\"max_buffer\":%lu,\"iterations\":%lu,\"ok\":%s,"
+        "\"transfers_per_call\":%.2f,\"starts_per_call\":%.2f,"
+        "\"bus_ns_per_call\":%.0f,\"bus_overhead_ns_per_call\":%.0f,"
+        "\"bus_data_ns_per_call\":%.0f,\"bus_bytes_per_s\":%.0f,"
+        "\"bus_calls_per_s\":%.1f,\"lib_ns_mean\":%.1f,\"lib_ns_p50\":%lu,"
+        "\"lib_ns_p90\":%lu,\"lib_ns_p99\":%lu,\"lib_ns_max\":%lu,"
+        "\"backend_ns_mean\":%.1f}\n",
+        bench.name,
+        (unsigned long)bus.getClock(),
+        (unsigned long)len,
+        (unsigned long)dev.maxBufferSize(),
+        (unsigned long)iterations,
+        ok ? "true" : "false",
+        (double)stats.transfers / iterations,
+        (double)(stats.starts + stats.repeatedStarts) / iterations,
+        busNs,
+        overheadNs,
+        busNs - overheadNs,
+        bytesPerS,
+        callsPerS,
+        lib.mean,
+        (unsigned long)lib.p50,
+        (unsigned long)lib.p90,
+        (unsigned long)lib.p99,
+        (unsigned long)lib.max,
+        (double)backendNs / iterations);
+};
+
+/// @brief Heap allocations made by the program, counted by the global
+/// [operator new] below.
+static std::atomic<uint64_t> heapAllocations(0);
+
+void * operator new(size_t size) {
+    heapAllocations++;
+    void *p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept {
+    (void)size;
+    free(p);
+}
+
+/// @brief A [Print] that discards its output and counts it.
+class NullPrint : public Print {
+public:
+    size_t written = 0;
+    size_t write(uint8_t c) override { (void)c; written++; return 1; }
+    size_t write(const uint8_t *buffer, size_t size) override {
+        (void)buffer;
+        written += size;
+        return size;
+    }
+};
+
+/// @brief [I2CDevice::getByteString] as it was before [I2CFormat]: a
+/// [String] built by concatenation and upper-cased in place.
+static String legacyByteString(uint8_t b, uint8_t format) {
+    String bStr;
+    String str = String(b, format);
+    std::transform(str.begin(), str.end(), str.begin(), ::toupper);
+    switch (format) {
+        case BIN:
+            bStr = String("0B") +
+                   (b < 0b10 ? "0000000" : b < 0b100 ? "000000" :
+                    b < 0b1000 ? "00000" : b < 0b10000 ? "0000" :
+                    b < 0b100000 ? "000" : b < 0b1000000 ? "00" :
+                    b < 0b10000000 ? "0" : "");
+        break;
+        case HEX:
+            bStr = String("0X") + (b < 0x10 ? "0" : "");
+        break;
+    }
+    return bStr + str;
+}
+
+/// @brief Renders a register dump through the old [String] path, the
+/// current [getByteString] and [I2CFormat::printRegisters], and prints
+/// the host time and heap allocations per dump.
+static void runFormatSeries(uint32_t iterations) {
+    uint8_t values[FORMAT_REG_COUNT];
+    for (uint8_t i = 0; i < FORMAT_REG_COUNT; i++) {
+        values[i] = i * 37;
+    }
+    const char *names[] = {
+        "format_dump_legacy_string", "format_dump_string", "format_dump_table"};
+    for (int mode = 0; mode < 3; mode++) {
+        NullPrint out;
+        std::vector<uint64_t> ns;
+        ns.reserve(iterations);
+        uint64_t allocations = heapAllocations;
+        for (uint32_t n = 0; n < iterations; n++) {
+            auto start = std::chrono::steady_clock::now();
+            if (mode == 2) {
+                I2CFormat::printRegisters(out, values, FORMAT_REG_COUNT);
+            } else {
+                out.println("___________________________________");
+                out.println("REGISTER                    VALUE");
+                out.println("-----------------------------------");
+                for (uint8_t i = 0; i < FORMAT_REG_COUNT; i++) {
+                    if (mode == 0) {
+                        out.printf(" %s              %s (%s)\n",
+                            legacyByteString(i, HEX).c_str(),
+                            legacyByteString(values[i], BIN).c_str(),
+                            legacyByteString(values[i], HEX).c_str());
+                    } else {
+                        out.printf(" %s              %s (%s)\n",
+                            I2CDevice::getByteString(i, HEX).c_str(),
+                            I2CDevice::getByteString(values[i], BIN).c_str(),
+                            I2CDevice::getByteString(values[i], HEX).c_str());
+                    }
+                }
+            }
+            ns.push_back(benchElapsedNs(start));
+        }
+        allocations = heapAllocations - allocations;
+        BenchPercentiles time = benchPercentiles(ns);
+        Serial.printf("{\"bench\":\"%s\",\"registers\":%d,"
+            "\"iterations\":%lu,\"bytes_per_dump\":%lu,"
+            "\"heap_allocs_per_dump\":%.1f,\"ns_mean\":%.1f,"
+            "\"ns_p50\":%lu,\"ns_p99\":%lu}\n",
+            names[mode],
+            FORMAT_REG_COUNT,
+            (unsigned long)iterations,
+            (unsigned long)(out.written / iterations),
+            (double)allocations / iterations,
+            time.mean,
+            (unsigned long)time.p50,
+            (unsigned long)time.p99);
+    }
+};
+
+/// @brief Flushes a datalog to a simulated EEPROM with [writeMemory]
+/// (ACK polling) and with page writes followed by the worst-case write
+/// cycle delay, and prints the virtual time each takes.
+static void runEepromSeries(uint32_t speed) {
+    SimBus bus(speed);
+    SimEepromDevice eeprom(BENCH_EEPROM_ADDR);
+    bus.attach(&eeprom);
+    TwoWire wire(3, &bus);
+    I2CDevice dev(BENCH_EEPROM_ADDR, &wire);
+    dev.begin(false);
+    dev.setPageSize(64, 2);
+    std::vector<uint8_t> log(EEPROM_FLUSH_LEN);
+    for (size_t i = 0; i < log.size(); i++) {
+        log[i] = (uint8_t)(i * 7);
+    }
+    const char *names[] = {"eeprom_flush_ack_poll", "eeprom_flush_delay"};
+    for (int mode = 0; mode < 2; mode++) {
+        bus.resetStats();
+        uint32_t cycles = eeprom.writeCycles();
+        uint64_t start = bus.now();
+        bool ok = true;
+        if (mode == 0) {
+            ok = dev.writeMemory(0, log.data(), log.size());
+        } else {
+            // one page at a time, then wait out the datasheet maximum
+            for (size_t pos = 0; pos < log.size() && ok; pos += 64) {
+                uint8_t prefix[2] = {(uint8_t)(pos >> 8), (uint8_t)pos};
+                ok = dev.write(log.data() + pos, 64, true, prefix, 2);
+                bus.idle(EEPROM_TWR_MAX_NS);
+            }
+        }
+        uint64_t elapsed = bus.now() - start;
+        SimBus::Stats stats = bus.stats();
+        Serial.printf("{\"bench\":\"%s\",\"clock_hz\":%lu,\"bytes\":%lu,"
+            "\"ok\":%s,\"write_cycles\":%lu,\"transfers\":%lu,"
+            "\"address_nacks\":%lu,\"bus_ns\":%llu,\"elapsed_ns\":%llu,"
+            "\"bytes_per_s\":%.0f}\n",
+            names[mode],
+            (unsigned long)speed,
+            (unsigned long)log.size(),
+            ok ? "true" : "false",
+            (unsigned long)(eeprom.writeCycles() - cycles),
+            (unsigned long)stats.transfers,
+            (unsigned long)stats.addressNacks,
+            (unsigned long long)stats.busTimeNs,
+            (unsigned long long)elapsed,
+            elapsed ? log.size() * 1e9 / elapsed : 0.0);
+    }
+};
+
+/// @brief Switches an APDS9930-like device between two modes, register
+/// by register as a driver does, once writing each register straight
+/// away and once staged and committed, and prints the bus time per
+/// switch. Both use the register cache for the read-modify-writes.
+static void runStagingSeries(uint32_t speed, uint32_t iterations) {
+    SimBus bus(speed);
+    SimRegisterDevice slave(BENCH_ADDR, 256);
+    bus.attach(&slave);
+    TwoWire wire(3, &bus);
+    I2CDevice dev(BENCH_ADDR, &wire);
+    dev.begin(false);
+    typedef I2CRegister<0x0F, uint8_t> Control;
+    typedef I2CField<Control, 0, 2> AGain;
+    typedef I2CField<Control, 6, 2> PDrive;
+    // ENABLE, ATIME, PTIME, WTIME, PERS, CONFIG, PPULSE of both modes
+    static const uint8_t regs[] = {0x00, 0x01, 0x02, 0x03, 0x0C, 0x0D, 0x0E};
+    static const uint8_t modes[2][7] = {
+        {0x0F, 0xFF, 0xFF, 0xFF, 0x22, 0x00, 0x08},
+        {0x0F, 0xDB, 0xFF, 0xFF, 0x22, 0x00, 0x04}};
+    const char *names[] = {"mode_switch_immediate", "mode_switch_staged"};
+    for (int staged = 0; staged < 2; staged++) {
+        dev.enableRegisterCache();
+        dev.registerCache()->setVolatile(0x00, false, 0x10);
+        dev.refreshRegisters(0x00, 0x10);
+        bus.resetStats();
+        bool ok = true;
+        for (uint32_t i = 0; i < iterations; i++) {
+            const uint8_t *mode = modes[i & 1];
+            if (staged) {
+                dev.beginStaging(0x10);
+            }
+            for (size_t r = 0; r < sizeof(regs); r++) {
+                ok = dev.write8(regs[r], mode[r]) && ok;
+            }
+            ok = dev.setField<AGain>(i & 1 ? 2 : 0) && ok;
+            ok = dev.setField<PDrive>(0) && ok;
+            if (staged) {
+                ok = dev.commit() && ok;
+            }
+        }
+        SimBus::Stats stats = bus.stats();
+        Serial.printf("{\"bench\":\"%s\",\"clock_hz\":%lu,"
+            "\"iterations\":%lu,\"ok\":%s,\"transfers_per_call\":%.2f,"
+            "\"bus_ns_per_call\":%.0f}\n",
+            names[staged],
+            (unsigned long)speed,
+            (unsigned long)iterations,
+            ok ? "true" : "false",
+            (double)stats.transfers / iterations,
+            (double)stats.busTimeNs / iterations);
+    }
+};
+
+/// @brief A sample as the channel benchmark passes it: a sequence number,
+/// the host time it was published and a payload derived from the
+/// sequence number, to detect torn reads.
+struct ChannelItem {
+    uint32_t seq;
+    uint64_t publishedNs;
+    uint32_t payload[6];
+};
+
+/// @brief A ring behind a [std::mutex], the way results were shared
+/// before [I2CChannel], for comparison.
+class MutexRing {
+public:
+    MutexRing(size_t capacity) : _items(capacity), _head(0), _count(0) {}
+
+    bool push(const ChannelItem &item) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_count == _items.size()) {
+            return false;
+        }
+        _items[(_head + _count) % _items.size()] = item;
+        _count++;
+        return true;
+    }
+
+    bool pop(ChannelItem &item) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_count == 0) {
+            return false;
+        }
+        item = _items[_head];
+        _head = (_head + 1) % _items.size();
+        _count--;
+        return true;
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<ChannelItem> _items;
+    size_t _head;
+    size_t _count;
+};
+
+/// @brief Fills an [I2C_OVERWRITE_OLDEST] channel while the consumer
+/// holds its oldest value and checks that the held value is never
+/// overwritten, on one thread so the sequence is exact: capacity 3, push
+/// 1 to 3, hold 1, then push 4 to 6.
+static void checkChannelOverwrite() {
+    I2CChannel<uint32_t> channel(3, I2C_OVERWRITE_OLDEST);
+    bool ok = true;
+    for (uint32_t v = 1; v <= 3; v++) {
+        ok = channel.push(v) && ok;
+    }
+    const uint32_t *held = channel.front();
+    ok = ok && held != nullptr && *held == 1;
+    for (uint32_t v = 4; v <= 6; v++) {
+        channel.push(v);
+        ok = ok && *held == 1;
+    }
+    channel.release();
+    // the values after the held one, newest last
+    uint32_t value, last = 1;
+    while (channel.pop(value)) {
+        ok = ok && value > last;
+        last = value;
+    }
+    Serial.printf("{\"bench\":\"channel_overwrite_held\",\"ok\":%s,"
+        "\"dropped\":%lu,\"overwritten\":%lu}\n", ok ? "true" : "false",
+        (unsigned long)channel.dropped(),
+        (unsigned long)channel.overwritten());
+}
+
+/// @brief Passes [count] items from a producer thread to a consumer
+/// thread through [I2CChannel] with both policies and through a
+/// [MutexRing], checks that the consumer sees them in order and untorn,
+/// and prints the host time per item and the publish-to-consume latency.
+/// The producer retries when [I2C_DROP_NEWEST] and the ring are full, and
+/// overwrites the oldest item otherwise.
+/// Run it in a ThreadSanitizer build to check the channel for races.
+static void runChannelSeries(uint32_t count) {
+    const char *names[] = {
+        "channel_drop_newest", "channel_overwrite_oldest", "mutex_ring"};
+    for (int mode = 0; mode < 3; mode++) {
+        I2CChannel<ChannelItem> channel(CHANNEL_CAPACITY,
+            mode == 1 ? I2C_OVERWRITE_OLDEST : I2C_DROP_NEWEST);
+        MutexRing ring(CHANNEL_CAPACITY);
+        std::atomic<bool> done(false);
+        auto epoch = std::chrono::steady_clock::now();
+        auto start = epoch;
+        std::thread producer([&] {
+            for (uint32_t seq = 0; seq < count; seq++) {
+                ChannelItem local;
+                ChannelItem *item = mode == 2 ? &local : channel.reserve();
+                if (item == nullptr) {
+                    // full: wait for the consumer, as a producer that
+                    // must not lose data would
+                    seq--;
+                    std::this_thread::yield();
+                    continue;
+                }
+                item->seq = seq;
+                for (uint8_t i = 0; i < 6; i++) {
+                    item->payload[i] = seq * 2654435761UL + i;
+                }
+                item->publishedNs = benchElapsedNs(epoch);
+                if (mode != 2) {
+                    channel.publish();
+                } else if (!ring.push(local)) {
+                    seq--;
+                    std::this_thread::yield();
+                }
+            }
+            done = true;
+        });
+        std::vector<uint64_t> latency;
+        latency.reserve(count);
+        bool ok = true;
+        uint32_t received = 0;
+        int64_t last = -1;
+        for (;;) {
+            bool finished = done;
+            ChannelItem copy;
+            const ChannelItem *item = nullptr;
+            if (mode == 2) {
+                item = ring.pop(copy) ? &copy : nullptr;
+            } else {
+                item = channel.front();
+            }
+            if (item == nullptr) {
+                if (finished) {
+                    break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            uint64_t now = benchElapsedNs(epoch);
+            latency.push_back(now > item->publishedNs ?
+                now - item->publishedNs : 0);
+            ok = ok && (int64_t)item->seq > last;
+            for (uint8_t i = 0; i < 6; i++) {
+                ok = ok && item->payload[i] ==
+                    (uint32_t)(item->seq * 2654435761UL + i);
+            }
+            last = item->seq;
+            received++;
+            if (mode != 2) {
+                channel.release();
+            }
+        }
+        producer.join();
+        uint64_t elapsed = benchElapsedNs(start);
+        BenchPercentiles lat = benchPercentiles(latency);
+        ok = ok && (mode == 1 || received == count);
+        Serial.printf("{\"bench\":\"%s\",\"capacity\":%d,\"items\":%lu,"
+            "\"ok\":%s,\"received\":%lu,\"dropped\":%lu,"
+            "\"overwritten\":%lu,\"ns_per_item\":%.1f,"
+            "\"latency_ns_p50\":%lu,\"latency_ns_p99\":%lu}\n",
+            names[mode],
+            CHANNEL_CAPACITY,
+            (unsigned long)count,
+            ok ? "true" : "false",
+            (unsigned long)received,
+            (unsigned long)channel.dropped(),
+            (unsigned long)channel.overwritten(),
+            (double)elapsed / count,
+            (unsigned long)lat.p50,
+            (unsigned long)lat.p99);
+    }
+};
+
+/// @brief Reads [MUX_REGS] registers of [MUX_SENSORS] identical sensors
+/// behind each of [MUX_COUNT] linked multiplexers at 400 kHz, in rounds
+/// ordered by register as a driver polling by quantity would: with a
+/// select write before every read, with channel-select caching, and as
+/// an [I2CGroupRead]. Prints transactions, selects and bus time per round.
+static void runMuxSeries(uint32_t iterations) {
+    SimBus bus(400000);
+    TwoWire wire(3, &bus);
+    std::vector<SimMuxDevice *> simMuxes;
+    std::vector<SimRegisterDevice *> simSensors;
+    std::vector<I2CMux *> muxes;
+    std::vector<I2CDevice *> sensors;
+    const size_t total = MUX_COUNT * MUX_SENSORS;
+    for (uint8_t m = 0; m < MUX_COUNT; m++) {
+        simMuxes.push_back(new SimMuxDevice(0x70 + m));
+        bus.attach(simMuxes[m]);
+        muxes.push_back(new I2CMux(0x70 + m, &wire));
+        muxes[0]->link(*muxes[m]);
+    }
+    for (size_t i = 0; i < total; i++) {
+        simSensors.push_back(new SimRegisterDevice(0x44));
+        simMuxes[i / MUX_SENSORS]->attach(i % MUX_SENSORS, simSensors[i]);
+        sensors.push_back(new I2CDevice(0x44, &wire));
+    }
+    uint8_t values[MUX_REGS][MUX_COUNT * MUX_SENSORS];
+    I2CGroupRead group;
+    for (uint8_t r = 0; r < MUX_REGS; r++) {
+        for (size_t i = 0; i < total; i++) {
+            group.add(*sensors[i], r, 1, &values[r][i]);
+        }
+    }
+    const char *names[] = {"mux_select_every_read", "mux_cached", "mux_group"};
+    for (int mode = 0; mode < 3; mode++) {
+        for (size_t i = 0; i < total; i++) {
+            sensors[i]->setMux(mode == 0 ? nullptr : muxes[i / MUX_SENSORS],
+                               i % MUX_SENSORS);
+        }
+        std::vector<uint64_t> ns;
+        ns.reserve(iterations);
+        bus.resetStats();
+        bool ok = true;
+        for (uint32_t n = 0; n < iterations; n++) {
+            auto start = std::chrono::steady_clock::now();
+            if (mode == 2) {
+                ok = group.run() && ok;
+            } else {
+                for (uint8_t r = 0; r < MUX_REGS; r++) {
+                    for (size_t i = 0; i < total; i++) {
+                        if (mode == 0) {
+                            I2CMux *mux = muxes[i / MUX_SENSORS];
+                            mux->invalidate();
+                            ok = mux->select(i % MUX_SENSORS) && ok;
+                        }
+                        ok = sensors[i]->readRegister(r, &values[r][i], 1) &&
+                             ok;
+                    }
+                }
+            }
+            ns.push_back(benchElapsedNs(start));
+        }
+        SimBus::Stats stats = bus.stats();
+        BenchPercentiles host = benchPercentiles(ns);
+        uint32_t selects = 0;
+        for (I2CMux *mux : muxes) {
+            selects += mux->stats().selects;
+            mux->resetStats();
+        }
+        Serial.printf("{\"bench\":\"%s\",\"ok\":%s,\"sensors\":%lu,"
+            "\"reads_per_round\":%lu,\"iterations\":%lu,"
+            "\"transfers_per_round\":%.2f,\"selects_per_round\":%.2f,"
+            "\"collisions\":%lu,\"bus_ns_per_round\":%.0f,"
+            "\"host_ns_mean\":%.1f,\"host_ns_p50\":%lu,"
+            "\"host_ns_p99\":%lu}\n",
+            names[mode], ok ? "true" : "false", (unsigned long)total,
+            (unsigned long)(MUX_REGS * total), (unsigned long)iterations,
+            (double)stats.transfers / iterations,
+            (double)selects / iterations,
+            (unsigned long)stats.collisions,
+            (double)stats.busTimeNs / iterations,
+            host.mean, (unsigned long)host.p50, (unsigned long)host.p99);
+    }
+    for (size_t i = 0; i < total; i++) {
+        delete sensors[i];
+        delete simSensors[i];
+    }
+    for (uint8_t m = 0; m < MUX_COUNT; m++) {
+        bus.detach(simMuxes[m]);
+        delete muxes[m];
+        delete simMuxes[m];
+    }
+}
+
+/// @brief Drains [FIFO_FRAMES] frames per round from a simulated IMU,
+/// one frame per read and with [I2CDevice::drainFifo].
+static void runFifoSeries(uint32_t iterations) {
+    SimBus bus(400000);
+    TwoWire wire(3, &bus);
+    SimFifoDevice simImu(0x6A, 0x3A, 0x78, FIFO_FRAME_SIZE, 2 * FIFO_FRAMES);
+    bus.attach(&simImu);
+    I2CDevice imu(0x6A, &wire);
+    const I2CFifoConfig config = {0x3A, 2, I2C_LITTLE_ENDIAN, 0x3FFF, 0x4000,
+                                  true, 0x78, FIFO_FRAME_SIZE, 1};
+    static uint8_t ring[FIFO_RING * FIFO_FRAME_SIZE];
+    I2CFifo fifo(config, ring, FIFO_RING);
+    uint8_t frame[FIFO_FRAME_SIZE] = {1, 2, 3, 4, 5, 6};
+    const char *names[] = {"fifo_frame_per_read", "fifo_drain"};
+    for (int mode = 0; mode < 2; mode++) {
+        std::vector<uint64_t> ns;
+        ns.reserve(iterations);
+        bus.resetStats();
+        bool ok = true;
+        uint32_t frames = 0;
+        for (uint32_t n = 0; n < iterations; n++) {
+            for (uint16_t i = 0; i < FIFO_FRAMES; i++) {
+                simImu.push(frame);
+            }
+            auto start = std::chrono::steady_clock::now();
+            if (mode == 0) {
+                uint16_t level = imu.read16(0x3A, false) & 0x3FFF;
+                for (uint16_t i = 0; i < level; i++) {
+                    ok = imu.readRegister(0x78, frame, FIFO_FRAME_SIZE) && ok;
+                }
+                frames += level;
+            } else {
+                ok = imu.drainFifo(fifo) && ok;
+                size_t contiguous;
+                while (fifo.front(contiguous) != nullptr) {
+                    frames += contiguous;
+                    fifo.release(contiguous);
+                }
+            }
+            ns.push_back(benchElapsedNs(start));
+        }
+        SimBus::Stats stats = bus.stats();
+        BenchPercentiles host = benchPercentiles(ns);
+        Serial.printf("{\"bench\":\"%s\",\"ok\":%s,\"frames\":%d,"
+            "\"frame_size\":%d,\"max_buffer\":%lu,\"iterations\":%lu,"
+            "\"frames_read\":%lu,\"transfers_per_round\":%.2f,"
+            "\"bus_ns_per_round\":%.0f,\"host_ns_mean\":%.1f,"
+            "\"host_ns_p50\":%lu,\"host_ns_p99\":%lu}\n",
+            names[mode], ok ? "true" : "false", FIFO_FRAMES, FIFO_FRAME_SIZE,
+            (unsigned long)imu.maxBufferSize(), (unsigned long)iterations,
+            (unsigned long)frames, (double)stats.transfers / iterations,
+            (double)stats.busTimeNs / iterations,
+            host.mean, (unsigned long)host.p50, (unsigned long)host.p99);
+    }
+    bus.detach(&simImu);
+}
+
+#if defined(__linux__)
+/// @brief Runs register reads and writes through an [I2CLinuxBus] on
+/// [path] in [mode] and prints the system calls and host time per call.
+/// @param file The device file stand-in, or nullptr for the kernel's.
+/// @param bus The simulated bus behind [file], or nullptr.
+static void runLinuxMode(const char *name, const char *path,
+                         I2CDevFile *file, SimBus *bus, I2CLinuxMode mode,
+                         uint8_t address, uint32_t iterations) {
+    I2CLinuxBus adapter(path, file);
+    adapter.setMode(mode);
+    TwoWire wire(4, &adapter);
+    I2CDevice dev(address, &wire);
+    if (!dev.begin(false)) {
+        Serial.printf("{\"error\":\"cannot open %s\"}\n", path);
+        return;
+    }
+    const char *modes[] = {"rdwr", "read_write", "smbus"};
+    const char *ops[] = {"read8", "read_block", "write8"};
+    uint8_t data[LINUX_BLOCK_LEN];
+    for (int op = 0; op < 3; op++) {
+        std::vector<uint64_t> ns;
+        ns.reserve(iterations);
+        adapter.resetStats();
+        if (bus != nullptr) {
+            bus->resetStats();
+        }
+        bool ok = true;
+        for (uint32_t i = 0; i < iterations; i++) {
+            auto start = std::chrono::steady_clock::now();
+            if (op == 0) {
+                ok = dev.readRegister(0x10, data, 1) && ok;
+            } else if (op == 1) {
+                ok = dev.readRegister(0x00, data, LINUX_BLOCK_LEN) && ok;
+            } else {
+                ok = dev.write8(0x20, (uint8_t)i) && ok;
+            }
+            ns.push_back(benchElapsedNs(start));
+        }
+        I2CLinuxBus::Stats stats = adapter.stats();
+        BenchPercentiles host = benchPercentiles(ns);
+        SimBus::Stats busStats = {};
+        if (bus != nullptr) {
+            busStats = bus->stats();
+        }
+        Serial.printf("{\"bench\":\"linux_%s_%s_%s\",\"ok\":%s,"
+            "\"iterations\":%lu,\"syscalls_per_call\":%.2f,"
+            "\"stops_per_call\":%.2f,\"host_ns_mean\":%.1f,"
+            "\"host_ns_p50\":%lu,\"host_ns_p99\":%lu}\n",
+            name, modes[adapter.mode()], ops[op], ok ? "true" : "false",
+            (unsigned long)iterations,
+            (double)stats.syscalls / iterations,
+            bus != nullptr ? (double)busStats.stops / iterations : -1.0,
+            host.mean, (unsigned long)host.p50, (unsigned long)host.p99);
+    }
+    dev.end();
+}
+
+/// @brief Compares one I2C_RDWR ioctl per transaction with a read() or
+/// write() per segment, against the [SimDevFile] stand-in and, if the
+/// environment names one in I2C_BENCH_DEVICE (e.g. /dev/i2c-7 with
+/// `modprobe i2c-stub chip_addr=0x40`), a real adapter at
+/// I2C_BENCH_ADDR (hex, 0x40 by default).
+static void runLinuxSeries(uint32_t iterations) {
+    SimBus bus(400000);
+    SimRegisterDevice slave(BENCH_ADDR, 256);
+    bus.attach(&slave);
+    SimDevFile plain(bus, I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL);
+    SimDevFile smbusOnly(bus, I2C_FUNC_SMBUS_EMUL);
+    runLinuxMode("sim", "/dev/i2c-sim", &plain, &bus, I2C_LINUX_RDWR,
+                 BENCH_ADDR, iterations);
+    runLinuxMode("sim", "/dev/i2c-sim", &plain, &bus, I2C_LINUX_READ_WRITE,
+                 BENCH_ADDR, iterations);
+    runLinuxMode("sim", "/dev/i2c-sim", &smbusOnly, &bus, I2C_LINUX_RDWR,
+                 BENCH_ADDR, iterations);
+    const char *device = getenv("I2C_BENCH_DEVICE");
+    if (device != nullptr) {
+        const char *addr = getenv("I2C_BENCH_ADDR");
+        uint8_t address = addr != nullptr
+            ? (uint8_t)strtoul(addr, nullptr, 16) : BENCH_ADDR;
+        runLinuxMode("dev", device, nullptr, nullptr, I2C_LINUX_RDWR,
+                     address, iterations);
+        runLinuxMode("dev", device, nullptr, nullptr, I2C_LINUX_READ_WRITE,
+                     address, iterations);
+    }
+}
+#endif
+
+int runBenchmarks(int argc, char **argv) {
+    uint32_t iterations = BENCH_ITERATIONS;
+    if (argc > 0) {
+        iterations = (uint32_t)strtoul(argv[0], nullptr, 10);
+        if (iterations == 0) {
+            iterations = BENCH_ITERATIONS;
+        }
+    }
+
+    SimBus bus;
+    SimRegisterDevice slave(BENCH_ADDR, 256);
+    bus.attach(&slave);
+    TimedBackend timed(&bus);
+    TwoWire wire(2, &timed);
+    I2CDevice dev(BENCH_ADDR, &wire);
+    I2CBusArbiter arbiter;
+    I2CTrace trace(256);
+    if (!dev.begin(true)) {
+        Serial.println("{\"error\":\"benchmark device not detected\"}");
+        return 1;
+    }
+
+    static const uint8_t reg[1] = {0x00};
+    static const uint8_t wordsReg[1] = {CRC_WORDS_REG};
+    for (uint8_t i = 0; i < CRC_WORDS; i++) {
+        uint8_t tuple[3] = {(uint8_t)(0x11 * (i + 1)), (uint8_t)(0x5A + i), 0};
+        tuple[2] = I2CCrcSensirion::compute(tuple, 2);
+        slave.load(CRC_WORDS_REG + 3 * i, tuple, 3);
+    }
+    static I2CReadPlan plan;
+    for (uint8_t i = 0; i < SCATTERED_COUNT; i++) {
+        plan.add(scatteredRegs[i], 1, &scatteredValues[i]);
+    }
+    const BenchCase cases[] = {
+        {"read", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            return d.read(buf, len);
+        }, 0, false, false, false, false},
+        {"write", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            return d.write(buf, len);
+        }, 0, false, false, false, false},
+        {"write_prefix", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            return d.write(buf, len, true, reg, 1);
+        }, 0, false, false, false, false},
+        {"write_gather", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            // register, payload and checksum straight from their buffers
+            static const uint8_t trailer[1] = {0xC5};
+            const I2CWriteSegment segments[3] = {
+                {reg, 1}, {buf, len}, {trailer, 1}};
+            return d.writeSegments(segments, 3);
+        }, 0, false, false, false, false},
+        {"write_copy", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            // the same frame assembled in a stack buffer first
+            uint8_t frame[I2C_BUFFER_LENGTH];
+            if (len + 2 > sizeof(frame)) {
+                return false;
+            }
+            frame[0] = reg[0];
+            memcpy(frame + 1, buf, len);
+            frame[len + 1] = 0xC5;
+            return d.write(frame, len + 2);
+        }, 0, false, false, false, false},
+        {"read_scatter", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            // a two byte header into its own struct, the rest into [buf]
+            static uint8_t header[2];
+            const I2CReadSegment segments[2] = {
+                {header, 2}, {buf, len > 2 ? len - 2 : 0}};
+            return d.readSegments(segments, 2, true, reg, 1);
+        }, 0, false, false, false, false},
+        {"write_byte", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            return d.write(buf[0]);
+        }, 1, false, false, false, false},
+        {"write_then_read", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            return d.write_then_read(reg, 1, buf, len);
+        }, 0, false, false, false, false},
+        {"write_then_read_stop", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            return d.write_then_read(reg, 1, buf, len, true);
+        }, 0, false, false, false, false},
+        {"read8", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            buf[0] = d.read8(0x10);
+            return true;
+        }, 1, false, false, false, false},
+        {"read16", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            uint16_t value = d.read16(0x10, false);
+            memcpy(buf, &value, 2);
+            return true;
+        }, 2, false, false, false, false},
+        {"get_u16", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            uint16_t value = d.get<BenchWord>();
+            memcpy(buf, &value, 2);
+            return true;
+        }, 2, false, false, false, false},
+        {"set_field", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            return d.setField<BenchGain>(buf[0] & 0x07);
+        }, 1, false, false, false, false},
+        {"read_words", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            uint16_t words[CRC_WORDS];
+            bool ok = d.readWords(words, CRC_WORDS, wordsReg, 1);
+            memcpy(buf, words, sizeof(words));
+            return ok;
+        }, 3 * CRC_WORDS, false, false, false, false},
+        {"read_words_bitwise", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            uint16_t words[CRC_WORDS];
+            return d.write_then_read(wordsReg, 1, buf, len, true) &&
+                   legacyWords(buf, words, CRC_WORDS);
+        }, 3 * CRC_WORDS, false, false, false, false},
+        {"read8_traced", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            buf[0] = d.read8(0x10);
+            return true;
+        }, 1, false, false, true, false},
+        {"write_traced", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            return d.write(buf, len);
+        }, 0, false, false, true, false},
+        {"read8_clocked", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            buf[0] = d.read8(0x10);
+            return true;
+        }, 1, false, false, false, true},
+        {"read8_cached", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            buf[0] = d.read8(0x10);
+            return true;
+        }, 1, true, false, false, false},
+        {"scattered_read8", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            for (uint8_t i = 0; i < SCATTERED_COUNT; i++) {
+                buf[i] = d.read8(scatteredRegs[i]);
+            }
+            return true;
+        }, SCATTERED_COUNT, false, false, false, false},
+        {"scattered_plan", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)buf;
+            (void)len;
+            return d.readPlan(plan);
+        }, SCATTERED_COUNT, false, false, false, false},
+        {"read8_arbitrated", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            buf[0] = d.read8(0x10);
+            return true;
+        }, 1, false, true, false, false},
+        {"scattered_read8_arbitrated",
+            [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            for (uint8_t i = 0; i < SCATTERED_COUNT; i++) {
+                buf[i] = d.read8(scatteredRegs[i]);
+            }
+            return true;
+        }, SCATTERED_COUNT, false, true, false, false},
+        {"scattered_read8_held", [](I2CDevice &d, uint8_t *buf, size_t len) {
+            (void)len;
+            // one bus acquisition for the whole batch
+            I2CBusLock lock(d);
+            for (uint8_t i = 0; i < SCATTERED_COUNT; i++) {
+                buf[i] = d.read8(scatteredRegs[i]);
+            }
+            return lock.locked();
+        }, SCATTERED_COUNT, false, true, false, false},
+    };
+
+    // 1 byte up to 8x the Wire buffer
+    std::vector<size_t> sizes;
+    for (size_t len = 1; len <= 8 * dev.maxBufferSize(); len *= 2) {
+        sizes.push_back(len);
+    }
+    const uint32_t speeds[] = {100000, 400000, 1000000};
+    for (uint32_t speed : speeds) {
+        dev.setSpeed(speed);
+        for (const BenchCase &bench : cases) {
+            for (size_t len : sizes) {
+                if (bench.fixedLen) {
+                    len = bench.fixedLen;
+                }
+                if (bench.cached) {
+                    // register 0x10 is a non-volatile configuration register
+                    dev.enableRegisterCache();
+                    dev.registerCache()->setVolatile(0x10, false);
+                }
+                if (bench.arbitrated) {
+                    dev.setArbiter(&arbiter);
+                }
+                if (bench.traced) {
+                    dev.setTrace(&trace);
+                }
+                if (bench.clocked) {
+                    dev.setMaxClock(speed);
+                }
+                runSeries(bench, dev, bus, timed, len, iterations);
+                dev.setMaxClock(0);
+                dev.disableRegisterCache();
+                dev.setArbiter(nullptr);
+                dev.setTrace(nullptr);
+                if (bench.fixedLen) {
+                    break;
+                }
+            }
+        }
+        runEepromSeries(speed);
+        runStagingSeries(speed, iterations);
+    }
+    runFormatSeries(iterations);
+    runCrcSeries(iterations);
+    runDecodeSeries(iterations);
+    runMuxSeries(iterations);
+    runFifoSeries(iterations);
+    checkChannelOverwrite();
+    runChannelSeries(iterations * 100);
+    #if defined(__linux__)
+    runLinuxSeries(iterations);
+    #endif
+    return 0;
+};
@@ -0,0 +1,63 @@
+#ifndef NATIVE_BENCH_H_
+#define NATIVE_BENCH_H_
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <chrono>
+#include <vector>
+
+/// @brief Forwards to another [I2CBusBackend] and accumulates the host
+/// time spent in it, so that time spent in the library can be told apart
+/// from time spent simulating the bus.
+class TimedBackend : public I2CBusBackend {
+public:
+
+    TimedBackend(I2CBusBackend *inner) : _inner(inner), _hostNs(0) {}
+
+    bool begin() override { return _inner->begin(); }
+    void end() override { _inner->end(); }
+    void setClock(uint32_t frequency) override { _inner->setClock(frequency); }
+    uint32_t getClock() override { return _inner->getClock(); }
+
+    uint8_t transfer(I2CMessage *msgs, size_t count, bool stop) override {
+        auto start = std::chrono::steady_clock::now();
+        uint8_t result = _inner->transfer(msgs, count, stop);
+        _hostNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    /// @brief Host time spent in the wrapped backend, in nanoseconds.
+    uint64_t hostNs() { return _hostNs; }
+
+private:
+
+    I2CBusBackend *_inner;
+    uint64_t _hostNs;
+
+};
+
+/// @brief Summary of a series of per-call samples, in nanoseconds.
+struct BenchPercentiles {
+    double mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+};
+
+/// @brief Sorts [samples] and returns their percentiles.
+BenchPercentiles benchPercentiles(std::vector<uint64_t> &samples);
+
+/// @brief Returns the host time since [start], in nanoseconds.
+inline uint64_t benchElapsedNs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+/// @brief Runs the transaction primitive benchmarks and prints one JSON
+/// object per line to [Serial].
+/// @return The process exit code.
+int runBenchmarks(int argc, char **argv);
+
+#endif // NATIVE_BENCH_H_
@@ -0,0 +1,1030 @@
+
+// Host-side counterpart of src/main.cpp for the `native` environment.
+// The APDS9930 is replaced by a simulated register device on [WireBus],
+// and the bus time of every transaction is reported from the timing
+// model at 100 kHz, 400 kHz and 1 MHz. See bench.cpp for the benchmarks.
+
+#define APDS_ADDR 0x39 // I2C address for an APDS9930 sensor.
+#define APDS_ID 0x39 // value of the APDS9930 "ID" register
+#define OTHER_ADDR 0x68 // a second device on the bus, e.g. an RTC
+
+#define REG_COUNT 32 // number of registers on the device
+#define READ_CMD 0xA0 // prefix for read commands to the APDS9930
+#define CMD_MASK 0x1F // register address bits of an APDS9930 command
+#define ID_REG_ADDR 0x12 // register address for "ID" on the APDS9930
+#define STATUS_REG_ADDR 0x13 // register address for "STATUS" on the APDS9930
+#define AVALID 0x01 // STATUS bit: ALS data valid
+#define CLEAR_INT_CMD 0xE7 // special function: clear all interrupts
+#define INT_PIN 4 // the simulated pin the APDS9930 INT line drives
+#define SCD_ADDR 0x62 // I2C address of an SCD4x CO2 sensor
+#define PEC_ADDR 0x0B // I2C address of an SMBus smart battery
+#define SHT_ADDR 0x44 // I2C address of the sensors behind the multiplexers
+#define MUX_SENSORS 4 // sensors behind each of the two multiplexers
+#define IMU_ADDR 0x6A // I2C address of an IMU with a FIFO, e.g. an LSM6DSO
+#define FIFO_STATUS_REG 0x3A // FIFO fill level, two bytes
+#define FIFO_DATA_REG 0x78 // FIFO data output
+#define IMU_FRAME 6 // bytes per FIFO frame: X, Y, Z, 16 bits each
+#define IMU_DEPTH 128 // frames the IMU's FIFO holds
+#define IMU_RING 64 // frames of the ring the FIFO is drained into
+
+#include <atomic>
+#include <thread>
+#include <Arduino.h>
+#include <I2CSimBus.h>
+#include "bench.h"
+#include "trace.h"
+
+// include the library in your main.cpp
+#include <I2CDevice.h>
+#include <I2CAsync.h>
+#include <I2CSampler.h>
+#include <I2CDataReady.h>
+#include <I2CMux.h>
+#if defined(__linux__)
+#include <I2CLinuxBus.h>
+#include <linux/i2c.h>
+#endif
+
+/// @brief List of connected I2C device addresses.
+byte devices[9];
+
+/// @brief The simulated APDS9930.
+SimRegisterDevice apds(APDS_ADDR, REG_COUNT);
+
+/// @brief A second simulated device, so the scan finds more than one.
+SimRegisterDevice other(OTHER_ADDR);
+
+/// @brief A device on the second bus, [Wire1Bus].
+SimRegisterDevice eeprom(0x50);
+
+/// @brief The I2CDevice instance to be tested.
+I2CDevice i2c(APDS_ADDR, &Wire);
+
+/// @brief Attaches the simulated devices to [WireBus].
+void setUpBus();
+
+/// @brief Prints the bus time of the last transaction.
+void printBusTime(const char *name);
+
+/// @brief Prints the value in register 0X12, the ID address.
+void printReg0x12();
+
+/// @brief Prints the values of all the registers from 0X00 to 0x1F.
+void printRegisters();
+
+/// @brief Reads all the registers in the background while the main
+/// thread keeps running.
+void readRegistersAsync();
+
+/// @brief Polls both devices from two threads through a bus arbiter.
+void shareBus();
+
+/// @brief Samples the ADC channels every 2 ms, first with a [delay()]
+/// loop, then with an [I2CSampler], and once more with a job the bus
+/// cannot keep up with.
+void sampleRegisters();
+
+/// @brief Prints the performance counters of [i2c], if the library was
+/// built with I2C_DEVICE_METRICS.
+void printMetrics();
+
+/// @brief Records a few transactions, including a NACK, in an [I2CTrace]
+/// and dumps it; pipe the output to `program decode` for a timeline.
+void traceTransfers();
+
+/// @brief Reads CRC protected words from a Sensirion-style sensor and
+/// PEC protected data from an SMBus device, with and without corrupted
+/// bytes on the bus.
+void checkCrcs();
+
+/// @brief Reads new ADC data as a simulated sensor produces it, first by
+/// polling the STATUS register, then on the data-ready interrupt.
+void readOnDataReady();
+
+/// @brief Calibrates the clock of four devices of different speeds on
+/// one bus, then reads them at 100 kHz, at their own clocks, and from a
+/// sampler that batches them by clock.
+void clockProfiles();
+
+/// @brief Reads two registers of eight identical sensors behind two
+/// linked multiplexers, selecting the channel before every read, with
+/// channel-select caching, and as an [I2CGroupRead].
+void routeThroughMuxes();
+
+/// @brief Drains the FIFO of a simulated IMU, one frame per read as
+/// drivers did by hand, then with [I2CDevice::drainFifo] into a ring
+/// smaller than the FIFO, and once more after the FIFO overflowed.
+/// Decodes drained frames to g with [I2CDecode].
+void drainImuFifo();
+
+/// @brief Reads the APDS9930 through an [I2CLinuxBus] whose device file
+/// is simulated by [SimDevFile], once per mapping of transfers to system
+/// calls.
+void readThroughI2cDev();
+
+/// @brief Makes a device hold SDA low and reads it, first without a
+/// recovery policy, then with retries and a bus clear, and once more with
+/// SDA held for good, within the deadline.
+void recoverStuckBus();
+
+/// @brief Scans [Wire] and [Wire1] one after the other, then at the same
+/// time, in wall-clock time.
+void scanBuses();
+
+int main(int argc, char **argv) {
+    // `program bench [iterations]` runs the benchmarks instead of the demo
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return runBenchmarks(argc - 2, argv + 2);
+    }
+    // `program decode [log.txt]` decodes an I2CTrace dump
+    if (argc > 1 && strcmp(argv[1], "decode") == 0) {
+        return runTraceDecoder(argc - 2, argv + 2);
+    }
+
+    setUpBus();
+
+    // initialize the [I2CDevice].
+    if (!i2c.begin(true)) {
+        Serial.println("I2C Device FAILED to initialize!");
+        return 1;
+    }
+    Serial.printf("I2C Device initialized with address 0x%02X\n",
+        i2c.address());
+
+    // list all the devices on the bus
+    WireBus.resetStats();
+    i2c.listDevices(devices);
+    printBusTime("listDevices");
+    scanBuses();
+
+    const uint32_t speeds[] = {100000, 400000, 1000000};
+    for (uint32_t speed : speeds) {
+        i2c.setSpeed(speed);
+        Serial.printf("\n--- SCL %lu Hz ---\n", (unsigned long)speed);
+        printReg0x12();
+        printRegisters();
+    }
+
+    Serial.println("\n--- metrics ---");
+    printMetrics();
+
+    Serial.println("\n--- trace ---");
+    traceTransfers();
+
+    Serial.println("\n--- CRC ---");
+    checkCrcs();
+
+    Serial.println("\n--- async ---");
+    readRegistersAsync();
+
+    Serial.println("\n--- shared bus ---");
+    shareBus();
+
+    Serial.println("\n--- periodic sampling ---");
+    sampleRegisters();
+
+    Serial.println("\n--- data ready ---");
+    readOnDataReady();
+
+    Serial.println("\n--- clock profiles ---");
+    clockProfiles();
+
+    Serial.println("\n--- multiplexers ---");
+    routeThroughMuxes();
+
+    Serial.println("\n--- FIFO drain ---");
+    drainImuFifo();
+
+    #if defined(__linux__)
+    Serial.println("\n--- linux i2c-dev ---");
+    readThroughI2cDev();
+    #endif
+
+    Serial.println("\n--- stuck bus ---");
+    recoverStuckBus();
+    return 0;
+}
+
+void setUpBus() {
+    apds.setCommandMask(CMD_MASK);
+    for (uint8_t i = 0; i < REG_COUNT; i++) {
+        apds.poke(i, i * 3);
+    }
+    apds.poke(ID_REG_ADDR, APDS_ID);
+    WireBus.attach(&apds);
+    WireBus.attach(&other);
+    Wire1Bus.attach(&eeprom);
+}
+
+void printBusTime(const char *name) {
+    SimBus::Stats stats = WireBus.stats();
+    Serial.printf("%s: %lu transfers, %lu START, %lu Sr, %lu STOP, "
+        "%lu bytes, bus time %.1f us (overhead %.1f us)\n",
+        name,
+        (unsigned long)stats.transfers,
+        (unsigned long)stats.starts,
+        (unsigned long)stats.repeatedStarts,
+        (unsigned long)stats.stops,
+        (unsigned long)(stats.bytesWritten + stats.bytesRead),
+        stats.busTimeNs / 1000.0,
+        stats.overheadNs / 1000.0);
+}
+
+void printReg0x12() {
+    byte regValues[1];
+    byte pref[1] = {ID_REG_ADDR | READ_CMD};
+    WireBus.resetStats();
+    i2c.write_then_read(pref, 1, regValues, 1);
+    Serial.printf("Returned 0X%02X from register 0X%02X (ID)\n",
+        regValues[0], ID_REG_ADDR);
+    printBusTime("read ID");
+}
+
+void printRegisters() {
+    byte regValues[REG_COUNT];
+    byte pref[1] = {READ_CMD};
+    WireBus.resetStats();
+    i2c.write_then_read(pref, 1, regValues, REG_COUNT);
+    printBusTime("read registers");
+    I2CFormat::printRegisters(Serial, regValues, REG_COUNT);
+}
+
+/// @brief Completion callback of [readRegistersAsync], runs on the worker.
+void onRegistersRead(I2CRequest *request, void *arg) {
+    Serial.printf("async read %s after %lu us on the bus\n",
+        request->status == I2C_REQUEST_DONE ? "done" : "FAILED",
+        (unsigned long)(request->finishedAt - request->startedAt));
+    ((std::atomic<bool> *)arg)->store(true);
+}
+
+void readRegistersAsync() {
+    static byte regValues[REG_COUNT];
+    static const byte pref[1] = {READ_CMD};
+    static std::atomic<bool> finished(false);
+    I2CAsync async;
+    async.begin();
+    // let the simulated transfer take its bus time in wall-clock time
+    WireBus.setRealtime(true);
+    i2c.setSpeed(100000);
+    unsigned long loops = 0;
+    async.write_then_read(i2c, pref, 1, regValues, REG_COUNT,
+        onRegistersRead, &finished);
+    while (!finished) {
+        loops++;
+        delayMicroseconds(10);
+    }
+    async.end();
+    WireBus.setRealtime(false);
+    Serial.printf("main loop ran %lu times while the bus was busy, "
+        "register 0X12 = 0X%02X\n", loops, regValues[ID_REG_ADDR]);
+}
+
+/// @brief Prints the bus contention statistics of [device].
+void printBusStats(const char *name, I2CDevice &device) {
+    const I2CBusStats &stats = device.busStats();
+    Serial.printf("%s: %lu acquisitions, %lu contended, wait mean %.0f us "
+        "max %lu us, hold mean %.0f us max %lu us\n",
+        name,
+        (unsigned long)stats.acquisitions,
+        (unsigned long)stats.contended,
+        stats.acquisitions ? (double)stats.waitUs / stats.acquisitions : 0.0,
+        (unsigned long)stats.maxWaitUs,
+        stats.acquisitions ? (double)stats.holdUs / stats.acquisitions : 0.0,
+        (unsigned long)stats.maxHoldUs);
+}
+
+void shareBus() {
+    static I2CBusArbiter arbiter;
+    static I2CDevice slow(OTHER_ADDR, &Wire);
+    // the sensor is polled at a high rate and must not be starved by
+    // the slow bulk reads of the other device
+    i2c.setArbiter(&arbiter, 2);
+    slow.setArbiter(&arbiter, 0);
+    i2c.resetBusStats();
+    slow.resetBusStats();
+    WireBus.setRealtime(true);
+    i2c.setSpeed(400000);
+    std::atomic<bool> running(true);
+    std::thread bulk([&running] {
+        byte block[64];
+        byte start[1] = {0x00};
+        while (running) {
+            slow.write_then_read(start, 1, block, sizeof(block));
+        }
+    });
+    std::thread sensor([&running] {
+        byte data[4];
+        byte pref[1] = {0x14 | READ_CMD};
+        while (running) {
+            i2c.write_then_read(pref, 1, data, sizeof(data));
+            delayMicroseconds(500);
+        }
+    });
+    delay(200);
+    running = false;
+    sensor.join();
+    bulk.join();
+    WireBus.setRealtime(false);
+    i2c.setArbiter(nullptr);
+    printBusStats("sensor (priority 2)", i2c);
+    printBusStats("bulk   (priority 0)", slow);
+}
+
+void scanBuses() {
+    static I2CDevice bus1(0x50, &Wire1);
+    bus1.begin(false);
+    I2CDevice *buses[2] = {&i2c, &bus1};
+    I2CScanResult results[2];
+    // let the probes take their bus time in wall-clock time
+    WireBus.setRealtime(true);
+    Wire1Bus.setRealtime(true);
+    i2c.setSpeed(100000);
+    bus1.setSpeed(100000);
+    const uint32_t clocks[] = {0, 400000};
+    for (uint32_t clock : clocks) {
+        uint32_t sequential = micros();
+        i2c.scan(results[0], clock);
+        bus1.scan(results[1], clock);
+        sequential = micros() - sequential;
+        uint32_t parallel = I2CDevice::scanBuses(buses, results, 2, clock);
+        Serial.printf("scan at %lu Hz: Wire %u devices in %lu us, Wire1 %u "
+            "devices in %lu us, both one after the other %lu us, at the "
+            "same time %lu us\n",
+            (unsigned long)results[0].clock,
+            results[0].count, (unsigned long)results[0].elapsedUs,
+            results[1].count, (unsigned long)results[1].elapsedUs,
+            (unsigned long)sequential, (unsigned long)parallel);
+    }
+    WireBus.setRealtime(false);
+    Wire1Bus.setRealtime(false);
+}
+
+/// @brief Prints the statistics of sampler job [job].
+void printSamplerStats(const char *name, I2CSampler &sampler, uint8_t job) {
+    I2CSamplerStats stats;
+    sampler.stats(job, stats);
+    Serial.printf("%s: %lu samples at %.1f Hz, %lu overruns, max late "
+        "%lu us, late <16/<64/<256/<1024/more us:",
+        name,
+        (unsigned long)stats.samples,
+        sampler.achievedHz(job),
+        (unsigned long)stats.overruns,
+        (unsigned long)stats.maxLateUs);
+    for (uint8_t bin = 0; bin < 5; bin++) {
+        uint32_t count = stats.jitter[bin];
+        if (bin == 4) {
+            for (uint8_t more = 5; more < I2C_SAMPLER_JITTER_BINS; more++) {
+                count += stats.jitter[more];
+            }
+        }
+        Serial.printf(" %lu", (unsigned long)count);
+    }
+    Serial.println();
+}
+
+void sampleRegisters() {
+    const uint32_t periodUs = 2000;
+    const uint32_t runMs = 200;
+    byte data[4];
+    i2c.setRegisterCommand(READ_CMD);
+    WireBus.setRealtime(true);
+    i2c.setSpeed(100000);
+
+    // the usual loop: the read time adds to every period
+    uint32_t start = micros();
+    uint32_t reads = 0;
+    while (micros() - start < runMs * 1000UL) {
+        i2c.readRegister(0x14, data, sizeof(data));
+        reads++;
+        delayMicroseconds(periodUs);
+    }
+    Serial.printf("delay loop: %lu samples at %.1f Hz\n",
+        (unsigned long)reads, reads * 1000.0 / runMs);
+
+    I2CSampler sampler(32);
+    sampler.addJob(i2c, 0x14, 4, periodUs);   // CH0 and CH1
+    sampler.addJob(i2c, 0x13, 1, 5000);       // STATUS
+    sampler.begin();
+    size_t popped = 0;
+    I2CSample sample;
+    start = micros();
+    while (micros() - start < runMs * 1000UL) {
+        while (sampler.pop(sample)) {
+            popped++;
+        }
+        delay(5);
+    }
+    sampler.end();
+    printSamplerStats("sampler CH0/CH1", sampler, 0);
+    printSamplerStats("sampler STATUS ", sampler, 1);
+    Serial.printf("popped %lu samples, %lu lost, bus utilization %.0f%%\n",
+        (unsigned long)popped, (unsigned long)sampler.lost(),
+        sampler.utilization() * 100);
+
+    // 16 registers every 1 ms take more than 1 ms at 100 kHz
+    sampler.clearJobs();
+    sampler.addJob(i2c, 0x00, 16, 1000);
+    sampler.begin();
+    delay(runMs);
+    sampler.end();
+    printSamplerStats("oversubscribed ", sampler, 0);
+    Serial.printf("bus utilization %.0f%%\n", sampler.utilization() * 100);
+
+    WireBus.setRealtime(false);
+    i2c.setRegisterCommand(0x00);
+}
+
+void printMetrics() {
+    I2CMetrics metrics;
+    if (!i2c.metrics(metrics)) {
+        Serial.println("built without I2C_DEVICE_METRICS");
+        return;
+    }
+    Serial.printf("%lu writes, %lu reads, %lu bytes out, %lu bytes in, "
+        "%lu NACKs, %lu short reads, %lu chunk splits, %lu CRC errors\n",
+        (unsigned long)metrics.writes, (unsigned long)metrics.reads,
+        (unsigned long)metrics.bytesOut, (unsigned long)metrics.bytesIn,
+        (unsigned long)metrics.nacks, (unsigned long)metrics.shortReads,
+        (unsigned long)metrics.chunkSplits,
+        (unsigned long)metrics.crcErrors);
+    const char *names[I2C_OP_COUNT] = {"write", "read", "write_then_read"};
+    for (uint8_t op = 0; op < I2C_OP_COUNT; op++) {
+        I2CMetricsOp type = (I2CMetricsOp)op;
+        if (metrics.ops[op] == 0) {
+            continue;
+        }
+        Serial.printf("%-15s %5lu ops, mean %.1f us, p50 <%lu us, "
+            "p99 <%lu us, max %lu us\n", names[op],
+            (unsigned long)metrics.ops[op], metrics.meanUs(type),
+            (unsigned long)metrics.percentileUs(type, 50),
+            (unsigned long)metrics.percentileUs(type, 99),
+            (unsigned long)metrics.maxUs[op]);
+    }
+    i2c.resetMetrics();
+}
+
+void checkCrcs() {
+    // an SCD4x answering "read measurement": CO2, temperature and
+    // humidity, each word followed by its CRC; the simulated device
+    // serves it as registers from 0x00
+    SimRegisterDevice scd(SCD_ADDR);
+    SimRegisterDevice battery(PEC_ADDR);
+    WireBus.attach(&scd);
+    WireBus.attach(&battery);
+    I2CDevice sensor(SCD_ADDR, &Wire);
+    I2CDevice smbus(PEC_ADDR, &Wire);
+    const uint16_t measurement[3] = {0x01F4, 0x6667, 0x5EB9};
+    for (uint8_t i = 0; i < 3; i++) {
+        uint8_t tuple[3] = {
+            (uint8_t)(measurement[i] >> 8), (uint8_t)measurement[i], 0};
+        tuple[2] = I2CCrcSensirion::compute(tuple, 2);
+        scd.load(3 * i, tuple, 3);
+    }
+    static const uint8_t command[1] = {0x00};
+    uint16_t words[3];
+    bool ok = sensor.readWords(words, 3, command, 1);
+    Serial.printf("readWords        %s: CO2 %u ppm, T 0x%04X, RH 0x%04X\n",
+        ok ? "ok    " : "failed", words[0], words[1], words[2]);
+    // a bit flipped in the temperature word on its way
+    scd.poke(4, scd.peek(4) ^ 0x04);
+    ok = sensor.readWords(words, 3, command, 1);
+    Serial.printf("readWords        %s with a flipped bit\n",
+        ok ? "ok    " : "failed");
+
+    // SMBus read word 0x09 (Voltage) with PEC, then a write with PEC
+    const uint8_t voltage[2] = {0x34, 0x30};   // 12340 mV, LSB first
+    const uint8_t header[3] = {PEC_ADDR << 1, 0x09, (PEC_ADDR << 1) | 1};
+    uint8_t pec = I2CCrcSmbus::compute(voltage, 2,
+                                       I2CCrcSmbus::compute(header, 3));
+    battery.load(0x09, voltage, 2);
+    battery.poke(0x0B, pec);
+    uint8_t value[2];
+    ok = smbus.readPec(0x09, value, 2);
+    Serial.printf("readPec          %s: %u mV, PEC 0x%02X\n",
+        ok ? "ok    " : "failed", value[0] | (value[1] << 8), pec);
+    battery.poke(0x0B, pec ^ 0x01);
+    ok = smbus.readPec(0x09, value, 2);
+    Serial.printf("readPec          %s with a wrong PEC\n",
+        ok ? "ok    " : "failed");
+    const uint8_t mode[2] = {0x01, 0x60};
+    ok = smbus.writePec(0x03, mode, 2);
+    Serial.printf("writePec         %s: 0x03 <- %02X %02X, PEC 0x%02X\n",
+        ok ? "ok    " : "failed", battery.peek(0x03), battery.peek(0x04),
+        battery.peek(0x05));
+
+    I2CMetrics metrics;
+    if (sensor.metrics(metrics)) {
+        I2CMetrics pecMetrics;
+        smbus.metrics(pecMetrics);
+        Serial.printf("CRC errors counted: %lu words, %lu PEC\n",
+            (unsigned long)metrics.crcErrors,
+            (unsigned long)pecMetrics.crcErrors);
+    }
+    WireBus.detach(&scd);
+    WireBus.detach(&battery);
+}
+
+void traceTransfers() {
+    I2CTrace trace(32);
+    I2CDevice absent(0x2A, &Wire);
+    i2c.setTrace(&trace);
+    absent.setTrace(&trace);
+    i2c.setSpeed(100000);
+    WireBus.setRealtime(true);
+
+    byte data[16];
+    i2c.setRegisterCommand(READ_CMD);
+    i2c.read8(ID_REG_ADDR);
+    i2c.readRegister(0x00, data, sizeof(data));
+    i2c.write8(0x00, 0x03);
+    i2c.setRegisterCommand(0x00);
+    absent.write(0x00);
+    byte status = 0;
+    const I2CReadSegment segment = {&status, 1};
+    const uint8_t reg[1] = {(uint8_t)(READ_CMD | STATUS_REG_ADDR)};
+    i2c.readSegments(&segment, 1, true, reg, 1);
+
+    WireBus.setRealtime(false);
+    i2c.setTrace(nullptr);
+    trace.dump(Serial);
+}
+
+/// @brief Simulates the APDS9930 finishing an ALS cycle every
+/// [periodUs] for [runMs]: loads new CH0/CH1 values and raises the
+/// interrupt. [raisedUs] receives [micros()] of the latest cycle.
+void produceData(uint32_t periodUs, uint32_t runMs,
+                 std::atomic<uint32_t> &raisedUs) {
+    uint32_t start = micros();
+    uint16_t count = 0;
+    while (micros() - start < runMs * 1000UL) {
+        delayMicroseconds(periodUs);
+        count++;
+        byte data[4] = {(byte)count, (byte)(count >> 8),
+                        (byte)~count, (byte)(~count >> 8)};
+        apds.load(0x14, data, sizeof(data));
+        raisedUs = micros();
+        apds.raiseInterrupt();
+    }
+}
+
+void readOnDataReady() {
+    const uint32_t periodUs = 3000;
+    const uint32_t pollUs = 500;
+    const uint32_t runMs = 300;
+    apds.poke(STATUS_REG_ADDR, 0x00);
+    apds.setInterruptStatus(STATUS_REG_ADDR, AVALID);
+    apds.setInterruptClear(CLEAR_INT_CMD);
+    apds.setInterruptPin(INT_PIN);
+    i2c.setRegisterCommand(READ_CMD);
+    i2c.setSpeed(400000);
+    WireBus.setRealtime(true);
+
+    // polling: read STATUS every 500 us, then the data, then clear
+    std::atomic<uint32_t> raisedUs(0);
+    std::atomic<bool> producing(true);
+    uint32_t events = 0;
+    uint64_t latencyUs = 0;
+    uint32_t maxLatencyUs = 0;
+    WireBus.resetStats();
+    std::thread sensor([&] {
+        produceData(periodUs, runMs, raisedUs);
+        producing = false;
+    });
+    while (producing) {
+        byte status = 0;
+        byte data[4];
+        if (i2c.readRegister(STATUS_REG_ADDR, &status, 1) &&
+            (status & AVALID) &&
+            i2c.readRegister(0x14, data, sizeof(data)) &&
+            i2c.write(CLEAR_INT_CMD)) {
+            uint32_t latency = micros() - raisedUs;
+            events++;
+            latencyUs += latency;
+            if (latency > maxLatencyUs) {
+                maxLatencyUs = latency;
+            }
+        }
+        delayMicroseconds(pollUs);
+    }
+    sensor.join();
+    Serial.printf("status polling: %lu events, latency mean %.0f us, "
+        "max %lu us\n", (unsigned long)events,
+        events ? (double)latencyUs / events : 0.0,
+        (unsigned long)maxLatencyUs);
+    printBusTime("status polling");
+
+    // interrupt: the edge wakes a thread that reads and clears at once
+    I2CDataReady ready(i2c);
+    byte clear[1] = {CLEAR_INT_CMD};
+    ready.setRead(0x14, 4);
+    ready.setClear(clear, sizeof(clear));
+    ready.begin(INT_PIN, FALLING);
+    WireBus.resetStats();
+    sensor = std::thread(produceData, periodUs, runMs, std::ref(raisedUs));
+    size_t popped = 0;
+    I2CDataReadyEvent event;
+    uint32_t start = micros();
+    while (micros() - start < runMs * 1000UL) {
+        while (ready.pop(event)) {
+            popped++;
+        }
+        delay(10);
+    }
+    sensor.join();
+    delay(5);
+    ready.end();
+    while (ready.pop(event)) {
+        popped++;
+    }
+    I2CDataReadyStats stats = ready.stats();
+    Serial.printf("data ready: %lu events (%lu edges, %lu coalesced, %lu "
+        "errors), latency mean %.0f us, max %lu us, popped %lu\n",
+        (unsigned long)stats.reads, (unsigned long)stats.edges,
+        (unsigned long)stats.coalesced, (unsigned long)stats.errors,
+        ready.meanLatencyUs(), (unsigned long)stats.maxLatencyUs,
+        (unsigned long)popped);
+    printBusTime("data ready");
+
+    WireBus.setRealtime(false);
+    i2c.setRegisterCommand(0x00);
+}
+
+void clockProfiles() {
+    // a 400 kHz sensor, a 1 MHz RTC and IMU, and a 100 kHz ADC
+    static SimRegisterDevice imu(0x6A);
+    static SimRegisterDevice adc(0x48);
+    static I2CDevice rtcDevice(OTHER_ADDR, &Wire);
+    static I2CDevice imuDevice(0x6A, &Wire);
+    static I2CDevice adcDevice(0x48, &Wire);
+    WireBus.attach(&imu);
+    WireBus.attach(&adc);
+    apds.setMaxClock(400000);
+    imu.setMaxClock(1000000);
+    adc.setMaxClock(100000);
+    for (uint8_t i = 0; i < 8; i++) {
+        other.poke(i, 0x10 + i);
+        imu.poke(i, 0x20 + i);
+        adc.poke(i, 0x30 + i);
+    }
+    i2c.setRegisterCommand(READ_CMD);
+    I2CDevice *devices[] = {&i2c, &rtcDevice, &imuDevice, &adcDevice};
+    const char *names[] = {"APDS9930", "RTC", "IMU", "ADC"};
+    const uint8_t regs[] = {ID_REG_ADDR, 0x00, 0x00, 0x00};
+    for (uint8_t d = 0; d < 4; d++) {
+        uint32_t clock = devices[d]->calibrateClock(regs[d], 1);
+        Serial.printf("%-8s calibrated to %7lu Hz\n", names[d],
+            (unsigned long)clock);
+    }
+
+    // the same rounds of 8-byte reads, first at the slowest device's
+    // clock for all, then each device at its own
+    const int rounds = 100;
+    byte data[8];
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t profiles[4];
+        for (uint8_t d = 0; d < 4; d++) {
+            profiles[d] = devices[d]->maxClock();
+            if (pass == 0) {
+                devices[d]->setMaxClock(0);
+            }
+            devices[d]->resetBusStats();
+        }
+        i2c.setSpeed(100000);
+        WireBus.resetStats();
+        uint32_t errors = 0;
+        for (int r = 0; r < rounds; r++) {
+            for (uint8_t d = 0; d < 4; d++) {
+                if (!devices[d]->readRegister(0x00, data, sizeof(data))) {
+                    errors++;
+                }
+            }
+        }
+        uint32_t switches = 0;
+        for (uint8_t d = 0; d < 4; d++) {
+            switches += devices[d]->busStats().clockSwitches;
+            devices[d]->setMaxClock(profiles[d]);
+        }
+        SimBus::Stats stats = WireBus.stats();
+        Serial.printf("%-18s bus time %6.2f ms, %3lu clock switches, "
+            "%lu errors\n", pass == 0 ? "all at 100 kHz:" : "own clocks:",
+            stats.busTimeNs / 1e6, (unsigned long)switches,
+            (unsigned long)errors);
+    }
+
+    // the sampler runs the jobs due together grouped by clock
+    I2CSampler sampler(64);
+    for (uint8_t d = 0; d < 4; d++) {
+        sampler.addJob(*devices[d], 0x00, 8, 5000);
+        devices[d]->resetBusStats();
+    }
+    sampler.begin();
+    delay(200);
+    sampler.end();
+    uint32_t samples = 0;
+    uint32_t switches = 0;
+    for (uint8_t d = 0; d < 4; d++) {
+        I2CSamplerStats stats;
+        sampler.stats(d, stats);
+        samples += stats.samples;
+        switches += devices[d]->busStats().clockSwitches;
+    }
+    Serial.printf("sampler, batched:  %lu samples, %.2f clock switches "
+        "per round (3 in job order)\n", (unsigned long)samples,
+        samples ? switches * 4.0 / samples : 0.0);
+
+    for (uint8_t d = 0; d < 4; d++) {
+        devices[d]->setMaxClock(0);
+    }
+    apds.setMaxClock(0);
+    i2c.setRegisterCommand(0x00);
+    WireBus.detach(&imu);
+    WireBus.detach(&adc);
+}
+
+void routeThroughMuxes() {
+    SimMuxDevice simMux[2] = {SimMuxDevice(0x70), SimMuxDevice(0x71)};
+    std::vector<SimRegisterDevice *> simSensors;
+    WireBus.attach(&simMux[0]);
+    WireBus.attach(&simMux[1]);
+    for (uint8_t i = 0; i < 2 * MUX_SENSORS; i++) {
+        simSensors.push_back(new SimRegisterDevice(SHT_ADDR));
+        simSensors[i]->poke(0x00, 0x60 + i);    // temperature
+        simSensors[i]->poke(0x02, 0x30 + i);    // humidity
+        simMux[i / MUX_SENSORS].attach(i % MUX_SENSORS, simSensors[i]);
+    }
+    I2CMux mux0(0x70), mux1(0x71);
+    mux0.link(mux1);
+    I2CMux *muxes[2] = {&mux0, &mux1};
+    std::vector<I2CDevice *> sensors;
+    for (uint8_t i = 0; i < 2 * MUX_SENSORS; i++) {
+        sensors.push_back(new I2CDevice(SHT_ADDR, &Wire));
+        sensors[i]->setMux(muxes[i / MUX_SENSORS], i % MUX_SENSORS);
+    }
+    i2c.setSpeed(400000);
+    uint8_t temperature[2 * MUX_SENSORS], humidity[2 * MUX_SENSORS];
+    I2CGroupRead group;
+    // declared temperatures first, as a driver polling by quantity would
+    for (uint8_t i = 0; i < 2 * MUX_SENSORS; i++) {
+        group.add(*sensors[i], 0x00, 1, &temperature[i]);
+    }
+    for (uint8_t i = 0; i < 2 * MUX_SENSORS; i++) {
+        group.add(*sensors[i], 0x02, 1, &humidity[i]);
+    }
+    const char *names[] = {
+        "select every read", "cached, by quantity", "cached, by sensor",
+        "I2CGroupRead"};
+    for (int mode = 0; mode < 4; mode++) {
+        mux0.invalidate();
+        mux1.invalidate();
+        mux0.resetStats();
+        mux1.resetStats();
+        WireBus.resetStats();
+        bool ok = true;
+        if (mode == 0) {
+            // what the drivers did: write the channel, then read
+            for (uint8_t q = 0; q < 2; q++) {
+                for (uint8_t i = 0; i < 2 * MUX_SENSORS; i++) {
+                    I2CMux *mux = muxes[i / MUX_SENSORS];
+                    mux->invalidate();
+                    ok = mux->select(i % MUX_SENSORS) && ok;
+                    uint8_t *dest = q == 0 ? &temperature[i] : &humidity[i];
+                    sensors[i]->setMux(nullptr, 0);
+                    ok = sensors[i]->readRegister(q == 0 ? 0x00 : 0x02,
+                                                  dest, 1) && ok;
+                    sensors[i]->setMux(mux, i % MUX_SENSORS);
+                }
+            }
+        } else if (mode == 1) {
+            for (uint8_t q = 0; q < 2; q++) {
+                for (uint8_t i = 0; i < 2 * MUX_SENSORS; i++) {
+                    uint8_t *dest = q == 0 ? &temperature[i] : &humidity[i];
+                    ok = sensors[i]->readRegister(q == 0 ? 0x00 : 0x02,
+                                                  dest, 1) && ok;
+                }
+            }
+        } else if (mode == 2) {
+            for (uint8_t i = 0; i < 2 * MUX_SENSORS; i++) {
+                ok = sensors[i]->readRegister(0x00, &temperature[i], 1) &&
+                     sensors[i]->readRegister(0x02, &humidity[i], 1) && ok;
+            }
+        } else {
+            ok = group.run();
+        }
+        SimBus::Stats stats = WireBus.stats();
+        Serial.printf("%-20s %s: %2lu transactions, %2lu selects, "
+            "%2lu skipped, %lu collisions, %6.1f us\n", names[mode],
+            ok ? "ok" : "failed", (unsigned long)stats.transfers,
+            (unsigned long)(mux0.stats().selects + mux1.stats().selects),
+            (unsigned long)(mux0.stats().skipped + mux1.stats().skipped),
+            (unsigned long)stats.collisions, stats.busTimeNs / 1000.0);
+    }
+    Serial.printf("sensor 6: T 0x%02X, RH 0x%02X\n", temperature[6],
+        humidity[6]);
+    for (I2CDevice *sensor : sensors) {
+        delete sensor;
+    }
+    WireBus.detach(&simMux[0]);
+    WireBus.detach(&simMux[1]);
+    for (SimRegisterDevice *sensor : simSensors) {
+        delete sensor;
+    }
+}
+
+/// @brief Queues [count] frames on [imu], numbered from [first].
+static void queueFrames(SimFifoDevice &imu, uint16_t first, uint16_t count) {
+    for (uint16_t n = first; n < first + count; n++) {
+        // X counts up, Y is small and negative, Z reads 1 g
+        uint8_t frame[IMU_FRAME] = {(uint8_t)n, (uint8_t)(n >> 8),
+                                    (uint8_t)~n, 0xFF, 0x00, 0x40};
+        imu.push(frame);
+    }
+}
+
+/// @brief Consumes the frames in [fifo], expecting them numbered from
+/// [next], and returns the number of frames in order.
+static uint16_t consumeFrames(I2CFifo &fifo, uint16_t &next) {
+    uint16_t inOrder = 0;
+    size_t contiguous;
+    const uint8_t *frame;
+    while ((frame = fifo.front(contiguous)) != nullptr) {
+        for (size_t i = 0; i < contiguous; i++, frame += IMU_FRAME) {
+            uint16_t n = (uint16_t)(frame[0] | (frame[1] << 8));
+            if (n == next && frame[2] == (uint8_t)~n) {
+                inOrder++;
+            }
+            next = n + 1;
+        }
+        fifo.release(contiguous);
+    }
+    return inOrder;
+}
+
+void drainImuFifo() {
+    SimFifoDevice simImu(IMU_ADDR, FIFO_STATUS_REG, FIFO_DATA_REG,
+                         IMU_FRAME, IMU_DEPTH);
+    WireBus.attach(&simImu);
+    I2CDevice imu(IMU_ADDR, &Wire);
+    imu.begin();
+    imu.setSpeed(400000);
+
+    // by hand: the level, then one transaction per frame
+    queueFrames(simImu, 0, 100);
+    WireBus.resetStats();
+    uint16_t level = imu.read16(FIFO_STATUS_REG, false) & 0x3FFF;
+    uint8_t frame[IMU_FRAME];
+    bool ok = true;
+    for (uint16_t i = 0; i < level; i++) {
+        ok = imu.readRegister(FIFO_DATA_REG, frame, IMU_FRAME) && ok;
+    }
+    printBusTime(ok ? "one frame per read" : "one frame per read failed");
+
+    I2CFifoConfig config = {FIFO_STATUS_REG, 2, I2C_LITTLE_ENDIAN, 0x3FFF,
+                            0x4000, true, FIFO_DATA_REG, IMU_FRAME, 16};
+    static uint8_t ring[IMU_RING * IMU_FRAME];
+    I2CFifo fifo(config, ring, IMU_RING);
+    uint16_t next = 100, inOrder = 0;
+    queueFrames(simImu, 100, 100);
+    WireBus.resetStats();
+    // the ring takes 64 frames, the rest wait in the sensor
+    ok = imu.drainFifo(fifo);
+    inOrder += consumeFrames(fifo, next);
+    ok = imu.drainFifo(fifo) && ok;
+    inOrder += consumeFrames(fifo, next);
+    printBusTime(ok ? "drainFifo" : "drainFifo failed");
+    const I2CFifoStats &stats = fifo.stats();
+    Serial.printf("%u frames per burst: %lu frames in %lu bursts, "
+        "%lu in order, %lu drain cut short by a full ring\n",
+        (unsigned)(imu.maxBufferSize() / IMU_FRAME),
+        (unsigned long)stats.frames, (unsigned long)stats.bursts,
+        (unsigned long)inOrder, (unsigned long)stats.ringFull);
+
+    // below the watermark nothing is read
+    queueFrames(simImu, 200, 10);
+    fifo.resetStats();
+    imu.drainFifo(fifo);
+    Serial.printf("10 frames, watermark 16: %lu read, %lu below watermark\n",
+        (unsigned long)fifo.stats().frames,
+        (unsigned long)fifo.stats().belowWatermark);
+    imu.drainFifo(fifo, true);
+    consumeFrames(fifo, next);
+
+    // the sensor filled up before the drain
+    queueFrames(simImu, 210, IMU_DEPTH + 12);
+    fifo.resetStats();
+    ok = imu.drainFifo(fifo);
+    level = fifo.stats().lastLevel;
+    consumeFrames(fifo, next);
+    ok = imu.drainFifo(fifo) && ok;
+    consumeFrames(fifo, next);
+    Serial.printf("after an overrun: %s, level %u, %lu overflow flagged, "
+        "%lu frames lost in the sensor, %lu read\n", ok ? "ok" : "failed",
+        (unsigned)level, (unsigned long)fifo.stats().overflows,
+        (unsigned long)simImu.lost(), (unsigned long)fifo.stats().frames);
+
+    // frames in a row in the ring decode in one call, 3 samples each
+    queueFrames(simImu, 1000, 8);
+    imu.drainFifo(fifo, true);
+    const I2CSampleFormat axis = {2, I2C_LITTLE_ENDIAN, 16, 0, true};
+    float g[3 * IMU_RING];
+    size_t run;
+    const uint8_t *frames = fifo.front(run);
+    if (frames != nullptr &&
+        I2CDecode::toFloat(frames, 3 * run, axis, g, 1.0f / 16384)) {
+        Serial.printf("%u frames decoded, last: X %.4f g, Y %.4f g, "
+            "Z %.4f g\n", (unsigned)run, g[3 * run - 3], g[3 * run - 2],
+            g[3 * run - 1]);
+        fifo.release(run);
+    }
+    WireBus.detach(&simImu);
+}
+
+#if defined(__linux__)
+void readThroughI2cDev() {
+    SimDevFile plain(WireBus, I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL);
+    SimDevFile smbusOnly(WireBus, I2C_FUNC_SMBUS_EMUL);
+    const char *names[] = {"I2C_RDWR", "read()/write()", "SMBus only"};
+    for (int run = 0; run < 3; run++) {
+        I2CLinuxBus adapter("/dev/i2c-1", run == 2 ? &smbusOnly : &plain);
+        adapter.setMode(run == 1 ? I2C_LINUX_READ_WRITE : I2C_LINUX_RDWR);
+        TwoWire wire(1, &adapter);
+        I2CDevice sensor(APDS_ADDR, &wire);
+        if (!sensor.begin(true)) {
+            Serial.printf("%-15s APDS9930 not detected\n", names[run]);
+            continue;
+        }
+        sensor.setRegisterCommand(READ_CMD);
+        adapter.resetStats();
+        WireBus.resetStats();
+        byte data[4];
+        uint8_t id = sensor.read8(ID_REG_ADDR);
+        bool ok = sensor.readRegister(0x14, data, sizeof(data));
+        I2CLinuxBus::Stats stats = adapter.stats();
+        SimBus::Stats bus = WireBus.stats();
+        Serial.printf("%-15s ID 0x%02X, CH0/CH1 %s: %lu system calls, "
+            "%lu STOP for 2 register reads\n", names[run], id,
+            ok ? "read" : "failed", (unsigned long)stats.syscalls,
+            (unsigned long)bus.stops);
+    }
+}
+#endif
+
+/// @brief Reads the ID register of [i2c] and prints the outcome and how
+/// long it took.
+void readStuck(const char *name) {
+    uint8_t id = 0;
+    uint32_t start = micros();
+    bool ok = i2c.readRegister(ID_REG_ADDR, &id, 1);
+    uint32_t us = micros() - start;
+    if (ok) {
+        Serial.printf("%-22s ID 0x%02X after %6lu us\n", name, id,
+            (unsigned long)us);
+    } else {
+        Serial.printf("%-22s failed after %6lu us\n", name,
+            (unsigned long)us);
+    }
+}
+
+void recoverStuckBus() {
+    WireBus.setPins(I2C_SDA, I2C_SCL);
+    WireBus.setRealtime(true);
+    i2c.setSpeed(100000);
+    i2c.setRegisterCommand(READ_CMD);
+
+    // without a policy every read waits for the Wire timeout and fails
+    // until the device is power cycled
+    WireBus.holdSda(3);
+    readStuck("no policy");
+    readStuck("no policy, again");
+
+    // retry after a bus clear, which frees SDA after three clocks
+    I2CRecoveryPolicy policy = {};
+    policy.retries = 3;
+    policy.backoffUs = 200;
+    policy.maxBackoffUs = 2000;
+    policy.clearAfter = 1;
+    policy.deadlineUs = 30000;
+    i2c.setRecoveryPolicy(policy);
+    i2c.resetRecoveryStats();
+    readStuck("policy");
+    readStuck("policy, bus free");
+
+    // a device the bus clear cannot free: given up within the deadline
+    WireBus.holdSda(1000);
+    readStuck("policy, held for good");
+
+    const I2CRecoveryStats &stats = i2c.recoveryStats();
+    Serial.printf("%lu calls, %lu failed attempts, %lu retries, "
+        "%lu recovered, %lu abandoned (%lu at the deadline), "
+        "%lu bus clears (%lu failed), %lu re-begins, max %lu us\n",
+        (unsigned long)stats.calls, (unsigned long)stats.failures,
+        (unsigned long)stats.retries, (unsigned long)stats.recovered,
+        (unsigned long)stats.abandoned, (unsigned long)stats.deadlineMisses,
+        (unsigned long)stats.busClears,
+        (unsigned long)stats.busClearFailures,
+        (unsigned long)stats.rebegins, (unsigned long)stats.maxCallUs);
+
+    WireBus.holdSda(0);
+    i2c.setRecoveryPolicy(I2CRecoveryPolicy());
+    i2c.setRegisterCommand(0x00);
+    WireBus.setRealtime(false);
+}
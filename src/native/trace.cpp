@@ -0,0 +1,134 @@
+// Host-side decoder of I2CTrace dumps: `program decode [log.txt]`.
+// The payload size is taken from the dump header, so traces of firmware
+// built with another I2C_TRACE_PAYLOAD decode as well.
+
+#include <stdio.h>
+#include <string.h>
+#include <I2CTrace.h>
+#include "trace.h"
+
+/// @brief Longest line read from the log.
+#define TRACE_LINE_SIZE 1024
+
+/// @brief Returns a readable name of record result [result].
+static const char * resultName(uint8_t result, char *buf) {
+    switch (result) {
+        case 0: return "ok";
+        case 1: return "too long";
+        case 2: return "addr NACK";
+        case 3: return "data NACK";
+        case 4: return "error";
+        case 5: return "timeout";
+        case I2C_TRACE_SHORT_READ: return "short read";
+    }
+    snprintf(buf, 8, "0x%02X", result);
+    return buf;
+}
+
+/// @brief Parses the hex string [hex] into at most [size] bytes.
+/// @return The number of bytes, or 0 if [hex] is not valid.
+static size_t parseHex(const char *hex, uint8_t *out, size_t size) {
+    size_t n = 0;
+    while (hex[0] != '\0' && hex[0] != '\n' && hex[0] != '\r') {
+        unsigned int value;
+        if (n == size || sscanf(hex, "%2x", &value) != 1 || hex[1] == '\0') {
+            return 0;
+        }
+        out[n++] = (uint8_t)value;
+        hex += 2;
+    }
+    return n;
+}
+
+int runTraceDecoder(int argc, char **argv) {
+    FILE *in = stdin;
+    if (argc > 0) {
+        in = fopen(argv[0], "r");
+        if (in == nullptr) {
+            fprintf(stderr, "cannot open %s\n", argv[0]);
+            return 1;
+        }
+    }
+    char line[TRACE_LINE_SIZE];
+    unsigned payload = I2C_TRACE_PAYLOAD;
+    uint32_t previous = 0;
+    size_t records = 0;
+    bool inDump = false;
+    while (fgets(line, sizeof(line), in) != nullptr) {
+        // the dump may follow a timestamp added by the serial monitor
+        const char *p = strstr(line, I2C_TRACE_PREFIX " ");
+        if (p == nullptr) {
+            continue;
+        }
+        p += sizeof(I2C_TRACE_PREFIX);
+        unsigned version;
+        unsigned long count, lost;
+        if (p[0] == 'H') {
+            if (sscanf(p, "H %u %u %lu %lu", &version, &payload, &count,
+                       &lost) != 4 || version != I2C_TRACE_VERSION) {
+                fprintf(stderr, "unsupported trace header: %s", line);
+                inDump = false;
+                continue;
+            }
+            printf("I2C trace: %lu records, %lu overwritten before them\n",
+                count, lost);
+            printf("%12s %8s %7s %5s %3s %5s %3s %-10s %s\n", "time us",
+                "+us", "dur us", "addr", "dir", "len", "end", "result",
+                "data");
+            inDump = true;
+            records = 0;
+            continue;
+        }
+        if (p[0] == 'E') {
+            if (inDump) {
+                printf("%lu records decoded\n\n", (unsigned long)records);
+            }
+            inDump = false;
+            continue;
+        }
+        if (p[0] != 'R' || !inDump) {
+            continue;
+        }
+        uint8_t bytes[TRACE_LINE_SIZE / 2];
+        size_t n = parseHex(p + 2, bytes, sizeof(bytes));
+        if (n != 11 + payload) {
+            fprintf(stderr, "bad trace record: %s", line);
+            continue;
+        }
+        uint32_t timestamp = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+                             ((uint32_t)bytes[3] << 24);
+        uint16_t duration = bytes[4] | (bytes[5] << 8);
+        uint16_t len = bytes[6] | (bytes[7] << 8);
+        uint8_t address = bytes[8];
+        uint8_t flags = bytes[9];
+        uint8_t result = bytes[10];
+        char name[8];
+        printf("%12lu %8lu %7u  0x%02X %3s %5u %3s %-10s",
+            (unsigned long)timestamp,
+            (unsigned long)(records ? timestamp - previous : 0),
+            duration,
+            address,
+            flags & I2C_TRACE_READ ? "R" : "W",
+            len,
+            flags & I2C_TRACE_STOP ? "P" : "Sr",
+            resultName(result, name));
+        // a failed read has no data
+        size_t shown = (flags & I2C_TRACE_READ) && result != 0 ? 0 : len;
+        if (shown > payload) {
+            shown = payload;
+        }
+        for (size_t i = 0; i < shown; i++) {
+            printf(" %02X", bytes[11 + i]);
+        }
+        if (shown < len && shown > 0) {
+            printf(" ...");
+        }
+        printf("\n");
+        previous = timestamp;
+        records++;
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef NATIVE_TRACE_H_
+#define NATIVE_TRACE_H_
+
+/// @brief Decodes the [I2CTrace::dump] lines found in the file named by
+/// [argv][0], or in the standard input, and prints them as a timeline.
+/// Other lines, e.g. the rest of a serial log, are skipped.
+/// @return The process exit code.
+int runTraceDecoder(int argc, char **argv);
+
+#endif // NATIVE_TRACE_H_
@@ -0,0 +1,112 @@
+// I2CChannel: order, drop and overwrite sequences, and the slot held by
+// the consumer. Run with `pio test -e native`.
+
+#include <Arduino.h>
+#include <I2CChannel.h>
+#include <unity.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief Items come out in the order they went in, across the wrap of
+/// the slot indices.
+void test_fifo_order(void) {
+    I2CChannel<uint32_t> channel(3);
+    TEST_ASSERT_EQUAL(3, channel.capacity());
+    uint32_t value;
+    for (uint32_t round = 0; round < 10; round++) {
+        TEST_ASSERT_TRUE(channel.push(2 * round));
+        TEST_ASSERT_TRUE(channel.push(2 * round + 1));
+        TEST_ASSERT_TRUE(channel.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(2 * round, value);
+        TEST_ASSERT_TRUE(channel.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(2 * round + 1, value);
+    }
+    TEST_ASSERT_FALSE(channel.pop(value));
+}
+
+/// @brief [I2C_DROP_NEWEST] refuses items while full and keeps the
+/// oldest.
+void test_drop_newest(void) {
+    I2CChannel<uint32_t> channel(3, I2C_DROP_NEWEST);
+    for (uint32_t v = 1; v <= 3; v++) {
+        TEST_ASSERT_TRUE(channel.push(v));
+    }
+    TEST_ASSERT_FALSE(channel.push(4));
+    TEST_ASSERT_FALSE(channel.push(5));
+    TEST_ASSERT_EQUAL_UINT32(2, channel.dropped());
+    TEST_ASSERT_EQUAL_UINT32(0, channel.overwritten());
+    uint32_t value;
+    for (uint32_t v = 1; v <= 3; v++) {
+        TEST_ASSERT_TRUE(channel.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(v, value);
+    }
+    TEST_ASSERT_FALSE(channel.pop(value));
+}
+
+/// @brief [I2C_OVERWRITE_OLDEST] always takes the item, replacing the
+/// oldest while full.
+void test_overwrite_oldest(void) {
+    I2CChannel<uint32_t> channel(3, I2C_OVERWRITE_OLDEST);
+    for (uint32_t v = 1; v <= 5; v++) {
+        TEST_ASSERT_TRUE(channel.push(v));
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, channel.overwritten());
+    TEST_ASSERT_EQUAL_UINT32(0, channel.dropped());
+    uint32_t value;
+    for (uint32_t v = 3; v <= 5; v++) {
+        TEST_ASSERT_TRUE(channel.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(v, value);
+    }
+    TEST_ASSERT_FALSE(channel.pop(value));
+}
+
+/// @brief The item the consumer holds between [front] and [release] is
+/// never overwritten: the producer drops instead.
+void test_overwrite_keeps_held_item(void) {
+    I2CChannel<uint32_t> channel(3, I2C_OVERWRITE_OLDEST);
+    for (uint32_t v = 1; v <= 3; v++) {
+        TEST_ASSERT_TRUE(channel.push(v));
+    }
+    const uint32_t *held = channel.front();
+    TEST_ASSERT_NOT_NULL(held);
+    TEST_ASSERT_EQUAL_UINT32(1, *held);
+    for (uint32_t v = 4; v <= 6; v++) {
+        channel.push(v);
+        TEST_ASSERT_EQUAL_UINT32(1, *held);
+    }
+    TEST_ASSERT_TRUE(channel.dropped() > 0);
+    channel.release();
+    uint32_t value;
+    uint32_t last = 1;
+    while (channel.pop(value)) {
+        TEST_ASSERT_TRUE(value > last);
+        last = value;
+    }
+    TEST_ASSERT_TRUE(last >= 4);
+}
+
+/// @brief An item filled in place through [reserve] is only seen after
+/// [publish].
+void test_reserve_publish(void) {
+    I2CChannel<uint32_t> channel(2);
+    uint32_t *slot = channel.reserve();
+    TEST_ASSERT_NOT_NULL(slot);
+    *slot = 42;
+    TEST_ASSERT_NULL(channel.front());
+    channel.publish();
+    const uint32_t *item = channel.front();
+    TEST_ASSERT_NOT_NULL(item);
+    TEST_ASSERT_EQUAL_UINT32(42, *item);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_order);
+    RUN_TEST(test_drop_newest);
+    RUN_TEST(test_overwrite_oldest);
+    RUN_TEST(test_overwrite_keeps_held_item);
+    RUN_TEST(test_reserve_publish);
+    return UNITY_END();
+}
@@ -0,0 +1,145 @@
+// CRC-8 tables against published check values and a bitwise reference,
+// and CRC-checked reads and SMBus PEC against a simulated device. Run
+// with `pio test -e native`.
+
+#include <Arduino.h>
+#include <I2CDevice.h>
+#include <I2CSimBus.h>
+#include <Wire.h>
+#include <unity.h>
+
+#define SENSOR_ADDR 0x44
+
+/// @brief Bit-at-a-time CRC-8, the reference for the tables.
+static uint8_t bitwiseCrc8(const uint8_t *data, size_t len, uint8_t poly,
+                           uint8_t crc) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = crc & 0x80 ? (uint8_t)((crc << 1) ^ poly)
+                             : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief The check values of the Sensirion datasheets and of the
+/// CRC-8/SMBUS catalogue entry ("123456789").
+void test_check_values(void) {
+    const uint8_t beef[2] = {0xBE, 0xEF};
+    TEST_ASSERT_EQUAL_HEX8(0x92, I2CCrcSensirion::compute(beef, 2));
+    const uint8_t digits[9] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    TEST_ASSERT_EQUAL_HEX8(0xF4, I2CCrcSmbus::compute(digits, 9));
+    TEST_ASSERT_EQUAL_HEX8(0xF7, I2CCrcSensirion::compute(digits, 9));
+}
+
+void test_tables_match_bitwise(void) {
+    for (uint16_t i = 0; i < 256; i++) {
+        uint8_t b = (uint8_t)i;
+        TEST_ASSERT_EQUAL_HEX8(bitwiseCrc8(&b, 1, 0x31, 0xFF),
+                               I2CCrcSensirion::compute(&b, 1));
+        TEST_ASSERT_EQUAL_HEX8(bitwiseCrc8(&b, 1, 0x07, 0x00),
+                               I2CCrcSmbus::compute(&b, 1));
+        TEST_ASSERT_EQUAL_HEX8(bitwiseCrc8(&b, 1, 0x31, 0x00),
+                               (I2CCrc8<0x31, 0x00>::compute(&b, 1)));
+    }
+}
+
+/// @brief [update] one byte at a time agrees with [compute].
+void test_update_matches_compute(void) {
+    uint8_t data[32];
+    for (uint8_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 31 + 5);
+    }
+    uint8_t crc = I2CCrcSmbus::init;
+    for (uint8_t i = 0; i < sizeof(data); i++) {
+        crc = I2CCrcSmbus::update(crc, data[i]);
+    }
+    TEST_ASSERT_EQUAL_HEX8(I2CCrcSmbus::compute(data, sizeof(data)), crc);
+}
+
+/// @brief Loads [count] words, each followed by its CRC, into [sim] from
+/// register 0.
+static void loadWords(SimRegisterDevice &sim, const uint16_t *words,
+                      size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint8_t word[2] = {(uint8_t)(words[i] >> 8), (uint8_t)words[i]};
+        sim.poke(3 * i, word[0]);
+        sim.poke(3 * i + 1, word[1]);
+        sim.poke(3 * i + 2, bitwiseCrc8(word, 2, 0x31, 0xFF));
+    }
+}
+
+void test_read_words(void) {
+    SimBus bus(400000);
+    TwoWire wire(3, &bus);
+    SimRegisterDevice sim(SENSOR_ADDR);
+    bus.attach(&sim);
+    I2CDevice sensor(SENSOR_ADDR, &wire);
+    TEST_ASSERT_TRUE(sensor.begin(true));
+    const uint16_t words[3] = {0xBEEF, 0x0000, 0x6667};
+    loadWords(sim, words, 3);
+    // the register pointer is at 0 after the command byte
+    const uint8_t command[1] = {0x00};
+    uint16_t read[3];
+    TEST_ASSERT_TRUE(sensor.readWords(read, 3, command, 1));
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(words, read, 3);
+    // a corrupted CRC fails the read
+    sim.poke(5, sim.peek(5) ^ 0x01);
+    TEST_ASSERT_FALSE(sensor.readWords(read, 3, command, 1));
+}
+
+void test_read_pec(void) {
+    SimBus bus(400000);
+    TwoWire wire(3, &bus);
+    SimRegisterDevice sim(SENSOR_ADDR);
+    bus.attach(&sim);
+    I2CDevice device(SENSOR_ADDR, &wire);
+    TEST_ASSERT_TRUE(device.begin(true));
+    const uint8_t command = 0x07;
+    const uint8_t data[2] = {0xD2, 0x3A};
+    // the PEC covers both address bytes, the command and the data
+    const uint8_t frame[5] = {SENSOR_ADDR << 1, command,
+                              (SENSOR_ADDR << 1) | 1, data[0], data[1]};
+    sim.poke(command, data[0]);
+    sim.poke(command + 1, data[1]);
+    sim.poke(command + 2, bitwiseCrc8(frame, 5, 0x07, 0x00));
+    uint8_t buf[2];
+    TEST_ASSERT_TRUE(device.readPec(command, buf, 2));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(data, buf, 2);
+    sim.poke(command + 2, sim.peek(command + 2) ^ 0x80);
+    TEST_ASSERT_FALSE(device.readPec(command, buf, 2));
+}
+
+void test_write_pec(void) {
+    SimBus bus(400000);
+    TwoWire wire(3, &bus);
+    SimRegisterDevice sim(SENSOR_ADDR);
+    bus.attach(&sim);
+    I2CDevice device(SENSOR_ADDR, &wire);
+    TEST_ASSERT_TRUE(device.begin(true));
+    const uint8_t command = 0x10;
+    const uint8_t data[3] = {0x01, 0x80, 0xFF};
+    TEST_ASSERT_TRUE(device.writePec(command, data, 3));
+    const uint8_t frame[5] = {SENSOR_ADDR << 1, command,
+                              data[0], data[1], data[2]};
+    TEST_ASSERT_EQUAL_HEX8(data[0], sim.peek(command));
+    TEST_ASSERT_EQUAL_HEX8(data[2], sim.peek(command + 2));
+    TEST_ASSERT_EQUAL_HEX8(bitwiseCrc8(frame, 5, 0x07, 0x00),
+                           sim.peek(command + 3));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_check_values);
+    RUN_TEST(test_tables_match_bitwise);
+    RUN_TEST(test_update_matches_compute);
+    RUN_TEST(test_read_words);
+    RUN_TEST(test_read_pec);
+    RUN_TEST(test_write_pec);
+    return UNITY_END();
+}
@@ -0,0 +1,210 @@
+// I2CDevice against a simulated register device: round trips, the
+// transactions they take, the register cache and the write stage. Run
+// with `pio test -e native`.
+
+#include <Arduino.h>
+#include <I2CDevice.h>
+#include <I2CSimBus.h>
+#include <Wire.h>
+#include <unity.h>
+
+#define SENSOR_ADDR 0x39
+
+/// @brief A register device on a bus of its own, and the I2CDevice
+/// talking to it.
+struct Fixture {
+    SimBus bus;
+    SimRegisterDevice sim;
+    TwoWire wire;
+    I2CDevice device;
+
+    Fixture()
+        : bus(400000), sim(SENSOR_ADDR), wire(3, &bus),
+          device(SENSOR_ADDR, &wire) {
+        bus.attach(&sim);
+        for (size_t i = 0; i < sim.size(); i++) {
+            sim.poke(i, (uint8_t)(i * 7));
+        }
+        device.begin(true);
+        bus.resetStats();
+    }
+};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_begin_detects_device(void) {
+    SimBus bus(400000);
+    TwoWire wire(3, &bus);
+    I2CDevice absent(SENSOR_ADDR, &wire);
+    TEST_ASSERT_FALSE(absent.begin(true));
+    SimRegisterDevice sim(SENSOR_ADDR);
+    bus.attach(&sim);
+    I2CDevice present(SENSOR_ADDR, &wire);
+    TEST_ASSERT_TRUE(present.begin(true));
+    TEST_ASSERT_TRUE(present.detected());
+}
+
+void test_write8_read8_round_trip(void) {
+    Fixture f;
+    for (uint16_t reg = 0; reg < 16; reg++) {
+        TEST_ASSERT_TRUE(f.device.write8((uint8_t)reg, (uint8_t)(0xA0 + reg)));
+        TEST_ASSERT_EQUAL_HEX8(0xA0 + reg, f.sim.peek(reg));
+        TEST_ASSERT_EQUAL_HEX8(0xA0 + reg, f.device.read8((uint8_t)reg));
+    }
+}
+
+void test_register_block_round_trip(void) {
+    Fixture f;
+    uint8_t out[24];
+    for (uint8_t i = 0; i < sizeof(out); i++) {
+        out[i] = (uint8_t)(0x55 ^ i);
+    }
+    TEST_ASSERT_TRUE(f.device.writeRegister(0x10, out, sizeof(out)));
+    uint8_t in[sizeof(out)];
+    TEST_ASSERT_TRUE(f.device.readRegister(0x10, in, sizeof(in)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(out, in, sizeof(out));
+}
+
+/// @brief A register read is one transaction: the register address, a
+/// repeated START and the data, with a single STOP.
+void test_register_read_is_one_transaction(void) {
+    Fixture f;
+    uint8_t buf[4];
+    TEST_ASSERT_TRUE(f.device.readRegister(0x20, buf, sizeof(buf)));
+    SimBus::Stats stats = f.bus.stats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.starts);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.repeatedStarts);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.stops);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.bytesWritten);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.bytesRead);
+    for (uint8_t i = 0; i < sizeof(buf); i++) {
+        TEST_ASSERT_EQUAL_HEX8((0x20 + i) * 7, buf[i]);
+    }
+}
+
+/// @brief A read larger than the Wire buffer is split into chunks joined
+/// by repeated STARTs, still with a single STOP.
+void test_long_read_is_chunked(void) {
+    Fixture f;
+    const size_t len = 2 * I2C_BUFFER_LENGTH + 10;
+    uint8_t buf[len];
+    TEST_ASSERT_TRUE(f.device.readRegister(0x00, buf, len));
+    SimBus::Stats stats = f.bus.stats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.starts);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.repeatedStarts);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.stops);
+    TEST_ASSERT_EQUAL_UINT32(len, stats.bytesRead);
+    for (size_t i = 0; i < len; i++) {
+        TEST_ASSERT_EQUAL_HEX8((i % 256) * 7, buf[i]);
+    }
+}
+
+/// @brief Non-volatile registers are read from the bus once, then served
+/// by the cache; volatile ones are always read from the bus.
+void test_register_cache(void) {
+    Fixture f;
+    TEST_ASSERT_TRUE(f.device.enableRegisterCache(64));
+    I2CRegisterCache *cache = f.device.registerCache();
+    cache->setVolatile(0x08, false, 4);
+    uint8_t buf[4];
+    TEST_ASSERT_TRUE(f.device.readRegister(0x08, buf, 4));
+    TEST_ASSERT_EQUAL_UINT32(1, f.bus.stats().transfers);
+    f.sim.poke(0x08, 0xEE);
+    TEST_ASSERT_TRUE(f.device.readRegister(0x08, buf, 4));
+    TEST_ASSERT_EQUAL_UINT32(1, f.bus.stats().transfers);
+    TEST_ASSERT_EQUAL_HEX8(0x08 * 7, buf[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, cache->hits());
+    // a write through the device updates the cached value
+    TEST_ASSERT_TRUE(f.device.write8(0x09, 0x5A));
+    TEST_ASSERT_EQUAL_HEX8(0x5A, f.device.read8(0x09));
+    // volatile registers always go to the bus
+    uint32_t transfers = f.bus.stats().transfers;
+    f.device.read8(0x20);
+    f.device.read8(0x20);
+    TEST_ASSERT_EQUAL_UINT32(transfers + 2, f.bus.stats().transfers);
+}
+
+/// @brief Staged writes reach the device only on [commit], adjacent
+/// registers in one burst, and reads see the staged values meanwhile.
+void test_write_stage(void) {
+    Fixture f;
+    TEST_ASSERT_TRUE(f.device.beginStaging());
+    for (uint8_t reg = 0x30; reg < 0x34; reg++) {
+        TEST_ASSERT_TRUE(f.device.write8(reg, (uint8_t)(0xC0 | reg)));
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, f.bus.stats().transfers);
+    TEST_ASSERT_EQUAL_HEX8(0x30 * 7, f.sim.peek(0x30));
+    TEST_ASSERT_EQUAL_HEX8(0xF1, f.device.read8(0x31));
+    TEST_ASSERT_EQUAL_UINT32(0, f.bus.stats().transfers);
+    TEST_ASSERT_TRUE(f.device.commit());
+    TEST_ASSERT_EQUAL_UINT32(1, f.bus.stats().transfers);
+    for (uint8_t reg = 0x30; reg < 0x34; reg++) {
+        TEST_ASSERT_EQUAL_HEX8(0xC0 | reg, f.sim.peek(reg));
+    }
+}
+
+/// @brief A staged write discarded before [commit] never reaches the
+/// device.
+void test_write_stage_discard(void) {
+    Fixture f;
+    TEST_ASSERT_TRUE(f.device.beginStaging());
+    TEST_ASSERT_TRUE(f.device.write8(0x40, 0x01));
+    f.device.discardStaged();
+    TEST_ASSERT_TRUE(f.device.commit());
+    TEST_ASSERT_EQUAL_UINT32(0, f.bus.stats().transfers);
+    TEST_ASSERT_EQUAL_HEX8(0x40 * 7, f.sim.peek(0x40));
+}
+
+/// @brief A refresh reaching past 0xFF stops there instead of wrapping
+/// around to register 0x00.
+void test_refresh_stops_at_last_register(void) {
+    Fixture f;
+    TEST_ASSERT_TRUE(f.device.enableRegisterCache());
+    f.device.registerCache()->setVolatile(0x00, false, 256);
+    TEST_ASSERT_TRUE(f.device.refreshRegisters(0xF0, 32));
+    TEST_ASSERT_EQUAL_UINT32(16, f.bus.stats().bytesRead);
+    f.sim.poke(0x00, 0xA5);
+    TEST_ASSERT_EQUAL_HEX8(0xA5, f.device.read8(0x00));
+}
+
+/// @brief A NACKed write fails and is reported as such.
+void test_nack_fails(void) {
+    Fixture f;
+    f.sim.nackAddress(1);
+    TEST_ASSERT_FALSE(f.device.write8(0x01, 0x02));
+    TEST_ASSERT_EQUAL_UINT32(1, f.bus.stats().addressNacks);
+    TEST_ASSERT_TRUE(f.device.write8(0x01, 0x02));
+}
+
+/// @brief A failed calibration read ends the climb: a recovery policy
+/// neither retries it nor clears the bus.
+void test_calibrate_ignores_recovery(void) {
+    Fixture f;
+    I2CRecoveryPolicy policy = {2, 0, 0, 1, 0};
+    f.device.setRecoveryPolicy(policy);
+    f.sim.nackAddress(1);
+    TEST_ASSERT_EQUAL_UINT32(0, f.device.calibrateClock(0x00, 4));
+    TEST_ASSERT_EQUAL_UINT32(0, f.device.recoveryStats().retries);
+    TEST_ASSERT_EQUAL_UINT32(0, f.device.recoveryStats().busClears);
+    f.sim.setMaxClock(400000);
+    TEST_ASSERT_EQUAL_UINT32(400000, f.device.calibrateClock(0x00, 4));
+    TEST_ASSERT_EQUAL_UINT8(7, f.device.read8(0x01));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_begin_detects_device);
+    RUN_TEST(test_write8_read8_round_trip);
+    RUN_TEST(test_register_block_round_trip);
+    RUN_TEST(test_register_read_is_one_transaction);
+    RUN_TEST(test_long_read_is_chunked);
+    RUN_TEST(test_register_cache);
+    RUN_TEST(test_write_stage);
+    RUN_TEST(test_write_stage_discard);
+    RUN_TEST(test_refresh_stops_at_last_register);
+    RUN_TEST(test_nack_fails);
+    RUN_TEST(test_calibrate_ignores_recovery);
+    return UNITY_END();
+}
@@ -0,0 +1,171 @@
+// I2CDevice::drainFifo against a simulated sensor FIFO: whole-frame
+// bursts, the wrap around the end of the ring, a full ring and a FIFO
+// overrun. Run with `pio test -e native`.
+
+#include <Arduino.h>
+#include <I2CDevice.h>
+#include <I2CSimBus.h>
+#include <Wire.h>
+#include <unity.h>
+
+#define IMU_ADDR 0x6A
+#define COUNT_REG 0x3A
+#define DATA_REG 0x78
+#define FRAME 6
+#define DEPTH 64
+#define RING 8
+
+/// @brief A FIFO sensor on a bus of its own, the I2CDevice talking to
+/// it and a ring of [RING] frames.
+struct Fixture {
+    SimBus bus;
+    SimFifoDevice sim;
+    TwoWire wire;
+    I2CDevice device;
+    uint8_t frames[RING * FRAME];
+    I2CFifo fifo;
+    uint16_t pushed;
+
+    Fixture(uint16_t watermark = 0)
+        : bus(400000), sim(IMU_ADDR, COUNT_REG, DATA_REG, FRAME, DEPTH),
+          wire(3, &bus), device(IMU_ADDR, &wire),
+          fifo(config(watermark), frames, RING), pushed(0) {
+        bus.attach(&sim);
+        device.begin(true);
+    }
+
+    static I2CFifoConfig config(uint16_t watermark) {
+        I2CFifoConfig c = {COUNT_REG, 2, I2C_LITTLE_ENDIAN, 0x3FFF, 0x4000,
+                           true, DATA_REG, FRAME, watermark};
+        return c;
+    }
+
+    /// @brief Queues [count] frames numbered on from the last.
+    void push(uint16_t count) {
+        for (uint16_t i = 0; i < count; i++, pushed++) {
+            uint8_t frame[FRAME];
+            for (uint8_t b = 0; b < FRAME; b++) {
+                frame[b] = (uint8_t)(pushed + b);
+            }
+            sim.push(frame);
+        }
+    }
+
+    /// @brief Pops [count] frames, checking they are numbered [first] on.
+    void expect(uint16_t first, uint16_t count) {
+        uint8_t frame[FRAME];
+        for (uint16_t i = 0; i < count; i++) {
+            TEST_ASSERT_TRUE(fifo.pop(frame));
+            for (uint8_t b = 0; b < FRAME; b++) {
+                TEST_ASSERT_EQUAL_HEX8((uint8_t)(first + i + b), frame[b]);
+            }
+        }
+    }
+};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_rejects_bad_ring(void) {
+    uint8_t frames[6 * FRAME];
+    I2CFifo fifo(Fixture::config(0), frames, 6);
+    TEST_ASSERT_FALSE(fifo.valid());
+}
+
+/// @brief The level is read, then the frames in one burst.
+void test_drain_in_one_burst(void) {
+    Fixture f;
+    f.push(5);
+    f.bus.resetStats();
+    TEST_ASSERT_TRUE(f.device.drainFifo(f.fifo));
+    TEST_ASSERT_EQUAL_UINT32(2, f.bus.stats().starts);
+    TEST_ASSERT_EQUAL_UINT32(5 * FRAME + 2, f.bus.stats().bytesRead);
+    const I2CFifoStats &stats = f.fifo.stats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.drains);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.bursts);
+    TEST_ASSERT_EQUAL_UINT32(5, stats.frames);
+    TEST_ASSERT_EQUAL_UINT16(5, stats.lastLevel);
+    TEST_ASSERT_EQUAL(5, f.fifo.size());
+    TEST_ASSERT_EQUAL(0, f.sim.level());
+    f.expect(0, 5);
+}
+
+/// @brief A burst running past the end of the ring continues at its
+/// start, in the same transaction.
+void test_drain_wraps_around_ring(void) {
+    Fixture f;
+    f.push(5);
+    TEST_ASSERT_TRUE(f.device.drainFifo(f.fifo));
+    f.expect(0, 5);
+    f.push(6);
+    TEST_ASSERT_TRUE(f.device.drainFifo(f.fifo));
+    TEST_ASSERT_EQUAL_UINT32(2, f.fifo.stats().bursts);
+    size_t contiguous;
+    TEST_ASSERT_NOT_NULL(f.fifo.front(contiguous));
+    TEST_ASSERT_EQUAL(3, contiguous);
+    f.expect(5, 6);
+    TEST_ASSERT_NULL(f.fifo.front());
+}
+
+/// @brief Frames the ring has no room for stay in the sensor for the
+/// next drain.
+void test_full_ring_leaves_frames(void) {
+    Fixture f;
+    f.push(RING + 3);
+    TEST_ASSERT_TRUE(f.device.drainFifo(f.fifo));
+    TEST_ASSERT_EQUAL(RING, f.fifo.size());
+    TEST_ASSERT_EQUAL_UINT32(1, f.fifo.stats().ringFull);
+    TEST_ASSERT_EQUAL(3, f.sim.level());
+    f.expect(0, RING);
+    TEST_ASSERT_TRUE(f.device.drainFifo(f.fifo));
+    f.expect(RING, 3);
+}
+
+/// @brief Below the watermark nothing is read unless forced.
+void test_watermark(void) {
+    Fixture f(4);
+    f.push(3);
+    TEST_ASSERT_TRUE(f.device.drainFifo(f.fifo));
+    TEST_ASSERT_EQUAL(0, f.fifo.size());
+    TEST_ASSERT_EQUAL_UINT32(1, f.fifo.stats().belowWatermark);
+    TEST_ASSERT_TRUE(f.device.drainFifo(f.fifo, true));
+    TEST_ASSERT_EQUAL(3, f.fifo.size());
+}
+
+/// @brief The sensor's overrun flag is counted.
+void test_overflow_counted(void) {
+    Fixture f;
+    f.push(DEPTH + 2);
+    TEST_ASSERT_EQUAL_UINT32(2, f.sim.lost());
+    TEST_ASSERT_TRUE(f.device.drainFifo(f.fifo));
+    TEST_ASSERT_EQUAL_UINT32(1, f.fifo.stats().overflows);
+    TEST_ASSERT_EQUAL_UINT16(DEPTH, f.fifo.stats().lastLevel);
+}
+
+/// @brief The level is read from the sensor even with the count
+/// register cached.
+void test_level_bypasses_cache(void) {
+    Fixture f;
+    TEST_ASSERT_TRUE(f.device.enableRegisterCache(COUNT_REG + 2));
+    f.device.registerCache()->setVolatile(COUNT_REG, false, 2);
+    f.push(2);
+    TEST_ASSERT_TRUE(f.device.drainFifo(f.fifo));
+    f.push(3);
+    TEST_ASSERT_TRUE(f.device.drainFifo(f.fifo));
+    TEST_ASSERT_EQUAL_UINT16(3, f.fifo.stats().lastLevel);
+    TEST_ASSERT_EQUAL(5, f.fifo.size());
+    TEST_ASSERT_EQUAL_UINT32(0, f.device.registerCache()->hits());
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_rejects_bad_ring);
+    RUN_TEST(test_drain_in_one_burst);
+    RUN_TEST(test_drain_wraps_around_ring);
+    RUN_TEST(test_full_ring_leaves_frames);
+    RUN_TEST(test_watermark);
+    RUN_TEST(test_overflow_counted);
+    RUN_TEST(test_level_bypasses_cache);
+    return UNITY_END();
+}
@@ -0,0 +1,165 @@
+// I2CMux and I2CGroupRead against simulated TCA9548A multiplexers with
+// identical sensors behind them: the channel selections made and
+// skipped, and that every read reaches the right sensor. Run with
+// `pio test -e native`.
+
+#include <Arduino.h>
+#include <I2CMux.h>
+#include <I2CSimBus.h>
+#include <Wire.h>
+#include <unity.h>
+
+#define SENSOR_ADDR 0x44
+#define MUXES 2
+#define SENSORS 3
+
+/// @brief [MUXES] linked multiplexers with [SENSORS] sensors of the same
+/// address behind each, register 0 of sensor n holding n.
+struct Fixture {
+    SimBus bus;
+    TwoWire wire;
+    SimMuxDevice *simMuxes[MUXES];
+    SimRegisterDevice *sims[MUXES * SENSORS];
+    I2CMux *muxes[MUXES];
+    I2CDevice *sensors[MUXES * SENSORS];
+
+    Fixture() : bus(400000), wire(3, &bus) {
+        for (uint8_t m = 0; m < MUXES; m++) {
+            simMuxes[m] = new SimMuxDevice(0x70 + m);
+            bus.attach(simMuxes[m]);
+            muxes[m] = new I2CMux(0x70 + m, &wire);
+            muxes[0]->link(*muxes[m]);
+        }
+        for (uint8_t i = 0; i < MUXES * SENSORS; i++) {
+            sims[i] = new SimRegisterDevice(SENSOR_ADDR);
+            sims[i]->poke(0, i);
+            simMuxes[i / SENSORS]->attach(i % SENSORS, sims[i]);
+            sensors[i] = new I2CDevice(SENSOR_ADDR, &wire);
+            sensors[i]->setMux(muxes[i / SENSORS], i % SENSORS);
+        }
+    }
+
+    ~Fixture() {
+        for (uint8_t i = 0; i < MUXES * SENSORS; i++) {
+            delete sensors[i];
+            delete sims[i];
+        }
+        for (uint8_t m = 0; m < MUXES; m++) {
+            delete muxes[m];
+            delete simMuxes[m];
+        }
+    }
+
+    /// @brief Control register writes received by all multiplexers.
+    uint32_t selects() {
+        uint32_t n = 0;
+        for (uint8_t m = 0; m < MUXES; m++) {
+            n += simMuxes[m]->selects();
+        }
+        return n;
+    }
+};
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+/// @brief Every read reaches its own sensor, and linked multiplexers
+/// never have identical sensors on the bus together.
+void test_reads_reach_their_sensor(void) {
+    Fixture f;
+    for (uint8_t round = 0; round < 2; round++) {
+        for (uint8_t i = 0; i < MUXES * SENSORS; i++) {
+            TEST_ASSERT_EQUAL_UINT8(i, f.sensors[i]->read8(0));
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, f.bus.stats().collisions);
+}
+
+/// @brief A channel already enabled is not selected again.
+void test_select_is_cached(void) {
+    Fixture f;
+    // the linked multiplexer's channels are unknown: it is switched off
+    f.sensors[0]->read8(0);
+    TEST_ASSERT_EQUAL_UINT32(2, f.selects());
+    TEST_ASSERT_EQUAL_HEX8(0x00, f.simMuxes[1]->channels());
+    f.sensors[0]->read8(0);
+    f.sensors[0]->read8(0);
+    TEST_ASSERT_EQUAL_UINT32(2, f.selects());
+    TEST_ASSERT_EQUAL_UINT32(1, f.muxes[0]->stats().selects);
+    TEST_ASSERT_EQUAL_UINT32(2, f.muxes[0]->stats().skipped);
+    TEST_ASSERT_EQUAL_HEX8(0x01, f.simMuxes[0]->channels());
+    // another channel of the same multiplexer: one write
+    f.sensors[1]->read8(0);
+    TEST_ASSERT_EQUAL_UINT32(3, f.selects());
+    TEST_ASSERT_EQUAL_HEX8(0x02, f.simMuxes[0]->channels());
+    // a channel of the linked one: the first is switched off too
+    f.sensors[SENSORS]->read8(0);
+    TEST_ASSERT_EQUAL_UINT32(5, f.selects());
+    TEST_ASSERT_EQUAL_HEX8(0x00, f.simMuxes[0]->channels());
+    TEST_ASSERT_EQUAL_HEX8(0x01, f.simMuxes[1]->channels());
+}
+
+/// @brief [invalidate] makes the next selection write the control
+/// register.
+void test_invalidate(void) {
+    Fixture f;
+    f.sensors[0]->read8(0);
+    uint32_t selects = f.selects();
+    f.muxes[0]->invalidate();
+    TEST_ASSERT_EQUAL(-1, f.muxes[0]->selected());
+    f.sensors[0]->read8(0);
+    TEST_ASSERT_EQUAL_UINT32(selects + 1, f.selects());
+}
+
+/// @brief A retry selects the channel again, as after a multiplexer
+/// reset that [I2CMux] did not see.
+void test_retry_reselects(void) {
+    Fixture f;
+    I2CRecoveryPolicy policy = {1, 0, 0, 0, 0};
+    f.sensors[1]->setRecoveryPolicy(policy);
+    TEST_ASSERT_EQUAL_UINT8(1, f.sensors[1]->read8(0));
+    // the multiplexer switched off behind the cached selection
+    I2CDevice control(0x70, &f.wire);
+    uint8_t off = 0x00;
+    TEST_ASSERT_TRUE(control.write(&off, 1));
+    uint32_t selects = f.selects();
+    TEST_ASSERT_EQUAL_UINT8(1, f.sensors[1]->read8(0));
+    TEST_ASSERT_EQUAL_UINT32(selects + 1, f.selects());
+    TEST_ASSERT_EQUAL_UINT32(1, f.sensors[1]->recoveryStats().recovered);
+}
+
+/// @brief A group read selects each channel once per run, however the
+/// reads were added.
+void test_group_read(void) {
+    Fixture f;
+    uint8_t values[2][MUXES * SENSORS];
+    I2CGroupRead group;
+    for (uint8_t r = 0; r < 2; r++) {
+        for (int8_t i = MUXES * SENSORS - 1; i >= 0; i--) {
+            TEST_ASSERT_TRUE(group.add(*f.sensors[i], r, 1, &values[r][i]));
+        }
+    }
+    TEST_ASSERT_TRUE(group.run());
+    for (uint8_t i = 0; i < MUXES * SENSORS; i++) {
+        TEST_ASSERT_EQUAL_UINT8(i, values[0][i]);
+    }
+    // one write per channel, and one per multiplexer to switch it off
+    // before the other's channels
+    TEST_ASSERT_EQUAL_UINT32(MUXES * SENSORS + MUXES, f.selects());
+    // the next run starts with the channel already enabled
+    TEST_ASSERT_TRUE(group.run());
+    TEST_ASSERT_EQUAL_UINT32(2 * (MUXES * SENSORS + MUXES) - 1,
+                             f.selects());
+    TEST_ASSERT_EQUAL_UINT32(0, f.bus.stats().collisions);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_reads_reach_their_sensor);
+    RUN_TEST(test_select_is_cached);
+    RUN_TEST(test_invalidate);
+    RUN_TEST(test_retry_reselects);
+    RUN_TEST(test_group_read);
+    return UNITY_END();
+}